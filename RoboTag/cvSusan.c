@@ -30,6 +30,7 @@
 */
 
 #include <ctype.h>
+#include <string.h>
 #include "cvSusan.h"
 
 static uchar susanBrightTable[516] =
@@ -22,6 +22,7 @@
 #include <stdio.h>
 #include "cvUtil.h"
 #include "rvCalibrate.h"
+#include "rvSampler.h"
 #include "rvTags384.h"
 
 static void rvCalibrate_GetCenterPoint(CvPoint2D32f corners[4], CvPoint2D32f *center)
@@ -41,153 +42,6 @@ static void rvCalibrate_GetCenterPoint(CvPoint2D32f corners[4], CvPoint2D32f *ce
 }
 
 
-static void rvCalibrate_GetReferencePoints(CvPoint2D32f corners[4], CvPoint2D32f reference[8])
-// Fill in the 8 reference points associated with the given quadralateral.  The first
-// 4 reference points are outside the quadralateral and the last four reference points
-// are inside the quadralateral.
-{
-    CvPoint2D32f t1;
-    CvPoint2D32f t2;
-
-    // Determine line along upper row of rvGrid.
-    t1.x = corners[1].x + (((corners[2].x - corners[1].x) * 5.0f) / 20.0f);
-    t1.y = corners[1].y + (((corners[2].y - corners[1].y) * 5.0f) / 20.0f);
-    t2.x = corners[0].x + (((corners[3].x - corners[0].x) * 5.0f) / 20.0f);
-    t2.y = corners[0].y + (((corners[3].y - corners[0].y) * 5.0f) / 20.0f);
-
-    // Set the outside and inside reference points along the line.
-    reference[0].x = t1.x + (((t2.x - t1.x) * -1.0f) / 20.0f);
-    reference[0].y = t1.y + (((t2.y - t1.y) * -1.0f) / 20.0f);
-    reference[4].x = t1.x + (((t2.x - t1.x) * 1.0f) / 20.0f);
-    reference[4].y = t1.y + (((t2.y - t1.y) * 1.0f) / 20.0f);
-    reference[1].x = t1.x + (((t2.x - t1.x) * 21.0f) / 20.0f);
-    reference[1].y = t1.y + (((t2.y - t1.y) * 21.0f) / 20.0f);
-    reference[5].x = t1.x + (((t2.x - t1.x) * 19.0f) / 20.0f);
-    reference[5].y = t1.y + (((t2.y - t1.y) * 19.0f) / 20.0f);
-
-    // Determine line along lower row of rvGrid.
-    t1.x = corners[1].x + (((corners[2].x - corners[1].x) * 15.0f) / 20.0f);
-    t1.y = corners[1].y + (((corners[2].y - corners[1].y) * 15.0f) / 20.0f);
-    t2.x = corners[0].x + (((corners[3].x - corners[0].x) * 15.0f) / 20.0f);
-    t2.y = corners[0].y + (((corners[3].y - corners[0].y) * 15.0f) / 20.0f);
-
-    // Set the outside and inside reference points along the line.
-    reference[2].x = t1.x + (((t2.x - t1.x) * -1.0f) / 20.0f);
-    reference[2].y = t1.y + (((t2.y - t1.y) * -1.0f) / 20.0f);
-    reference[6].x = t1.x + (((t2.x - t1.x) * 1.0f) / 20.0f);
-    reference[6].y = t1.y + (((t2.y - t1.y) * 1.0f) / 20.0f);
-    reference[3].x = t1.x + (((t2.x - t1.x) * 21.0f) / 20.0f);
-    reference[3].y = t1.y + (((t2.y - t1.y) * 21.0f) / 20.0f);
-    reference[7].x = t1.x + (((t2.x - t1.x) * 19.0f) / 20.0f);
-    reference[7].y = t1.y + (((t2.y - t1.y) * 19.0f) / 20.0f);
-}
-
-
-static void rvCalibrate_GetSamplePoints(CvPoint2D32f corners[4], CvPoint2D32f samples[64])
-// Fill in the 64 sample points points associated with the given quadralateral.
-{
-    int i;
-    int j;
-    int k = 0;
-
-    // Loop over the vertical axis of the rvGrid.
-    // for (i = 14; i >= 0; i -= 2)
-    for (i = 0; i < 16; i += 2)
-    {
-        float fi = (float) i;
-        CvPoint2D32f t1;
-        CvPoint2D32f t2;
-
-        t1.x = corners[1].x + (((corners[2].x - corners[1].x) * (3.0f + i)) / 20.0f);
-        t1.y = corners[1].y + (((corners[2].y - corners[1].y) * (3.0f + i)) / 20.0f);
-        t2.x = corners[0].x + (((corners[3].x - corners[0].x) * (3.0f + i)) / 20.0f);
-        t2.y = corners[0].y + (((corners[3].y - corners[0].y) * (3.0f + i)) / 20.0f);
-
-        // Loop over the horizontal axis of the rvGrid.
-        // for (j = 0; j < 16; j += 2)
-        for (j = 14; j >= 0; j -= 2)
-        {
-            float fj = (float) j;
-
-            // Write the rvGrid position into the rvGrid array.
-            samples[k].x = t1.x + (((t2.x - t1.x) * (3.0f + j)) / 20.0f);
-            samples[k].y = t1.y + (((t2.y - t1.y) * (3.0f + j)) / 20.0f);
-
-            // Increment the array index.
-            ++k;
-        }
-    }
-}
-
-
-static int rvCalibrate_SamplePoint(IplImage *img, CvPoint2D32f point)
-// Sample five pixels at and around the indicated point returning the average value.
-// This function currently assumes a single plane image.
-{
-    uchar *pixel;
-    uchar *pixelLt;
-    uchar *pixelRt;
-    uchar *pixelUp;
-    uchar *pixelDn;
-    int average = 0;
-    int x = cvRound(point.x);
-    int y = cvRound(point.y);
-
-    // Sanity check the values.
-    if (x < 1 || y < 1 || x >= (img->width - 1) || y >= (img->height - 1)) return -1;
-
-    // Get the pixels to be sampled.
-    pixel = &((uchar*)(img->imageData + img->widthStep * y))[x];
-    pixelLt = &((uchar*)(img->imageData + img->widthStep * y))[(x - 1)];
-    pixelRt = &((uchar*)(img->imageData + img->widthStep * y))[(x + 1)];
-    pixelUp = &((uchar*)(img->imageData + img->widthStep * (y - 1)))[x];
-    pixelDn = &((uchar*)(img->imageData + img->widthStep * (y + 1)))[x];
-
-    // Sample the pixels.
-    average += (int) *pixel;
-    average += (int) *pixelLt;
-    average += (int) *pixelRt;
-    average += (int) *pixelUp;
-    average += (int) *pixelDn;
-
-    // Return the average sample.
-    return average / 5;
-}
-
-
-static int rvCalibrate_SamplePoints(IplImage *img, CvPoint2D32f *points, int count)
-// Sample the array of pixels and return the average value.
-{
-    int i;
-    int value;
-    int samples = 0;
-    int average = 0;
-
-    // Loop over each pixel to sample.
-    for (i = 0; i < count; ++i)
-    {
-        // Sample the pixel.
-        value = rvCalibrate_SamplePoint(img, points[0]);
-
-        // Was the value obtained?
-        if (value != -1)
-        {
-            // Add to the avarage.
-            average += value;
-
-            // Add to the sample count.
-            samples += 1;
-        }
-    }
-
-    // Average the samples.
-    if (samples) average /= samples;
-
-    // Return the average sample.
-    return average;
-}
-
-
 rvCalibrate *rvCalibrate_New(CvSize imageSize, int origin)
 // Allocate a new rvCalibrate object.
 {
@@ -195,7 +49,7 @@ rvCalibrate *rvCalibrate_New(CvSize imageSize, int origin)
     rvTag* tag = NULL;
     IplImage *grayImage = NULL;
     IplImage *edgeImage = NULL;
-    CvMemStorage *memStorage = NULL;
+    rvStorage *storage = NULL;
 
     // Allocate a new calibrate object.
     self = (rvCalibrate*) malloc(sizeof(rvCalibrate));
@@ -204,10 +58,10 @@ rvCalibrate *rvCalibrate_New(CvSize imageSize, int origin)
     tag = rvTag_New();
     grayImage = cvCreateImage(imageSize, IPL_DEPTH_8U, 1);
     edgeImage = cvCreateImage(imageSize, IPL_DEPTH_8U, 1);
-    memStorage = cvCreateMemStorage(0);
+    storage = rvStorage_New(RVSTORAGE_DEFAULT_BUDGET, RVSTORAGE_DEFAULT_MAX_CONTOURS);
 
     // Did we allocate the object.
-    if ((self != NULL) && (tag != NULL) && (grayImage != NULL) && (edgeImage != NULL) && (memStorage != NULL))
+    if ((self != NULL) && (tag != NULL) && (grayImage != NULL) && (edgeImage != NULL) && (storage != NULL))
     {
         // No result yet.
         self->results = false;
@@ -223,8 +77,8 @@ rvCalibrate *rvCalibrate_New(CvSize imageSize, int origin)
         self->grayImage->origin = origin;
         self->edgeImage->origin = origin;
 
-        // Set the memory storage.
-        self->memStorage = memStorage;
+        // Set the contour storage.
+        self->storage = storage;
 
         // Create the matrices.
         self->cameraMatrix = cvCreateMat(3, 3, CV_64FC1);
@@ -252,7 +106,7 @@ rvCalibrate *rvCalibrate_New(CvSize imageSize, int origin)
         if (tag) rvTag_Free(tag);
         if (grayImage) cvReleaseImage(&grayImage);
         if (edgeImage) cvReleaseImage(&edgeImage);
-        if (memStorage != NULL) cvReleaseMemStorage(&memStorage);
+        if (storage != NULL) rvStorage_Free(storage);
         if (self) free(self);
 
         return NULL;
@@ -275,7 +129,7 @@ void rvCalibrate_Free(rvCalibrate *self)
         rvTag_Free(self->tag);
         cvReleaseImage(&self->grayImage);
         cvReleaseImage(&self->edgeImage);
-        cvReleaseMemStorage(&self->memStorage);
+        rvStorage_Free(self->storage);
 
         // Free this object.
         free(self);
@@ -372,10 +226,10 @@ bool rvCalibrate_GetViewCount(rvCalibrate *self, rvUint16* count)
 bool rvCalibrate_AddView(rvCalibrate *self, IplImage *image, bool add)
 {
     CvSeq* contours = NULL;
-    CvPoint2D32f reference[8];
-    CvPoint2D32f samples[RVTAG_SAMPLE_COUNT];
+    rvSamplerQuad sampler;
+    CvPoint2D32f reference[RVSAMPLER_REFERENCE_COUNT];
+    CvPoint2D32f samples[RVSAMPLER_SAMPLE_COUNT];
     CvPoint2D32f corners[RVTAG_CORNER_COUNT];
-    rvUint8 tagSamples[RVTAG_SAMPLE_COUNT];
 
     // Sanity check the view count.
     if (self->viewCount >= RVCALIBRATE_MAX_VIEWS) return false;
@@ -383,8 +237,8 @@ bool rvCalibrate_AddView(rvCalibrate *self, IplImage *image, bool add)
     // Reset the count of tags in this view.
     self->views[self->viewCount] = 0;
 
-    // Clear the memory storage.
-    cvClearMemStorage(self->memStorage);
+    // Clear the contour storage.
+    rvStorage_Clear(self->storage);
 
     // Convert the image to gray scale.
     cvCvtColor(image, self->grayImage, CV_RGB2GRAY);
@@ -395,21 +249,23 @@ bool rvCalibrate_AddView(rvCalibrate *self, IplImage *image, bool add)
     // Dialate the edge output to remove holes between edge segments.
     cvDilate(self->edgeImage, self->edgeImage, 0, 1);
 
-    // Get the lines from the edge image.
-    cvFindContours(self->edgeImage, self->memStorage, &contours, sizeof(CvContour), CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE, cvPoint(0, 0));
+    // Get the lines from the edge image.  The number of contours is limited by the
+    // storage budget.
+    contours = rvStorage_FindContours(self->storage, self->edgeImage, CV_RETR_EXTERNAL, cvPoint(0, 0));
 
     // Draw the contours found in the image as red arrows.
     // XXX cvDrawContourArrows(image, contours, CV_RGB(255, 0, 0), 1, 8);
 
-    // Loop over all the countours.
-    while (contours)
+    // Loop over all the countours while there is storage for their polygons.
+    while (contours && rvStorage_CheckBudget(self->storage))
     {
         int i;
         int whiteReference;
         int blackReference;
+        rvUint64 pattern = 0;
 
         // Approximates polygonal curve with precision proportional to the contour perimeter.
-        CvSeq *result = cvApproxPoly(contours, sizeof(CvContour), self->memStorage, CV_POLY_APPROX_DP, cvArcLength(contours, CV_WHOLE_SEQ, 1) * 0.02, 0);
+        CvSeq *result = cvApproxPoly(contours, sizeof(CvContour), rvStorage_GetMemStorage(self->storage), CV_POLY_APPROX_DP, cvArcLength(contours, CV_WHOLE_SEQ, 1) * 0.02, 0);
 
         // Draw the contours found in the image as red arrows.
         // XXX cvDrawContourArrows(image, result, CV_RGB(255, 0, 0), 1, 8);
@@ -438,60 +294,32 @@ bool rvCalibrate_AddView(rvCalibrate *self, IplImage *image, bool add)
             cvFindCornerSubPix(self->grayImage, &corners[0], 4, cvSize(5, 5), cvSize(-1, -1),
                                 cvTermCriteria(CV_TERMCRIT_ITER | CV_TERMCRIT_EPS, 5, 0.2f));
 
-            // Get the reference points.
-            rvCalibrate_GetReferencePoints(corners, reference);
-
-            // Get the black and white pixel values from the reference points.
-            whiteReference = rvCalibrate_SamplePoints(self->grayImage, &reference[0], 4);
-            blackReference = rvCalibrate_SamplePoints(self->grayImage, &reference[4], 4);
-
-            // Draw the reference points.
-            cvDrawCrosses(image, &reference[0], 4, CV_RGB(255, 0, 0));
-            cvDrawCrosses(image, &reference[4], 4, CV_RGB(0, 255, 0));
-
-            // Get the sample points.
-            rvCalibrate_GetSamplePoints(corners, samples);
-
-            // Sample each point.
-            for (i = 0; i < RVTAG_SAMPLE_COUNT; ++i)
+            // Map the sample grid onto the polygon.
+            if (rvSampler_SetQuad(&sampler, corners))
             {
-                int gridSample;
-                int blackDifference;
-                int whiteDifference;
-                CvPoint pt;
+                // Get the black and white pixel values from the reference points.
+                rvSampler_SampleReferences(self->grayImage, &sampler, &whiteReference, &blackReference);
 
-                // Sample the point.
-                gridSample = rvCalibrate_SamplePoint(self->grayImage, samples[i]);
+                // Draw the reference points.
+                rvSampler_GetReferencePoints(&sampler, reference);
+                cvDrawCrosses(image, &reference[0], 4, CV_RGB(255, 0, 0));
+                cvDrawCrosses(image, &reference[4], 4, CV_RGB(0, 255, 0));
 
-                // Get the black and white differences.
-                blackDifference = gridSample - blackReference;
-                whiteDifference = gridSample - whiteReference;
-                if (blackDifference < 0) blackDifference = -blackDifference;
-                if (whiteDifference < 0) whiteDifference = -whiteDifference;
+                // Sample the points as a bit pattern with white squares as set bits.
+                pattern = rvSampler_SamplePattern(self->grayImage, &sampler, blackReference, whiteReference);
 
-                pt.x = cvRound(samples[i].x);
-                pt.y = cvRound(samples[i].y);
+                // Get the sample points.
+                rvSampler_GetSamplePoints(&sampler, samples);
 
-                if (whiteDifference < blackDifference)
+                // Draw white squares as red crosses and black squares as green crosses.
+                for (i = 0; i < RVTAG_SAMPLE_COUNT; ++i)
                 {
-                    // We found a white square.
-                    tagSamples[i] = 1;
-
-                    // Draw the red cross.
-                    cvDrawCross(image, pt, CV_RGB(255, 0, 0));
-                }
-                else
-                {
-                    // We found a black square.
-                    tagSamples[i] = 0;
-
-                    // Draw the green cross.
-                    cvDrawCross(image, pt, CV_RGB(0, 255, 0));
+                    cvDrawCross(image, cvPointFrom32f(samples[i]), ((pattern >> i) & 1) ? CV_RGB(255, 0, 0) : CV_RGB(0, 255, 0));
                 }
             }
 
             // Decode the bits and see if we found a valid pattern.
-            if (rvTag_DecodeSamples(self->tag, corners, tagSamples))
+            if (rvTag_DecodePattern(self->tag, corners, pattern))
             {
                 // Make sure we can add another tag.
                 if (self->tagCount < RVCALIBRATE_MAX_TAGS)
@@ -533,7 +361,7 @@ bool rvCalibrate_AddView(rvCalibrate *self, IplImage *image, bool add)
                         CvPoint2D32f center;
 
                         // Print the grid id into the buffer.
-                        _snprintf(buffer, sizeof(buffer), "%d", (int) tagId);
+                        rvSnprintf(buffer, sizeof(buffer), "%d", (int) tagId);
 
                         // Get the coordinates of the center.
                         rvCalibrate_GetCenterPoint(corners, &center);
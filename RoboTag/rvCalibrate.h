@@ -23,6 +23,7 @@
 
 #include "rvTypes.h"
 #include "rvTag.h"
+#include "rvStorage.h"
 #include "cv.h"
 
 #ifdef __cplusplus
@@ -45,7 +46,7 @@ struct _rvCalibrate
 
     IplImage *grayImage;
     IplImage *edgeImage;
-    CvMemStorage *memStorage;
+    rvStorage *storage;
 
     rvTag* tag;
 
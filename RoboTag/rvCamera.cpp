@@ -42,12 +42,6 @@ rvCamera::rvCamera(wxWindow *parent, wxWindowID id, const wxPoint& pos, const wx
     m_width = size.GetWidth( );
     m_height = size.GetHeight( );
 
-    // Start the camera.
-    m_graphManager.BuildGraph(640, 480, 30.0);
-    m_graphManager.EnableMemoryBuffer(3);
-    m_graphManager.SetImageHandler(this);
-    m_graphManager.Run();
-
     // Create a new grid object.
     m_grid = rvGrid_New(cvSize(640, 480), IPL_ORIGIN_BL);
 
@@ -57,20 +51,36 @@ rvCamera::rvCamera(wxWindow *parent, wxWindowID id, const wxPoint& pos, const wx
     // Create a flipped image buffer.  This buffer is needed the camera  and OpenCV
     // deal with the image with a different orgin and RGB order than wxWidgets.
     m_flippedImage = cvCreateImage(cvSize(640, 480), IPL_DEPTH_8U, 3);
+    cvZero(m_flippedImage);
+
+    // Create the pipeline which processes images on a detection thread.
+    m_pipeline = rvPipeline_New(m_grid, cvSize(640, 480), RVPIPELINE_DEF_FRAMES);
+    rvPipeline_SetFrameCallback(m_pipeline, rvCamera::OnFrameReady, this);
+    rvPipeline_Start(m_pipeline);
+
+    // Start the camera.  Captured images are pushed straight into the pipeline.
+    m_graphManager.BuildGraph(640, 480, 30.0);
+    m_graphManager.EnableMemoryBuffer(3);
+    m_graphManager.SetPipeline(m_pipeline);
+    m_graphManager.Run();
 }
 
 rvCamera::~rvCamera()
 {
+    // Release the graph manager resources.
+    m_graphManager.Stop();
+    m_graphManager.SetPipeline(NULL);
+    m_graphManager.DisableMemoryBuffer();
+    m_graphManager.ReleaseGraph();
+
+    // Stop and free the pipeline.
+    rvPipeline_Free(m_pipeline);
+
     // Release the flipped image buffer.
     cvReleaseImage(&m_flippedImage);
 
     // Free the grid object.
     rvGrid_Free(m_grid);
-
-    // Release the graph manager resources.
-    m_graphManager.Stop();
-    m_graphManager.DisableMemoryBuffer();
-    m_graphManager.ReleaseGraph();
 }
 
 rvGrid* rvCamera::GetGrid()
@@ -78,6 +88,18 @@ rvGrid* rvCamera::GetGrid()
     return m_grid;
 }
 
+void rvCamera::LockGrid()
+{
+    // Keep the detection thread from using the grid.
+    rvPipeline_LockGrid(m_pipeline);
+}
+
+void rvCamera::UnlockGrid()
+{
+    // Allow the detection thread to use the grid.
+    rvPipeline_UnlockGrid(m_pipeline);
+}
+
 void rvCamera::Draw(wxDC& dc)
 {
     // Check if dc available.
@@ -88,42 +110,29 @@ void rvCamera::Draw(wxDC& dc)
         // Get the clipping box.
         dc.GetClippingBox(&x, &y, &w, &h);
 
-        // Check out the image.
-        IplImage image;
-        if (m_graphManager.CheckoutIplImage(&image))
-        {
-            int step;
-            CvSize roiSize;
-            unsigned char *rawData;
-
-            // Process the image to determine the position.
-            rvGrid_ProcessImage(m_grid, &image);
-
-            // Flip the image and swap the red and blue channels.
-            cvConvertImage(&image, m_flippedImage, CV_CVTIMG_FLIP | CV_CVTIMG_SWAP_RB);
+        int step;
+        CvSize roiSize;
+        unsigned char *rawData;
 
-            // Get raw data from the image.
-            cvGetRawData(m_flippedImage, &rawData, &step, &roiSize);
+        // Get raw data from the latest processed image.  The image is
+        // processed on the pipeline detection thread, not here.
+        cvGetRawData(m_flippedImage, &rawData, &step, &roiSize);
 
-            // Convert data from raw image data to a native wxImage.
-            wxImage nativeImage = wxImage(640, 480, rawData, TRUE);
+        // Convert data from raw image data to a native wxImage.
+        wxImage nativeImage = wxImage(640, 480, rawData, TRUE);
 
-            // Do we need to scale the image?
-            if (roiSize.width != m_width || roiSize.height != m_height)
-            {
-                // Rescale the image.
-                nativeImage.Rescale(m_width, m_height, wxIMAGE_QUALITY_NORMAL);
-            }
-
-            // Convert to image to bitmap so we can draw it to a window.
-            wxBitmap bitmap = wxBitmap(nativeImage);
+        // Do we need to scale the image?
+        if (roiSize.width != m_width || roiSize.height != m_height)
+        {
+            // Rescale the image.
+            nativeImage.Rescale(m_width, m_height, wxIMAGE_QUALITY_NORMAL);
+        }
 
-            // Draw the bitmap.
-            dc.DrawBitmap(bitmap, x, y);
+        // Convert to image to bitmap so we can draw it to a window.
+        wxBitmap bitmap = wxBitmap(nativeImage);
 
-            // We are finished with the image.
-            m_graphManager.CheckinIplImage(&image);
-        }
+        // Draw the bitmap.
+        dc.DrawBitmap(bitmap, x, y);
     }
 }
 
@@ -149,8 +158,30 @@ void rvCamera::OnEraseBackground(wxEraseEvent &WXUNUSED(event))
 
 void rvCamera::OnImageReady(wxCommandEvent &WXUNUSED(event))
 {
-    // Force an update of the window.
-    Refresh(false, NULL);
+    // Check out the latest processed frame.  Older frames are skipped.
+    rvPipelineFrame *frame = rvPipeline_CheckoutFrame(m_pipeline);
+    if (frame != NULL)
+    {
+        // Flip the image and swap the red and blue channels.
+        cvConvertImage(frame->image, m_flippedImage, CV_CVTIMG_FLIP | CV_CVTIMG_SWAP_RB);
+
+        // We are finished with the frame.
+        rvPipeline_CheckinFrame(m_pipeline, frame);
+
+        // Force an update of the window.
+        Refresh(false, NULL);
+    }
+}
+
+void rvCamera::OnFrameReady(rvPipeline *WXUNUSED(pipeline), rvPipelineFrame *WXUNUSED(frame), void *arg)
+{
+    rvCamera *camera = (rvCamera *) arg;
+
+    // Called from the detection thread.  Queue an event so the frame is
+    // rendered on the GUI thread.
+    wxCommandEvent event(wxEVT_CAMERA_IMAGE_READY);
+    event.SetEventObject(camera);
+    camera->AddPendingEvent(event);
 }
 
 void rvCamera::OnShowPinProperties(wxCommandEvent &WXUNUSED(event))
@@ -26,6 +26,7 @@
 #include "highgui.h"
 #include "rvDSCamera.h"
 #include "rvGrid.h"
+#include "rvPipeline.h"
 
 BEGIN_DECLARE_EVENT_TYPES()
 DECLARE_EVENT_TYPE(wxEVT_SHOW_PIN_PROPERTIES, -2)
@@ -43,6 +44,8 @@ public:
     virtual ~rvCamera();
 
     rvGrid* GetGrid();
+    void LockGrid();
+    void UnlockGrid();
 
     void Draw(wxDC& dc);
 
@@ -55,9 +58,12 @@ public:
     void OnShowFilterProperties(wxCommandEvent &event);
 
 private:
+    static void OnFrameReady(rvPipeline *pipeline, rvPipelineFrame *frame, void *arg);
+
     int m_width;
     int m_height;
     rvGrid *m_grid;
+    rvPipeline *m_pipeline;
     rvDSCamera m_graphManager;
     IplImage *m_flippedImage;
 
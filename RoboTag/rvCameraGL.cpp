@@ -34,6 +34,10 @@ rvCamera::rvCamera(wxWindow *parent, wxWindowID id, const wxPoint& pos, const wx
     // Create a new grid object.
     m_grid = rvGrid_New(cvSize(640, 480), IPL_ORIGIN_BL);
 
+    // Create the output image once rather than for every frame.
+    m_outputImage = cvCreateImage(cvSize(640, 480), IPL_DEPTH_8U, 1);
+    m_outputImage->origin = IPL_ORIGIN_BL;
+
     // Initialize what grid items to draw.
     rvGrid_DrawTagCorners(m_grid, 1);
     rvGrid_DrawTagSamples(m_grid, 1);
@@ -52,6 +56,9 @@ rvCamera::~rvCamera()
     // Free the grid object.
     rvGrid_Free(m_grid);
 
+    // Release the output image.
+    cvReleaseImage(&m_outputImage);
+
     // Delete GL resources.
     if (m_gllist) glDeleteLists(m_gllist, 1);
     glDeleteTextures(RVCAMERA_TEXTURES_NUM, m_gltexid);
@@ -104,23 +111,16 @@ void rvCamera::Render()
     IplImage image;
     if (m_graphManager.CheckoutIplImage(&image))
     {
-        // Initialize the output image.
-        IplImage *outputImage = cvCreateImage(cvSize(640, 480), IPL_DEPTH_8U, 1);
-        outputImage->origin = IPL_ORIGIN_BL;
-
         // Blur the camera image into the output image.
-        // cvSmooth(&image, outputImage, CV_BLUR, 15, 0, 0.0, 0.0);
-        cvCvtColor(&image, outputImage, CV_BGR2GRAY);
+        // cvSmooth(&image, m_outputImage, CV_BLUR, 15, 0, 0.0, 0.0);
+        cvCvtColor(&image, m_outputImage, CV_BGR2GRAY);
 
         // Bind the texture name to the appropriate texture target.
         glBindTexture(GL_TEXTURE_2D, m_gltexid[RVCAMERA_TEXTURE_ID]);
 
         // Specify the pixel image as two-dimensional texture subimage.
-        // glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 640, 480, GL_BGR_EXT, GL_UNSIGNED_BYTE, (void*) outputImage->imageData);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 640, 480, GL_LUMINANCE, GL_UNSIGNED_BYTE, (void*) outputImage->imageData);
-
-        // Release the output image.
-        cvReleaseImage(&outputImage);
+        // glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 640, 480, GL_BGR_EXT, GL_UNSIGNED_BYTE, (void*) m_outputImage->imageData);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 640, 480, GL_LUMINANCE, GL_UNSIGNED_BYTE, (void*) m_outputImage->imageData);
 
         // We are finished with the image.
         m_graphManager.CheckinIplImage(&image);
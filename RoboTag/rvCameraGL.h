@@ -56,6 +56,7 @@ private:
     GLuint m_gllist;
     GLuint m_gltexid[RVCAMERA_TEXTURES_NUM];
     rvGrid *m_grid;
+    IplImage *m_outputImage;
 
     rvDSCamera m_graphManager;
 
@@ -0,0 +1,367 @@
+/*
+    Copyright (C) 2010, Michael P. Thompson
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 2 as
+    specified in the README.txt file or as published by the Free Software
+    Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    $Id$
+*/
+
+#include <stdlib.h>
+#include "rvCodebook.h"
+#include "rvDecode.h"
+#include "rvTagSet.h"
+
+// Implements a hash table of the sample patterns of valid tags in each of the
+// four directions.  Patterns read without errors are found with a single lookup
+// which avoids the error correction and CRC checks of the full decoder.
+//
+// The patterns are also kept in a list indexed by each of their eight bytes.  A
+// pattern within seven bits of a stored pattern must match it exactly in at least
+// one byte, so the nearest stored pattern is found by only comparing against the
+// patterns which share a byte with the pattern being searched for.
+
+// Multiplier used to hash the sample patterns.
+#define RVCODEBOOK_HASH_MULTIPLIER  rvUint64Const(0x9e3779b97f4a7c15)
+
+// Codebook entry types.
+typedef struct _rvCodebookEntry rvCodebookEntry;
+
+// Codebook entry structure.  Unused entries have an unknown direction.
+struct _rvCodebookEntry
+{
+    rvUint64 pattern;
+    rvUint16 id;
+    rvInt16 direction;
+};
+
+// Codebook structure.
+struct _rvCodebook
+{
+    int count;                  // Number of ids in the codebook.
+    int capacity;               // Maximum number of ids in the codebook.
+    int shift;                  // Shift which reduces a hash to an entry index.
+    rvUint32 mask;              // Mask of the entry index.
+    rvDecode *decoder;          // Decoder used to encode and validate patterns.
+    rvTagSet *ids;              // Set of the ids in the codebook.
+    rvCodebookEntry *entries;
+    int patternCount;           // Number of patterns in the list.
+    rvCodebookEntry *patterns;  // List of the patterns.
+    int *chunkNext;             // Next pattern with the same byte for each byte of each pattern.
+    int chunkHead[8][256];      // First pattern with each value of each byte.
+};
+
+
+static rvUint32 rvCodebook_Hash(rvCodebook *self, rvUint64 pattern)
+// Returns the index of the first entry to probe for the pattern.
+{
+    return (rvUint32) ((pattern * RVCODEBOOK_HASH_MULTIPLIER) >> self->shift);
+}
+
+
+rvCodebook *rvCodebook_New(int capacity)
+// Create a new empty codebook able to hold the given number of tag ids.
+{
+    int bits;
+    rvCodebook *self;
+
+    // Sanity check the arguments.
+    if (capacity < 1) return NULL;
+
+    // Allocate the object.
+    self = (rvCodebook *) malloc(sizeof(rvCodebook));
+
+    // Did we allocate the object.
+    if (self != NULL)
+    {
+        // Size the table to keep it at most two thirds full with four
+        // patterns for each id.
+        for (bits = 4; ((1 << bits) * 2) < (capacity * 4 * 3); ++bits);
+
+        // Set the object variables.
+        self->count = 0;
+        self->capacity = capacity;
+        self->shift = 64 - bits;
+        self->mask = (1 << bits) - 1;
+        self->decoder = rvDecode_New(64);
+        self->ids = rvTagSet_New();
+        self->entries = (rvCodebookEntry *) malloc(sizeof(rvCodebookEntry) << bits);
+        self->patterns = (rvCodebookEntry *) malloc(sizeof(rvCodebookEntry) * capacity * 4);
+        self->chunkNext = (int *) malloc(sizeof(int) * capacity * 4 * 8);
+
+        // Did we allocate the internal objects?
+        if ((self->decoder == NULL) || (self->ids == NULL) || (self->entries == NULL) || (self->patterns == NULL) || (self->chunkNext == NULL))
+        {
+            // Clean up.
+            if (self->decoder) rvDecode_Free(self->decoder);
+            if (self->ids) rvTagSet_Free(self->ids);
+            if (self->entries) free(self->entries);
+            if (self->patterns) free(self->patterns);
+            if (self->chunkNext) free(self->chunkNext);
+            free(self);
+
+            return NULL;
+        }
+
+        // Mark each entry unused.
+        rvCodebook_Clear(self);
+    }
+
+    return self;
+}
+
+
+void rvCodebook_Free(rvCodebook *self)
+// Free the codebook object.
+{
+    // Sanity check the arguments.
+    if (self == NULL) return;
+
+    // Free the internal objects.
+    rvDecode_Free(self->decoder);
+    rvTagSet_Free(self->ids);
+    free(self->entries);
+    free(self->patterns);
+    free(self->chunkNext);
+
+    // Free the object.
+    free(self);
+}
+
+
+void rvCodebook_Clear(rvCodebook *self)
+// Remove all ids from the codebook.
+{
+    rvUint32 i;
+    rvUint32 j;
+
+    // Mark each entry unused.
+    for (i = 0; i <= self->mask; ++i) self->entries[i].direction = rvDecodeUnknown;
+
+    // Empty the pattern list and its index.
+    for (i = 0; i < 8; ++i)
+    {
+        for (j = 0; j < 256; ++j) self->chunkHead[i][j] = -1;
+    }
+    self->patternCount = 0;
+
+    // Reset the id count.
+    rvTagSet_Clear(self->ids);
+    self->count = 0;
+}
+
+
+bool rvCodebook_AddId(rvCodebook *self, rvUint16 id)
+// Add the sample patterns of the tag id in each direction to the codebook.  A
+// pattern is only added if the full decoder decodes it to the same id and
+// direction, so the codebook never accepts a pattern the decoder would reject.
+// Returns false if the codebook is full.
+{
+    int i;
+    rvUint16 decodedId;
+    rvInt16 decodedDirection;
+    rvUint64 codeword;
+    static rvInt16 directions[4] = { rvDecodeNorth, rvDecodeSouth, rvDecodeEast, rvDecodeWest };
+
+    // Is the id already in the codebook?
+    if (rvTagSet_Contains(self->ids, id)) return true;
+
+    // Make sure there is room for the id.
+    if (self->count >= self->capacity) return false;
+
+    // Get the codeword of the tag id.
+    codeword = rvDecode_GetIdCodeword(self->decoder, id);
+
+    // Loop over each direction.
+    for (i = 0; i < 4; ++i)
+    {
+        int j;
+        rvUint32 index;
+        rvUint64 pattern = rvDecode_GetPattern(codeword, directions[i]);
+
+        // Make sure the full decoder gives the same result.
+        if (!rvDecode_SetPattern(self->decoder, pattern)) continue;
+        rvDecode_GetId(self->decoder, &decodedId);
+        rvDecode_GetDirection(self->decoder, &decodedDirection);
+        if ((decodedId != id) || (decodedDirection != directions[i])) continue;
+
+        // Find the entry for the pattern.
+        for (index = rvCodebook_Hash(self, pattern); self->entries[index].direction != rvDecodeUnknown; index = (index + 1) & self->mask)
+        {
+            if (self->entries[index].pattern == pattern) break;
+        }
+
+        // Skip patterns which are already in the codebook.
+        if (self->entries[index].direction != rvDecodeUnknown) continue;
+
+        // Fill in the entry.
+        self->entries[index].pattern = pattern;
+        self->entries[index].id = id;
+        self->entries[index].direction = directions[i];
+
+        // Add the entry to the pattern list.
+        self->patterns[self->patternCount] = self->entries[index];
+
+        // Index the pattern by each of its bytes.
+        for (j = 0; j < 8; ++j)
+        {
+            int chunk = (int) ((pattern >> (j << 3)) & 0xff);
+
+            self->chunkNext[(self->patternCount << 3) + j] = self->chunkHead[j][chunk];
+            self->chunkHead[j][chunk] = self->patternCount;
+        }
+
+        ++self->patternCount;
+    }
+
+    // Add the id to the set and increment the id count.
+    rvTagSet_Add(self->ids, id);
+    ++self->count;
+
+    return true;
+}
+
+
+bool rvCodebook_HasId(rvCodebook *self, rvUint16 id)
+// Returns true if the tag id has been added to the codebook.
+{
+    return rvTagSet_Contains(self->ids, id);
+}
+
+
+int rvCodebook_GetCount(rvCodebook *self)
+{
+    return self->count;
+}
+
+
+int rvCodebook_GetCapacity(rvCodebook *self)
+{
+    return self->capacity;
+}
+
+
+bool rvCodebook_Find(rvCodebook *self, rvUint64 pattern, rvUint16 *id, rvInt16 *direction)
+// Look up the sample pattern returning the tag id and direction.  Returns false
+// if the pattern is not an exact match for a tag in the codebook.
+{
+    rvUint32 index;
+
+    // Probe the entries until an unused entry is reached.
+    for (index = rvCodebook_Hash(self, pattern); self->entries[index].direction != rvDecodeUnknown; index = (index + 1) & self->mask)
+    {
+        // Is this the pattern?
+        if (self->entries[index].pattern == pattern)
+        {
+            // Return the id and direction.
+            *id = self->entries[index].id;
+            *direction = self->entries[index].direction;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+bool rvCodebook_FindNearest(rvCodebook *self, rvUint64 pattern, int maxDistance, rvUint16 *id, rvInt16 *direction, int *distance)
+// Find the pattern in the codebook nearest to the given pattern in Hamming
+// distance.  Returns false if no pattern is within the maximum distance or if
+// more than one pattern is at the nearest distance.
+{
+    int i;
+    int nearest = -1;
+    int nearestDistance = maxDistance + 1;
+    bool ambiguous = false;
+
+    // Can the chunk index find every pattern within the maximum distance?
+    if (maxDistance <= RVCODEBOOK_INDEX_DISTANCE)
+    {
+        // Loop over the patterns sharing each byte with the pattern.
+        for (i = 0; i < 8; ++i)
+        {
+            int n;
+
+            for (n = self->chunkHead[i][(pattern >> (i << 3)) & 0xff]; n >= 0; n = self->chunkNext[(n << 3) + i])
+            {
+                int d;
+
+                // Patterns sharing several bytes are visited more than once.
+                if (n == nearest) continue;
+
+                // Is this the nearest pattern so far?
+                d = rvCodebook_GetDistance(pattern, self->patterns[n].pattern);
+                if (d < nearestDistance)
+                {
+                    nearest = n;
+                    nearestDistance = d;
+                    ambiguous = false;
+                }
+                else if (d == nearestDistance)
+                {
+                    ambiguous = true;
+                }
+            }
+        }
+    }
+    else
+    {
+        // Compare against every pattern.
+        for (i = 0; i < self->patternCount; ++i)
+        {
+            int d = rvCodebook_GetDistance(pattern, self->patterns[i].pattern);
+
+            // Is this the nearest pattern so far?
+            if (d < nearestDistance)
+            {
+                nearest = i;
+                nearestDistance = d;
+                ambiguous = false;
+            }
+            else if (d == nearestDistance)
+            {
+                ambiguous = true;
+            }
+        }
+    }
+
+    // Did we find a single nearest pattern?
+    if ((nearest < 0) || ambiguous) return false;
+
+    // Return the id, direction and distance.
+    *id = self->patterns[nearest].id;
+    *direction = self->patterns[nearest].direction;
+    *distance = nearestDistance;
+
+    return true;
+}
+
+
+int rvCodebook_GetDistance(rvUint64 pattern1, rvUint64 pattern2)
+// Returns the number of bits which differ between the patterns.
+{
+    rvUint64 x = pattern1 ^ pattern2;
+
+#if defined(__GNUC__)
+    return __builtin_popcountll(x);
+#else
+    // Count the bits in parallel.
+    x = x - ((x >> 1) & rvUint64Const(0x5555555555555555));
+    x = (x & rvUint64Const(0x3333333333333333)) + ((x >> 2) & rvUint64Const(0x3333333333333333));
+    x = (x + (x >> 4)) & rvUint64Const(0x0f0f0f0f0f0f0f0f);
+
+    return (int) ((x * rvUint64Const(0x0101010101010101)) >> 56);
+#endif
+}
@@ -0,0 +1,53 @@
+/*
+    Copyright (C) 2010, Michael P. Thompson
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 2 as
+    specified in the README.txt file or as published by the Free Software
+    Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    $Id$
+*/
+
+#ifndef _RV_CODEBOOK_INCLUDED_
+#define _RV_CODEBOOK_INCLUDED_
+
+#include "rvTypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Largest distance searched by rvCodebook_FindNearest() using the chunk index.
+// Larger distances fall back to comparing against every pattern.
+#define RVCODEBOOK_INDEX_DISTANCE   7
+
+// Codebook types.
+typedef struct _rvCodebook rvCodebook;
+
+// Codebook methods.
+rvCodebook *rvCodebook_New(int capacity);
+void rvCodebook_Free(rvCodebook *self);
+void rvCodebook_Clear(rvCodebook *self);
+bool rvCodebook_AddId(rvCodebook *self, rvUint16 id);
+bool rvCodebook_HasId(rvCodebook *self, rvUint16 id);
+int rvCodebook_GetCount(rvCodebook *self);
+int rvCodebook_GetCapacity(rvCodebook *self);
+bool rvCodebook_Find(rvCodebook *self, rvUint64 pattern, rvUint16 *id, rvInt16 *direction);
+bool rvCodebook_FindNearest(rvCodebook *self, rvUint64 pattern, int maxDistance, rvUint16 *id, rvInt16 *direction, int *distance);
+int rvCodebook_GetDistance(rvUint64 pattern1, rvUint64 pattern2);
+
+#ifdef __cplusplus
+} // "C"
+#endif
+
+#endif // _RV_CODEBOOK_INCLUDED_
@@ -421,6 +421,7 @@ rvDSCamera::rvDSCamera() :
     m_refCount = 0;
     m_graphInitialized = false;
     m_imageHandler = NULL;
+    m_pipeline = NULL;
     m_imageBufferList = rvLinkedList_New(16, sizeof(rvDSCameraBuffer), 0);
     m_sync = CreateEvent(NULL, TRUE, 0, _T("SyncEvent"));
 }
@@ -533,12 +534,28 @@ HRESULT WINAPI rvDSCamera::SampleCB(double SampleTime, IMediaSample *pMediaSampl
     // Signal that we have an image.
     SetEvent(m_sync);
 
-    // Send an event that we are ready with a new image.
+    // Pass a copy of the image to the processing pipeline.  This never blocks.
+    if (m_pipeline != NULL)
+    {
+        IplImage image;
+
+        // Initialize the image header with three channels, origin in the bottom left and alignment of 4.
+        cvInitImageHeader(&image, cvSize(m_imageWidth, m_imageHeight), IPL_DEPTH_8U, 3, IPL_ORIGIN_BL, 4);
+
+        // Point the image header at the sample buffer and push it.
+        if (SUCCEEDED(pMediaSample->GetPointer((BYTE **) &image.imageData)))
+        {
+            rvPipeline_PushImage(m_pipeline, &image);
+        }
+    }
+
+    // Post an event that we are ready with a new image.  The event is queued
+    // rather than processed here so the capture thread is never blocked.
     if (m_imageHandler != NULL)
     {
         wxCommandEvent event(wxEVT_CAMERA_IMAGE_READY);
         event.SetEventObject(this);
-        m_imageHandler->ProcessEvent(event);
+        m_imageHandler->AddPendingEvent(event);
     }
 
     return S_OK;
@@ -558,6 +575,18 @@ bool rvDSCamera::SetImageHandler(wxEvtHandler *imageHandler)
     return true;
 }
 
+
+bool rvDSCamera::SetPipeline(rvPipeline *pipeline)
+{
+    // Lock this code block as a critical section.
+    CAutoLock cObjectLock(&m_critSection);
+
+    // Set the processing pipeline.
+    m_pipeline = pipeline;
+
+    return true;
+}
+
 bool rvDSCamera::EnableMemoryBuffer(unsigned int maxConcurrentClients, unsigned int allocatorBuffersPerClient)
 {
     HRESULT hr;
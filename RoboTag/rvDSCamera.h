@@ -28,6 +28,7 @@
 #include "wx/wx.h"
 #include "cv.h"
 #include "rvLinkedList.h"
+#include "rvPipeline.h"
 
 // There are problems compiling wxWidgets and DirectX/DirectShow files because
 // of name and type conflicts.  The changes below help work around these issues.
@@ -96,6 +97,7 @@ private:
     int m_imageHeight;
     rvLinkedList *m_imageBufferList;
     wxEvtHandler *m_imageHandler;
+    rvPipeline *m_pipeline;
 
 public:
     rvDSCamera();
@@ -103,6 +105,7 @@ public:
 
     // Camera setup.
     bool SetImageHandler(wxEvtHandler *imageHandler = NULL);
+    bool SetPipeline(rvPipeline *pipeline = NULL);
     bool EnableMemoryBuffer(unsigned int maxConcurrentClients = DEF_CONCURRENT_CLIENTS, unsigned int allocatorBuffersPerClient = MIN_ALLOCATOR_BUFFERS_PER_CLIENT);
     bool DisableMemoryBuffer();
     bool BuildGraph(int width, int height, double frameRate);
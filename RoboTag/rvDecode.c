@@ -44,59 +44,60 @@ rvUint8 rvDecodeMappingNorth[] =
     28, 29, 30, 31, 12, 13, 14, 15
 };
 
-// East Mapping
-rvUint8 rvDecodeMappingEast[] =
-{
-    28, 24, 44, 40, 36, 32,  4,  0,
-    29, 25, 45, 41, 37, 33,  5,  1,
-    30, 26, 46, 42, 38, 34,  6,  2,
-    31, 27, 47, 43, 39, 35,  7,  3,
-    12,  8, 60, 56, 52, 48, 20, 16,
-    13,  9, 61, 57, 53, 49, 21, 17,
-    14, 10, 62, 58, 54, 50, 22, 18,
-    15, 11, 63, 59, 55, 51, 23, 19
+// Sample patterns hold the 8x8 grid of samples with bit (row * 8 + column)
+// holding the sample at the row and column.  In the north direction each group
+// of four samples maps to four consecutive codeword bits.  This table gives the
+// destination nibble of the codeword for each nibble of the sample pattern.  The
+// other directions rotate the sample pattern before mapping the nibbles.
+static rvUint8 nibbles[16] =
+{
+     0,  4,  1,  5,  8, 12,  9, 13,
+    10, 14, 11, 15,  6,  2,  7,  3
 };
 
-// South Mapping
-rvUint8 rvDecodeMappingSouth[] =
-{
-    15, 14, 13, 12, 31, 30, 29, 28,
-    11, 10,  9,  8, 27, 26, 25, 24,
-    63, 62, 61, 60, 47, 46, 45, 44,
-    59, 58, 57, 56, 43, 42, 41, 40,
-    55, 54, 53, 52, 39, 38, 37, 36,
-    51, 50, 49, 48, 35, 34, 33, 32,
-    23, 22, 21, 20,  7,  6,  5,  4,
-    19, 18, 17, 16,  3,  2,  1,  0
-};
 
-// West Mapping
-rvUint8 rvDecodeMappingWest[] =
-{
-    19, 23, 51, 55, 59, 63, 11, 15,
-    18, 22, 50, 54, 58, 62, 10, 14,
-    17, 21, 49, 53, 57, 61,  9, 13,
-    16, 20, 48, 52, 56, 60,  8, 12,
-     3,  7, 35, 39, 43, 47, 27, 31,
-     2,  6, 34, 38, 42, 46, 26, 30,
-     1,  5, 33, 37, 41, 45, 25, 29,
-     0,  4, 32, 36, 40, 44, 24, 28
-};
+static rvUint64 rvDecode_Transpose(rvUint64 x)
+// Transpose the 8x8 bit matrix so rows become columns.
+{
+    rvUint64 t;
+
+    t = (x ^ (x >> 7)) & rvUint64Const(0x00aa00aa00aa00aa);
+    x = x ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & rvUint64Const(0x0000cccc0000cccc);
+    x = x ^ t ^ (t << 14);
+    t = (x ^ (x >> 28)) & rvUint64Const(0x00000000f0f0f0f0);
+    x = x ^ t ^ (t << 28);
+
+    return x;
+}
 
-// Used to convert from  integer to mapping.
-static rvUint8 *mappings[4] =
+
+static rvUint64 rvDecode_ReverseColumns(rvUint64 x)
+// Reverse the order of the columns of the 8x8 bit matrix.
 {
-    rvDecodeMappingNorth,
-    rvDecodeMappingWest,
-    rvDecodeMappingSouth,
-    rvDecodeMappingEast
-};
+    x = ((x >> 1) & rvUint64Const(0x5555555555555555)) | ((x & rvUint64Const(0x5555555555555555)) << 1);
+    x = ((x >> 2) & rvUint64Const(0x3333333333333333)) | ((x & rvUint64Const(0x3333333333333333)) << 2);
+    x = ((x >> 4) & rvUint64Const(0x0f0f0f0f0f0f0f0f)) | ((x & rvUint64Const(0x0f0f0f0f0f0f0f0f)) << 4);
+
+    return x;
+}
+
+
+static rvUint64 rvDecode_ReverseRows(rvUint64 x)
+// Reverse the order of the rows of the 8x8 bit matrix.
+{
+    x = ((x >> 8) & rvUint64Const(0x00ff00ff00ff00ff)) | ((x & rvUint64Const(0x00ff00ff00ff00ff)) << 8);
+    x = ((x >> 16) & rvUint64Const(0x0000ffff0000ffff)) | ((x & rvUint64Const(0x0000ffff0000ffff)) << 16);
+    x = (x >> 32) | (x << 32);
+
+    return x;
+}
+
 
 rvDecode *rvDecode_New(rvUint8 bitcount)
 // Allocate a new bit rvDecode object with the specified bit count.
 {
     rvDecode* self = NULL;
-    rvBitfield* gridBits = NULL;
     rvFec* gridFec = NULL;
 
     // Bit count must be a multiple of bits in a byte.
@@ -105,25 +106,26 @@ rvDecode *rvDecode_New(rvUint8 bitcount)
     // Allocate a new rvDecode object and other objects.
     self = (rvDecode *) malloc(sizeof(rvDecode));
     gridFec = rvFec_New(8, 4, 4);
-    gridBits = rvBitfield_New(bitcount);
 
     // Did we allocate the object.
-    if ((self != NULL) && (gridFec != NULL) && (gridBits != NULL))
+    if ((self != NULL) && (gridFec != NULL))
     {
         // Set the object variables.
         self->result = false;
         self->bitcount = bitcount;
         self->gridFec = gridFec;
-        self->gridBits = gridBits;
+        self->codebook = NULL;
         self->gridId = 0;
         self->gridDir = rvDecodeUnknown;
+        self->bitErrors = 0;
+        self->method = rvDecodeMethodFec;
+        self->maxBitErrors = 0;
     }
     else
     {
         // Clean up.
         if (self) free(self);
         if (gridFec) rvFec_Free(gridFec);
-        if (gridBits) rvBitfield_Free(gridBits);
 
         return NULL;
     }
@@ -139,25 +141,199 @@ void rvDecode_Free(rvDecode *self)
     {
         // Free the rvDecode object.
         rvFec_Free(self->gridFec);
-        rvBitfield_Free(self->gridBits);
         free(self);
     }
 }
 
 
+rvUint64 rvDecode_GetCodeword(rvUint64 pattern, rvInt16 direction)
+// Rearrange the sample pattern into the codeword read in the given direction.
+// Byte n of the codeword is held in bits (n * 8) to (n * 8 + 7).
+{
+    int i;
+    rvUint64 codeword = 0;
+
+    // Rotate the pattern to the north direction.
+    switch (direction)
+    {
+        default:
+        case rvDecodeNorth:
+            break;
+
+        case rvDecodeWest:
+            pattern = rvDecode_ReverseColumns(rvDecode_Transpose(pattern));
+            break;
+
+        case rvDecodeSouth:
+            pattern = rvDecode_ReverseColumns(rvDecode_ReverseRows(pattern));
+            break;
+
+        case rvDecodeEast:
+            pattern = rvDecode_ReverseRows(rvDecode_Transpose(pattern));
+            break;
+    }
+
+    // Move each nibble of the pattern into place.
+    for (i = 0; i < 16; ++i)
+    {
+        codeword |= ((pattern >> (i << 2)) & 0x0f) << (nibbles[i] << 2);
+    }
+
+    return codeword;
+}
+
+
+rvUint64 rvDecode_GetPattern(rvUint64 codeword, rvInt16 direction)
+// Rearrange the codeword into the sample pattern which reads as the codeword in
+// the given direction.  This is the inverse of rvDecode_GetCodeword().
+{
+    int i;
+    rvUint64 pattern = 0;
+
+    // Move each nibble of the codeword into place.
+    for (i = 0; i < 16; ++i)
+    {
+        pattern |= ((codeword >> (nibbles[i] << 2)) & 0x0f) << (i << 2);
+    }
+
+    // Rotate the pattern from the north direction.
+    switch (direction)
+    {
+        default:
+        case rvDecodeNorth:
+            break;
+
+        case rvDecodeWest:
+            pattern = rvDecode_Transpose(rvDecode_ReverseColumns(pattern));
+            break;
+
+        case rvDecodeSouth:
+            pattern = rvDecode_ReverseColumns(rvDecode_ReverseRows(pattern));
+            break;
+
+        case rvDecodeEast:
+            pattern = rvDecode_Transpose(rvDecode_ReverseRows(pattern));
+            break;
+    }
+
+    return pattern;
+}
+
+
+rvUint64 rvDecode_GetIdCodeword(rvDecode *self, rvUint16 id)
+// Encode the tag id into a codeword.  The codeword holds the XOR'ed id, the CRC
+// of the id and the error correction parity as printed on the tag.
+{
+    int i;
+    rvUint64 codeword = 0;
+    rvUint8 gridBytes[8];
+
+    // XOR the grid id.
+    id ^= 0xa5a5;
+
+    // Place the grid id into the grid bytes.
+    gridBytes[0] = (rvUint8) ((id >> 8) & 0xff);
+    gridBytes[1] = (rvUint8) (id & 0xff);
+
+    // Calculate the CRC and error correction portions of the grid bytes.
+    rvCrc16_CCITT(gridBytes, 2, gridBytes + 2);
+    rvFec_Parity(self->gridFec, gridBytes, gridBytes + 4);
+
+    // Pack the grid bytes into the codeword.
+    for (i = 0; i < 8; ++i) codeword |= ((rvUint64) gridBytes[i]) << (i << 3);
+
+    return codeword;
+}
+
+
+void rvDecode_SetCodebook(rvDecode *self, rvCodebook *codebook)
+// Set the codebook used to decode clean patterns without error correction.  Ids
+// which are not in the codebook are rejected by every decoding method.  The
+// codebook is not owned by the decoder and may be NULL.
+{
+    self->codebook = codebook;
+}
+
+
+void rvDecode_SetMethod(rvDecode *self, rvInt16 method, rvInt16 maxBitErrors)
+// Set the method used to decode patterns which are not clean reads of a tag in
+// the codebook.  The Reed-Solomon method corrects up to two byte errors in each
+// direction.  The nearest method accepts the nearest tag in the codebook if it
+// is within the maximum number of bit errors and no other tag is as near.  The
+// nearest method requires a codebook.
+{
+    self->method = method;
+    self->maxBitErrors = maxBitErrors;
+}
+
+
 bool rvDecode_SetBits(rvDecode *self, rvUint8 *values, rvUint8 count)
+// Pack the array of sample values into a sample pattern and decode it.
+{
+    rvUint8 i;
+    rvUint64 pattern = 0;
+
+    // Sanity check the count value.
+    if (count > 64) count = 64;
+
+    // Set a bit for each non-zero sample value.
+    for (i = 0; i < count; ++i)
+    {
+        if (values[i]) pattern |= ((rvUint64) 1) << i;
+    }
+
+    return rvDecode_SetPattern(self, pattern);
+}
+
+
+bool rvDecode_SetPattern(rvDecode *self, rvUint64 pattern)
+// Decode the 64 bit sample pattern with bit n set for white sample n.
 {
     rvUint16 i;
+    rvUint16 j;
     rvUint16 dirCount;
+    rvUint16 gridId;
+    int distance;
+    rvUint64 codeword;
     rvUint8 gridCrc[2];
     rvUint8 gridBytes[8];
 
     // Assume decode fails.
     self->result = false;
 
-    // Reset the grid id and grid direction.
+    // Reset the grid id, grid direction and bit errors.
     self->gridId = 0;
     self->gridDir = rvDecodeUnknown;
+    self->bitErrors = 0;
+
+    // Is the pattern a clean read of a tag in the codebook?
+    if ((self->codebook != NULL) && rvCodebook_Find(self->codebook, pattern, &self->gridId, &self->gridDir))
+    {
+        // Success.  Set the return value.
+        self->result = true;
+
+        return self->result;
+    }
+
+    // Should we find the nearest tag in the codebook?
+    if ((self->codebook != NULL) && (self->method == rvDecodeMethodNearest))
+    {
+        // Find the nearest tag within the maximum number of bit errors.
+        if (rvCodebook_FindNearest(self->codebook, pattern, self->maxBitErrors, &self->gridId, &self->gridDir, &distance))
+        {
+            // Success.  Save the bit errors and set the return value.
+            self->bitErrors = (rvInt16) distance;
+            self->result = true;
+        }
+        else
+        {
+            // Reset the grid id and grid direction.
+            self->gridId = 0;
+            self->gridDir = rvDecodeUnknown;
+        }
+
+        return self->result;
+    }
 
     // Reset the direction count.
     dirCount = 0;
@@ -165,11 +341,11 @@ bool rvDecode_SetBits(rvDecode *self, rvUint8 *values, rvUint8 count)
     // Loop over each direction.
     for (i = 0; i < 4; ++i)
     {
-        // Set the bits in the indexed direction.
-        rvBitfield_SetBits(self->gridBits, count, values, mappings[i]);
+        // Get the codeword in the indexed direction.
+        codeword = rvDecode_GetCodeword(pattern, directions[i]);
 
-        // Get the bytes from the rvBitfield.
-        rvBitfield_GetBytes(self->gridBits, sizeof(gridBytes), gridBytes);
+        // Get the bytes from the codeword.
+        for (j = 0; j < sizeof(gridBytes); ++j) gridBytes[j] = (rvUint8) (codeword >> (j << 3));
 
         // Can we error correct the grid bytes?
         if (rvFec_Correct(self->gridFec, gridBytes))
@@ -180,13 +356,17 @@ bool rvDecode_SetBits(rvDecode *self, rvUint8 *values, rvUint8 count)
             // Validate the CRC bytes.
             if ((gridBytes[2] == gridCrc[0]) && (gridBytes[3] == gridCrc[1]))
             {
+                // Get the grid id and XOR it.
+                gridId = (((rvUint16) gridBytes[0]) << 8) | gridBytes[1];
+                gridId ^= 0xa5a5;
+
+                // Ignore ids which are not in the codebook.
+                if ((self->codebook != NULL) && !rvCodebook_HasId(self->codebook, gridId)) continue;
+
                 // Success. Save the grid id and grid direction.
-                self->gridId = (((rvUint16) gridBytes[0]) << 8) | gridBytes[1];
+                self->gridId = gridId;
                 self->gridDir = directions[i];
 
-                // XOR the grid id.
-                self->gridId ^= 0xa5a5;
-
                 // Save the count of valid directions.
                 ++dirCount;
             }
@@ -196,6 +376,10 @@ bool rvDecode_SetBits(rvDecode *self, rvUint8 *values, rvUint8 count)
     // We should never find more than one direction.
     if (dirCount == 1)
     {
+        // Count the bits which differ from the pattern of the corrected tag.
+        codeword = rvDecode_GetIdCodeword(self, self->gridId);
+        self->bitErrors = (rvInt16) rvCodebook_GetDistance(pattern, rvDecode_GetPattern(codeword, self->gridDir));
+
         // Success.  Set the return value.
         self->result = true;
     }
@@ -234,3 +418,16 @@ bool rvDecode_GetDirection(rvDecode *self, rvInt16 *direction)
 
     return self->result;
 }
+
+
+bool rvDecode_GetBitErrors(rvDecode *self, rvInt16 *bitErrors)
+{
+    // Did last rvDecode work?
+    if (self->result)
+    {
+        // Return the number of bits which differed from the decoded tag.
+        *bitErrors = self->bitErrors;
+    }
+
+    return self->result;
+}
@@ -28,13 +28,10 @@ extern "C" {
 #endif
 
 #include "rvFec.h"
-#include "rvBitfield.h"
+#include "rvCodebook.h"
 
 // Global mappings.
 extern rvUint8 rvDecodeMappingNorth[];
-extern rvUint8 rvDecodeMappingEast[];
-extern rvUint8 rvDecodeMappingSouth[];
-extern rvUint8 rvDecodeMappingWest[];
 
 // Decode enums.
 enum
@@ -46,6 +43,13 @@ enum
     rvDecodeWest = 3
 };
 
+// Decode methods.
+enum
+{
+    rvDecodeMethodFec = 0,
+    rvDecodeMethodNearest = 1
+};
+
 // Decode types.
 typedef struct _rvDecode rvDecode;
 
@@ -56,16 +60,26 @@ struct _rvDecode
     rvUint8 bitcount;
     rvInt16 gridDir;
     rvUint16 gridId;
+    rvInt16 bitErrors;
+    rvInt16 method;
+    rvInt16 maxBitErrors;
     rvFec* gridFec;
-    rvBitfield* gridBits;
+    rvCodebook* codebook;
 };
 
 // Decode methods.
 rvDecode* rvDecode_New(rvUint8 bitcount);
 void rvDecode_Free(rvDecode *self);
 bool rvDecode_SetBits(rvDecode *self, rvUint8 *values, rvUint8 count);
+bool rvDecode_SetPattern(rvDecode *self, rvUint64 pattern);
+void rvDecode_SetCodebook(rvDecode *self, rvCodebook *codebook);
+void rvDecode_SetMethod(rvDecode *self, rvInt16 method, rvInt16 maxBitErrors);
+rvUint64 rvDecode_GetCodeword(rvUint64 pattern, rvInt16 direction);
+rvUint64 rvDecode_GetPattern(rvUint64 codeword, rvInt16 direction);
+rvUint64 rvDecode_GetIdCodeword(rvDecode *self, rvUint16 id);
 bool rvDecode_GetId(rvDecode *self, rvUint16 *id);
 bool rvDecode_GetDirection(rvDecode *self, rvInt16 *direction);
+bool rvDecode_GetBitErrors(rvDecode *self, rvInt16 *bitErrors);
 
 #ifdef __cplusplus
 } // "C"
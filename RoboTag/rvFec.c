@@ -356,7 +356,7 @@ rvInt16 rvFec_Correct(rvFec* self, rvUint8* blockBuffer)
     uintGF *indexOf = self->indexOf;
 
     // Allocate the recieve buffer off the stack.
-    recd = (uintGF*) _alloca(sizeof(uintGF) * nn);
+    recd = (uintGF*) rvAlloca(sizeof(uintGF) * nn);
 
     // Copy and convert the encoded buffer from polynomial form to index form.
     for (i = nn - 1; i >= 0; --i)
@@ -366,7 +366,7 @@ rvInt16 rvFec_Correct(rvFec* self, rvUint8* blockBuffer)
     }
 
     // Allocate the syndromes buffer off the stack.
-    syndromes = (uintGF*) _alloca(sizeof(uintGF) * (self->paritySize + 1));
+    syndromes = (uintGF*) rvAlloca(sizeof(uintGF) * (self->paritySize + 1));
 
     // Initialize the syndrome error flag.
     syn_error = 0;
@@ -401,15 +401,15 @@ rvInt16 rvFec_Correct(rvFec* self, rvUint8* blockBuffer)
     }
 
     // Allocate the lambda buffer off the stack.
-    lambda = (uintGF*) _alloca(sizeof(uintGF) * (self->paritySize + 1));
+    lambda = (uintGF*) rvAlloca(sizeof(uintGF) * (self->paritySize + 1));
 
     // Clear the lampda buffer.
     for (i = 1; i < self->paritySize + 1; ++i) lambda[i] = 0;
 
     lambda[0] = 1;
 
-    b = (uintGF*) _alloca(sizeof(uintGF) * (self->paritySize + 1));
-    t = (uintGF*) _alloca(sizeof(uintGF) * (self->paritySize + 1));
+    b = (uintGF*) rvAlloca(sizeof(uintGF) * (self->paritySize + 1));
+    t = (uintGF*) rvAlloca(sizeof(uintGF) * (self->paritySize + 1));
 
     for (i = 0; i < self->paritySize + 1; i++) b[i] = indexOf[lambda[i]];
 
@@ -487,9 +487,9 @@ rvInt16 rvFec_Correct(rvFec* self, rvUint8* blockBuffer)
         if (lambda[i] != ALPHA_ZERO) deg_lambda = i;
     }
 
-    loc = (rvInt16*) _alloca(sizeof(rvInt16) * self->paritySize);
-    reg = (uintGF*) _alloca(sizeof(uintGF) * (self->paritySize + 1));
-    root = (uintGF*) _alloca(sizeof(uintGF) * self->paritySize);
+    loc = (rvInt16*) rvAlloca(sizeof(rvInt16) * self->paritySize);
+    reg = (uintGF*) rvAlloca(sizeof(uintGF) * (self->paritySize + 1));
+    root = (uintGF*) rvAlloca(sizeof(uintGF) * self->paritySize);
 
     // Find roots of the error locator polynomial by Chien search.
     for (i = 1; i < self->paritySize + 1; ++i) reg[i] = lambda[i];
@@ -534,7 +534,7 @@ rvInt16 rvFec_Correct(rvFec* self, rvUint8* blockBuffer)
 
     deg_omega = 0;
 
-    omega = (uintGF*) _alloca(sizeof(uintGF) * (self->paritySize + 1));
+    omega = (uintGF*) rvAlloca(sizeof(uintGF) * (self->paritySize + 1));
 
     // Compute error evaluator poly omega(x) = s(x) * lambda(x) (modulo x**(NN-KK))
     // in index form. Also find deg(omega).
@@ -20,9 +20,13 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include <assert.h>
 #include "cvUtil.h"
 #include "rvGrid.h"
 #include "rvObject.h"
+#include "rvSampler.h"
 #include "rvTags384.h"
 
 int rvGrid_OpenCVErrorHandler(int status, const char* func_name, const char* err_msg, const char* file_name, int line )
@@ -52,170 +56,28 @@ static void rvGrid_GetCenterPoint(CvPoint2D32f corners[4], CvPoint2D32f *center)
 }
 
 
-static void rvGrid_GetReferencePoints(CvPoint2D32f corners[4], CvPoint2D32f reference[8])
-// Fill in the 8 reference points associated with the given quadralateral.  The first
-// 4 reference points are outside the quadralateral and the last four reference points
-// are inside the quadralateral.
-{
-    CvPoint2D32f t1;
-    CvPoint2D32f t2;
-
-    // Determine line along upper row of rvGrid.
-    t1.x = corners[1].x + (((corners[2].x - corners[1].x) * 5.0f) / 20.0f);
-    t1.y = corners[1].y + (((corners[2].y - corners[1].y) * 5.0f) / 20.0f);
-    t2.x = corners[0].x + (((corners[3].x - corners[0].x) * 5.0f) / 20.0f);
-    t2.y = corners[0].y + (((corners[3].y - corners[0].y) * 5.0f) / 20.0f);
-
-    // Set the outside and inside reference points along the line.
-    reference[0].x = t1.x + (((t2.x - t1.x) * -1.0f) / 20.0f);
-    reference[0].y = t1.y + (((t2.y - t1.y) * -1.0f) / 20.0f);
-    reference[4].x = t1.x + (((t2.x - t1.x) * 1.0f) / 20.0f);
-    reference[4].y = t1.y + (((t2.y - t1.y) * 1.0f) / 20.0f);
-    reference[1].x = t1.x + (((t2.x - t1.x) * 21.0f) / 20.0f);
-    reference[1].y = t1.y + (((t2.y - t1.y) * 21.0f) / 20.0f);
-    reference[5].x = t1.x + (((t2.x - t1.x) * 19.0f) / 20.0f);
-    reference[5].y = t1.y + (((t2.y - t1.y) * 19.0f) / 20.0f);
-
-    // Determine line along lower row of rvGrid.
-    t1.x = corners[1].x + (((corners[2].x - corners[1].x) * 15.0f) / 20.0f);
-    t1.y = corners[1].y + (((corners[2].y - corners[1].y) * 15.0f) / 20.0f);
-    t2.x = corners[0].x + (((corners[3].x - corners[0].x) * 15.0f) / 20.0f);
-    t2.y = corners[0].y + (((corners[3].y - corners[0].y) * 15.0f) / 20.0f);
-
-    // Set the outside and inside reference points along the line.
-    reference[2].x = t1.x + (((t2.x - t1.x) * -1.0f) / 20.0f);
-    reference[2].y = t1.y + (((t2.y - t1.y) * -1.0f) / 20.0f);
-    reference[6].x = t1.x + (((t2.x - t1.x) * 1.0f) / 20.0f);
-    reference[6].y = t1.y + (((t2.y - t1.y) * 1.0f) / 20.0f);
-    reference[3].x = t1.x + (((t2.x - t1.x) * 21.0f) / 20.0f);
-    reference[3].y = t1.y + (((t2.y - t1.y) * 21.0f) / 20.0f);
-    reference[7].x = t1.x + (((t2.x - t1.x) * 19.0f) / 20.0f);
-    reference[7].y = t1.y + (((t2.y - t1.y) * 19.0f) / 20.0f);
-}
-
-
-static void rvGrid_GetSamplePoints(CvPoint2D32f corners[4], CvPoint2D32f samples[64])
-// Fill in the 64 sample points points associated with the given quadralateral.
-{
-    int i;
-    int j;
-    int k = 0;
-
-    // Loop over the vertical axis of the rvGrid.
-    // for (i = 14; i >= 0; i -= 2)
-    for (i = 0; i < 16; i += 2)
-    {
-        float fi = (float) i;
-        CvPoint2D32f t1;
-        CvPoint2D32f t2;
-
-        t1.x = corners[1].x + (((corners[2].x - corners[1].x) * (3.0f + i)) / 20.0f);
-        t1.y = corners[1].y + (((corners[2].y - corners[1].y) * (3.0f + i)) / 20.0f);
-        t2.x = corners[0].x + (((corners[3].x - corners[0].x) * (3.0f + i)) / 20.0f);
-        t2.y = corners[0].y + (((corners[3].y - corners[0].y) * (3.0f + i)) / 20.0f);
-
-        // Loop over the horizontal axis of the rvGrid.
-        // for (j = 0; j < 16; j += 2)
-        for (j = 14; j >= 0; j -= 2)
-        {
-            float fj = (float) j;
-
-            // Write the rvGrid position into the rvGrid array.
-            samples[k].x = t1.x + (((t2.x - t1.x) * (3.0f + j)) / 20.0f);
-            samples[k].y = t1.y + (((t2.y - t1.y) * (3.0f + j)) / 20.0f);
-
-            // Increment the array index.
-            ++k;
-        }
-    }
-}
-
-
-static int rvGrid_SamplePoint(IplImage *img, CvPoint2D32f point)
-// Sample five pixels at and around the indicated point returning the average value.
-// This function currently assumes a single plane image.
-{
-    uchar *pixel;
-    uchar *pixel_lt;
-    uchar *pixel_rt;
-    uchar *pixel_up;
-    uchar *pixel_dn;
-    int average = 0;
-    int x = cvRound(point.x);
-    int y = cvRound(point.y);
-
-    // Sanity check the values.
-    if (x < 1 || y < 1 || x >= (img->width - 1) || y >= (img->height - 1)) return -1;
-
-    // Get the pixels to be sampled.
-    pixel = &((uchar*)(img->imageData + img->widthStep * y))[x];
-    pixel_lt = &((uchar*)(img->imageData + img->widthStep * y))[(x - 1)];
-    pixel_rt = &((uchar*)(img->imageData + img->widthStep * y))[(x + 1)];
-    pixel_up = &((uchar*)(img->imageData + img->widthStep * (y - 1)))[x];
-    pixel_dn = &((uchar*)(img->imageData + img->widthStep * (y + 1)))[x];
-
-    // Sample the pixels.
-    average += (int) *pixel;
-    average += (int) *pixel_lt;
-    average += (int) *pixel_rt;
-    average += (int) *pixel_up;
-    average += (int) *pixel_dn;
-
-    // Return the average sample.
-    return average / 5;
-}
-
-
-static int rvGrid_SamplePoints(IplImage *img, CvPoint2D32f *points, int count)
-// Sample the array of pixels and return the average value.
-{
-    int i;
-    int value;
-    int samples = 0;
-    int average = 0;
-
-    // Loop over each pixel to sample.
-    for (i = 0; i < count; ++i)
-    {
-        // Sample the pixel.
-        value = rvGrid_SamplePoint(img, points[0]);
-
-        // Was the value obtained?
-        if (value != -1)
-        {
-            // Add to the avarage.
-            average += value;
-
-            // Add to the sample count.
-            samples += 1;
-        }
-    }
-
-    // Average the samples.
-    if (samples) average /= samples;
-
-    // Return the average sample.
-    return average;
-}
-
-
 static bool rvGrid_ProjectPoints(rvGrid *self, CvMat *rotationVector, CvMat *translationVector, CvPoint3D32f* points3d, CvPoint2D32f* points2d, rvUint16 count)
 // Use the intrinsic matrix and most recent translation/rotation vectors to project the points.
+// The point matrices are allocated from the scratch memory.
 {
     int i;
-    CvMat *matPoints2D;
-    CvMat *matPoints3D;
+    int rows = count < 3 ? 3 : count;
+    CvMat header2D;
+    CvMat header3D;
+    CvMat *matPoints2D = &header2D;
+    CvMat *matPoints3D = &header3D;
 
     // Make sure we have points.
     if (count < 1) return false;
 
+    // Create the image and object matrices.
+    cvInitMatHeader(matPoints2D, rows, 2, CV_64FC1, rvMemPool_Alloc(self->scratch, sizeof(double) * rows * 2), CV_AUTOSTEP);
+    cvInitMatHeader(matPoints3D, rows, 3, CV_64FC1, rvMemPool_Alloc(self->scratch, sizeof(double) * rows * 3), CV_AUTOSTEP);
+
     // There seems to be a bug (or feature) in OpenCV where it can't properly project
     // fewer than 3 points.  Therefore we fake it out below by padding zero values.
     if (count < 3)
     {
-        // Create the image and object matrices.
-        matPoints2D = cvCreateMat(3, 2, CV_64FC1);
-        matPoints3D = cvCreateMat(3, 3, CV_64FC1);
 
         // Place the 3d points into the object points matrix.
         for (i = 0; i < 3; ++i)
@@ -237,10 +99,6 @@ static bool rvGrid_ProjectPoints(rvGrid *self, CvMat *rotationVector, CvMat *tra
     }
     else
     {
-        // Create the image and object matrices.
-        matPoints2D = cvCreateMat(count, 2, CV_64FC1);
-        matPoints3D = cvCreateMat(count, 3, CV_64FC1);
-
         // Place the 3d points into the object points matrix.
         for (i = 0; i < count; ++i)
         {
@@ -262,15 +120,12 @@ static bool rvGrid_ProjectPoints(rvGrid *self, CvMat *rotationVector, CvMat *tra
         points2d[i].y = (float) cvGetReal2D(matPoints2D, i, 1);
     }
 
-    // Release the image and object matrices.
-    cvReleaseMat(&matPoints2D);
-    cvReleaseMat(&matPoints3D);
-
     return true;
 }
 
-static bool rvGrid_AddTag(rvGrid *self, rvUint16 id, CvPoint2D32f corners[RVTAG_CORNER_COUNT])
-// Adds a tag id and tag corners to the list of tags to be processed in the rvGrid.
+static bool rvGrid_AddTag(rvGrid *self, rvUint16 id, CvPoint2D32f corners[RVTAG_CORNER_COUNT], rvInt16 bitErrors)
+// Adds a tag id, tag corners and the bits read in error to the list of tags to be
+// processed in the rvGrid.
 {
     // Is this a navigation tag?
     if (rvTags384_IsNavTag(id))
@@ -279,7 +134,7 @@ static bool rvGrid_AddTag(rvGrid *self, rvUint16 id, CvPoint2D32f corners[RVTAG_
         rvGridNavTag *navTag;
 
         // Prevent tag buffer overflow.
-        if (self->navTagCount > RVGRID_MAX_NAV_TAGS) return false;
+        if (self->navTagCount >= RVGRID_MAX_NAV_TAGS) return false;
 
         // Point to the tag to fill in.
         navTag = &self->navTags[self->navTagCount];
@@ -290,6 +145,9 @@ static bool rvGrid_AddTag(rvGrid *self, rvUint16 id, CvPoint2D32f corners[RVTAG_
         navTag->corners[1] = corners[1];
         navTag->corners[2] = corners[2];
         navTag->corners[3] = corners[3];
+        navTag->bitErrors = bitErrors;
+        navTag->inlier = false;
+        navTag->residual = -1.0;
 
         // Increment the navigation tag count.
         ++self->navTagCount;
@@ -300,7 +158,7 @@ static bool rvGrid_AddTag(rvGrid *self, rvUint16 id, CvPoint2D32f corners[RVTAG_
         rvGridObjTag *objTag;
 
         // Prevent tag buffer overflow.
-        if (self->objTagCount > RVGRID_MAX_OBJ_TAGS) return false;
+        if (self->objTagCount >= RVGRID_MAX_OBJ_TAGS) return false;
 
         // Point to the tag to fill in.
         objTag = &self->objTags[self->objTagCount];
@@ -311,6 +169,7 @@ static bool rvGrid_AddTag(rvGrid *self, rvUint16 id, CvPoint2D32f corners[RVTAG_
         objTag->corners[1] = corners[1];
         objTag->corners[2] = corners[2];
         objTag->corners[3] = corners[3];
+        objTag->bitErrors = bitErrors;
 
         // Increment the navigation tag count.
         ++self->objTagCount;
@@ -321,7 +180,7 @@ static bool rvGrid_AddTag(rvGrid *self, rvUint16 id, CvPoint2D32f corners[RVTAG_
         rvGridCharTag *charTag;
 
         // Prevent tag buffer overflow.
-        if (self->charTagCount > RVGRID_MAX_CHAR_TAGS) return false;
+        if (self->charTagCount >= RVGRID_MAX_CHAR_TAGS) return false;
 
         // Point to the tag to fill in.
         charTag = &self->charTags[self->charTagCount];
@@ -332,6 +191,7 @@ static bool rvGrid_AddTag(rvGrid *self, rvUint16 id, CvPoint2D32f corners[RVTAG_
         charTag->corners[1] = corners[1];
         charTag->corners[2] = corners[2];
         charTag->corners[3] = corners[3];
+        charTag->bitErrors = bitErrors;
 
         // Increment the character tag count.
         ++self->charTagCount;
@@ -371,8 +231,16 @@ static bool rvGrid_DrawNavTags(rvGrid *self, IplImage *img)
         // Get the tag projection coordinates.
         if (rvGrid_ProjectTag(self, navTag->id, corners))
         {
-            // Reproject the navigation tags onto the grid.
-            cvDrawCorners(img, corners, CV_RGB(128, 128, 255), CV_RGB(0, 0, 255), 1, 8, 0);
+            // Reproject the navigation tags onto the grid.  Tags which don't
+            // agree with the camera pose are drawn in red.
+            if (navTag->inlier)
+            {
+                cvDrawCorners(img, corners, CV_RGB(128, 128, 255), CV_RGB(0, 0, 255), 1, 8, 0);
+            }
+            else
+            {
+                cvDrawCorners(img, corners, CV_RGB(255, 128, 128), CV_RGB(255, 0, 0), 1, 8, 0);
+            }
         }
     }
 
@@ -398,8 +266,8 @@ static bool rvGrid_DrawObject(rvGrid *self, IplImage* img, CvMat *objectVectors,
     objPointCount = (rvUint16) objectVectors->rows;
 
     // Allocate space on the stack to contain the transformed shape.
-    objPoints2d = (CvPoint2D32f *) _alloca(objPointCount * sizeof(CvPoint2D32f));
-    objPoints3d = (CvPoint3D32f *) _alloca(objPointCount * sizeof(CvPoint3D32f));
+    objPoints2d = (CvPoint2D32f *) rvAlloca(objPointCount * sizeof(CvPoint2D32f));
+    objPoints3d = (CvPoint3D32f *) rvAlloca(objPointCount * sizeof(CvPoint3D32f));
 
     // Loop over each row in the shape matrix.
     for (i = 0; i < objPointCount; ++i)
@@ -492,7 +360,7 @@ static bool rvGrid_DrawCharacters(rvGrid *self, IplImage *img)
             CvPoint2D32f center;
 
             // Print the rvGrid id into the buffer.
-            _snprintf(buffer, sizeof(buffer), "%c", (int) (charTag->id - 4096));
+            rvSnprintf(buffer, sizeof(buffer), "%c", (int) (charTag->id - 4096));
 
             // Get the coordinates of the center.
             rvGrid_GetCenterPoint(charTag->corners, &center);
@@ -506,228 +374,1526 @@ static bool rvGrid_DrawCharacters(rvGrid *self, IplImage *img)
 }
 
 
-rvGrid *rvGrid_New(CvSize imageSize, int origin)
-// Allocate a new rvGrid object.
+static bool rvGrid_FindTag(rvGrid *self, rvUint16 id, CvPoint2D32f corners[RVTAG_CORNER_COUNT])
+// Returns true if a tag with the same id has already been added at about the same
+// position.  This is used to ignore tags found twice where processing tiles overlap.
 {
-    int i;
-    rvGrid *self = NULL;
-    rvTag *tag = NULL;
-    IplImage *grayImage = NULL;
-    IplImage *edgeImage = NULL;
-    CvMemStorage *memStorage = NULL;
+    rvUint16 i;
+    float dx;
+    float dy;
+    float limit;
+    CvPoint2D32f center;
+    CvPoint2D32f other;
+    CvPoint2D32f *tagCorners;
+
+    // Get the center of the tag.
+    rvGrid_GetCenterPoint(corners, &center);
+
+    // Tags closer than a quarter of a side length are the same tag.
+    dx = corners[1].x - corners[0].x;
+    dy = corners[1].y - corners[0].y;
+    limit = (dx * dx + dy * dy) / 16.0f;
+
+    // Loop over each tag of the type matching the id.
+    for (i = 0; ; ++i)
+    {
+        // Point to the corners of the next tag with a matching id.
+        if (rvTags384_IsNavTag(id))
+        {
+            if (i >= self->navTagCount) break;
+            if (self->navTags[i].id != id) continue;
+            tagCorners = self->navTags[i].corners;
+        }
+        else if (rvTags384_IsObjectTag(id))
+        {
+            if (i >= self->objTagCount) break;
+            if (self->objTags[i].id != id) continue;
+            tagCorners = self->objTags[i].corners;
+        }
+        else if (rvTags384_IsCharTag(id))
+        {
+            if (i >= self->charTagCount) break;
+            if (self->charTags[i].id != id) continue;
+            tagCorners = self->charTags[i].corners;
+        }
+        else
+        {
+            break;
+        }
 
-    // Set the OpenCV error handler.
-    cvRedirectError((CvErrorCallback) rvGrid_OpenCVErrorHandler, NULL, NULL);
+        // Is the tag at the same position?
+        rvGrid_GetCenterPoint(tagCorners, &other);
+        dx = other.x - center.x;
+        dy = other.y - center.y;
+        if ((dx * dx + dy * dy) < limit) return true;
+    }
 
-    // Allocate a new rvGrid object.
-    self = (rvGrid*) malloc(sizeof(rvGrid));
+    return false;
+}
 
-    // Allocate internal objects.
-    tag = rvTag_New();
-    grayImage = cvCreateImage(imageSize, IPL_DEPTH_8U, 1);
-    edgeImage = cvCreateImage(imageSize, IPL_DEPTH_8U, 1);
-    memStorage = cvCreateMemStorage(0);
 
-    // Did we allocate the object.
-    if ((self != NULL) && (tag != NULL) && (grayImage != NULL) && (edgeImage != NULL) && (memStorage != NULL))
+static rvTagSet *rvGrid_NewActiveTags(void)
+// Create a tag set holding every valid tag id.
+{
+    long id;
+    rvTagSet *activeTags;
+
+    // Create the tag set.
+    activeTags = rvTagSet_New();
+    if (activeTags == NULL) return NULL;
+
+    // Add each valid tag id.
+    for (id = 0; id <= 0xffff; ++id)
     {
-        // No result yet.
-        self->results = false;
+        if (rvTags384_IsNavTag((rvUint16) id) || rvTags384_IsObjectTag((rvUint16) id) || rvTags384_IsCharTag((rvUint16) id))
+        {
+            rvTagSet_Add(activeTags, (rvUint16) id);
+        }
+    }
 
-        // Set the objects.
-        self->tag = tag;
+    return activeTags;
+}
 
-        // Set the images.
-        self->imageSize = imageSize;
-        self->grayImage = grayImage;
-        self->edgeImage = edgeImage;
 
-        // Set the image origins.
-        self->grayImage->origin = origin;
-        self->edgeImage->origin = origin;
+static rvCodebook *rvGrid_NewCodebook(rvTagSet *activeTags)
+// Create a codebook holding the patterns of each active tag.
+{
+    long id;
+    int count;
+    rvCodebook *codebook;
 
-        // Set the memory storage.
-        self->memStorage = memStorage;
+    // Create the codebook with room for at least one id.
+    count = rvTagSet_GetCount(activeTags);
+    codebook = rvCodebook_New(count > 0 ? count : 1);
+    if (codebook == NULL) return NULL;
 
-        // Set the default properties.
-        self->display = RVGRID_DISPLAY_COLOR;
-        self->edgeMethod = RVGRID_EDGE_ADAPTIVE;
-        self->edgeDilation = 0;
-        self->gaussianBlur = 0;
-        self->adaptiveMethod = RVGRID_ADAPTIVE_METHOD_GAUSSIAN;
-        self->adaptiveBlockSize = 45;
-        self->adaptiveSubtraction = 5;
+    // Add each active tag id.
+    for (id = 0; id <= 0xffff; ++id)
+    {
+        if (rvTagSet_Contains(activeTags, (rvUint16) id)) rvCodebook_AddId(codebook, (rvUint16) id);
+    }
 
-        // Set the default draw flags.
-        self->drawRawContours = false;
-        self->drawPolygonContours = false;
-        self->drawQuadContours = false;
-        self->drawTagCorners = true;
-        self->drawTagReferences = true;
-        self->drawTagSamples = true;
-        self->drawTagIdentifiers = true;
-        self->drawCameraPosition = true;
-        self->drawTagReprojection = true;
-        self->drawObjectReprojection = true;
-        self->drawCharacters = true;
+    return codebook;
+}
 
-        // Create the matrices.
-        self->cameraMatrix = cvCreateMat(3, 3, CV_64FC1);
-        self->distortionCoeffs = cvCreateMat(4, 1, CV_64FC1);
-        self->rotationVector = cvCreateMat(1, 3, CV_64FC1);
-        self->translationVector = cvCreateMat(1, 3, CV_64FC1);
-        self->cameraPositionMatrix = cvCreateMat(4, 4, CV_64FC1);
 
-        // Initialize to identity.
-        cvSetIdentity(self->cameraMatrix, cvRealScalar(1));
-        cvSetIdentity(self->distortionCoeffs, cvRealScalar(1));
-        cvSetIdentity(self->rotationVector, cvRealScalar(1));
-        cvSetIdentity(self->translationVector, cvRealScalar(1));
-        cvSetIdentity(self->cameraPositionMatrix, cvRealScalar(1));
+static void rvGrid_SetContextDecodeMethod(rvGrid *self, rvGridContext *context)
+// Set the decoding method of the processing context from the grid properties.
+{
+    rvInt16 method = (self->decodeMethod == RVGRID_DECODE_NEAREST) ? rvDecodeMethodNearest : rvDecodeMethodFec;
 
-        // Initialize the object and navigation tag counts.
-        self->objTagCount = 0;
-        self->navTagCount = 0;
-        self->charTagCount = 0;
+    rvTag_SetDecodeMethod(context->tag, method, (rvInt16) self->decodeMaxBitErrors);
+}
 
-        // Initialize calibration information.
-        self->calibrateTagCount = 0;
-        self->calibrateImageCount = 0;
 
-        // Initialize each object tag.
-        for (i = 0; i < RVGRID_MAX_OBJ_TAGS; ++i)
-        {
-            // Point to the object tags.
-            rvGridObjTag *tag = &self->objTags[i];
+static void rvGrid_ResetStages(rvGridContext *context)
+// Reset the time and items of each stage processed by the context.
+{
+    memset(context->stageTicks, 0, sizeof(context->stageTicks));
+    memset(context->stageCounts, 0, sizeof(context->stageCounts));
+}
 
-            // Initialize the object tag matrices.
-            cvInitMatHeader(&tag->rotationVector, 1, 3, CV_64FC1, &tag->rotationData, CV_AUTOSTEP);
-            cvInitMatHeader(&tag->translationVector, 1, 3, CV_64FC1, &tag->translationData, CV_AUTOSTEP);
-            cvInitMatHeader(&tag->positionMatrix, 4, 4, CV_64FC1, &tag->positionData, CV_AUTOSTEP);
-        }
 
-        // Initialize a font for drawing tag ids and characters.
-        cvInitFont(&self->idFont, CV_FONT_HERSHEY_PLAIN, 2.0f, 2.0f, 0.0f, 3, 8);
-        cvInitFont(&self->charFont, CV_FONT_HERSHEY_PLAIN, 4.0f, 4.0f, 0.0f, 3, 16);
-    }
-    else
-    {
-        // Clean up.
-        if (tag) rvTag_Free(tag);
-        if (grayImage) cvReleaseImage(&grayImage);
-        if (edgeImage) cvReleaseImage(&edgeImage);
-        if (memStorage != NULL) cvReleaseMemStorage(&memStorage);
-        if (self) free(self);
+static rvUint64 rvGrid_EndStage(rvGridContext *context, int stage, rvUint64 start, int count)
+// Add the time since the start of the stage and the items it processed to the
+// stage totals of the context.  Returns the time the stage ended so the next
+// stage can start from it.
+{
+    rvUint64 end = rvProfile_GetTicks();
 
-        return NULL;
-    }
+    context->stageTicks[stage] += end - start;
+    context->stageCounts[stage] += count;
 
-    return self;
+    return end;
 }
 
 
-void rvGrid_Free(rvGrid *self)
+static rvGridContext *rvGrid_NewContext(rvCodebook *codebook, int storageBudget, int maxContours)
+// Allocate a new processing context which decodes using the codebook and
+// reserves the storage budget.
 {
-    // Sanity check the object pointer.
-    if (self != NULL)
-    {
-        // Free the matrices.
-        cvReleaseMat(&self->cameraMatrix);
-        cvReleaseMat(&self->distortionCoeffs);
-        cvReleaseMat(&self->rotationVector);
-        cvReleaseMat(&self->translationVector);
-        cvReleaseMat(&self->cameraPositionMatrix);
+    rvGridContext *context;
 
-        // Free the internal objects.
-        rvTag_Free(self->tag);
-        cvReleaseImage(&self->grayImage);
-        cvReleaseImage(&self->edgeImage);
-        cvReleaseMemStorage(&self->memStorage);
+    // Allocate the context.
+    context = (rvGridContext *) malloc(sizeof(rvGridContext));
 
-        // Free this object.
-        free(self);
+    // Did we allocate the context.
+    if (context != NULL)
+    {
+        // Allocate the internal objects.
+        context->tag = rvTag_New();
+        context->quadFinder = rvQuadFinder_New();
+        context->storage = rvStorage_New(storageBudget, maxContours);
+        context->tileImage = NULL;
+        context->contours = NULL;
+        context->polygons = NULL;
+        context->candidateCount = 0;
+        rvGrid_ResetStages(context);
+
+        // Did we allocate the internal objects?
+        if ((context->tag == NULL) || (context->quadFinder == NULL) || (context->storage == NULL))
+        {
+            // Clean up.
+            if (context->tag) rvTag_Free(context->tag);
+            if (context->quadFinder) rvQuadFinder_Free(context->quadFinder);
+            if (context->storage) rvStorage_Free(context->storage);
+            free(context);
+            context = NULL;
+        }
+        else
+        {
+            // Decode clean patterns using the codebook.
+            rvTag_SetCodebook(context->tag, codebook);
+        }
     }
+
+    return context;
 }
 
 
-bool rvGrid_ResetIntrinsics(rvGrid *self)
-// Reset the camera intrinsics.
+static void rvGrid_FreeContext(rvGridContext *context)
+// Free the processing context.
 {
-    // Reset camera and distortion matrix to identity.
-    cvSetIdentity(self->cameraMatrix, cvRealScalar(1));
-    cvSetIdentity(self->distortionCoeffs, cvRealScalar(1));
+    // Sanity check the pointer.
+    if (context == NULL) return;
 
-    return true;
+    // Free the internal objects.
+    rvTag_Free(context->tag);
+    rvQuadFinder_Free(context->quadFinder);
+    rvStorage_Free(context->storage);
+    if (context->tileImage) cvReleaseMat(&context->tileImage);
+
+    // Free the context.
+    free(context);
 }
 
 
-bool rvGrid_LoadIntrinsics(rvGrid *self, const char *filepath)
-// Load the camera intrinsics.
+static void rvGrid_ResetContext(rvGridContext *context)
+// Reset the processing context for a new image.
 {
-    CvMat *cameraMatrix;
-    CvMat *distortionCoeffs;
-    CvFileStorage *fileStore = NULL;
+    // Clear the storage.
+    rvStorage_Clear(context->storage);
 
-    // Open the file storage.
-    fileStore = cvOpenFileStorage(filepath, NULL, CV_STORAGE_READ );
+    // Reset the contours and candidates.
+    context->contours = NULL;
+    context->polygons = NULL;
+    context->candidateCount = 0;
+}
 
-    // Did we open the file storage?
-    if (!fileStore) return false;
 
-    // Get the camera matrix and distortion coefficients.  These objects are allocated
-    // in temporary storate which is freed when the file store is released.
-    cameraMatrix = (CvMat *) cvReadByName(fileStore, NULL, "CameraMatrix", NULL);
-    distortionCoeffs = (CvMat *) cvReadByName(fileStore, NULL, "DistortionCoeffs", NULL);
+static bool rvGrid_PrepareWorkers(rvGrid *self)
+// Make sure the task pool exists and there is a processing context for each
+// worker thread.  Returns false if processing must stay on the calling thread.
+{
+    int workerCount;
 
-    // Set the camera matrix and distortion coeffs.
-    rvGrid_SetCameraMatrix(self, cameraMatrix);
-    rvGrid_SetDistortionCoeffs(self, distortionCoeffs);
+    // Is processing limited to the calling thread?
+    if (self->threadCount == 1) return false;
 
-    // Release the file store.
-    cvReleaseFileStorage(&fileStore);
+    // Create the task pool.  A thread count of zero uses one worker for each
+    // processor, which is limited to the contexts the grid can hold.
+    if (self->taskPool == NULL)
+    {
+        workerCount = self->threadCount > 0 ? self->threadCount : rvThread_GetCpuCount();
+        if (workerCount > RVGRID_MAX_THREADS) workerCount = RVGRID_MAX_THREADS;
+        self->taskPool = rvTaskPool_New(workerCount);
+    }
+    if (self->taskPool == NULL) return false;
+
+    // Create a context for each worker.
+    while (self->contextCount < rvTaskPool_GetWorkerCount(self->taskPool))
+    {
+        self->contexts[self->contextCount] = rvGrid_NewContext(self->codebook, self->storageBudget, self->maxContours);
+        if (self->contexts[self->contextCount] == NULL) return false;
+        rvGrid_SetContextDecodeMethod(self, self->contexts[self->contextCount]);
+        ++self->contextCount;
+    }
 
-    // We succeeded.
     return true;
 }
 
-bool rvGrid_SaveIntrinsics(rvGrid *self, const char *filepath)
-// Save the camera intrinsics.
+
+static bool rvGrid_PrepareTiles(rvGrid *self)
+// Divide the image into overlapping tiles and make sure there is a processing
+// context for each worker thread.  Returns false if tiles should not be used.
 {
-    CvMat *cameraMatrix;
-    CvMat *distortionCoeffs;
-    CvFileStorage *fileStore;
+    int x;
+    int y;
+    int i;
+    int span;
+    int width = self->imageSize.width;
+    int height = self->imageSize.height;
 
-    // Get the camera information.
-    rvGrid_GetCameraMatrix(self, &cameraMatrix);
-    rvGrid_GetDistortionCoeffs(self, &distortionCoeffs);
+    // Is tiling enabled and is the image larger than a tile?
+    if ((self->tileSize == 0) || ((width <= self->tileSize) && (height <= self->tileSize))) return false;
 
-    // Open the file store at the indicated path.
-    fileStore = cvOpenFileStorage(filepath, 0, CV_STORAGE_WRITE);
+    // Make sure we have worker threads.
+    if (!rvGrid_PrepareWorkers(self)) return false;
 
-    // Did we open the file storage?
-    if (!fileStore) return false;
+    // Each tile extends into the next tile by the overlap.
+    span = self->tileSize + self->tileOverlap;
 
-    // Write the camera matrix.
-    cvWrite(fileStore, "CameraMatrix", cameraMatrix, cvAttrList(0,0));
+    // Divide the image into tiles.  Tiles entirely within the overlap of the
+    // previous tile are skipped.
+    self->tileCount = 0;
+    for (y = 0; (y == 0) || (y + self->tileOverlap < height); y += self->tileSize)
+    {
+        for (x = 0; (x == 0) || (x + self->tileOverlap < width); x += self->tileSize)
+        {
+            // Prevent tile buffer overflow.
+            if (self->tileCount >= RVGRID_MAX_TILES) return false;
 
-    // Write the distortion matrix.
-    cvWrite(fileStore, "DistortionCoeffs", distortionCoeffs, cvAttrList(0,0));
+            self->tiles[self->tileCount++] = cvRect(x, y, span < width - x ? span : width - x, span < height - y ? span : height - y);
+        }
+    }
 
-    // Close the file store.
-    cvReleaseFileStorage(&fileStore);
+    // Make sure each context has a large enough tile image.
+    for (i = 0; i < self->contextCount; ++i)
+    {
+        rvGridContext *context = self->contexts[i];
 
-    // Release the camera information.
-    cvReleaseMat(&cameraMatrix);
-    cvReleaseMat(&distortionCoeffs);
+        if ((context->tileImage != NULL) && ((context->tileImage->cols < span) || (context->tileImage->rows < span)))
+        {
+            cvReleaseMat(&context->tileImage);
+        }
+
+        if (context->tileImage == NULL)
+        {
+            context->tileImage = cvCreateMat(span, span, CV_8UC1);
+            ++self->allocCount;
+        }
+        if (context->tileImage == NULL) return false;
+    }
 
-    // Return success.
     return true;
 }
 
-int rvGrid_GetDisplay(rvGrid *self)
-{
-    return self->display;
-}
+
+static void rvGrid_AddQuad(rvGrid *self, rvGridContext *context, CvPoint2D32f quad[RVTAG_CORNER_COUNT], CvRect region, rvUint16 tile, int level, bool fitted)
+// Add the quad found in the region of the image at the pyramid level as a
+// candidate.  Candidates found below the full image are scaled up to it.
+{
+    int i;
+    float scale = (float) (1 << level);
+    rvGridCandidate *candidate;
+
+    // Prevent candidate buffer overflow.
+    if (context->candidateCount >= RVGRID_MAX_CANDIDATES) return;
+
+    // Point to the candidate to fill in.
+    candidate = &context->candidates[context->candidateCount];
+
+    // Copy the corners of the quad.
+    for (i = 0; i < RVTAG_CORNER_COUNT; ++i)
+    {
+        CvPoint2D32f pt = quad[i];
+
+        // Skip quads touching a tile edge that is not also an image edge.  These
+        // are clipped by the tile and are found whole in a neighboring tile.
+        if (((pt.x <= region.x + 1) && (region.x > 0)) ||
+            ((pt.y <= region.y + 1) && (region.y > 0)) ||
+            ((pt.x >= region.x + region.width - 2) && (((region.x + region.width) << level) < self->imageSize.width)) ||
+            ((pt.y >= region.y + region.height - 2) && (((region.y + region.height) << level) < self->imageSize.height))) return;
+
+        candidate->quad[i] = cvPoint2D32f(pt.x * scale, pt.y * scale);
+    }
+
+    // Add the candidate.
+    candidate->tile = tile;
+    candidate->level = (rvUint16) level;
+    candidate->referenced = false;
+    candidate->decoded = false;
+    candidate->fitted = fitted;
+    candidate->rejection = RVGRID_REJECT_NONE;
+    ++context->candidateCount;
+}
+
+
+static void rvGrid_FindComponentQuads(rvGrid *self, rvGridContext *context, CvArr *edgeImage, CvRect region, rvUint16 tile, int level)
+// Find the four sided black components in the edge image and add them as
+// candidates.  The corners are fitted to sub-pixel positions so candidates at
+// the full image are not refined further.
+{
+    int i;
+    int count;
+    int first = context->candidateCount;
+    rvUint64 start = rvProfile_GetTicks();
+    CvPoint2D32f (*quads)[RVTAG_CORNER_COUNT] = context->quads;
+
+    // Find the quads in the edge image.
+    count = rvQuadFinder_Find(context->quadFinder, edgeImage, (double) (500 >> (2 * level)), quads,
+                              RVGRID_MAX_CANDIDATES - context->candidateCount);
+    start = rvGrid_EndStage(context, RVGRID_STAGE_CONTOURS, start, count);
+
+    // Add the quads as candidates in image coordinates.
+    for (i = 0; i < count; ++i)
+    {
+        int j;
+
+        for (j = 0; j < RVTAG_CORNER_COUNT; ++j)
+        {
+            quads[i][j].x += (float) region.x;
+            quads[i][j].y += (float) region.y;
+        }
+
+        rvGrid_AddQuad(self, context, quads[i], region, tile, level, level == 0);
+    }
+
+    // Count the candidates added.
+    rvGrid_EndStage(context, RVGRID_STAGE_FILTER, start, context->candidateCount - first);
+}
+
+
+static void rvGrid_FindCandidates(rvGrid *self, rvGridContext *context, CvArr *edgeImage, CvRect region, rvUint16 tile, int level)
+// Find the four sided contours in the edge image and add them as candidates.  The
+// edge image covers the region of the image at the pyramid level and is modified
+// by this call.  Candidates found below the full image are scaled up to it.
+{
+    int i;
+    int count = 0;
+    int first = context->candidateCount;
+    rvUint64 start;
+    CvSeq *contours = NULL;
+    CvSeq *contour;
+    CvSeq *result;
+
+    // Find the candidates as black components rather than contours?  The black
+    // components are only found in thresholded edge images, so the edge images of
+    // the edge detectors fall back to contours.
+    if ((self->quadMethod == RVGRID_QUAD_COMPONENTS) && (self->edgeMethod != RVGRID_EDGE_CANNY) && (self->edgeMethod != RVGRID_EDGE_SUZAN))
+    {
+        rvGrid_FindComponentQuads(self, context, edgeImage, region, tile, level);
+        return;
+    }
+
+    // Convert the edges in the edge image to a sequence of contours.  The number
+    // of contours is limited by the storage budget of the context.
+    start = rvProfile_GetTicks();
+    contours = rvStorage_FindContours(context->storage, edgeImage, CV_RETR_LIST, cvPoint(region.x, region.y));
+    start = rvGrid_EndStage(context, RVGRID_STAGE_CONTOURS, start, 0);
+
+    // Loop over all the countours while there is storage for their polygons.
+    for (contour = contours; (contour != NULL) && rvStorage_CheckBudget(context->storage); contour = contour->h_next)
+    {
+        CvPoint2D32f quad[RVTAG_CORNER_COUNT];
+
+        ++count;
+
+        // Approximates polygonal curve with precision proportional to the contour perimeter.
+        result = cvApproxPoly(contour, sizeof(CvContour), rvStorage_GetMemStorage(context->storage), CV_POLY_APPROX_DP, cvArcLength(contour, CV_WHOLE_SEQ, 1) * 0.02, 0);
+
+        // Keep the polygons for drawing.  Polygons found below the full image are
+        // not in image coordinates so are not drawn.
+        if (level == 0)
+        {
+            result->h_next = context->polygons;
+            context->polygons = result;
+        }
+
+        // Square contours should have:
+        //
+        //   o 4 vertices after approximation
+        //   o relatively large area (to filter out noisy contours)
+        //   o and be convex
+        //
+        // Note: Absolute value of an area is used because area may be positive or
+        // negative - in accordance with the contour orientation.
+        if ((result->total != 4) || !cvCheckContourConvexity(result) || (fabs(cvContourArea(result, CV_WHOLE_SEQ)) <= (500 >> (2 * level)))) continue;
+
+        // Convert the polygon to an array of corners.
+        for (i = 0; i < RVTAG_CORNER_COUNT; ++i)
+        {
+            CvPoint pt = *((CvPoint*) cvGetSeqElem(result, i));
+
+            quad[i] = cvPoint2D32f((float) pt.x, (float) pt.y);
+        }
+
+        // Add the quad as a candidate.
+        rvGrid_AddQuad(self, context, quad, region, tile, level, false);
+    }
+
+    // Keep the raw contours for drawing.
+    if ((contours != NULL) && (level == 0))
+    {
+        for (contour = contours; contour->h_next != NULL; contour = contour->h_next);
+        contour->h_next = context->contours;
+        context->contours = contours;
+    }
+
+    // Count the contours processed and the candidates added.
+    context->stageCounts[RVGRID_STAGE_CONTOURS] += count;
+    rvGrid_EndStage(context, RVGRID_STAGE_FILTER, start, context->candidateCount - first);
+}
+
+
+static int rvGrid_RejectCandidate(rvGrid *self, rvGridCandidate *candidate)
+// Run the cheap stages of the rejection cascade on the unrefined quad of the
+// candidate.  Most candidates in cluttered scenes are not tags and are rejected
+// here before the corners are refined and the bits sampled.  Candidates found
+// on a pyramid level have corners scaled up from the smaller image which can be
+// off by more than the border width, so only their aspect ratio is checked.
+// Returns the stage which rejected the candidate or RVGRID_REJECT_NONE.
+{
+    int i;
+    int count = 0;
+    int insideCount = 0;
+    int darkCount = 0;
+    int outsideSum = 0;
+    int insideSum = 0;
+    int middle;
+    double shortest = DBL_MAX;
+    double longest = 0.0;
+    int outside[RVSAMPLER_BORDER_COUNT];
+    int inside[RVSAMPLER_BORDER_COUNT];
+    rvSamplerQuad sampler;
+
+    // Find the shortest and longest sides.
+    for (i = 0; i < RVTAG_CORNER_COUNT; ++i)
+    {
+        CvPoint2D32f *corner1 = &candidate->quad[i];
+        CvPoint2D32f *corner2 = &candidate->quad[(i + 1) % RVTAG_CORNER_COUNT];
+        double length = sqrt((corner2->x - corner1->x) * (corner2->x - corner1->x) + (corner2->y - corner1->y) * (corner2->y - corner1->y));
+
+        if (length < shortest) shortest = length;
+        if (length > longest) longest = length;
+    }
+
+    // Reject quads which are too narrow to be a tag seen at an angle.
+    if ((longest > shortest * RVGRID_MAX_ASPECT_RATIO) || !rvSampler_SetQuad(&sampler, candidate->quad)) return RVGRID_REJECT_ASPECT;
+
+    // Leave candidates found on a pyramid level to the later stages.
+    if (candidate->level > 0) return RVGRID_REJECT_NONE;
+
+    // Sample pairs of points across the edge of the quad.
+    rvSampler_SampleBorder(self->grayImage, &sampler, outside, inside);
+    for (i = 0; i < RVSAMPLER_BORDER_COUNT; ++i)
+    {
+        if ((outside[i] < 0) || (inside[i] < 0)) continue;
+        outsideSum += outside[i];
+        insideSum += inside[i];
+        ++count;
+    }
+
+    // Leave quads whose border is outside the image to the later stages.
+    if (count == 0) return RVGRID_REJECT_NONE;
+
+    // Reject quads without a white border outside a darker black border.
+    if (outsideSum <= insideSum * RVGRID_MIN_CONTRAST_RATIO) return RVGRID_REJECT_CONTRAST;
+
+    // Reject quads whose black border has gaps.  The inside samples should be
+    // darker than the middle of the outside and inside averages.
+    middle = (outsideSum + insideSum) / (2 * count);
+    for (i = 0; i < RVSAMPLER_BORDER_COUNT; ++i)
+    {
+        if (inside[i] < 0) continue;
+        if (inside[i] < middle) ++darkCount;
+        ++insideCount;
+    }
+    if (darkCount < insideCount * RVGRID_MIN_RING_FRACTION) return RVGRID_REJECT_RING;
+
+    return RVGRID_REJECT_NONE;
+}
+
+
+static void rvGrid_DecodeCandidate(rvGrid *self, rvGridContext *context, rvGridCandidate *candidate)
+// Refine the corners of the candidate, sample the bits within it and decode the
+// bits into a tag id using the tag object of the context.  Only reads shared
+// grid state so it may be called from multiple worker threads with different
+// contexts.  The time taken by each stage is added to the context.
+{
+    int whiteReference;
+    int blackReference;
+    rvUint64 start = rvProfile_GetTicks();
+    rvSamplerQuad sampler;
+
+    // Reject candidates which fail the cheap stages of the cascade.  The border
+    // samples are symmetric so the corners don't need to be normalized first.
+    candidate->rejection = (rvUint16) rvGrid_RejectCandidate(self, candidate);
+    start = rvGrid_EndStage(context, RVGRID_STAGE_FILTER, start, 0);
+    if (candidate->rejection != RVGRID_REJECT_NONE) return;
+
+    // Refine the corner coordinates to sub-pixel values unless already fitted.
+    // Candidates found below the full image start further from the corners so
+    // use a wider search.
+    if (!candidate->fitted)
+    {
+        cvFindCornerSubPix(self->grayImage, candidate->quad, 4, cvSize(5 + 2 * candidate->level, 5 + 2 * candidate->level), cvSize(-1, -1),
+                           cvTermCriteria(CV_TERMCRIT_ITER | CV_TERMCRIT_EPS, 5 * (candidate->level + 1), 0.2f));
+        start = rvGrid_EndStage(context, RVGRID_STAGE_SUBPIX, start, 1);
+    }
+
+    // The polygon may be going in a counter-clockwise direction which will
+    // defeat encoding.  Normalize the polygon to follow a clockwise direction.
+    cvNormalizeCorners(candidate->quad);
+
+    // Map the sample grid onto the polygon.
+    if (!rvSampler_SetQuad(&sampler, candidate->quad))
+    {
+        candidate->rejection = RVGRID_REJECT_ASPECT;
+        rvGrid_EndStage(context, RVGRID_STAGE_SAMPLE, start, 1);
+        return;
+    }
+
+    // Get the black and white pixel values from the reference points.
+    rvSampler_SampleReferences(self->grayImage, &sampler, &whiteReference, &blackReference);
+
+    // Our markers consist of a black border against a white background. If the black
+    // reference is not less bright than the white reference we can skip the tag.
+    if (blackReference >= whiteReference)
+    {
+        candidate->rejection = RVGRID_REJECT_REFERENCE;
+        rvGrid_EndStage(context, RVGRID_STAGE_SAMPLE, start, 1);
+        return;
+    }
+
+    candidate->referenced = true;
+
+    // Sample the points as a bit pattern with white squares as set bits.
+    candidate->pattern = rvSampler_SamplePattern(self->grayImage, &sampler, blackReference, whiteReference);
+    start = rvGrid_EndStage(context, RVGRID_STAGE_SAMPLE, start, 1);
+
+    // Decode the bits and see if we found a valid pattern.
+    if (rvTag_DecodePattern(context->tag, candidate->quad, candidate->pattern))
+    {
+        // Get the decoded tag id and the number of bits read in error.
+        rvTag_GetDecodedId(context->tag, &candidate->id);
+        rvTag_GetDecodedBitErrors(context->tag, &candidate->bitErrors);
+
+        // Get the decoded tag corners.  These are the 2D positions of
+        // corners of the tag within the image.
+        rvTag_GetDecodedCorners(context->tag, candidate->corners);
+
+        candidate->decoded = true;
+    }
+    else
+    {
+        candidate->rejection = RVGRID_REJECT_DECODE;
+    }
+
+    rvGrid_EndStage(context, RVGRID_STAGE_DECODE, start, 1);
+}
+
+
+static void rvGrid_TileTask(void *arg, int task, int worker)
+// Find and decode the candidates within a single tile.  Called on a task pool worker.
+{
+    int i;
+    int first;
+    CvMat edgeTile;
+    CvMat tileImage;
+    rvGrid *self = (rvGrid *) arg;
+    rvGridContext *context = self->contexts[worker];
+    CvRect region = self->tiles[task];
+
+    // Copy the tile from the shared edge image as finding contours modifies the image.
+    cvGetSubRect(self->edgeImage, &edgeTile, region);
+    cvGetSubRect(context->tileImage, &tileImage, cvRect(0, 0, region.width, region.height));
+    cvCopy(&edgeTile, &tileImage, NULL);
+
+    // Find the candidates in the tile.
+    first = context->candidateCount;
+    rvGrid_FindCandidates(self, context, &tileImage, region, (rvUint16) task, 0);
+
+    // Decode the candidates.
+    for (i = first; i < context->candidateCount; ++i) rvGrid_DecodeCandidate(self, context, &context->candidates[i]);
+}
+
+
+static void rvGrid_DecodeTask(void *arg, int task, int worker)
+// Decode a batch of the candidates found on the calling thread using the context
+// of the worker.  Called on a task pool worker.
+{
+    int i;
+    rvGrid *self = (rvGrid *) arg;
+    rvGridContext *context = self->contexts[0];
+    rvGridContext *workerContext = self->contexts[worker];
+    int end = (task + 1) * RVGRID_DECODE_BATCH;
+
+    // Decode the candidates in the batch.
+    if (end > context->candidateCount) end = context->candidateCount;
+    for (i = task * RVGRID_DECODE_BATCH; i < end; ++i) rvGrid_DecodeCandidate(self, workerContext, &context->candidates[i]);
+}
+
+
+static void rvGrid_DecodeCandidates(rvGrid *self)
+// Decode the candidates found on the calling thread in batches on the worker
+// threads if there is more than one batch.  Each worker decodes with its own
+// context.
+{
+    int i;
+    rvGridContext *context = self->contexts[0];
+
+    if ((context->candidateCount > RVGRID_DECODE_BATCH) && rvGrid_PrepareWorkers(self))
+    {
+        rvTaskPool_Run(self->taskPool, (context->candidateCount + RVGRID_DECODE_BATCH - 1) / RVGRID_DECODE_BATCH, rvGrid_DecodeTask, self);
+    }
+    else
+    {
+        for (i = 0; i < context->candidateCount; ++i) rvGrid_DecodeCandidate(self, context, &context->candidates[i]);
+    }
+}
+
+
+static void rvGrid_DrawContext(rvGrid *self, IplImage *image, rvGridContext *context)
+// Draw the contours found by a processing context.
+{
+    CvSeq *contour;
+
+    // Draw the contours found in the image.
+    if (self->drawRawContours)
+    {
+        for (contour = context->contours; contour != NULL; contour = contour->h_next)
+        {
+            cvDrawContours(image, contour, CV_RGB(255, 0, 0), CV_RGB(255, 0, 0), 0, 2, 8, cvPoint(0,0));
+        }
+    }
+
+    // Draw the polygons within the image.
+    if (self->drawPolygonContours)
+    {
+        for (contour = context->polygons; contour != NULL; contour = contour->h_next)
+        {
+            cvDrawContours(image, contour, CV_RGB(0, 255, 0), CV_RGB(0, 255, 0), 0, 2, 8, cvPoint(0,0));
+        }
+    }
+}
+
+
+static void rvGrid_AddCandidate(rvGrid *self, IplImage *image, rvGridCandidate *candidate, bool unique)
+// Add a decoded candidate to the tags in the grid and draw it.  If unique is true the
+// candidate is ignored if the same tag has already been added.
+{
+    int i;
+
+    // Count the candidate and the stage which rejected it.
+    ++self->candidateCount;
+    ++self->rejectCounts[candidate->rejection];
+
+    // Draw the four sided polygons within the image.
+    if (self->drawQuadContours)
+    {
+        CvPoint points[RVTAG_CORNER_COUNT];
+        CvPoint *polygon = points;
+        int count = RVTAG_CORNER_COUNT;
+
+        for (i = 0; i < RVTAG_CORNER_COUNT; ++i) points[i] = cvPointFrom32f(candidate->quad[i]);
+        cvPolyLine(image, &polygon, &count, 1, 1, CV_RGB(0, 255, 0), 2, 8, 0);
+    }
+
+    // Skip candidates that failed the reference test.
+    if (!candidate->referenced) return;
+
+    // Should we draw sample reference points?
+    if (self->drawTagReferences)
+    {
+        rvSamplerQuad sampler;
+        CvPoint2D32f reference[RVSAMPLER_REFERENCE_COUNT];
+
+        // Draw sample reference points.
+        rvSampler_SetQuad(&sampler, candidate->quad);
+        rvSampler_GetReferencePoints(&sampler, reference);
+        cvDrawCrosses(image, &reference[0], 4, CV_RGB(255, 0, 0));
+        cvDrawCrosses(image, &reference[4], 4, CV_RGB(0, 255, 0));
+    }
+
+    // Should we draw the samples?
+    if (self->drawTagSamples)
+    {
+        rvSamplerQuad sampler;
+        CvPoint2D32f samples[RVSAMPLER_SAMPLE_COUNT];
+
+        // Draw white samples as red crosses and black samples as green crosses.
+        rvSampler_SetQuad(&sampler, candidate->quad);
+        rvSampler_GetSamplePoints(&sampler, samples);
+        for (i = 0; i < RVTAG_SAMPLE_COUNT; ++i)
+        {
+            cvDrawCross(image, cvPointFrom32f(samples[i]), ((candidate->pattern >> i) & 1) ? CV_RGB(255, 0, 0) : CV_RGB(0, 255, 0));
+        }
+    }
+
+    // Skip candidates that were not decoded.
+    if (!candidate->decoded) return;
+
+    // Skip tags which have already been found.
+    if (unique && rvGrid_FindTag(self, candidate->id, candidate->corners)) return;
+
+    // Place the tag id and tag corners in the rvGrid object.
+    rvGrid_AddTag(self, candidate->id, candidate->corners, candidate->bitErrors);
+
+    // Draw the corners of the tag.
+    if (self->drawTagCorners) cvDrawCorners(image, candidate->corners, CV_RGB(0, 255, 0), CV_RGB(255, 0, 0), 1, 8, 0);
+
+    // Draw the identifiers of the tag.
+    if (self->drawTagIdentifiers)
+    {
+        char buffer[16];
+        CvPoint2D32f center;
+
+        // Print the rvGrid id into the buffer.
+        rvSnprintf(buffer, sizeof(buffer), "%d", (int) candidate->id);
+
+        // Get the coordinates of the center.
+        rvGrid_GetCenterPoint(candidate->corners, &center);
+
+        // Write the buffer to the image.
+        cvPutText(image, buffer, cvPointFrom32f(center), &self->idFont, CV_RGB(255, 0, 0));
+    }
+}
+
+
+static void rvGrid_FindEdges(rvGrid *self, CvArr *grayImage, CvArr *edgeImage, int level)
+// Convert the gray image to edges in the edge image.  The adaptive block size is
+// scaled down to the pyramid level of the images.
+{
+    rvUint64 start = rvProfile_GetTicks();
+    CvSize size = cvGetSize(edgeImage);
+
+    // Handle the edge method for creating contours.
+    if (self->edgeMethod == RVGRID_EDGE_CANNY)
+    {
+        // Apply the Canny algorithm for edge detection.
+        cvCanny(grayImage, edgeImage, 50, 200, 3);
+
+        // Dialate the edge output to remove holes between edge segments.
+        if (self->edgeDilation) cvDilate(edgeImage, edgeImage, NULL, self->edgeDilation);
+    }
+    else if (self->edgeMethod == RVGRID_EDGE_SUZAN)
+    {
+        // Apply the Suzan algorithm for edge detection.
+        cvSusan(grayImage, edgeImage, 10, 1);
+
+        // Dialate the edge output to remove holes between edge segments.
+        if (self->edgeDilation) cvDilate(edgeImage, edgeImage, NULL, self->edgeDilation);
+    }
+    else  // Default is adaptive threshold.
+    {
+        // Adjust the block size to prevent passing in an even number.  If the number is
+        // even, the number is rounded down the previous negative number.
+        int adaptiveBlockSize = self->adaptiveBlockSize >> level;
+        int blockSize = adaptiveBlockSize <= 1 ? 1 : (((adaptiveBlockSize - 1) / 2) * 2) + 1;
+
+        // The integral threshold compares against the mean of the block at a cost
+        // independent of the block size.  Fall back to the adaptive threshold if
+        // it can't handle the image.  The fused threshold uses the integral
+        // threshold for images it doesn't convert itself.
+        if (((self->edgeMethod != RVGRID_EDGE_INTEGRAL) && (self->edgeMethod != RVGRID_EDGE_FUSED)) ||
+            !rvThreshold_Apply(self->threshold, grayImage, edgeImage, blockSize, self->adaptiveSubtraction))
+        {
+            // Apply the adaptive threshold algorithm for edge detection.
+            cvAdaptiveThreshold(grayImage, edgeImage, 255.0,
+                                !self->adaptiveMethod ? CV_ADAPTIVE_THRESH_MEAN_C : CV_ADAPTIVE_THRESH_GAUSSIAN_C,
+                                CV_THRESH_BINARY, blockSize, (double) self->adaptiveSubtraction);
+        }
+    }
+
+    rvGrid_EndStage(self->contexts[0], RVGRID_STAGE_THRESHOLD, start, size.width * size.height);
+}
+
+
+static void rvGrid_ConvertGray(rvGrid *self, IplImage *image, CvRect region)
+// Convert the region of the image to gray scale and smooth it.
+{
+    int blur;
+    rvUint64 start = rvProfile_GetTicks();
+    CvMat imageRegion;
+    CvMat grayRegion;
+
+    // Point to the region of each image.
+    cvGetSubRect(image, &imageRegion, region);
+    cvGetSubRect(self->grayImage, &grayRegion, region);
+
+    // Convert the image to gray scale.
+    cvCvtColor(&imageRegion, &grayRegion, CV_RGB2GRAY);
+    start = rvGrid_EndStage(self->contexts[0], RVGRID_STAGE_CONVERT, start, region.width * region.height);
+
+    // Adjust the blur to prevent passing in an even number.  If the number is
+    // not zero and even, the number is rounded down the previous negative number.
+    blur = self->gaussianBlur < 1 ? 0 : (((self->gaussianBlur - 1) / 2) * 2) + 1;
+
+    // Smooth the gray scale image.
+    if (blur)
+    {
+        cvSmooth(&grayRegion, &grayRegion, CV_GAUSSIAN, blur, 0, 0.0, 0.0);
+        rvGrid_EndStage(self->contexts[0], RVGRID_STAGE_BLUR, start, region.width * region.height);
+    }
+}
+
+
+static bool rvGrid_ConvertEdges(rvGrid *self, IplImage *image)
+// Convert the whole image to gray scale, smooth it and threshold it to edges in
+// a single pass over the image.  Returns false if the image can't be converted
+// this way and must be converted to gray scale and edges separately.  The single
+// pass is timed as the threshold stage.
+{
+    int blur;
+    int blockSize;
+    rvUint64 start = rvProfile_GetTicks();
+
+    // Only the fused threshold converts the image in a single pass.
+    if (self->edgeMethod != RVGRID_EDGE_FUSED) return false;
+
+    // Adjust the blur and block size to odd numbers as when converted separately.
+    blur = self->gaussianBlur < 1 ? 0 : (((self->gaussianBlur - 1) / 2) * 2) + 1;
+    blockSize = self->adaptiveBlockSize <= 1 ? 1 : (((self->adaptiveBlockSize - 1) / 2) * 2) + 1;
+
+    // Convert the image to gray scale and edges.
+    if (!rvThreshold_ApplyColor(self->threshold, image, self->grayImage, self->edgeImage,
+                                blur, blockSize, self->adaptiveSubtraction)) return false;
+    rvGrid_EndStage(self->contexts[0], RVGRID_STAGE_THRESHOLD, start, self->imageSize.width * self->imageSize.height);
+
+    return true;
+}
+
+
+static void rvGrid_PrepareRegion(rvGrid *self, IplImage *image, CvRect region, bool convert)
+// Convert the region of the image to edges ready for finding candidates.  If
+// convert is true the gray image has not been converted for the whole image so
+// the region is also converted to gray scale along with a margin which keeps the
+// corner refinement and sampling of tags near the region edges within gray pixels.
+{
+    int right;
+    int bottom;
+    CvRect grayRegion;
+    CvMat edgeRegion;
+    CvMat grayMat;
+
+    // Should we convert the region to gray scale?
+    if (convert)
+    {
+        // Enlarge the region by the margin clipped to the image.
+        grayRegion.x = region.x > RVGRID_REGION_MARGIN ? region.x - RVGRID_REGION_MARGIN : 0;
+        grayRegion.y = region.y > RVGRID_REGION_MARGIN ? region.y - RVGRID_REGION_MARGIN : 0;
+        right = region.x + region.width + RVGRID_REGION_MARGIN;
+        bottom = region.y + region.height + RVGRID_REGION_MARGIN;
+        grayRegion.width = (right < self->imageSize.width ? right : self->imageSize.width) - grayRegion.x;
+        grayRegion.height = (bottom < self->imageSize.height ? bottom : self->imageSize.height) - grayRegion.y;
+
+        rvGrid_ConvertGray(self, image, grayRegion);
+    }
+
+    // Convert the region to edges.
+    cvGetSubRect(self->grayImage, &grayMat, region);
+    cvGetSubRect(self->edgeImage, &edgeRegion, region);
+    rvGrid_FindEdges(self, &grayMat, &edgeRegion, 0);
+}
+
+
+static void rvGrid_DisplayRegions(rvGrid *self, IplImage *image)
+// Write the edges of each tracked region or region of interest back to the
+// image once all the regions have been searched, so the gray scale conversion
+// of a region never reads the edges of another.  Finding the candidates modifies
+// the edge image so the edges are converted again from the gray image.
+{
+    int i;
+    CvMat imageRegion;
+    CvMat edgeRegion;
+    CvMat grayMat;
+
+    for (i = 0; i < self->tileCount; ++i)
+    {
+        cvGetSubRect(self->grayImage, &grayMat, self->tiles[i]);
+        cvGetSubRect(self->edgeImage, &edgeRegion, self->tiles[i]);
+        cvGetSubRect(image, &imageRegion, self->tiles[i]);
+        rvGrid_FindEdges(self, &grayMat, &edgeRegion, 0);
+        cvCvtColor(&edgeRegion, &imageRegion, CV_GRAY2RGB);
+    }
+}
+
+
+static void rvGrid_SearchRegions(rvGrid *self, IplImage *image, bool convert)
+// Find and decode the candidates within each region of interest on the calling
+// thread.  Each region is treated as a tile.
+{
+    int i;
+    int j;
+    int first;
+    CvMat edgeRegion;
+    rvGridContext *context = self->contexts[0];
+
+    // Loop over each region.
+    for (i = 0; i < self->regionCount; ++i)
+    {
+        // Convert the region to edges.
+        rvGrid_PrepareRegion(self, image, self->regions[i], convert);
+
+        // Find the candidates in the region.
+        first = context->candidateCount;
+        cvGetSubRect(self->edgeImage, &edgeRegion, self->regions[i]);
+        rvGrid_FindCandidates(self, context, &edgeRegion, self->regions[i], (rvUint16) i, 0);
+
+        // Decode the candidates.
+        for (j = first; j < context->candidateCount; ++j) rvGrid_DecodeCandidate(self, context, &context->candidates[j]);
+
+        // Save the region as a tile.
+        self->tiles[i] = self->regions[i];
+    }
+
+    self->tileCount = self->regionCount;
+}
+
+
+static bool rvGrid_PreparePyramid(rvGrid *self)
+// Make sure there are gray and edge images for each pyramid level.  Returns
+// false if the images could not be created.
+{
+    int i;
+    CvSize size = self->imageSize;
+
+    for (i = 0; i < self->pyramidLevels; ++i)
+    {
+        // Each level is half the size of the level above rounded up.
+        size = cvSize((size.width + 1) / 2, (size.height + 1) / 2);
+
+        // Create the images.
+        if (self->pyramidImages[i] == NULL)
+        {
+            self->pyramidImages[i] = cvCreateImage(size, IPL_DEPTH_8U, 1);
+            self->pyramidEdges[i] = cvCreateImage(size, IPL_DEPTH_8U, 1);
+            self->allocCount += 2;
+        }
+        if ((self->pyramidImages[i] == NULL) || (self->pyramidEdges[i] == NULL)) return false;
+    }
+
+    return true;
+}
+
+
+static void rvGrid_SearchPyramid(rvGrid *self, IplImage *image)
+// Find the candidates in the lowest pyramid level of the gray image and decode
+// them in the full image.  Edge detection and contour finding run on an image
+// with a quarter of the pixels for each level.
+{
+    int i;
+    int level = self->pyramidLevels;
+    rvUint64 start = rvProfile_GetTicks();
+    IplImage *edgeImage = self->pyramidEdges[level - 1];
+    rvGridContext *context = self->contexts[0];
+
+    // Halve the gray image down to the lowest level.
+    cvPyrDown(self->grayImage, self->pyramidImages[0], CV_GAUSSIAN_5x5);
+    for (i = 1; i < level; ++i) cvPyrDown(self->pyramidImages[i - 1], self->pyramidImages[i], CV_GAUSSIAN_5x5);
+    rvGrid_EndStage(context, RVGRID_STAGE_BLUR, start, self->imageSize.width * self->imageSize.height);
+
+    // Convert the lowest level to edges.
+    rvGrid_FindEdges(self, self->pyramidImages[level - 1], edgeImage, level);
+
+    // Should we write the edge image back?
+    if (self->display == RVGRID_DISPLAY_EDGE)
+    {
+        cvResize(edgeImage, self->edgeImage, CV_INTER_NN);
+        cvCvtColor(self->edgeImage, image, CV_GRAY2RGB);
+    }
+
+    // Find the candidates in the lowest level.
+    self->tileCount = 1;
+    self->tiles[0] = cvRect(0, 0, self->imageSize.width, self->imageSize.height);
+    rvGrid_FindCandidates(self, context, edgeImage, cvRect(0, 0, edgeImage->width, edgeImage->height), 0, level);
+
+    // Decode the candidates in the full image.
+    rvGrid_DecodeCandidates(self);
+}
+
+
+static bool rvGrid_GetTrackRegion(rvGrid *self, rvGridTrack *track, CvRect *region)
+// Predict the region of the current frame containing the tracked tag by moving
+// the tag at its velocity in the previous frame.  The region is enlarged by half
+// the tag size so the white border around the tag is included.  Returns false if
+// the predicted region is outside the image.
+{
+    int i;
+    int margin;
+    float x;
+    float y;
+    float minX = FLT_MAX;
+    float minY = FLT_MAX;
+    float maxX = -FLT_MAX;
+    float maxY = -FLT_MAX;
+    int left;
+    int top;
+    int right;
+    int bottom;
+
+    // Get the bounds of the predicted corners.
+    for (i = 0; i < RVTAG_CORNER_COUNT; ++i)
+    {
+        x = track->corners[i].x + track->velocity.x;
+        y = track->corners[i].y + track->velocity.y;
+        if (x < minX) minX = x;
+        if (x > maxX) maxX = x;
+        if (y < minY) minY = y;
+        if (y > maxY) maxY = y;
+    }
+
+    // Enlarge the bounds by half the larger side of the tag.
+    margin = cvRound(((maxX - minX) > (maxY - minY) ? (maxX - minX) : (maxY - minY)) / 2.0f) + RVGRID_TRACK_MARGIN;
+    left = cvFloor(minX) - margin;
+    top = cvFloor(minY) - margin;
+    right = cvCeil(maxX) + margin;
+    bottom = cvCeil(maxY) + margin;
+
+    // Clip the region to the image.
+    if (left < 0) left = 0;
+    if (top < 0) top = 0;
+    if (right > self->imageSize.width) right = self->imageSize.width;
+    if (bottom > self->imageSize.height) bottom = self->imageSize.height;
+
+    // Is enough of the region left to hold the tag?
+    if ((right - left <= 2 * RVGRID_TRACK_MARGIN) || (bottom - top <= 2 * RVGRID_TRACK_MARGIN)) return false;
+
+    *region = cvRect(left, top, right - left, bottom - top);
+
+    return true;
+}
+
+
+static bool rvGrid_TrackTags(rvGrid *self, IplImage *image, bool convert)
+// Look for each tag found in the previous frame within the region predicted for
+// it in the current frame.  Only the tracked regions are converted to edges and
+// searched for candidates.  Each region is treated as a tile holding candidates
+// found on the calling thread.  Returns false if a full image search is due or
+// any tracked tag was lost.
+{
+    int i;
+    int j;
+    bool found;
+    CvMat edgeRegion;
+    rvGridContext *context = self->contexts[0];
+
+    // Is tracking enabled and is a full image search not yet due?
+    if ((self->trackCount == 0) || (self->trackFrames >= self->trackInterval)) return false;
+
+    // Loop over each track.
+    self->tileCount = 0;
+    for (i = 0; i < self->trackCount; ++i)
+    {
+        rvGridTrack *track = &self->tracks[i];
+        int first = context->candidateCount;
+
+        // Prevent tile buffer overflow.
+        if (self->tileCount >= RVGRID_MAX_TILES) return false;
+
+        // Predict the region containing the tag.
+        if (!rvGrid_GetTrackRegion(self, track, &self->tiles[self->tileCount])) return false;
+
+        // Find the candidates in the region.
+        rvGrid_PrepareRegion(self, image, self->tiles[self->tileCount], convert);
+        cvGetSubRect(self->edgeImage, &edgeRegion, self->tiles[self->tileCount]);
+        rvGrid_FindCandidates(self, context, &edgeRegion, self->tiles[self->tileCount], (rvUint16) self->tileCount, 0);
+
+        // Decode the candidates and look for the tracked tag.
+        found = false;
+        for (j = first; j < context->candidateCount; ++j)
+        {
+            rvGrid_DecodeCandidate(self, context, &context->candidates[j]);
+            if (context->candidates[j].decoded && (context->candidates[j].id == track->id)) found = true;
+        }
+
+        // Give up if the tag was lost.
+        if (!found) return false;
+
+        ++self->tileCount;
+    }
+
+    return true;
+}
+
+
+static void rvGrid_AddTrack(rvGrid *self, rvGridTrack *tracks, int trackCount, rvUint16 id, CvPoint2D32f corners[RVTAG_CORNER_COUNT])
+// Add a tag found in the current frame as a track for the next frame.  The
+// velocity is the movement from the nearest previous track with the same id.
+{
+    int i;
+    float dx;
+    float dy;
+    float distance;
+    float nearest = FLT_MAX;
+    CvPoint2D32f center;
+    CvPoint2D32f other;
+    rvGridTrack *track;
+
+    // Prevent track buffer overflow.
+    if (self->trackCount >= RVGRID_MAX_TRACKS) return;
+
+    // Point to the track to fill in.
+    track = &self->tracks[self->trackCount++];
+
+    // Fill in the track information.
+    track->id = id;
+    for (i = 0; i < RVTAG_CORNER_COUNT; ++i) track->corners[i] = corners[i];
+    track->velocity = cvPoint2D32f(0.0f, 0.0f);
+
+    // Find the nearest previous track of the tag.
+    rvGrid_GetCenterPoint(corners, &center);
+    for (i = 0; i < trackCount; ++i)
+    {
+        if (tracks[i].id != id) continue;
+
+        rvGrid_GetCenterPoint(tracks[i].corners, &other);
+        dx = center.x - other.x;
+        dy = center.y - other.y;
+        distance = dx * dx + dy * dy;
+        if (distance < nearest)
+        {
+            nearest = distance;
+            track->velocity = cvPoint2D32f(dx, dy);
+        }
+    }
+}
+
+
+static void rvGrid_UpdateTracks(rvGrid *self, bool tracked)
+// Replace the tracks with the tags found in the current frame.
+{
+    int i;
+    int trackCount = self->trackCount;
+    rvGridTrack tracks[RVGRID_MAX_TRACKS];
+
+    // Count the frames since the last full image search.
+    self->trackFrames = tracked ? self->trackFrames + 1 : 0;
+
+    // Keep the previous tracks to determine the velocity of each tag.
+    memcpy(tracks, self->tracks, sizeof(rvGridTrack) * trackCount);
+
+    // Add a track for each tag.
+    self->trackCount = 0;
+    if (self->trackInterval == 0) return;
+    for (i = 0; i < self->navTagCount; ++i) rvGrid_AddTrack(self, tracks, trackCount, self->navTags[i].id, self->navTags[i].corners);
+    for (i = 0; i < self->objTagCount; ++i) rvGrid_AddTrack(self, tracks, trackCount, self->objTags[i].id, self->objTags[i].corners);
+    for (i = 0; i < self->charTagCount; ++i) rvGrid_AddTrack(self, tracks, trackCount, self->charTags[i].id, self->charTags[i].corners);
+}
+
+
+static void rvGrid_EndFrame(rvGrid *self, rvUint64 start)
+// Total the time and items of each stage over the contexts and add the times to
+// the profile.  The frame stage is the time since the start of the image.  The
+// image is counted as truncated if any context cut its contours short.
+{
+    int i;
+    int j;
+    bool truncated = false;
+    rvUint64 stageTicks[RVGRID_STAGE_COUNT];
+
+    // Count the image once however many contexts were truncated.
+    for (i = 0; i < self->contextCount; ++i) truncated = truncated || rvStorage_IsTruncated(self->contexts[i]->storage);
+    if (truncated) ++self->storageTruncations;
+
+    // Total the stages over the contexts.
+    for (i = 0; i < RVGRID_STAGE_COUNT; ++i)
+    {
+        stageTicks[i] = 0;
+        self->stageCounts[i] = 0;
+
+        for (j = 0; j < self->contextCount; ++j)
+        {
+            stageTicks[i] += self->contexts[j]->stageTicks[i];
+            self->stageCounts[i] += self->contexts[j]->stageCounts[i];
+        }
+    }
+
+    // Time the whole frame.
+    stageTicks[RVGRID_STAGE_FRAME] = rvProfile_GetTicks() - start;
+    self->stageCounts[RVGRID_STAGE_FRAME] = 1;
+
+    // Add the times to the profile.
+    for (i = 0; i < RVGRID_STAGE_COUNT; ++i) rvProfile_AddSample(self->profile, i, rvProfile_GetMicroseconds(stageTicks[i]));
+}
+
+
+rvGrid *rvGrid_New(CvSize imageSize, int origin)
+// Allocate a new rvGrid object.
+{
+    int i;
+    rvGrid *self = NULL;
+    rvGridContext *context = NULL;
+    rvTagSet *activeTags = NULL;
+    rvCodebook *codebook = NULL;
+    IplImage *grayImage = NULL;
+    IplImage *edgeImage = NULL;
+    rvThreshold *threshold = NULL;
+    rvMemPool *scratch = NULL;
+    rvProfile *profile = NULL;
+    rvPose *pose = NULL;
+
+    // Set the OpenCV error handler.
+    cvRedirectError((CvErrorCallback) rvGrid_OpenCVErrorHandler, NULL, NULL);
+
+    // Allocate a new rvGrid object.
+    self = (rvGrid*) malloc(sizeof(rvGrid));
+
+    // Allocate internal objects.
+    activeTags = rvGrid_NewActiveTags();
+    codebook = activeTags ? rvGrid_NewCodebook(activeTags) : NULL;
+    context = rvGrid_NewContext(codebook, RVSTORAGE_DEFAULT_BUDGET, RVSTORAGE_DEFAULT_MAX_CONTOURS);
+    grayImage = cvCreateImage(imageSize, IPL_DEPTH_8U, 1);
+    edgeImage = cvCreateImage(imageSize, IPL_DEPTH_8U, 1);
+    threshold = rvThreshold_New(imageSize.width);
+    scratch = rvMemPool_New(RVGRID_SCRATCH_SIZE);
+    profile = rvProfile_New(RVGRID_STAGE_COUNT);
+    pose = rvPose_New(RVGRID_MAX_NAV_TAGS * RVTAG_CORNER_COUNT);
+
+    // Did we allocate the object.
+    if ((self != NULL) && (activeTags != NULL) && (codebook != NULL) && (context != NULL) && (grayImage != NULL) && (edgeImage != NULL) &&
+        (threshold != NULL) && (scratch != NULL) && (profile != NULL) && (pose != NULL))
+    {
+        // No result yet.
+        self->results = false;
+
+        // Set the processing context used on the calling thread.
+        self->contextCount = 1;
+        self->contexts[0] = context;
+        self->taskPool = NULL;
+        self->codebook = codebook;
+        self->activeTags = activeTags;
+        self->tileCount = 0;
+        self->regionCount = 0;
+
+        // Set the images.
+        self->imageSize = imageSize;
+        self->grayImage = grayImage;
+        self->edgeImage = edgeImage;
+        self->threshold = threshold;
+        self->scratch = scratch;
+        self->pose = pose;
+        self->allocCount = 0;
+        self->storageTruncations = 0;
+
+        // The pyramid images are created when needed.
+        for (i = 0; i < RVGRID_MAX_PYRAMID_LEVELS; ++i)
+        {
+            self->pyramidImages[i] = NULL;
+            self->pyramidEdges[i] = NULL;
+        }
+
+        // Set the image origins.
+        self->grayImage->origin = origin;
+        self->edgeImage->origin = origin;
+
+        // Set the default properties.
+        self->display = RVGRID_DISPLAY_COLOR;
+        self->edgeMethod = RVGRID_EDGE_ADAPTIVE;
+        self->edgeDilation = 0;
+        self->gaussianBlur = 0;
+        self->adaptiveMethod = RVGRID_ADAPTIVE_METHOD_GAUSSIAN;
+        self->adaptiveBlockSize = 45;
+        self->adaptiveSubtraction = 5;
+        self->threadCount = 0;
+        self->tileSize = 0;
+        self->tileOverlap = 128;
+        self->decodeMethod = RVGRID_DECODE_FEC;
+        self->decodeMaxBitErrors = 3;
+        self->trackInterval = 0;
+        self->pyramidLevels = 0;
+        self->quadMethod = RVGRID_QUAD_CONTOURS;
+        self->storageBudget = RVSTORAGE_DEFAULT_BUDGET;
+        self->maxContours = RVSTORAGE_DEFAULT_MAX_CONTOURS;
+        self->poseIterations = 0;
+        self->poseThreshold = 4;
+        rvGrid_SetContextDecodeMethod(self, context);
+
+        // Set the default draw flags.
+        self->drawRawContours = false;
+        self->drawPolygonContours = false;
+        self->drawQuadContours = false;
+        self->drawTagCorners = true;
+        self->drawTagReferences = true;
+        self->drawTagSamples = true;
+        self->drawTagIdentifiers = true;
+        self->drawCameraPosition = true;
+        self->drawTagReprojection = true;
+        self->drawObjectReprojection = true;
+        self->drawCharacters = true;
+
+        // Create the matrices.
+        self->cameraMatrix = cvCreateMat(3, 3, CV_64FC1);
+        self->distortionCoeffs = cvCreateMat(4, 1, CV_64FC1);
+        self->rotationVector = cvCreateMat(1, 3, CV_64FC1);
+        self->translationVector = cvCreateMat(1, 3, CV_64FC1);
+        self->cameraPositionMatrix = cvCreateMat(4, 4, CV_64FC1);
+        self->poseCovariance = cvCreateMat(6, 6, CV_64FC1);
+
+        // Initialize to identity.
+        cvSetIdentity(self->cameraMatrix, cvRealScalar(1));
+        cvSetIdentity(self->distortionCoeffs, cvRealScalar(1));
+        cvSetIdentity(self->rotationVector, cvRealScalar(1));
+        cvSetIdentity(self->translationVector, cvRealScalar(1));
+        cvSetIdentity(self->cameraPositionMatrix, cvRealScalar(1));
+        cvSetZero(self->poseCovariance);
+        self->poseError = -1.0;
+        self->posed = false;
+        self->inlierCount = 0;
+
+        // Initialize the object and navigation tag counts.
+        self->objTagCount = 0;
+        self->navTagCount = 0;
+        self->charTagCount = 0;
+
+        // Initialize the tracks.
+        self->trackCount = 0;
+        self->trackFrames = 0;
+
+        // Initialize the candidate and stage counts.
+        self->candidateCount = 0;
+        memset(self->rejectCounts, 0, sizeof(self->rejectCounts));
+        memset(self->stageCounts, 0, sizeof(self->stageCounts));
+        self->profile = profile;
+
+        // Initialize calibration information.
+        self->calibrateTagCount = 0;
+        self->calibrateImageCount = 0;
+
+        // Initialize each object tag.
+        for (i = 0; i < RVGRID_MAX_OBJ_TAGS; ++i)
+        {
+            // Point to the object tags.
+            rvGridObjTag *tag = &self->objTags[i];
+
+            // Initialize the object tag matrices.
+            cvInitMatHeader(&tag->rotationVector, 1, 3, CV_64FC1, &tag->rotationData, CV_AUTOSTEP);
+            cvInitMatHeader(&tag->translationVector, 1, 3, CV_64FC1, &tag->translationData, CV_AUTOSTEP);
+            cvInitMatHeader(&tag->positionMatrix, 4, 4, CV_64FC1, &tag->positionData, CV_AUTOSTEP);
+        }
+
+        // Initialize a font for drawing tag ids and characters.
+        cvInitFont(&self->idFont, CV_FONT_HERSHEY_PLAIN, 2.0f, 2.0f, 0.0f, 3, 8);
+        cvInitFont(&self->charFont, CV_FONT_HERSHEY_PLAIN, 4.0f, 4.0f, 0.0f, 3, 16);
+    }
+    else
+    {
+        // Clean up.
+        if (context) rvGrid_FreeContext(context);
+        if (codebook) rvCodebook_Free(codebook);
+        if (activeTags) rvTagSet_Free(activeTags);
+        if (grayImage) cvReleaseImage(&grayImage);
+        if (edgeImage) cvReleaseImage(&edgeImage);
+        if (threshold) rvThreshold_Free(threshold);
+        if (scratch) rvMemPool_Free(scratch);
+        if (profile) rvProfile_Free(profile);
+        if (pose) rvPose_Free(pose);
+        if (self) free(self);
+
+        return NULL;
+    }
+
+    return self;
+}
+
+
+void rvGrid_Free(rvGrid *self)
+{
+    int i;
+
+    // Sanity check the object pointer.
+    if (self != NULL)
+    {
+        // Free the matrices.
+        cvReleaseMat(&self->cameraMatrix);
+        cvReleaseMat(&self->distortionCoeffs);
+        cvReleaseMat(&self->rotationVector);
+        cvReleaseMat(&self->translationVector);
+        cvReleaseMat(&self->cameraPositionMatrix);
+        cvReleaseMat(&self->poseCovariance);
+
+        // Free the internal objects.
+        rvTaskPool_Free(self->taskPool);
+        for (i = 0; i < self->contextCount; ++i) rvGrid_FreeContext(self->contexts[i]);
+        rvCodebook_Free(self->codebook);
+        rvTagSet_Free(self->activeTags);
+        cvReleaseImage(&self->grayImage);
+        cvReleaseImage(&self->edgeImage);
+        rvThreshold_Free(self->threshold);
+        rvMemPool_Free(self->scratch);
+        rvProfile_Free(self->profile);
+        rvPose_Free(self->pose);
+        for (i = 0; i < RVGRID_MAX_PYRAMID_LEVELS; ++i)
+        {
+            cvReleaseImage(&self->pyramidImages[i]);
+            cvReleaseImage(&self->pyramidEdges[i]);
+        }
+
+        // Free this object.
+        free(self);
+    }
+}
+
+
+bool rvGrid_ResetIntrinsics(rvGrid *self)
+// Reset the camera intrinsics.
+{
+    // Reset camera and distortion matrix to identity.
+    cvSetIdentity(self->cameraMatrix, cvRealScalar(1));
+    cvSetIdentity(self->distortionCoeffs, cvRealScalar(1));
+
+    return true;
+}
+
+
+bool rvGrid_LoadIntrinsics(rvGrid *self, const char *filepath)
+// Load the camera intrinsics.
+{
+    CvMat *cameraMatrix;
+    CvMat *distortionCoeffs;
+    CvFileStorage *fileStore = NULL;
+
+    // Open the file storage.
+    fileStore = cvOpenFileStorage(filepath, NULL, CV_STORAGE_READ );
+
+    // Did we open the file storage?
+    if (!fileStore) return false;
+
+    // Get the camera matrix and distortion coefficients.  These objects are allocated
+    // in temporary storate which is freed when the file store is released.
+    cameraMatrix = (CvMat *) cvReadByName(fileStore, NULL, "CameraMatrix", NULL);
+    distortionCoeffs = (CvMat *) cvReadByName(fileStore, NULL, "DistortionCoeffs", NULL);
+
+    // Set the camera matrix and distortion coeffs.
+    rvGrid_SetCameraMatrix(self, cameraMatrix);
+    rvGrid_SetDistortionCoeffs(self, distortionCoeffs);
+
+    // Release the file store.
+    cvReleaseFileStorage(&fileStore);
+
+    // We succeeded.
+    return true;
+}
+
+bool rvGrid_SaveIntrinsics(rvGrid *self, const char *filepath)
+// Save the camera intrinsics.
+{
+    CvMat *cameraMatrix;
+    CvMat *distortionCoeffs;
+    CvFileStorage *fileStore;
+
+    // Get the camera information.
+    rvGrid_GetCameraMatrix(self, &cameraMatrix);
+    rvGrid_GetDistortionCoeffs(self, &distortionCoeffs);
+
+    // Open the file store at the indicated path.
+    fileStore = cvOpenFileStorage(filepath, 0, CV_STORAGE_WRITE);
+
+    // Did we open the file storage?
+    if (!fileStore) return false;
+
+    // Write the camera matrix.
+    cvWrite(fileStore, "CameraMatrix", cameraMatrix, cvAttrList(0,0));
+
+    // Write the distortion matrix.
+    cvWrite(fileStore, "DistortionCoeffs", distortionCoeffs, cvAttrList(0,0));
+
+    // Close the file store.
+    cvReleaseFileStorage(&fileStore);
+
+    // Release the camera information.
+    cvReleaseMat(&cameraMatrix);
+    cvReleaseMat(&distortionCoeffs);
+
+    // Return success.
+    return true;
+}
+
+int rvGrid_GetDisplay(rvGrid *self)
+{
+    return self->display;
+}
 
 
 int rvGrid_GetEdgeMethod(rvGrid *self)
@@ -766,6 +1932,187 @@ int rvGrid_GetAdaptiveSubtraction(rvGrid *self)
 }
 
 
+int rvGrid_GetThreadCount(rvGrid *self)
+{
+    return self->threadCount;
+}
+
+
+int rvGrid_GetTileSize(rvGrid *self)
+{
+    return self->tileSize;
+}
+
+
+int rvGrid_GetTileOverlap(rvGrid *self)
+{
+    return self->tileOverlap;
+}
+
+
+int rvGrid_GetDecodeMethod(rvGrid *self)
+{
+    return self->decodeMethod;
+}
+
+
+int rvGrid_GetDecodeMaxBitErrors(rvGrid *self)
+{
+    return self->decodeMaxBitErrors;
+}
+
+
+void rvGrid_GetActiveTags(rvGrid *self, rvTagSet *activeTags)
+// Copy the set of tag ids accepted by the decoder.
+{
+    rvTagSet_Copy(activeTags, self->activeTags);
+}
+
+
+int rvGrid_GetTrackInterval(rvGrid *self)
+{
+    return self->trackInterval;
+}
+
+
+int rvGrid_GetPyramidLevels(rvGrid *self)
+{
+    return self->pyramidLevels;
+}
+
+
+int rvGrid_GetQuadMethod(rvGrid *self)
+{
+    return self->quadMethod;
+}
+
+
+int rvGrid_GetCandidateCount(rvGrid *self)
+// Get the number of candidates found in the last image.
+{
+    return self->candidateCount;
+}
+
+
+int rvGrid_GetRejectCount(rvGrid *self, int stage)
+// Get the number of candidates in the last image rejected at the stage of the
+// rejection cascade.  The count for RVGRID_REJECT_NONE is the decoded candidates.
+{
+    // Sanity check the stage.
+    if ((stage < 0) || (stage >= RVGRID_REJECT_COUNT)) return 0;
+
+    return self->rejectCounts[stage];
+}
+
+
+int rvGrid_GetAllocCount(rvGrid *self)
+// Get the number of buffers allocated from the heap while processing images.
+// The buffers are kept between images so the count stops increasing once the
+// settings stop changing.
+{
+    return self->allocCount + rvMemPool_GetAllocCount(self->scratch);
+}
+
+
+int rvGrid_GetStorageBudget(rvGrid *self)
+{
+    return self->storageBudget;
+}
+
+
+int rvGrid_GetMaxContours(rvGrid *self)
+{
+    return self->maxContours;
+}
+
+
+int rvGrid_GetPoseIterations(rvGrid *self)
+{
+    return self->poseIterations;
+}
+
+
+int rvGrid_GetPoseThreshold(rvGrid *self)
+{
+    return self->poseThreshold;
+}
+
+
+int rvGrid_GetStorageHighWater(rvGrid *self)
+// Get the most contour storage in bytes used by any context in an image.
+{
+    int i;
+    int highWater = 0;
+
+    for (i = 0; i < self->contextCount; ++i)
+    {
+        int contextHighWater = rvStorage_GetHighWater(self->contexts[i]->storage);
+
+        if (contextHighWater > highWater) highWater = contextHighWater;
+    }
+
+    return highWater;
+}
+
+
+int rvGrid_GetStorageTruncations(rvGrid *self)
+// Get the number of images in which finding or processing contours was cut
+// short by the storage budget or contour limit of a context.
+{
+    return self->storageTruncations;
+}
+
+
+int rvGrid_GetStageCount(rvGrid *self, int stage)
+// Get the number of pixels, contours or candidates processed by the stage in
+// the last image.
+{
+    // Sanity check the stage.
+    if ((stage < 0) || (stage >= RVGRID_STAGE_COUNT)) return 0;
+
+    return self->stageCounts[stage];
+}
+
+
+double rvGrid_GetStageTime(rvGrid *self, int stage)
+// Get the microseconds taken by the stage in the last image.
+{
+    return rvProfile_GetLast(self->profile, stage);
+}
+
+
+double rvGrid_GetStagePercentile(rvGrid *self, int stage, double percentile)
+// Get the microseconds taken by the stage which the percentile of the recent
+// images did not exceed.  A percentile of 50.0 gives the median and 99.0 the
+// time exceeded by one image in a hundred.
+{
+    return rvProfile_GetPercentile(self->profile, stage, percentile);
+}
+
+
+void rvGrid_ResetProfile(rvGrid *self)
+// Discard the stage times of the recent images.
+{
+    rvProfile_Reset(self->profile);
+}
+
+
+int rvGrid_GetRegionCount(rvGrid *self)
+{
+    return self->regionCount;
+}
+
+
+void rvGrid_GetRegions(rvGrid *self, CvRect *regions)
+// Copy the regions of interest into the array which must have room for the
+// region count.
+{
+    int i;
+
+    for (i = 0; i < self->regionCount; ++i) regions[i] = self->regions[i];
+}
+
+
 bool rvGrid_GetDrawRawContours(rvGrid *self)
 {
     return self->drawRawContours;
@@ -881,6 +2228,202 @@ void rvGrid_SetAdaptiveSubtraction(rvGrid *self, int adaptiveSubtraction)
 }
 
 
+void rvGrid_SetThreadCount(rvGrid *self, int threadCount)
+{
+    // Sanity check and set the thread count value.
+    if ((threadCount >= 0) && (threadCount <= RVGRID_MAX_THREADS) && (threadCount != self->threadCount))
+    {
+        self->threadCount = threadCount;
+
+        // The task pool is created again with the new thread count when needed.
+        rvTaskPool_Free(self->taskPool);
+        self->taskPool = NULL;
+    }
+}
+
+
+void rvGrid_SetTileSize(rvGrid *self, int tileSize)
+{
+    // Sanity check and set the tile size value.  Zero disables tiling.
+    if ((tileSize == 0) || ((tileSize >= 64) && (tileSize <= 4096))) self->tileSize = tileSize;
+}
+
+
+void rvGrid_SetTileOverlap(rvGrid *self, int tileOverlap)
+{
+    // Sanity check and set the tile overlap value.
+    if ((tileOverlap >= 0) && (tileOverlap <= 1024)) self->tileOverlap = tileOverlap;
+}
+
+
+void rvGrid_SetDecodeMethod(rvGrid *self, int decodeMethod)
+{
+    int i;
+
+    // Sanity check and set the decode method value.
+    if ((decodeMethod >= 0) && (decodeMethod < RVGRID_DECODE_COUNT))
+    {
+        self->decodeMethod = decodeMethod;
+
+        // Update the decoder of each processing context.
+        for (i = 0; i < self->contextCount; ++i) rvGrid_SetContextDecodeMethod(self, self->contexts[i]);
+    }
+}
+
+
+void rvGrid_SetDecodeMaxBitErrors(rvGrid *self, int decodeMaxBitErrors)
+{
+    int i;
+
+    // Sanity check and set the decode maximum bit errors value.
+    if ((decodeMaxBitErrors >= 0) && (decodeMaxBitErrors <= RVGRID_MAX_BIT_ERRORS))
+    {
+        self->decodeMaxBitErrors = decodeMaxBitErrors;
+
+        // Update the decoder of each processing context.
+        for (i = 0; i < self->contextCount; ++i) rvGrid_SetContextDecodeMethod(self, self->contexts[i]);
+    }
+}
+
+
+bool rvGrid_SetActiveTags(rvGrid *self, rvTagSet *activeTags)
+// Restrict decoding to the tag ids in the set.  The codebook is rebuilt to
+// hold only the active tags so lookups are faster and ids which are not in
+// use are never reported.  Returns false if the codebook could not be created
+// in which case the previous set remains active.
+{
+    int i;
+    rvCodebook *codebook;
+
+    // Create a codebook for the active tags.
+    codebook = rvGrid_NewCodebook(activeTags);
+    if (codebook == NULL) return false;
+
+    // Save the active tags.
+    rvTagSet_Copy(self->activeTags, activeTags);
+
+    // Update the decoder of each processing context.
+    for (i = 0; i < self->contextCount; ++i) rvTag_SetCodebook(self->contexts[i]->tag, codebook);
+
+    // Replace the previous codebook.
+    rvCodebook_Free(self->codebook);
+    self->codebook = codebook;
+
+    return true;
+}
+
+
+void rvGrid_SetTrackInterval(rvGrid *self, int trackInterval)
+{
+    // Sanity check and set the track interval value.  Zero disables tracking.
+    if ((trackInterval >= 0) && (trackInterval <= RVGRID_MAX_TRACK_INTERVAL)) self->trackInterval = trackInterval;
+}
+
+
+void rvGrid_SetPyramidLevels(rvGrid *self, int pyramidLevels)
+{
+    // Sanity check and set the pyramid levels value.  Zero finds candidates in the full image.
+    if ((pyramidLevels >= 0) && (pyramidLevels <= RVGRID_MAX_PYRAMID_LEVELS)) self->pyramidLevels = pyramidLevels;
+}
+
+
+void rvGrid_SetQuadMethod(rvGrid *self, int quadMethod)
+// Black components are only found with the threshold edge methods.  Contours
+// are found with the other edge methods whichever method is set.
+{
+    // Sanity check and set the method used to find the candidates.
+    if ((quadMethod >= 0) && (quadMethod < RVGRID_QUAD_COUNT)) self->quadMethod = quadMethod;
+}
+
+
+bool rvGrid_SetStorageBudget(rvGrid *self, int storageBudget)
+// Set the bytes of contour storage reserved for each context.  Returns false if
+// the storage could not be reserved.
+{
+    int i;
+    bool rv = true;
+
+    // Sanity check and set the storage budget value.
+    if ((storageBudget < RVSTORAGE_MIN_BUDGET) || (storageBudget > RVSTORAGE_MAX_BUDGET)) return false;
+    self->storageBudget = storageBudget;
+
+    // Reserve the storage of each context.  This clears the contours of the
+    // last image.
+    for (i = 0; i < self->contextCount; ++i)
+    {
+        rvGrid_ResetContext(self->contexts[i]);
+        if (!rvStorage_SetBudget(self->contexts[i]->storage, storageBudget)) rv = false;
+    }
+
+    return rv;
+}
+
+
+void rvGrid_SetMaxContours(rvGrid *self, int maxContours)
+{
+    int i;
+
+    // Sanity check and set the maximum contours value.
+    if ((maxContours >= 1) && (maxContours <= RVSTORAGE_MAX_CONTOURS))
+    {
+        self->maxContours = maxContours;
+
+        // Set the limit of each context.
+        for (i = 0; i < self->contextCount; ++i) rvStorage_SetMaxContours(self->contexts[i]->storage, maxContours);
+    }
+}
+
+
+void rvGrid_SetPoseIterations(rvGrid *self, int poseIterations)
+{
+    // Sanity check and set the pose iterations value.  Zero solves each pose from scratch.
+    if ((poseIterations >= 0) && (poseIterations <= RVGRID_MAX_POSE_ITERATIONS)) self->poseIterations = poseIterations;
+}
+
+
+void rvGrid_SetPoseThreshold(rvGrid *self, int poseThreshold)
+{
+    // Sanity check and set the pose threshold value.  Zero fits the pose to every tag.
+    if ((poseThreshold >= 0) && (poseThreshold <= RVGRID_MAX_POSE_THRESHOLD)) self->poseThreshold = poseThreshold;
+}
+
+
+bool rvGrid_SetRegions(rvGrid *self, CvRect *regions, int count)
+// Restrict processing to the regions of interest.  Gray scale conversion, edge
+// detection and contour finding only run inside the regions.  The regions are
+// clipped to the image and regions outside the image are dropped.  A count of
+// zero processes the whole image.  Returns false if there are too many regions.
+{
+    int i;
+    int left;
+    int top;
+    int right;
+    int bottom;
+
+    // Sanity check the arguments.
+    if ((count < 0) || (count > RVGRID_MAX_REGIONS)) return false;
+
+    // Clip and save each region.
+    self->regionCount = 0;
+    for (i = 0; i < count; ++i)
+    {
+        left = regions[i].x > 0 ? regions[i].x : 0;
+        top = regions[i].y > 0 ? regions[i].y : 0;
+        right = regions[i].x + regions[i].width;
+        bottom = regions[i].y + regions[i].height;
+        if (right > self->imageSize.width) right = self->imageSize.width;
+        if (bottom > self->imageSize.height) bottom = self->imageSize.height;
+
+        // Skip regions outside the image.
+        if ((right <= left) || (bottom <= top)) continue;
+
+        self->regions[self->regionCount++] = cvRect(left, top, right - left, bottom - top);
+    }
+
+    return true;
+}
+
+
 void rvGrid_SetDrawRawContours(rvGrid *self, bool value)
 {
     self->drawRawContours = value;
@@ -1017,84 +2560,226 @@ bool rvGrid_GetCameraPositionMatrix(rvGrid *self, CvMat **cameraPositionMatrix)
 }
 
 
+bool rvGrid_GetPoseCovariance(rvGrid *self, CvMat **poseCovariance)
+// Get a clone of the 6x6 covariance matrix of the camera pose.  The returned
+// matrix must be freed.  The parameters are a small rotation vector applied
+// after the rotation vector's rotation, so in the camera frame, followed by the
+// translation vector.  The matrix is zero if no camera pose was found.
+{
+    // Clone the pose covariance matrix.
+    *poseCovariance = cvCloneMat(self->poseCovariance);
+
+    return true;
+}
+
+
+double rvGrid_GetPoseError(rvGrid *self)
+// Get the RMS reprojection error in pixels of the corners of the navigation
+// tags used to find the camera pose, or -1 if no camera pose was found.
+{
+    return self->poseError;
+}
+
+
+int rvGrid_GetNavTagCount(rvGrid *self)
+// Get the number of navigation tags found in the last image.
+{
+    return self->navTagCount;
+}
+
+
+int rvGrid_GetNavTagId(rvGrid *self, int index)
+// Get the id of the navigation tag.
+{
+    // Sanity check the index.
+    if ((index < 0) || (index >= self->navTagCount)) return -1;
+
+    return self->navTags[index].id;
+}
+
+
+bool rvGrid_GetNavTagInlier(rvGrid *self, int index)
+// Get whether the navigation tag agrees with the camera pose.  Tags which
+// don't agree were left out when finding the camera pose.
+{
+    // Sanity check the index.
+    if ((index < 0) || (index >= self->navTagCount)) return false;
+
+    return self->navTags[index].inlier;
+}
+
+
+double rvGrid_GetNavTagResidual(rvGrid *self, int index)
+// Get the RMS reprojection error in pixels of the corners of the navigation tag
+// under the camera pose, or -1 if no camera pose was found.
+{
+    // Sanity check the index.
+    if ((index < 0) || (index >= self->navTagCount)) return -1.0;
+
+    return self->navTags[index].residual;
+}
+
+
+int rvGrid_GetNavTagBitErrors(rvGrid *self, int index)
+// Get the number of bits of the navigation tag which were read in error and
+// corrected when decoding it.
+{
+    // Sanity check the index.
+    if ((index < 0) || (index >= self->navTagCount)) return -1;
+
+    return self->navTags[index].bitErrors;
+}
+
+
+int rvGrid_GetObjTagBitErrors(rvGrid *self, int index)
+// Get the number of bits of the object tag which were read in error and
+// corrected when decoding it.
+{
+    // Sanity check the index.
+    if ((index < 0) || (index >= self->objTagCount)) return -1;
+
+    return self->objTags[index].bitErrors;
+}
+
+
+int rvGrid_GetCharTagBitErrors(rvGrid *self, int index)
+// Get the number of bits of the character tag which were read in error and
+// corrected when decoding it.
+{
+    // Sanity check the index.
+    if ((index < 0) || (index >= self->charTagCount)) return -1;
+
+    return self->charTags[index].bitErrors;
+}
+
+
+int rvGrid_GetInlierCount(rvGrid *self)
+// Get the number of navigation tags which agree with the camera pose.
+{
+    return self->inlierCount;
+}
+
+
 bool rvGrid_CameraPosition(rvGrid *self)
-// Calculates the position from the current set of tag information.
+// Calculates the position from the current set of tag information.  If the pose
+// threshold is set, tags which don't agree with the other tags are left out.
 {
     int i;
-    CvMat tagPoints2d;
-    CvMat tagPoints3d;
-    CvMat extrinsicMatrix;
-    double *tagPoints2dData;
-    double *tagPoints3dData;
-    double extrinsicData[16];
-
-    // Assume we failed.
+    int count = self->navTagCount * RVTAG_CORNER_COUNT;
+    bool guess;
+    bool *inliers;
+    double *residuals;
+    CvMat rotationVector;
+    CvMat translationVector;
+    CvMat positionMatrix;
+    CvMat covarianceMatrix;
+    CvPoint2D32f *imagePoints;
+    CvPoint3D32f *objectPoints;
+    double rotationData[3];
+    double translationData[3];
+    double positionData[16];
+    double covarianceData[36];
+
+    // Assume we failed and clear the results of the previous image.
     self->results = false;
+    self->inlierCount = 0;
+    self->poseError = -1.0;
+    cvSetZero(self->poseCovariance);
+    for (i = 0; i < self->navTagCount; ++i)
+    {
+        self->navTags[i].inlier = false;
+        self->navTags[i].residual = -1.0;
+    }
 
     // Make sure we have some navigation tags to process.
     if (self->navTagCount == 0) return false;
 
-    // Allocate the data for the 2D and 3D points on the stack.
-    tagPoints2dData = (double *) _alloca(sizeof(double) * self->navTagCount * 4 * 2);
-    tagPoints3dData = (double *) _alloca(sizeof(double) * self->navTagCount * 4 * 3);
+    // Allocate the packed 2D and 3D points and the result for each tag from the scratch memory.
+    imagePoints = (CvPoint2D32f *) rvMemPool_Alloc(self->scratch, sizeof(CvPoint2D32f) * count);
+    objectPoints = (CvPoint3D32f *) rvMemPool_Alloc(self->scratch, sizeof(CvPoint3D32f) * count);
+    inliers = (bool *) rvMemPool_Alloc(self->scratch, sizeof(bool) * self->navTagCount);
+    residuals = (double *) rvMemPool_Alloc(self->scratch, sizeof(double) * self->navTagCount);
+    if ((imagePoints == NULL) || (objectPoints == NULL) || (inliers == NULL) || (residuals == NULL)) return false;
 
-    // Initialize the matrices used by this function.
-    cvInitMatHeader(&tagPoints2d, self->navTagCount * 4, 2, CV_64FC1, tagPoints2dData, CV_AUTOSTEP);
-    cvInitMatHeader(&tagPoints3d, self->navTagCount * 4, 3, CV_64FC1, tagPoints3dData, CV_AUTOSTEP);
-    cvInitMatHeader(&extrinsicMatrix, 4, 4, CV_64FC1, extrinsicData, CV_AUTOSTEP);
-
-    // Set the position of each corner in the image.
+    // Pack the corners of each tag in the image and on the grid.
     for (i = 0; i < self->navTagCount; ++i)
     {
-        rvGridNavTag *navTag;
-        CvPoint3D32f corners[RVTAG_CORNER_COUNT];
+        rvGridNavTag *navTag = &self->navTags[i];
 
-        // Point to the indexed navigation tag information.
-        navTag = &self->navTags[i];
+        memcpy(&imagePoints[i * RVTAG_CORNER_COUNT], navTag->corners, sizeof(navTag->corners));
+        rvTags384_GetCorners(navTag->id, &objectPoints[i * RVTAG_CORNER_COUNT]);
+    }
+
+    // Point to the rotation and translation vectors as arrays.
+    cvInitMatHeader(&rotationVector, 1, 3, CV_64FC1, rotationData, CV_AUTOSTEP);
+    cvInitMatHeader(&translationVector, 1, 3, CV_64FC1, translationData, CV_AUTOSTEP);
 
-        // Set the 2D position of the tag in the image.
-        cvSetReal2D(&tagPoints2d, (i << 2), 0, navTag->corners[0].x);
-        cvSetReal2D(&tagPoints2d, (i << 2), 1, navTag->corners[0].y);
-        cvSetReal2D(&tagPoints2d, (i << 2) + 1, 0, navTag->corners[1].x);
-        cvSetReal2D(&tagPoints2d, (i << 2) + 1, 1, navTag->corners[1].y);
-        cvSetReal2D(&tagPoints2d, (i << 2) + 2, 0, navTag->corners[2].x);
-        cvSetReal2D(&tagPoints2d, (i << 2) + 2, 1, navTag->corners[2].y);
-        cvSetReal2D(&tagPoints2d, (i << 2) + 3, 0, navTag->corners[3].x);
-        cvSetReal2D(&tagPoints2d, (i << 2) + 3, 1, navTag->corners[3].y);
+    // The camera barely moves between images so start from the pose of the
+    // previous image if tracking the pose.
+    rvPose_SetIntrinsics(self->pose, self->cameraMatrix, self->distortionCoeffs);
+    guess = self->posed && (self->poseIterations > 0);
+    if (guess)
+    {
+        cvCopy(self->rotationVector, &rotationVector, NULL);
+        cvCopy(self->translationVector, &translationVector, NULL);
+    }
+
+    // Should we leave out the tags which don't agree?
+    if (self->poseThreshold > 0)
+    {
+        // Refine the previous pose against the tags which agree with it and
+        // fall back to finding the pose which the most tags agree with if the
+        // same tags don't agree once it is refined or it doesn't fit them.
+        self->inlierCount = !guess ? 0 :
+                            rvPose_RefineRobust(self->pose, objectPoints, imagePoints, self->navTagCount, RVTAG_CORNER_COUNT,
+                                                self->poseThreshold, self->poseIterations, rotationData, translationData, inliers, residuals);
+        if ((self->inlierCount == 0) || (rvPose_GetError(self->pose) > RVGRID_MAX_POSE_ERROR))
+        {
+            self->inlierCount = rvPose_SolveRobust(self->pose, objectPoints, imagePoints, self->navTagCount, RVTAG_CORNER_COUNT,
+                                                   self->poseThreshold, rotationData, translationData, inliers, residuals);
+        }
+        self->posed = self->inlierCount > 0;
+        if (!self->posed) return false;
+    }
+    else
+    {
+        // Refine the previous pose and fall back to solving for the pose from
+        // scratch if the refined pose doesn't fit the tags.
+        self->posed = guess &&
+                      rvPose_Refine(self->pose, objectPoints, imagePoints, count, rotationData, translationData, self->poseIterations) &&
+                      (rvPose_GetError(self->pose) <= RVGRID_MAX_POSE_ERROR);
 
-        // Get the 3D position of the corners of the tag in the grid.
-        rvTags384_GetCorners(navTag->id, corners);
+        // Find the extrinsic camera parameters for the particular view.
+        if (!self->posed && !rvPose_Solve(self->pose, objectPoints, imagePoints, count, rotationData, translationData)) return false;
+        self->posed = true;
 
-        // Set the 3D position of the tag corner on the grid.
-        cvSetReal2D(&tagPoints3d, (i << 2), 0, corners[0].x);
-        cvSetReal2D(&tagPoints3d, (i << 2), 1, corners[0].y);
-        cvSetReal2D(&tagPoints3d, (i << 2), 2, corners[0].z);
-        cvSetReal2D(&tagPoints3d, (i << 2) + 1, 0, corners[1].x);
-        cvSetReal2D(&tagPoints3d, (i << 2) + 1, 1, corners[1].y);
-        cvSetReal2D(&tagPoints3d, (i << 2) + 1, 2, corners[1].z);
-        cvSetReal2D(&tagPoints3d, (i << 2) + 2, 0, corners[2].x);
-        cvSetReal2D(&tagPoints3d, (i << 2) + 2, 1, corners[2].y);
-        cvSetReal2D(&tagPoints3d, (i << 2) + 2, 2, corners[2].z);
-        cvSetReal2D(&tagPoints3d, (i << 2) + 3, 0, corners[3].x);
-        cvSetReal2D(&tagPoints3d, (i << 2) + 3, 1, corners[3].y);
-        cvSetReal2D(&tagPoints3d, (i << 2) + 3, 2, corners[3].z);
-    }
-
-    // Initialize the translation and rotation vectors to identity.
-    cvSetIdentity(self->rotationVector, cvRealScalar(1));
-    cvSetIdentity(self->translationVector, cvRealScalar(1));
-
-    // Find the extrinsic camera parameters for the particular view.
-    // The rotation and translation vectors are filled in by this function.
-    cvFindExtrinsicCameraParams2(&tagPoints3d, &tagPoints2d,
-                                 self->cameraMatrix, self->distortionCoeffs,
-                                 self->rotationVector, self->translationVector);
-
-    // Convert the output vectors into matrix form to create the extrinsic matrix.
-    cvVectorsToMatrix(self->rotationVector, self->translationVector, &extrinsicMatrix);
-
-    // Invert the extrinsic matrix to get the camera position matrix.
-    cvInvert(&extrinsicMatrix, self->cameraPositionMatrix, CV_LU);
+        // Every tag is used.
+        rvPose_GetGroupErrors(self->pose, objectPoints, imagePoints, self->navTagCount, RVTAG_CORNER_COUNT, rotationData, translationData, residuals);
+        for (i = 0; i < self->navTagCount; ++i) inliers[i] = true;
+        self->inlierCount = self->navTagCount;
+    }
+
+    // Keep the reprojection error and covariance of the pose.
+    self->poseError = rvPose_GetError(self->pose);
+    rvPose_GetCovariance(self->pose, covarianceData);
+    cvInitMatHeader(&covarianceMatrix, 6, 6, CV_64FC1, covarianceData, CV_AUTOSTEP);
+    cvCopy(&covarianceMatrix, self->poseCovariance, NULL);
+
+    // Keep the result for each tag.
+    for (i = 0; i < self->navTagCount; ++i)
+    {
+        self->navTags[i].inlier = inliers[i];
+        self->navTags[i].residual = residuals[i];
+    }
+
+    // Copy the rotation and translation vectors.
+    cvCopy(&rotationVector, self->rotationVector, NULL);
+    cvCopy(&translationVector, self->translationVector, NULL);
+
+    // The camera position matrix is the inverse of the extrinsic matrix.
+    rvPose_GetInverseMatrix(rotationData, translationData, positionData);
+    cvInitMatHeader(&positionMatrix, 4, 4, CV_64FC1, positionData, CV_AUTOSTEP);
+    cvCopy(&positionMatrix, self->cameraPositionMatrix, NULL);
 
     // We succeeded.
     self->results = true;
@@ -1104,136 +2789,170 @@ bool rvGrid_CameraPosition(rvGrid *self)
 
 
 bool rvGrid_ObjectPositions(rvGrid *self)
-// Calculates the position of objects.
+// Calculates the position of objects.  Objects whose position can't be found
+// are removed from the object tags.
 {
     int i;
-    CvMat tagPoints2d;
-    CvMat tagPoints3d;
-    double tagPoints2dData[8];
-    double tagPoints3dData[12];
+    int count = 0;
+    int tagCount = self->objTagCount;
+    CvPoint2D32f (*imagePoints)[RVTAG_CORNER_COUNT];
+    CvPoint3D32f (*objectPoints)[RVTAG_CORNER_COUNT];
+    double (*rotationVectors)[3];
+    double (*translationVectors)[3];
+    double (*positionMatrices)[16];
+    bool *solved;
 
     // Make sure we have some object tags to process.
-    if (self->objTagCount == 0) return false;
-
-    // Initialize the matrices used by this function.
-    cvInitMatHeader(&tagPoints2d, 4, 2, CV_64FC1, tagPoints2dData, CV_AUTOSTEP);
-    cvInitMatHeader(&tagPoints3d, 4, 3, CV_64FC1, tagPoints3dData, CV_AUTOSTEP);
-
-    // Loop over each object and calculate its relative position.
-    for (i = 0; i < self->objTagCount; ++i)
+    if (tagCount == 0) return false;
+
+    // Allocate the packed corners and poses of the tags from the scratch memory.
+    imagePoints = (CvPoint2D32f (*)[RVTAG_CORNER_COUNT]) rvMemPool_Alloc(self->scratch, sizeof(*imagePoints) * tagCount);
+    objectPoints = (CvPoint3D32f (*)[RVTAG_CORNER_COUNT]) rvMemPool_Alloc(self->scratch, sizeof(*objectPoints) * tagCount);
+    rotationVectors = (double (*)[3]) rvMemPool_Alloc(self->scratch, sizeof(*rotationVectors) * tagCount);
+    translationVectors = (double (*)[3]) rvMemPool_Alloc(self->scratch, sizeof(*translationVectors) * tagCount);
+    positionMatrices = (double (*)[16]) rvMemPool_Alloc(self->scratch, sizeof(*positionMatrices) * tagCount);
+    solved = (bool *) rvMemPool_Alloc(self->scratch, sizeof(bool) * tagCount);
+    if ((imagePoints == NULL) || (objectPoints == NULL) || (rotationVectors == NULL) ||
+        (translationVectors == NULL) || (positionMatrices == NULL) || (solved == NULL)) return false;
+
+    // Pack the corners of each tag in the image and on the tag.
+    for (i = 0; i < tagCount; ++i)
     {
-        rvGridObjTag *objTag;
-        CvPoint3D32f corners[RVTAG_CORNER_COUNT];
-
-        // Point to the indexed object tag information.
-        objTag = &self->objTags[i];
+        memcpy(imagePoints[i], self->objTags[i].corners, sizeof(self->objTags[i].corners));
+        rvTags384_GetCorners(self->objTags[i].id, objectPoints[i]);
+    }
 
-        // Set the 2D position of the tag in the image.
-        cvSetReal2D(&tagPoints2d, 0, 0, objTag->corners[0].x);
-        cvSetReal2D(&tagPoints2d, 0, 1, objTag->corners[0].y);
-        cvSetReal2D(&tagPoints2d, 1, 0, objTag->corners[1].x);
-        cvSetReal2D(&tagPoints2d, 1, 1, objTag->corners[1].y);
-        cvSetReal2D(&tagPoints2d, 2, 0, objTag->corners[2].x);
-        cvSetReal2D(&tagPoints2d, 2, 1, objTag->corners[2].y);
-        cvSetReal2D(&tagPoints2d, 3, 0, objTag->corners[3].x);
-        cvSetReal2D(&tagPoints2d, 3, 1, objTag->corners[3].y);
+    // Find the extrinsic parameters of every tag in the view together.
+    rvPose_SetIntrinsics(self->pose, self->cameraMatrix, self->distortionCoeffs);
+    rvPose_SolveTags(self->pose, (const CvPoint3D32f (*)[RVTAG_CORNER_COUNT]) objectPoints, (const CvPoint2D32f (*)[RVTAG_CORNER_COUNT]) imagePoints,
+                     tagCount, rotationVectors, translationVectors, positionMatrices, solved);
 
-        // Get the 3D position of the corners of the tag in the grid.
-        rvTags384_GetCorners(objTag->id, corners);
+    // Copy the position of each solved tag.
+    for (i = 0; i < tagCount; ++i)
+    {
+        rvGridObjTag *objTag = &self->objTags[i];
+        rvGridObjTag *keptTag = &self->objTags[count];
 
-        // Set the 3D position of the tag corner on the grid.
-        cvSetReal2D(&tagPoints3d, 0, 0, corners[0].x);
-        cvSetReal2D(&tagPoints3d, 0, 1, corners[0].y);
-        cvSetReal2D(&tagPoints3d, 0, 2, corners[0].z);
-        cvSetReal2D(&tagPoints3d, 1, 0, corners[1].x);
-        cvSetReal2D(&tagPoints3d, 1, 1, corners[1].y);
-        cvSetReal2D(&tagPoints3d, 1, 2, corners[1].z);
-        cvSetReal2D(&tagPoints3d, 2, 0, corners[2].x);
-        cvSetReal2D(&tagPoints3d, 2, 1, corners[2].y);
-        cvSetReal2D(&tagPoints3d, 2, 2, corners[2].z);
-        cvSetReal2D(&tagPoints3d, 3, 0, corners[3].x);
-        cvSetReal2D(&tagPoints3d, 3, 1, corners[3].y);
-        cvSetReal2D(&tagPoints3d, 3, 2, corners[3].z);
-
-        // Initialize the translation and rotation vectors to identity.
-        cvSetIdentity(&objTag->rotationVector, cvRealScalar(1));
-        cvSetIdentity(&objTag->translationVector, cvRealScalar(1));
+        if (!solved[i]) continue;
 
-        // Find the extrinsic camera parameters for the particular view.
-        // The rotation and translation vectors are filled in by this function.
-        cvFindExtrinsicCameraParams2(&tagPoints3d, &tagPoints2d,
-                                     self->cameraMatrix, self->distortionCoeffs,
-                                     &objTag->rotationVector, &objTag->translationVector);
+        // Move the tag down over any removed tags.  The matrix headers of
+        // each tag point to its own data so only the values are moved.
+        if (keptTag != objTag)
+        {
+            keptTag->id = objTag->id;
+            memcpy(keptTag->corners, objTag->corners, sizeof(objTag->corners));
+            keptTag->bitErrors = objTag->bitErrors;
+        }
 
-        // Convert the output vectors into matrix form to create the extrinsic matrix.
-        cvVectorsToMatrix(&objTag->rotationVector, &objTag->translationVector, &objTag->positionMatrix);
+        memcpy(keptTag->rotationData, rotationVectors[i], sizeof(keptTag->rotationData));
+        memcpy(keptTag->translationData, translationVectors[i], sizeof(keptTag->translationData));
+        memcpy(keptTag->positionData, positionMatrices[i], sizeof(keptTag->positionData));
+        ++count;
     }
 
-    return true;
+    self->objTagCount = (rvUint16) count;
+
+    return count > 0;
 }
 
 
 bool rvGrid_ProcessImage(rvGrid *self, IplImage *image)
 // Process the indicated image to obtain the position.
 {
-    int blur;
-    CvSeq *contours = NULL;
-    CvPoint2D32f reference[8];
-    CvPoint2D32f samples[RVTAG_SAMPLE_COUNT];
-    CvPoint2D32f corners[RVTAG_CORNER_COUNT];
-    rvUint8 tagSamples[RVTAG_SAMPLE_COUNT];
+    int i;
+    int j;
+    bool tiled = false;
+    bool tracked;
+    bool convert;
+    bool fuse;
+    bool positioned;
     bool rv = false;
+    rvUint64 frameStart = rvProfile_GetTicks();
+    rvUint64 start;
+    CvRect whole = cvRect(0, 0, self->imageSize.width, self->imageSize.height);
 
-    // Clear the memory storage.
-    cvClearMemStorage(self->memStorage);
+    // Release the scratch memory used by the previous image and count the blocks
+    // allocated for it.
+    self->allocCount += rvMemPool_GetAllocCount(self->scratch);
+    rvMemPool_Reset(self->scratch);
 
-    // Convert the image to gray scale.
-    cvCvtColor(image, self->grayImage, CV_RGB2GRAY);
+    // Reset the processing contexts and their stage totals.
+    for (i = 0; i < self->contextCount; ++i)
+    {
+        rvGrid_ResetContext(self->contexts[i]);
+        rvGrid_ResetStages(self->contexts[i]);
+    }
 
-    // Adjust the blur to prevent passing in an even number.  If the number is
-    // not zero and even, the number is rounded down the previous negative number.
-    blur = self->gaussianBlur < 1 ? 0 : (((self->gaussianBlur - 1) / 2) * 2) + 1;
+    // Only the searched regions are converted to gray scale when regions of
+    // interest are set unless the gray image is displayed.
+    convert = (self->regionCount > 0) && (self->display != RVGRID_DISPLAY_GRAY);
 
-    // Smooth the gray scale image.
-    if (blur) cvSmooth(self->grayImage, self->grayImage, CV_GAUSSIAN, blur, 0, 0.0, 0.0);
+    // The whole image is converted to gray scale and edges in a single pass if
+    // it is searched with the fused threshold.  This is left until the tags are
+    // known not to be tracked, so until then only the tracked regions are
+    // converted to gray scale.
+    fuse = !convert && (self->pyramidLevels == 0) && (self->edgeMethod == RVGRID_EDGE_FUSED) &&
+           (self->display != RVGRID_DISPLAY_GRAY);
+
+    // Convert the whole image to gray scale.
+    if (!convert && !fuse) rvGrid_ConvertGray(self, image, whole);
 
     // Should we write the gray image back?
     if (self->display == RVGRID_DISPLAY_GRAY) cvCvtColor(self->grayImage, image, CV_GRAY2RGB);
 
-    // Handle the edge method for creating contours.
-    if (self->edgeMethod == RVGRID_EDGE_CANNY)
-    {
-        // Apply the Canny algorithm for edge detection.
-        cvCanny(self->grayImage, self->edgeImage, 50, 200, 3);
+    // Look for the tags found in the previous frame near their predicted positions.
+    tracked = rvGrid_TrackTags(self, image, convert || fuse);
 
-        // Dialate the edge output to remove holes between edge segments.
-        if (self->edgeDilation) cvDilate(self->edgeImage, self->edgeImage, NULL, self->edgeDilation);
+    // Discard any candidates found if the tags were not all tracked.
+    if (!tracked) rvGrid_ResetContext(self->contexts[0]);
+
+    // Search the regions of interest if the tags were not all tracked.
+    if (!tracked && (self->regionCount > 0))
+    {
+        rvGrid_SearchRegions(self, image, convert);
     }
-    else if (self->edgeMethod == RVGRID_EDGE_SUZAN)
+    else if (!tracked && (self->pyramidLevels > 0) && rvGrid_PreparePyramid(self))
     {
-        // Apply the Suzan algorithm for edge detection.
-        cvSusan(self->grayImage, self->edgeImage, 10, 1);
-
-        // Dialate the edge output to remove holes between edge segments.
-        if (self->edgeDilation) cvDilate(self->edgeImage, self->edgeImage, NULL, self->edgeDilation);
+        // Search the whole image at the lowest pyramid level.
+        rvGrid_SearchPyramid(self, image);
     }
-    else  // Default is adaptive threshold.
+    else if (!tracked)
     {
-        // Adjust the block size to prevent passing in an even number.  If the number is
-        // even, the number is rounded down the previous negative number.
-        int blockSize = self->adaptiveBlockSize <= 1 ? 1 : (((self->adaptiveBlockSize - 1) / 2) * 2) + 1;
+        // Convert the whole image to gray scale and edges in a single pass or
+        // separately if it can't be converted in a single pass.
+        if (!fuse || !rvGrid_ConvertEdges(self, image))
+        {
+            if (fuse) rvGrid_ConvertGray(self, image, whole);
+            rvGrid_FindEdges(self, self->grayImage, self->edgeImage, 0);
+        }
 
-        // Apply the adaptive threshold algorithm for edge detection.
-        cvAdaptiveThreshold(self->grayImage, self->edgeImage, 255.0,
-                            !self->adaptiveMethod ? CV_ADAPTIVE_THRESH_MEAN_C : CV_ADAPTIVE_THRESH_GAUSSIAN_C,
-                            CV_THRESH_BINARY, blockSize, (double) self->adaptiveSubtraction);
-    }
+        // Should we write the edge image back?
+        if (self->display == RVGRID_DISPLAY_EDGE) cvCvtColor(self->edgeImage, image, CV_GRAY2RGB);
 
-    // Should we write the edge image back?
-    if (self->display == RVGRID_DISPLAY_EDGE) cvCvtColor(self->edgeImage, image, CV_GRAY2RGB);
+        // Should the image be split into tiles processed in parallel?
+        tiled = rvGrid_PrepareTiles(self);
+
+        if (tiled)
+        {
+            // Find and decode the candidates in each tile on the worker threads.
+            rvTaskPool_Run(self->taskPool, self->tileCount, rvGrid_TileTask, self);
+        }
+        else
+        {
+            rvGridContext *context = self->contexts[0];
+
+            // Find the candidates in the whole image.
+            self->tileCount = 1;
+            self->tiles[0] = cvRect(0, 0, self->imageSize.width, self->imageSize.height);
+            rvGrid_FindCandidates(self, context, self->edgeImage, self->tiles[0], 0, 0);
+
+            // Decode the candidates.
+            rvGrid_DecodeCandidates(self);
+        }
+    }
 
-    // Convert the edges in the edge image to a sequence of contours.
-    cvFindContours(self->edgeImage, self->memStorage, &contours, sizeof(CvContour), CV_RETR_LIST, CV_CHAIN_APPROX_SIMPLE, cvPoint(0, 0));
+    // Should we write the edges of the searched regions back?
+    if ((self->display == RVGRID_DISPLAY_EDGE) && (tracked || (self->regionCount > 0))) rvGrid_DisplayRegions(self, image);
 
     // Reset the position results.
     self->results = false;
@@ -1242,157 +2961,44 @@ bool rvGrid_ProcessImage(rvGrid *self, IplImage *image)
     self->objTagCount = 0;
     self->navTagCount = 0;
     self->charTagCount = 0;
+    self->inlierCount = 0;
 
-    // Loop over all the countours.
-    while (contours)
-    {
-        int i;
-        int whiteReference;
-        int blackReference;
-        CvSeq *result;
-
-        // Draw the contours found in the image.
-        // if (self->drawRawContours) cvDrawContourArrows(image, contours, CV_RGB(255, 0, 0), CV_RGB(255, 0, 0), 1, 8, 0);
-        if (self->drawRawContours) cvDrawContours(image, contours, CV_RGB(255, 0, 0), CV_RGB(255, 0, 0), 0, 2, 8, cvPoint(0,0));
-
-        // Approximates polygonal curve with precision proportional to the contour perimeter.
-        result = cvApproxPoly(contours, sizeof(CvContour), self->memStorage, CV_POLY_APPROX_DP, cvArcLength(contours, CV_WHOLE_SEQ, 1) * 0.02, 0);
+    // Draw the contours found by each context.
+    start = rvProfile_GetTicks();
+    for (i = 0; i < self->contextCount; ++i) rvGrid_DrawContext(self, image, self->contexts[i]);
 
-        // Draw the polygons within the image.
-        // if (self->drawPolygonContours) cvDrawContourArrows(image, result, CV_RGB(255, 0, 0), CV_RGB(255, 0, 0), 1, 8, 0);
-        if (self->drawPolygonContours) cvDrawContours(image, result, CV_RGB(0, 255, 0), CV_RGB(0, 255, 0), 0, 2, 8, cvPoint(0,0));
+    // Reset the candidate counts.
+    self->candidateCount = 0;
+    memset(self->rejectCounts, 0, sizeof(self->rejectCounts));
 
-        // Square contours should have:
-        //
-        //   o 4 vertices after approximation
-        //   o relatively large area (to filter out noisy contours)
-        //   o and be convex
-        //
-        // Note: Absolute value of an area is used because area may be positive or
-        // negative - in accordance with the contour orientation.
-        if ((result->total == 4) && cvCheckContourConvexity(result) && (fabs(cvContourArea(result, CV_WHOLE_SEQ)) > 500))
+    // Add the candidates to the grid tile by tile and in contour order within each tile
+    // so the results do not depend on which worker processed each tile or candidate.
+    // Tags found in more than one tile, tracked region or region of interest are
+    // added once.
+    for (j = 0; j < self->tileCount; ++j)
+    {
+        for (i = 0; i < self->contextCount; ++i)
         {
-            // Draw the four sided polygons within the image.
-            // if (self->drawQuadContours) cvDrawContourArrows(image, result, CV_RGB(255, 0, 0), CV_RGB(255, 0, 0), 1, 8, 0);
-            if (self->drawQuadContours) cvDrawContours(image, result, CV_RGB(0, 255, 0), CV_RGB(0, 255, 0), 0, 2, 8, cvPoint(0,0));
-
-            // Convert the polygon to an array of corners.
-            corners[0] = cvPointTo32f(*((CvPoint*) cvGetSeqElem(result, 0)));
-            corners[1] = cvPointTo32f(*((CvPoint*) cvGetSeqElem(result, 1)));
-            corners[2] = cvPointTo32f(*((CvPoint*) cvGetSeqElem(result, 2)));
-            corners[3] = cvPointTo32f(*((CvPoint*) cvGetSeqElem(result, 3)));
-
-            // Refine the corner coordinates to sub-pixel values.
-            cvFindCornerSubPix(self->grayImage, &corners[0], 4, cvSize(5, 5), cvSize(-1, -1),
-                               cvTermCriteria(CV_TERMCRIT_ITER | CV_TERMCRIT_EPS, 5, 0.2f));
-
-            // The polygon may be going in a counter-clockwise direction which will
-            // defeat encoding.  Normalize the polygon to follow a clockwise direction.
-            cvNormalizeCorners(corners);
-
-            // Get the reference points.
-            rvGrid_GetReferencePoints(corners, reference);
-
-            // Get the black and white pixel values from the reference points.
-            whiteReference = rvGrid_SamplePoints(self->grayImage, &reference[0], 4);
-            blackReference = rvGrid_SamplePoints(self->grayImage, &reference[4], 4);
-
-            // Our markers consist of a black border against a white background. If the black
-            // reference is not less bright than the white reference we can skip the tag.
-            if (blackReference < whiteReference)
+            int k;
+            rvGridContext *context = self->contexts[i];
+
+            for (k = 0; k < context->candidateCount; ++k)
             {
-                // Should we draw sample reference points?
-                if (self->drawTagReferences)
-                {
-                    // Draw sample reference points.
-                    cvDrawCrosses(image, &reference[0], 4, CV_RGB(255, 0, 0));
-                    cvDrawCrosses(image, &reference[4], 4, CV_RGB(0, 255, 0));
-                }
-
-                // Get the sample points.
-                rvGrid_GetSamplePoints(corners, samples);
-
-                // Sample each point.
-                for (i = 0; i < RVTAG_SAMPLE_COUNT; ++i)
-                {
-                    int gridSample;
-                    int blackDifference;
-                    int whiteDifference;
-                    CvPoint pt;
-
-                    // Sample the point.
-                    gridSample = rvGrid_SamplePoint(self->grayImage, samples[i]);
-
-                    // Get the black and white differences.
-                    blackDifference = gridSample - blackReference;
-                    whiteDifference = gridSample - whiteReference;
-                    if (blackDifference < 0) blackDifference = -blackDifference;
-                    if (whiteDifference < 0) whiteDifference = -whiteDifference;
-
-                    pt.x = cvRound(samples[i].x);
-                    pt.y = cvRound(samples[i].y);
-
-                    if (whiteDifference < blackDifference)
-                    {
-                        // We found a white square.
-                        tagSamples[i] = 1;
-
-                        // Draw the red cross.
-                        if (self->drawTagSamples) cvDrawCross(image, pt, CV_RGB(255, 0, 0));
-                    }
-                    else
-                    {
-                        // We found a black square.
-                        tagSamples[i] = 0;
-
-                        // Draw the green cross.
-                        if (self->drawTagSamples) cvDrawCross(image, pt, CV_RGB(0, 255, 0));
-                    }
-                }
-
-                // Decode the bits and see if we found a valid pattern.
-                if (rvTag_DecodeSamples(self->tag, corners, tagSamples))
-                {
-                    rvUint16 tag_id;
-
-                    // Get the decoded tag id.
-                    rvTag_GetDecodedId(self->tag, &tag_id);
-
-                    // Get the decoded tag corners.  These are the 2D positions of
-                    // corners of the tag within the image.
-                    rvTag_GetDecodedCorners(self->tag, corners);
-
-                    // Place the tag id and tag corners in the rvGrid object.
-                    rvGrid_AddTag(self, tag_id, corners);
-
-                    // Draw the corners of the tag.
-                    if (self->drawTagCorners) cvDrawCorners(image, corners, CV_RGB(0, 255, 0), CV_RGB(255, 0, 0), 1, 8, 0);
-
-                    // Draw the identifiers of the tag.
-                    if (self->drawTagIdentifiers)
-                    {
-                        char buffer[16];
-                        CvPoint2D32f center;
-
-                        // Print the rvGrid id into the buffer.
-                        _snprintf(buffer, sizeof(buffer), "%d", (int) tag_id);
-
-                        // Get the coordinates of the center.
-                        rvGrid_GetCenterPoint(corners, &center);
-
-                        // Write the buffer to the image.
-                        cvPutText(image, buffer, cvPointFrom32f(center), &self->idFont, CV_RGB(255, 0, 0));
-                    }
-                }
+                if (context->candidates[k].tile == j) rvGrid_AddCandidate(self, image, &context->candidates[k], tiled || tracked || (self->regionCount > 0));
             }
         }
-
-        // Get the next contour.
-        contours = contours->h_next;
     }
 
+    start = rvGrid_EndStage(self->contexts[0], RVGRID_STAGE_DRAW, start, self->candidateCount);
+
+    // Follow the tags found into the next frame.
+    rvGrid_UpdateTracks(self, tracked);
+
     // Determine the camera position relative to the navigation tags.
-    if (rvGrid_CameraPosition(self))
+    start = rvProfile_GetTicks();
+    positioned = rvGrid_CameraPosition(self);
+    start = rvGrid_EndStage(self->contexts[0], RVGRID_STAGE_POSE, start, positioned ? 1 : 0);
+    if (positioned)
     {
         // Reproject the navigation tags.
         if (self->drawTagReprojection) rvGrid_DrawNavTags(self, image);
@@ -1400,24 +3006,20 @@ bool rvGrid_ProcessImage(rvGrid *self, IplImage *image)
         // Should we draw the camera position?
         if (self->drawCameraPosition)
         {
-            CvMat *positionMatrix;
-
-            // Get the position matrix.
-            rvGrid_GetCameraPositionMatrix(self, &positionMatrix);
-
             // Print the position matrix.
-            cvDrawPositionInfo(image, positionMatrix, true);
-
-            // Release the position matrix.
-            cvReleaseMat(&positionMatrix);
+            cvDrawPositionInfo(image, self->cameraPositionMatrix, true);
         }
 
         // We succeeded.
         rv = true;
     }
 
+    start = rvGrid_EndStage(self->contexts[0], RVGRID_STAGE_DRAW, start, 0);
+
     // Determine the object positions relative to the camera.
-    if (rvGrid_ObjectPositions(self))
+    positioned = rvGrid_ObjectPositions(self);
+    start = rvGrid_EndStage(self->contexts[0], RVGRID_STAGE_POSE, start, positioned ? self->objTagCount : 0);
+    if (positioned)
     {
         // Should we reproject the objects?
         if (self->drawObjectReprojection)
@@ -1432,6 +3034,16 @@ bool rvGrid_ProcessImage(rvGrid *self, IplImage *image)
 
     // Draw any characters.
     if (self->drawCharacters) rvGrid_DrawCharacters(self, image);
+    rvGrid_EndStage(self->contexts[0], RVGRID_STAGE_DRAW, start, 0);
+
+#ifdef _DEBUG
+    // The scratch memory should hold everything used while processing an image
+    // without allocating from the heap.
+    assert(rvMemPool_GetAllocCount(self->scratch) == 0);
+#endif
+
+    // Add the stage times of the image to the profile.
+    rvGrid_EndFrame(self, frameStart);
 
     return rv;
 }
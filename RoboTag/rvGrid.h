@@ -23,6 +23,14 @@
 
 #include "rvTypes.h"
 #include "rvTag.h"
+#include "rvTaskPool.h"
+#include "rvTagSet.h"
+#include "rvThreshold.h"
+#include "rvQuadFinder.h"
+#include "rvMemPool.h"
+#include "rvStorage.h"
+#include "rvProfile.h"
+#include "rvPose.h"
 #include "cv.h"
 
 #ifdef __cplusplus
@@ -30,10 +38,36 @@ extern "C" {
 #endif
 
 #define RVGRID_MAX_NAV_TAGS         128
-#define RVGRID_MAX_OBJ_TAGS         16
+#define RVGRID_MAX_OBJ_TAGS         256
 #define RVGRID_MAX_CHAR_TAGS        32
 #define RVGRID_MAX_CALIBRATE_TAGS   (32 * 256)
 #define RVGRID_MAX_CALIBRATE_IMAGES (256)
+#define RVGRID_MAX_CANDIDATES       512
+#define RVGRID_MAX_THREADS          32
+#define RVGRID_MAX_TILES            256
+#define RVGRID_DECODE_BATCH         8
+#define RVGRID_MAX_BIT_ERRORS       16
+#define RVGRID_MAX_TRACKS           (RVGRID_MAX_NAV_TAGS + RVGRID_MAX_OBJ_TAGS + RVGRID_MAX_CHAR_TAGS)
+#define RVGRID_MAX_TRACK_INTERVAL   1000
+#define RVGRID_TRACK_MARGIN         8
+#define RVGRID_MAX_REGIONS          32
+#define RVGRID_REGION_MARGIN        8
+#define RVGRID_MAX_PYRAMID_LEVELS   3
+#define RVGRID_SCRATCH_SIZE         262144
+#define RVGRID_MAX_POSE_ITERATIONS  100
+#define RVGRID_MAX_POSE_THRESHOLD   64
+
+// RMS reprojection error in pixels above which the camera pose refined from the
+// previous image is discarded and the pose is solved from scratch.
+#define RVGRID_MAX_POSE_ERROR       2.0
+
+// Limits of the candidate rejection cascade.  Candidates are rejected if the
+// longest side exceeds the shortest side by the aspect ratio, if the border
+// outside the quad is not brighter than the border inside by the contrast
+// ratio or if too few of the samples inside the border are dark.
+#define RVGRID_MAX_ASPECT_RATIO     4.0
+#define RVGRID_MIN_CONTRAST_RATIO   1.2
+#define RVGRID_MIN_RING_FRACTION    0.75
 
 enum
 {
@@ -48,6 +82,8 @@ enum
     RVGRID_EDGE_ADAPTIVE = 0,
     RVGRID_EDGE_CANNY,
     RVGRID_EDGE_SUZAN,
+    RVGRID_EDGE_INTEGRAL,
+    RVGRID_EDGE_FUSED,
     RVGRID_EDGE_COUNT
 };
 
@@ -59,17 +95,71 @@ enum
     RVGRID_ADAPTIVE_METHOD_COUNT
 };
 
+enum
+{
+    RVGRID_DECODE_FEC = 0,
+    RVGRID_DECODE_NEAREST,
+    RVGRID_DECODE_COUNT
+};
+
+// Stages of the candidate rejection cascade.  Candidates which pass every stage
+// and decode are not rejected.
+enum
+{
+    RVGRID_REJECT_NONE = 0,
+    RVGRID_REJECT_ASPECT,
+    RVGRID_REJECT_CONTRAST,
+    RVGRID_REJECT_RING,
+    RVGRID_REJECT_REFERENCE,
+    RVGRID_REJECT_DECODE,
+    RVGRID_REJECT_COUNT
+};
+
+enum
+{
+    RVGRID_QUAD_CONTOURS = 0,
+    RVGRID_QUAD_COMPONENTS,
+    RVGRID_QUAD_COUNT
+};
+
+// Stages of processing an image which are timed.  The image stages count the
+// pixels processed and the candidate stages count the contours or candidates
+// processed.  The fused threshold converts, blurs and thresholds in one pass
+// which is timed as the threshold stage.  Stages run on worker threads are
+// summed over the workers so may take longer than the whole frame.
+enum
+{
+    RVGRID_STAGE_CONVERT = 0,   // Color conversion to gray scale.
+    RVGRID_STAGE_BLUR,          // Gaussian blur and pyramid downsampling.
+    RVGRID_STAGE_THRESHOLD,     // Edge detection.
+    RVGRID_STAGE_CONTOURS,      // Finding contours or components.
+    RVGRID_STAGE_FILTER,        // Polygon approximation and the rejection cascade.
+    RVGRID_STAGE_SUBPIX,        // Sub-pixel corner refinement.
+    RVGRID_STAGE_SAMPLE,        // Sampling the references and bits.
+    RVGRID_STAGE_DECODE,        // Decoding the bits.
+    RVGRID_STAGE_POSE,          // Camera and object positions.
+    RVGRID_STAGE_DRAW,          // Drawing and adding the candidates.
+    RVGRID_STAGE_FRAME,         // The whole frame.
+    RVGRID_STAGE_COUNT
+};
+
 // Grid types.
 typedef struct _rvGrid rvGrid;
 typedef struct _rvGridNavTag rvGridNavTag;
 typedef struct _rvGridObjTag rvGridObjTag;
 typedef struct _rvGridCharTag rvGridCharTag;
+typedef struct _rvGridCandidate rvGridCandidate;
+typedef struct _rvGridTrack rvGridTrack;
+typedef struct _rvGridContext rvGridContext;
 
 // Grid navigation tag structure.
 struct _rvGridNavTag
 {
     rvUint16 id;
     CvPoint2D32f corners[4];
+    rvInt16 bitErrors;          // Bits which differed from the decoded tag.
+    bool inlier;                // Tag agrees with the camera pose.
+    double residual;            // RMS reprojection error in pixels under the camera pose or -1 if none was found.
 };
 
 // Grid object tag structure.
@@ -77,6 +167,7 @@ struct _rvGridObjTag
 {
     rvUint16 id;
     CvPoint2D32f corners[4];
+    rvInt16 bitErrors;          // Bits which differed from the decoded tag.
     double rotationData[3];
     double translationData[3];
     double positionData[16];
@@ -90,6 +181,49 @@ struct _rvGridCharTag
 {
     rvUint16 id;
     CvPoint2D32f corners[4];
+    rvInt16 bitErrors;          // Bits which differed from the decoded tag.
+};
+
+// Grid tag candidate structure.  A candidate is a four sided convex contour
+// which may be a tag.
+struct _rvGridCandidate
+{
+    rvUint16 tile;              // Tile in which the candidate was found.
+    rvUint16 level;             // Pyramid level at which the candidate was found.
+    bool referenced;            // Passed the black and white reference test.
+    bool decoded;               // Decoded to a valid tag.
+    bool fitted;                // Quad corners were fitted to sub-pixel positions.
+    rvUint16 rejection;         // Stage of the rejection cascade which rejected the candidate.
+    rvUint16 id;
+    rvInt16 bitErrors;          // Bits which differed from the decoded tag.
+    CvPoint2D32f quad[RVTAG_CORNER_COUNT];
+    CvPoint2D32f corners[RVTAG_CORNER_COUNT];
+    rvUint64 pattern;           // Sampled bits with white samples set.
+};
+
+// Grid track structure.  A track follows a tag found in the previous frame.
+struct _rvGridTrack
+{
+    rvUint16 id;
+    CvPoint2D32f corners[RVTAG_CORNER_COUNT];   // Corners in the previous frame.
+    CvPoint2D32f velocity;                      // Movement of the tag per frame.
+};
+
+// Grid processing context structure.  Each worker thread processes
+// candidates using its own context.
+struct _rvGridContext
+{
+    rvStorage *storage;         // Storage of the contours and polygons.
+    rvTag *tag;
+    rvQuadFinder *quadFinder;
+    CvMat *tileImage;           // Copy of the edge image tile being processed.
+    CvSeq *contours;            // Raw contours linked through h_next.
+    CvSeq *polygons;            // Approximated polygons linked through h_next.
+    int candidateCount;
+    rvGridCandidate candidates[RVGRID_MAX_CANDIDATES];
+    CvPoint2D32f quads[RVGRID_MAX_CANDIDATES][RVTAG_CORNER_COUNT];   // Quads found as black components.
+    rvUint64 stageTicks[RVGRID_STAGE_COUNT];    // Time spent in each stage on the image.
+    int stageCounts[RVGRID_STAGE_COUNT];        // Items processed by each stage on the image.
 };
 
 // Grid structures.
@@ -102,13 +236,48 @@ struct _rvGrid
     CvMat *rotationVector;
     CvMat *translationVector;
     CvMat *cameraPositionMatrix;
+    CvMat *poseCovariance;      // Covariance of the camera pose as a small rotation and translation.
+    double poseError;           // RMS reprojection error in pixels of the camera pose or -1 if none was found.
+    bool posed;                 // Rotation and translation vectors hold the pose of a previous image.
+    int inlierCount;            // Navigation tags which agree with the camera pose.
 
     CvSize imageSize;
     IplImage *grayImage;
     IplImage *edgeImage;
-    CvMemStorage *memStorage;
-
-    rvTag *tag;
+    rvThreshold *threshold;     // Integral image threshold of the gray image.
+    rvMemPool *scratch;         // Scratch memory reset for each image.
+    rvPose *pose;               // Planar pose solver for the navigation and object tags.
+    int allocCount;             // Buffers allocated from the heap while processing images.
+    int storageTruncations;     // Images in which finding or processing contours was cut short.
+
+    // Downsampled gray and edge images for each pyramid level below the full image.
+    IplImage *pyramidImages[RVGRID_MAX_PYRAMID_LEVELS];
+    IplImage *pyramidEdges[RVGRID_MAX_PYRAMID_LEVELS];
+
+    // Processing contexts.  The first context is used when processing
+    // on the calling thread.
+    int contextCount;
+    rvGridContext *contexts[RVGRID_MAX_THREADS];
+    rvTaskPool *taskPool;
+    rvCodebook *codebook;       // Patterns of the active tags shared by the contexts.
+    rvTagSet *activeTags;       // Tag ids accepted by the decoder.
+
+    // Tiles processed in parallel.
+    int tileCount;
+    CvRect tiles[RVGRID_MAX_TILES];
+
+    // Regions of interest searched instead of the whole image.
+    int regionCount;
+    CvRect regions[RVGRID_MAX_REGIONS];
+
+    // Candidates found in the last image and the number rejected at each stage.
+    int candidateCount;
+    int rejectCounts[RVGRID_REJECT_COUNT];
+
+    // Items processed by each stage in the last image and the rolling histogram
+    // of the time taken by each stage.
+    int stageCounts[RVGRID_STAGE_COUNT];
+    rvProfile *profile;
 
     CvFont idFont;
     CvFont charFont;
@@ -125,6 +294,11 @@ struct _rvGrid
     rvUint16 charTagCount;
     rvGridCharTag charTags[RVGRID_MAX_CHAR_TAGS];
 
+    // Tags followed from the previous frame.
+    int trackCount;
+    int trackFrames;            // Frames tracked since the last full image search.
+    rvGridTrack tracks[RVGRID_MAX_TRACKS];
+
     // Calibration data.
     rvUint16 calibrateTagCount;
     rvUint16 calibrateImageCount;
@@ -140,6 +314,18 @@ struct _rvGrid
     int adaptiveBlockSize;      // Adaptive block size.
     int adaptiveSubtraction;    // Adaptive subtraction.
     int edgeDilation;           // Edge dilation.
+    int threadCount;            // Worker threads or zero for one per processor.
+    int tileSize;               // Tile size or zero to process the whole image at once.
+    int tileOverlap;            // Tile overlap which should exceed the largest tag size.
+    int decodeMethod;           // Tag decoding method.
+    int decodeMaxBitErrors;     // Bit errors accepted by the nearest tag decoding method.
+    int trackInterval;          // Frames tracked between full image searches or zero to search every frame.
+    int pyramidLevels;          // Levels the image is halved to find candidates or zero for the full image.
+    int quadMethod;             // Method of finding the four sided candidates in the edge image.
+    int storageBudget;          // Bytes of contour storage reserved for each context.
+    int maxContours;            // Contours found by each context in an image.
+    int poseIterations;         // Iterations refining the previous camera pose or zero to solve each pose from scratch.
+    int poseThreshold;          // Reprojection error in pixels of tags agreeing with the camera pose or zero to fit every tag.
 
     // Flags to control drawing of tag properties.
     bool drawRawContours;
@@ -172,6 +358,30 @@ int rvGrid_GetGaussianBlur(rvGrid *self);
 int rvGrid_GetAdaptiveMethod(rvGrid *self);
 int rvGrid_GetAdaptiveBlockSize(rvGrid *self);
 int rvGrid_GetAdaptiveSubtraction(rvGrid *self);
+int rvGrid_GetThreadCount(rvGrid *self);
+int rvGrid_GetTileSize(rvGrid *self);
+int rvGrid_GetTileOverlap(rvGrid *self);
+int rvGrid_GetDecodeMethod(rvGrid *self);
+int rvGrid_GetDecodeMaxBitErrors(rvGrid *self);
+void rvGrid_GetActiveTags(rvGrid *self, rvTagSet *activeTags);
+int rvGrid_GetTrackInterval(rvGrid *self);
+int rvGrid_GetPyramidLevels(rvGrid *self);
+int rvGrid_GetQuadMethod(rvGrid *self);
+int rvGrid_GetRegionCount(rvGrid *self);
+void rvGrid_GetRegions(rvGrid *self, CvRect *regions);
+int rvGrid_GetCandidateCount(rvGrid *self);
+int rvGrid_GetRejectCount(rvGrid *self, int stage);
+int rvGrid_GetAllocCount(rvGrid *self);
+int rvGrid_GetStorageBudget(rvGrid *self);
+int rvGrid_GetMaxContours(rvGrid *self);
+int rvGrid_GetPoseIterations(rvGrid *self);
+int rvGrid_GetPoseThreshold(rvGrid *self);
+int rvGrid_GetStorageHighWater(rvGrid *self);
+int rvGrid_GetStorageTruncations(rvGrid *self);
+int rvGrid_GetStageCount(rvGrid *self, int stage);
+double rvGrid_GetStageTime(rvGrid *self, int stage);
+double rvGrid_GetStagePercentile(rvGrid *self, int stage, double percentile);
+void rvGrid_ResetProfile(rvGrid *self);
 
 // Draw property getters.
 bool rvGrid_GetDrawRawContours(rvGrid *self);
@@ -194,6 +404,20 @@ void rvGrid_SetGaussianBlur(rvGrid *self, int gaussianBlur);
 void rvGrid_SetAdaptiveMethod(rvGrid *self, int adaptiveMethod);
 void rvGrid_SetAdaptiveBlockSize(rvGrid *self, int adaptiveMethod);
 void rvGrid_SetAdaptiveSubtraction(rvGrid *self, int adaptiveMethod);
+void rvGrid_SetThreadCount(rvGrid *self, int threadCount);
+void rvGrid_SetTileSize(rvGrid *self, int tileSize);
+void rvGrid_SetTileOverlap(rvGrid *self, int tileOverlap);
+void rvGrid_SetDecodeMethod(rvGrid *self, int decodeMethod);
+void rvGrid_SetDecodeMaxBitErrors(rvGrid *self, int decodeMaxBitErrors);
+bool rvGrid_SetActiveTags(rvGrid *self, rvTagSet *activeTags);
+void rvGrid_SetTrackInterval(rvGrid *self, int trackInterval);
+void rvGrid_SetPyramidLevels(rvGrid *self, int pyramidLevels);
+void rvGrid_SetQuadMethod(rvGrid *self, int quadMethod);
+bool rvGrid_SetStorageBudget(rvGrid *self, int storageBudget);
+void rvGrid_SetMaxContours(rvGrid *self, int maxContours);
+void rvGrid_SetPoseIterations(rvGrid *self, int poseIterations);
+void rvGrid_SetPoseThreshold(rvGrid *self, int poseThreshold);
+bool rvGrid_SetRegions(rvGrid *self, CvRect *regions, int count);
 
 // Draw property setters.
 void rvGrid_SetDrawRawContours(rvGrid *self, bool value);
@@ -216,6 +440,16 @@ bool rvGrid_GetDistortionCoeffs(rvGrid *self, CvMat **distortionCoeffs);
 bool rvGrid_GetRotationVector(rvGrid *self, CvMat **rotationVector);
 bool rvGrid_GetTranslationVector(rvGrid *self, CvMat **translationVector);
 bool rvGrid_GetCameraPositionMatrix(rvGrid *self, CvMat **inverseExtrinsicMatrix);
+bool rvGrid_GetPoseCovariance(rvGrid *self, CvMat **poseCovariance);
+double rvGrid_GetPoseError(rvGrid *self);
+int rvGrid_GetNavTagCount(rvGrid *self);
+int rvGrid_GetNavTagId(rvGrid *self, int index);
+bool rvGrid_GetNavTagInlier(rvGrid *self, int index);
+double rvGrid_GetNavTagResidual(rvGrid *self, int index);
+int rvGrid_GetNavTagBitErrors(rvGrid *self, int index);
+int rvGrid_GetObjTagBitErrors(rvGrid *self, int index);
+int rvGrid_GetCharTagBitErrors(rvGrid *self, int index);
+int rvGrid_GetInlierCount(rvGrid *self);
 
 bool rvGrid_CameraPosition(rvGrid *self);
 bool rvGrid_ObjectPositions(rvGrid *self);
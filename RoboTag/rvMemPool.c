@@ -38,10 +38,14 @@ struct _rvMemPool
 {
     int size;
     int used;
+    int allocCount;             // Blocks allocated from the heap since the last reset.  Only kept in the first block.
     rvMemPool *next;
     // Alloc space follows here.
 };
 
+// Allocations are rounded up to keep each allocation aligned for doubles.
+#define RVMEMPOOL_ALIGN(size)   (((size) + (int) sizeof(double) - 1) & ~((int) sizeof(double) - 1))
+
 static __inline void *rvMemPool_AllocBlock(rvMemPool *self, size_t nbytes)
 {
     // Allocate the memory block.
@@ -70,14 +74,15 @@ rvMemPool_New(int allocSize)
     if (allocSize < 512) allocSize = 512;
 
     // Add the memory management overhead to the size of the memory allocated.
-    allocSize += sizeof(rvMemPool);
+    allocSize += RVMEMPOOL_ALIGN((int) sizeof(rvMemPool));
 
     // Allocate the object.
     self = (rvMemPool *) malloc(allocSize);
 
     // Initialize this block.
     self->size = allocSize;
-    self->used = sizeof(rvMemPool);
+    self->used = RVMEMPOOL_ALIGN((int) sizeof(rvMemPool));
+    self->allocCount = 0;
 
     // This is a circular list. self->next is always the most recently added block.
     self->next = self;
@@ -116,7 +121,8 @@ rvMemPool_Reset(rvMemPool *self)
     self->next = self;
 
     // Release all the space in the first block.
-    self->used = sizeof(rvMemPool);
+    self->used = RVMEMPOOL_ALIGN((int) sizeof(rvMemPool));
+    self->allocCount = 0;
 }
 
 
@@ -127,8 +133,12 @@ rvMemPool_Alloc(rvMemPool *self, int size)
 // allocSize passed to rvMemPool_New.
 {
     int allocSize;
+    int headerSize = RVMEMPOOL_ALIGN((int) sizeof(rvMemPool));
     rvMemPool *pool;
 
+    // Keep the next allocation aligned.
+    size = RVMEMPOOL_ALIGN(size);
+
     // See if there's space in the current block.
     pool = self->next;
     if (pool->size - pool->used >= size)
@@ -139,16 +149,27 @@ rvMemPool_Alloc(rvMemPool *self, int size)
 
     // Couldn't get space in the current block, so add a new one.
     allocSize = self->size;
-    if (size + (int) sizeof(rvMemPool) > self->size)
-        allocSize = size + sizeof(rvMemPool);
+    if (size + headerSize > self->size)
+        allocSize = size + headerSize;
 
     pool = (rvMemPool*) rvMemPool_AllocBlock(self, allocSize);
     pool->size = allocSize;
-    pool->used = sizeof(rvMemPool) + size;
+    pool->used = headerSize + size;
     pool->next = self->next;
     self->next = pool;
+    ++self->allocCount;
+
+    return (char *) pool + headerSize;
+}
+
 
-    return (char *) pool + sizeof(rvMemPool);
+int
+rvMemPool_GetAllocCount(rvMemPool *self)
+// Returns the number of blocks allocated from the heap since the rvMemPool was
+// created or last reset, not counting the first block allocated when it was
+// created.  A pool sized for its use returns zero.
+{
+    return self->allocCount;
 }
 
 
@@ -46,6 +46,7 @@ extern void rvMemPool_Free(rvMemPool *self);
 extern void rvMemPool_Reset(rvMemPool *self);
 extern void *rvMemPool_Alloc(rvMemPool *self, int size);
 extern char *rvMemPool_AllocStr(rvMemPool *self, const char *str);
+extern int rvMemPool_GetAllocCount(rvMemPool *self);
 
 // Utility and debug functions.
 #ifdef DEBUG
@@ -0,0 +1,302 @@
+/*
+    Copyright (C) 2010, Michael P. Thompson
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 2 as
+    specified in the README.txt file or as published by the Free Software
+    Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    $Id$
+*/
+
+#include <stdlib.h>
+#include "rvPipeline.h"
+
+
+static void rvPipeline_DetectThread(void *arg)
+// Detection thread.  Waits for captured frames, processes the most recent
+// one and passes it on to the render stage.  Older frames that were queued
+// while the previous frame was being processed are skipped.
+{
+    rvPipeline *self = (rvPipeline *) arg;
+
+    // Loop until the pipeline is stopped.
+    while (rvAtomic_Load(&self->running))
+    {
+        rvPipelineFrame *frame = NULL;
+        rvPipelineFrame *next;
+
+        // Wait for a frame to be captured.
+        rvEvent_Wait(self->frameEvent, 100);
+
+        // Drain the ring keeping only the latest frame.
+        while ((next = (rvPipelineFrame *) rvRing_Pop(self->detectRing)) != NULL)
+        {
+            // Return the older frame to the capture stage.
+            if (frame != NULL)
+            {
+                rvRing_Push(self->detectFreeRing, frame);
+                rvAtomic_Add(&self->skippedCount, 1);
+            }
+
+            frame = next;
+        }
+
+        // Continue if no frame was captured.
+        if (frame == NULL) continue;
+
+        // Process the image.
+        rvMutex_Lock(self->gridLock);
+        rvGrid_ProcessImage(self->grid, frame->image);
+        frame->results = self->grid->results;
+        rvMutex_Unlock(self->gridLock);
+
+        rvAtomic_Add(&self->processedCount, 1);
+
+        // Pass the frame to the render stage.
+        rvRing_Push(self->renderRing, frame);
+
+        // Let the render stage know a frame is ready.
+        if (self->frameFunc != NULL) self->frameFunc(self, frame, self->frameArg);
+    }
+}
+
+
+rvPipeline *rvPipeline_New(rvGrid *grid, CvSize imageSize, int frameCount)
+// Create a pipeline which processes images with the grid object.  The grid
+// object remains owned by the caller.
+{
+    int i;
+    rvPipeline *self;
+
+    // Sanity check the arguments.
+    if (grid == NULL) return NULL;
+    if (frameCount < RVPIPELINE_MIN_FRAMES) frameCount = RVPIPELINE_MIN_FRAMES;
+
+    // Allocate the object.
+    self = (rvPipeline *) calloc(1, sizeof(rvPipeline));
+
+    // Did we allocate the object.
+    if (self != NULL)
+    {
+        // Set the object variables.
+        self->grid = grid;
+        self->imageSize = imageSize;
+        self->frameCount = frameCount;
+        self->gridLock = rvMutex_New();
+        self->frameEvent = rvEvent_New();
+        self->frames = (rvPipelineFrame *) calloc(frameCount, sizeof(rvPipelineFrame));
+
+        // Each ring can hold every frame so that pushes never fail.
+        self->detectRing = rvRing_New(frameCount);
+        self->renderRing = rvRing_New(frameCount);
+        self->detectFreeRing = rvRing_New(frameCount);
+        self->renderFreeRing = rvRing_New(frameCount);
+
+        // Did we allocate everything?
+        if ((self->gridLock == NULL) || (self->frameEvent == NULL) || (self->frames == NULL) ||
+            (self->detectRing == NULL) || (self->renderRing == NULL) ||
+            (self->detectFreeRing == NULL) || (self->renderFreeRing == NULL))
+        {
+            // Clean up.
+            rvPipeline_Free(self);
+            return NULL;
+        }
+
+        // Create the frame images and give them to the capture stage.
+        for (i = 0; i < frameCount; ++i)
+        {
+            self->frames[i].image = cvCreateImage(imageSize, IPL_DEPTH_8U, 3);
+            rvRing_Push(self->renderFreeRing, &self->frames[i]);
+        }
+    }
+
+    return self;
+}
+
+
+void rvPipeline_Free(rvPipeline *self)
+// Stop the pipeline and free all resources.
+{
+    int i;
+
+    // Sanity check the arguments.
+    if (self == NULL) return;
+
+    // Stop the detection thread.
+    rvPipeline_Stop(self);
+
+    // Release the frame images.
+    if (self->frames != NULL)
+    {
+        for (i = 0; i < self->frameCount; ++i)
+        {
+            if (self->frames[i].image) cvReleaseImage(&self->frames[i].image);
+        }
+        free(self->frames);
+    }
+
+    // Free the rings and synchronization objects.
+    rvRing_Free(self->detectRing);
+    rvRing_Free(self->renderRing);
+    rvRing_Free(self->detectFreeRing);
+    rvRing_Free(self->renderFreeRing);
+    rvEvent_Free(self->frameEvent);
+    rvMutex_Free(self->gridLock);
+
+    // Free the object.
+    free(self);
+}
+
+
+void rvPipeline_SetFrameCallback(rvPipeline *self, rvPipeline_FrameFunc func, void *arg)
+// Set the function called from the detection thread when a frame is ready
+// for rendering.  This should only be called while the pipeline is stopped.
+{
+    self->frameFunc = func;
+    self->frameArg = arg;
+}
+
+
+bool rvPipeline_Start(rvPipeline *self)
+// Start the detection thread.
+{
+    // Are we already running?
+    if (self->thread != NULL) return true;
+
+    // Start the thread.
+    rvAtomic_Store(&self->running, 1);
+    self->thread = rvThread_New(rvPipeline_DetectThread, self);
+    if (self->thread == NULL)
+    {
+        rvAtomic_Store(&self->running, 0);
+        return false;
+    }
+
+    return true;
+}
+
+
+void rvPipeline_Stop(rvPipeline *self)
+// Stop the detection thread and wait for it to exit.
+{
+    // Are we running?
+    if (self->thread == NULL) return;
+
+    // Signal the thread to exit and wait for it.
+    rvAtomic_Store(&self->running, 0);
+    rvEvent_Signal(self->frameEvent);
+    rvThread_Free(self->thread);
+    self->thread = NULL;
+}
+
+
+bool rvPipeline_PushImage(rvPipeline *self, IplImage *image)
+// Capture stage.  Copies the image into a free frame and queues it for the
+// detection thread.  This never blocks.  Returns false if the image was
+// dropped because no free frame was available.
+{
+    rvPipelineFrame *frame;
+
+    // Sanity check the image.
+    if ((image == NULL) || (image->width != self->imageSize.width) ||
+        (image->height != self->imageSize.height) || (image->nChannels != 3)) return false;
+
+    rvAtomic_Add(&self->capturedCount, 1);
+
+    // Get a free frame from either the render or detection stage.
+    frame = (rvPipelineFrame *) rvRing_Pop(self->renderFreeRing);
+    if (frame == NULL) frame = (rvPipelineFrame *) rvRing_Pop(self->detectFreeRing);
+
+    // Drop the image if all frames are busy.
+    if (frame == NULL)
+    {
+        rvAtomic_Add(&self->droppedCount, 1);
+        return false;
+    }
+
+    // Copy the image into the frame.
+    frame->image->origin = image->origin;
+    cvCopy(image, frame->image, NULL);
+    frame->sequence = ++self->sequence;
+    frame->results = false;
+
+    // Queue the frame and wake the detection thread.
+    rvRing_Push(self->detectRing, frame);
+    rvEvent_Signal(self->frameEvent);
+
+    return true;
+}
+
+
+rvPipelineFrame *rvPipeline_CheckoutFrame(rvPipeline *self)
+// Render stage.  Returns the most recently finished frame or NULL if no
+// new frame has been finished since the last call.  Older finished frames
+// are returned to the capture stage.  The frame must be checked back in.
+{
+    rvPipelineFrame *frame = NULL;
+    rvPipelineFrame *next;
+
+    // Drain the ring keeping only the latest frame.
+    while ((next = (rvPipelineFrame *) rvRing_Pop(self->renderRing)) != NULL)
+    {
+        if (frame != NULL) rvRing_Push(self->renderFreeRing, frame);
+        frame = next;
+    }
+
+    return frame;
+}
+
+
+void rvPipeline_CheckinFrame(rvPipeline *self, rvPipelineFrame *frame)
+// Render stage.  Return a checked out frame to the capture stage.
+{
+    if (frame != NULL) rvRing_Push(self->renderFreeRing, frame);
+}
+
+
+void rvPipeline_LockGrid(rvPipeline *self)
+// Lock the grid against concurrent processing by the detection thread.
+{
+    rvMutex_Lock(self->gridLock);
+}
+
+
+void rvPipeline_UnlockGrid(rvPipeline *self)
+// Unlock the grid.
+{
+    rvMutex_Unlock(self->gridLock);
+}
+
+
+long rvPipeline_GetCapturedCount(rvPipeline *self)
+{
+    return rvAtomic_Load(&self->capturedCount);
+}
+
+
+long rvPipeline_GetDroppedCount(rvPipeline *self)
+{
+    return rvAtomic_Load(&self->droppedCount);
+}
+
+
+long rvPipeline_GetSkippedCount(rvPipeline *self)
+{
+    return rvAtomic_Load(&self->skippedCount);
+}
+
+
+long rvPipeline_GetProcessedCount(rvPipeline *self)
+{
+    return rvAtomic_Load(&self->processedCount);
+}
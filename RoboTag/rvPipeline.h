@@ -0,0 +1,113 @@
+/*
+    Copyright (C) 2010, Michael P. Thompson
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 2 as
+    specified in the README.txt file or as published by the Free Software
+    Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    $Id$
+*/
+
+#ifndef _RV_PIPELINE_INCLUDED_
+#define _RV_PIPELINE_INCLUDED_
+
+#include "rvTypes.h"
+#include "rvThread.h"
+#include "rvRing.h"
+#include "rvGrid.h"
+#include "cv.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RVPIPELINE_MIN_FRAMES       3
+#define RVPIPELINE_DEF_FRAMES       4
+
+// Pipeline types.
+typedef struct _rvPipeline rvPipeline;
+typedef struct _rvPipelineFrame rvPipelineFrame;
+
+// Callback made from the detection thread each time a frame is finished.
+typedef void (*rvPipeline_FrameFunc)(rvPipeline *pipeline, rvPipelineFrame *frame, void *arg);
+
+// Pipeline frame structure.
+struct _rvPipelineFrame
+{
+    IplImage *image;
+    rvUint32 sequence;
+    bool results;
+};
+
+// Pipeline structure.  Frames move from the capture stage to the detection
+// thread to the render stage through single producer/single consumer rings
+// and are recycled back to the capture stage through the free rings.
+struct _rvPipeline
+{
+    rvGrid *grid;
+    rvMutex *gridLock;
+
+    CvSize imageSize;
+    int frameCount;
+    rvPipelineFrame *frames;
+
+    rvRing *detectRing;         // Capture to detection.
+    rvRing *renderRing;         // Detection to render.
+    rvRing *detectFreeRing;     // Detection to capture (skipped frames).
+    rvRing *renderFreeRing;     // Render to capture (displayed frames).
+
+    rvEvent *frameEvent;
+    rvThread *thread;
+    rvAtomic running;
+
+    rvPipeline_FrameFunc frameFunc;
+    void *frameArg;
+
+    rvUint32 sequence;
+
+    // Statistics.
+    rvAtomic capturedCount;
+    rvAtomic droppedCount;
+    rvAtomic skippedCount;
+    rvAtomic processedCount;
+};
+
+// Pipeline methods.
+rvPipeline *rvPipeline_New(rvGrid *grid, CvSize imageSize, int frameCount);
+void rvPipeline_Free(rvPipeline *self);
+void rvPipeline_SetFrameCallback(rvPipeline *self, rvPipeline_FrameFunc func, void *arg);
+bool rvPipeline_Start(rvPipeline *self);
+void rvPipeline_Stop(rvPipeline *self);
+
+// Capture stage methods.
+bool rvPipeline_PushImage(rvPipeline *self, IplImage *image);
+
+// Render stage methods.
+rvPipelineFrame *rvPipeline_CheckoutFrame(rvPipeline *self);
+void rvPipeline_CheckinFrame(rvPipeline *self, rvPipelineFrame *frame);
+
+// Grid access from threads other than the detection thread.
+void rvPipeline_LockGrid(rvPipeline *self);
+void rvPipeline_UnlockGrid(rvPipeline *self);
+
+// Statistics methods.
+long rvPipeline_GetCapturedCount(rvPipeline *self);
+long rvPipeline_GetDroppedCount(rvPipeline *self);
+long rvPipeline_GetSkippedCount(rvPipeline *self);
+long rvPipeline_GetProcessedCount(rvPipeline *self);
+
+#ifdef __cplusplus
+} // "C"
+#endif
+
+#endif // _RV_PIPELINE_INCLUDED_
@@ -0,0 +1,1680 @@
+/*
+    Copyright (C) 2010, Michael P. Thompson
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 2 as
+    specified in the README.txt file or as published by the Free Software
+    Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    $Id$
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "rvPose.h"
+
+// Select the vector instruction set used to solve tags in batches.  Defining
+// RV_NO_SIMD forces the portable scalar code.
+#if !defined(RV_NO_SIMD) && defined(__AVX2__)
+#define RVPOSE_AVX2
+#include <immintrin.h>
+#endif
+
+// Tags solved together by the batch solver.  Each tag is a lane of the vectors.
+#define RVPOSE_LANES    4
+
+#if defined(RVPOSE_AVX2)
+typedef __m256d rvPoseLanes;
+
+#define RVPOSE_SET(a)           _mm256_set1_pd(a)
+#define RVPOSE_LOAD(p)          _mm256_loadu_pd(p)
+#define RVPOSE_STORE(p, a)      _mm256_storeu_pd(p, a)
+#define RVPOSE_ADD(a, b)        _mm256_add_pd(a, b)
+#define RVPOSE_SUB(a, b)        _mm256_sub_pd(a, b)
+#define RVPOSE_MUL(a, b)        _mm256_mul_pd(a, b)
+#define RVPOSE_DIV(a, b)        _mm256_div_pd(a, b)
+#define RVPOSE_SQRT(a)          _mm256_sqrt_pd(a)
+#define RVPOSE_LESS(a, b)       _mm256_cmp_pd(a, b, _CMP_LT_OQ)
+#define RVPOSE_SELECT(m, a, b)  _mm256_blendv_pd(b, a, m)
+#else
+typedef struct _rvPoseLanes
+{
+    double v[RVPOSE_LANES];
+} rvPoseLanes;
+
+#define RVPOSE_SET(a)           rvPose_LanesSet(a)
+#define RVPOSE_LOAD(p)          rvPose_LanesLoad(p)
+#define RVPOSE_STORE(p, a)      rvPose_LanesStore(p, a)
+#define RVPOSE_ADD(a, b)        rvPose_LanesOp(a, b, 0)
+#define RVPOSE_SUB(a, b)        rvPose_LanesOp(a, b, 1)
+#define RVPOSE_MUL(a, b)        rvPose_LanesOp(a, b, 2)
+#define RVPOSE_DIV(a, b)        rvPose_LanesOp(a, b, 3)
+#define RVPOSE_SQRT(a)          rvPose_LanesOp(a, a, 4)
+#define RVPOSE_LESS(a, b)       rvPose_LanesOp(a, b, 5)
+#define RVPOSE_SELECT(m, a, b)  rvPose_LanesSelect(m, a, b)
+
+
+static __inline rvPoseLanes rvPose_LanesSet(double a)
+// Set every lane to the value.
+{
+    int i;
+    rvPoseLanes r;
+
+    for (i = 0; i < RVPOSE_LANES; ++i) r.v[i] = a;
+
+    return r;
+}
+
+
+static __inline rvPoseLanes rvPose_LanesLoad(const double *p)
+// Load the lanes from an array.
+{
+    rvPoseLanes r;
+
+    memcpy(r.v, p, sizeof(r.v));
+
+    return r;
+}
+
+
+static __inline void rvPose_LanesStore(double *p, rvPoseLanes a)
+// Store the lanes to an array.
+{
+    memcpy(p, a.v, sizeof(a.v));
+}
+
+
+static __inline rvPoseLanes rvPose_LanesOp(rvPoseLanes a, rvPoseLanes b, int op)
+// Apply the operation to each lane.  Comparisons set lanes which pass to one.
+{
+    int i;
+    rvPoseLanes r;
+
+    for (i = 0; i < RVPOSE_LANES; ++i)
+    {
+        switch (op)
+        {
+            case 0: r.v[i] = a.v[i] + b.v[i]; break;
+            case 1: r.v[i] = a.v[i] - b.v[i]; break;
+            case 2: r.v[i] = a.v[i] * b.v[i]; break;
+            case 3: r.v[i] = a.v[i] / b.v[i]; break;
+            case 4: r.v[i] = sqrt(a.v[i]); break;
+            default: r.v[i] = a.v[i] < b.v[i] ? 1.0 : 0.0; break;
+        }
+    }
+
+    return r;
+}
+
+
+static __inline rvPoseLanes rvPose_LanesSelect(rvPoseLanes m, rvPoseLanes a, rvPoseLanes b)
+// Select lanes of a where the mask is set and of b elsewhere.
+{
+    int i;
+    rvPoseLanes r;
+
+    for (i = 0; i < RVPOSE_LANES; ++i) r.v[i] = m.v[i] != 0.0 ? a.v[i] : b.v[i];
+
+    return r;
+}
+#endif
+
+// Finds the pose of a planar target relative to the camera from the image
+// positions of points on the target.  The target points must lie in the z = 0
+// plane of the target as the tag corners do.  The image points are undistorted
+// and a homography is fitted from the target plane to them, which is decomposed
+// into a rotation and translation.  The pose is then refined by Levenberg-Marquardt
+// iterations which minimize the reprojection error in pixels through the full
+// camera and distortion model, so the result agrees with the OpenCV solver.
+// The rotation is updated as a small rotation applied to the current rotation
+// matrix which keeps the Jacobian simple.  A pose found in a previous frame may
+// be refined directly which skips the homography.
+
+// Pose structure.
+struct _rvPose
+{
+    int maxPoints;
+    double fx;                  // Focal lengths in pixels.
+    double fy;
+    double cx;                  // Principal point in pixels.
+    double cy;
+    double k1;                  // Radial distortion coefficients.
+    double k2;
+    double k3;
+    double p1;                  // Tangential distortion coefficients.
+    double p2;
+    double *undistorted;        // Undistorted image points in normalized coordinates.
+    double *residuals;          // Reprojection error in pixels of each point.
+    double *weights;            // Weight of each point when refining a robust pose.
+    double error;               // RMS reprojection error in pixels of the last pose found.
+    double covariance[36];      // Covariance of the last pose found.
+};
+
+
+static bool rvPose_SolveLinear(double *a, double *b, int n)
+// Solve the n by n system a * x = b by Gaussian elimination with partial
+// pivoting.  Both a and b are overwritten and b receives the solution.  Returns
+// false if the system is singular.
+{
+    int i;
+    int j;
+    int k;
+
+    for (i = 0; i < n; ++i)
+    {
+        int pivot = i;
+        double scale;
+
+        // Find the largest value in the column to pivot on.
+        for (j = i + 1; j < n; ++j)
+        {
+            if (fabs(a[j * n + i]) > fabs(a[pivot * n + i])) pivot = j;
+        }
+        if (fabs(a[pivot * n + i]) < DBL_EPSILON) return false;
+
+        // Swap the pivot row into place.
+        if (pivot != i)
+        {
+            double swap;
+
+            for (k = 0; k < n; ++k)
+            {
+                swap = a[i * n + k];
+                a[i * n + k] = a[pivot * n + k];
+                a[pivot * n + k] = swap;
+            }
+            swap = b[i];
+            b[i] = b[pivot];
+            b[pivot] = swap;
+        }
+
+        // Eliminate the column below the pivot.
+        for (j = i + 1; j < n; ++j)
+        {
+            scale = a[j * n + i] / a[i * n + i];
+            for (k = i; k < n; ++k) a[j * n + k] -= scale * a[i * n + k];
+            b[j] -= scale * b[i];
+        }
+    }
+
+    // Substitute back up the rows.
+    for (i = n - 1; i >= 0; --i)
+    {
+        for (k = i + 1; k < n; ++k) b[i] -= a[i * n + k] * b[k];
+        b[i] /= a[i * n + i];
+    }
+
+    return true;
+}
+
+
+static void rvPose_VectorToRotation(const double vector[3], double rotation[9])
+// Convert a rotation vector to a rotation matrix with the Rodrigues formula.
+{
+    double theta = sqrt(vector[0] * vector[0] + vector[1] * vector[1] + vector[2] * vector[2]);
+    double c;
+    double s;
+    double k[3];
+
+    // Small rotations are approximated to first order.
+    if (theta < 1e-12)
+    {
+        rotation[0] = 1.0;        rotation[1] = -vector[2]; rotation[2] = vector[1];
+        rotation[3] = vector[2];  rotation[4] = 1.0;        rotation[5] = -vector[0];
+        rotation[6] = -vector[1]; rotation[7] = vector[0];  rotation[8] = 1.0;
+        return;
+    }
+
+    // Rotate by theta about the unit axis k.
+    c = cos(theta);
+    s = sin(theta);
+    k[0] = vector[0] / theta;
+    k[1] = vector[1] / theta;
+    k[2] = vector[2] / theta;
+
+    rotation[0] = c + (1.0 - c) * k[0] * k[0];
+    rotation[1] = (1.0 - c) * k[0] * k[1] - s * k[2];
+    rotation[2] = (1.0 - c) * k[0] * k[2] + s * k[1];
+    rotation[3] = (1.0 - c) * k[1] * k[0] + s * k[2];
+    rotation[4] = c + (1.0 - c) * k[1] * k[1];
+    rotation[5] = (1.0 - c) * k[1] * k[2] - s * k[0];
+    rotation[6] = (1.0 - c) * k[2] * k[0] - s * k[1];
+    rotation[7] = (1.0 - c) * k[2] * k[1] + s * k[0];
+    rotation[8] = c + (1.0 - c) * k[2] * k[2];
+}
+
+
+static void rvPose_RotationToVector(const double rotation[9], double vector[3])
+// Convert a rotation matrix to a rotation vector.
+{
+    double c = (rotation[0] + rotation[4] + rotation[8] - 1.0) * 0.5;
+    double theta;
+    double s;
+
+    // Clamp rounding errors and find the angle of rotation.
+    if (c > 1.0) c = 1.0;
+    if (c < -1.0) c = -1.0;
+    theta = acos(c);
+    s = sin(theta);
+
+    if (s > 1e-6)
+    {
+        // The axis follows from the skew symmetric part of the matrix.
+        double scale = theta / (2.0 * s);
+
+        vector[0] = (rotation[7] - rotation[5]) * scale;
+        vector[1] = (rotation[2] - rotation[6]) * scale;
+        vector[2] = (rotation[3] - rotation[1]) * scale;
+    }
+    else if (c > 0.0)
+    {
+        // Small rotations are approximated to first order.
+        vector[0] = (rotation[7] - rotation[5]) * 0.5;
+        vector[1] = (rotation[2] - rotation[6]) * 0.5;
+        vector[2] = (rotation[3] - rotation[1]) * 0.5;
+    }
+    else
+    {
+        // Rotations near a half turn take the axis from the symmetric part of
+        // the matrix starting with its largest diagonal element.
+        int i;
+        int m = 0;
+        double k[3];
+
+        if (rotation[4] > rotation[m * 4]) m = 1;
+        if (rotation[8] > rotation[m * 4]) m = 2;
+        k[m] = sqrt((rotation[m * 4] + 1.0) * 0.5);
+        for (i = 0; i < 3; ++i)
+        {
+            if (i != m) k[i] = (rotation[m * 3 + i] + rotation[i * 3 + m]) / (4.0 * k[m]);
+        }
+
+        vector[0] = k[0] * theta;
+        vector[1] = k[1] * theta;
+        vector[2] = k[2] * theta;
+    }
+}
+
+
+static void rvPose_Distort(rvPose *self, double x, double y, double *xd, double *yd, double jacobian[4])
+// Apply the lens distortion to the normalized point.  The Jacobian of the
+// distorted point with respect to the normalized point is returned in row order.
+{
+    double r2 = x * x + y * y;
+    double radial = 1.0 + r2 * (self->k1 + r2 * (self->k2 + r2 * self->k3));
+    double dradial = self->k1 + r2 * (2.0 * self->k2 + r2 * 3.0 * self->k3);
+
+    *xd = x * radial + 2.0 * self->p1 * x * y + self->p2 * (r2 + 2.0 * x * x);
+    *yd = y * radial + self->p1 * (r2 + 2.0 * y * y) + 2.0 * self->p2 * x * y;
+
+    jacobian[0] = radial + 2.0 * x * x * dradial + 2.0 * self->p1 * y + 6.0 * self->p2 * x;
+    jacobian[1] = 2.0 * x * y * dradial + 2.0 * self->p1 * x + 2.0 * self->p2 * y;
+    jacobian[2] = jacobian[1];
+    jacobian[3] = radial + 2.0 * y * y * dradial + 6.0 * self->p1 * y + 2.0 * self->p2 * x;
+}
+
+
+static void rvPose_Undistort(rvPose *self, const CvPoint2D32f *imagePoints, int count)
+// Remove the lens distortion from the image points to give points in normalized
+// coordinates.  The distortion is inverted iteratively as OpenCV does.
+{
+    int i;
+    int j;
+
+    for (i = 0; i < count; ++i)
+    {
+        double x0 = (imagePoints[i].x - self->cx) / self->fx;
+        double y0 = (imagePoints[i].y - self->cy) / self->fy;
+        double x = x0;
+        double y = y0;
+
+        for (j = 0; j < 5; ++j)
+        {
+            double r2 = x * x + y * y;
+            double radial = 1.0 + r2 * (self->k1 + r2 * (self->k2 + r2 * self->k3));
+            double dx = 2.0 * self->p1 * x * y + self->p2 * (r2 + 2.0 * x * x);
+            double dy = self->p1 * (r2 + 2.0 * y * y) + 2.0 * self->p2 * x * y;
+
+            x = (x0 - dx) / radial;
+            y = (y0 - dy) / radial;
+        }
+
+        self->undistorted[i << 1] = x;
+        self->undistorted[(i << 1) + 1] = y;
+    }
+}
+
+
+static bool rvPose_FindHomography(rvPose *self, const CvPoint3D32f *objectPoints, const double *points, int count, double homography[9])
+// Fit the homography from the target plane to the undistorted image points by
+// least squares.  Both sets of points are centered and scaled first to keep the
+// equations well conditioned.  Returns false if the points are degenerate.
+{
+    int i;
+    int j;
+    int k;
+    double objectMean[2] = { 0.0, 0.0 };
+    double imageMean[2] = { 0.0, 0.0 };
+    double objectScale = 0.0;
+    double imageScale = 0.0;
+    double a[64];
+    double b[8];
+    double h[9];
+
+    // Find the centers of the points.
+    for (i = 0; i < count; ++i)
+    {
+        objectMean[0] += objectPoints[i].x;
+        objectMean[1] += objectPoints[i].y;
+        imageMean[0] += points[i << 1];
+        imageMean[1] += points[(i << 1) + 1];
+    }
+    for (i = 0; i < 2; ++i)
+    {
+        objectMean[i] /= count;
+        imageMean[i] /= count;
+    }
+
+    // Scale the points to an average distance of one from their centers.
+    for (i = 0; i < count; ++i)
+    {
+        objectScale += sqrt((objectPoints[i].x - objectMean[0]) * (objectPoints[i].x - objectMean[0]) +
+                            (objectPoints[i].y - objectMean[1]) * (objectPoints[i].y - objectMean[1]));
+        imageScale += sqrt((points[i << 1] - imageMean[0]) * (points[i << 1] - imageMean[0]) +
+                           (points[(i << 1) + 1] - imageMean[1]) * (points[(i << 1) + 1] - imageMean[1]));
+    }
+    if ((objectScale < DBL_EPSILON) || (imageScale < DBL_EPSILON)) return false;
+    objectScale = count / objectScale;
+    imageScale = count / imageScale;
+
+    // Accumulate the normal equations of the homography with its last element fixed at one.
+    memset(a, 0, sizeof(a));
+    memset(b, 0, sizeof(b));
+    for (i = 0; i < count; ++i)
+    {
+        double X = (objectPoints[i].x - objectMean[0]) * objectScale;
+        double Y = (objectPoints[i].y - objectMean[1]) * objectScale;
+        double u = (points[i << 1] - imageMean[0]) * imageScale;
+        double v = (points[(i << 1) + 1] - imageMean[1]) * imageScale;
+        double ru[8];
+        double rv[8];
+
+        ru[0] = X;   ru[1] = Y;   ru[2] = 1.0; ru[3] = 0.0; ru[4] = 0.0; ru[5] = 0.0; ru[6] = -u * X; ru[7] = -u * Y;
+        rv[0] = 0.0; rv[1] = 0.0; rv[2] = 0.0; rv[3] = X;   rv[4] = Y;   rv[5] = 1.0; rv[6] = -v * X; rv[7] = -v * Y;
+
+        for (j = 0; j < 8; ++j)
+        {
+            for (k = j; k < 8; ++k) a[j * 8 + k] += ru[j] * ru[k] + rv[j] * rv[k];
+            b[j] += ru[j] * u + rv[j] * v;
+        }
+    }
+    for (j = 0; j < 8; ++j)
+    {
+        for (k = 0; k < j; ++k) a[j * 8 + k] = a[k * 8 + j];
+    }
+
+    // Solve for the homography between the scaled points.
+    if (!rvPose_SolveLinear(a, b, 8)) return false;
+    for (i = 0; i < 8; ++i) h[i] = b[i];
+    h[8] = 1.0;
+
+    // Undo the centering and scaling.  The homography maps the scaled object
+    // points so the object scaling is applied to its columns, and the image
+    // scaling is removed from its rows.
+    for (i = 0; i < 3; ++i)
+    {
+        double c0 = h[i * 3] * objectScale;
+        double c1 = h[i * 3 + 1] * objectScale;
+        double c2 = h[i * 3 + 2] - c0 * objectMean[0] - c1 * objectMean[1];
+
+        homography[i * 3] = c0;
+        homography[i * 3 + 1] = c1;
+        homography[i * 3 + 2] = c2;
+    }
+    for (i = 0; i < 3; ++i)
+    {
+        homography[i] = homography[i] / imageScale + imageMean[0] * homography[6 + i];
+        homography[3 + i] = homography[3 + i] / imageScale + imageMean[1] * homography[6 + i];
+    }
+
+    return true;
+}
+
+
+static bool rvPose_DecomposeHomography(const double homography[9], double rotation[9], double translation[3])
+// Decompose the homography from the target plane to normalized coordinates into
+// a rotation and translation.  The first two columns of the rotation are made
+// orthonormal symmetrically so neither is favored.  Returns false if the
+// homography is degenerate.
+{
+    int i;
+    double scale;
+    double norm1 = sqrt(homography[0] * homography[0] + homography[3] * homography[3] + homography[6] * homography[6]);
+    double norm2 = sqrt(homography[1] * homography[1] + homography[4] * homography[4] + homography[7] * homography[7]);
+    double r1[3];
+    double r2[3];
+    double sum[3];
+    double difference[3];
+    double sumNorm;
+    double differenceNorm;
+
+    if (norm1 + norm2 < DBL_EPSILON) return false;
+
+    // Scale the columns to unit length with the target in front of the camera.
+    scale = 2.0 / (norm1 + norm2);
+    if (homography[8] < 0.0) scale = -scale;
+
+    for (i = 0; i < 3; ++i)
+    {
+        r1[i] = homography[i * 3] / norm1;
+        r2[i] = homography[i * 3 + 1] / norm2;
+        if (scale < 0.0)
+        {
+            r1[i] = -r1[i];
+            r2[i] = -r2[i];
+        }
+        translation[i] = homography[i * 3 + 2] * scale;
+        sum[i] = r1[i] + r2[i];
+        difference[i] = r1[i] - r2[i];
+    }
+
+    // Rotate the columns apart about their bisector until they are perpendicular.
+    sumNorm = sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+    differenceNorm = sqrt(difference[0] * difference[0] + difference[1] * difference[1] + difference[2] * difference[2]);
+    if ((sumNorm < DBL_EPSILON) || (differenceNorm < DBL_EPSILON)) return false;
+    for (i = 0; i < 3; ++i)
+    {
+        r1[i] = (sum[i] / sumNorm + difference[i] / differenceNorm) * sqrt(0.5);
+        r2[i] = (sum[i] / sumNorm - difference[i] / differenceNorm) * sqrt(0.5);
+    }
+
+    // The third column is perpendicular to the first two.
+    for (i = 0; i < 3; ++i)
+    {
+        rotation[i * 3] = r1[i];
+        rotation[i * 3 + 1] = r2[i];
+    }
+    rotation[2] = r1[1] * r2[2] - r1[2] * r2[1];
+    rotation[5] = r1[2] * r2[0] - r1[0] * r2[2];
+    rotation[8] = r1[0] * r2[1] - r1[1] * r2[0];
+
+    return true;
+}
+
+
+static bool rvPose_Accumulate(rvPose *self, const CvPoint3D32f *objectPoints, const CvPoint2D32f *imagePoints, const double *weights,
+                              int count, const double rotation[9], const double translation[3], double jtj[36], double jtr[6], double *error)
+// Find the sum of the squared reprojection errors of the pose and accumulate the
+// normal equations of its Gauss-Newton step.  The first three parameters are a
+// small rotation applied to the rotation and the last three are the translation.
+// Each point is scaled by its weight if there are weights, and points with no
+// weight are skipped.  Returns false if a point is behind the camera.
+{
+    int i;
+    int j;
+    int k;
+
+    *error = 0.0;
+    memset(jtj, 0, sizeof(double) * 36);
+    memset(jtr, 0, sizeof(double) * 6);
+
+    for (i = 0; i < count; ++i)
+    {
+        double a[3];
+        double p[3];
+        double x;
+        double y;
+        double xd;
+        double yd;
+        double iz;
+        double ru;
+        double rv;
+        double distortion[4];
+        double gu[3];
+        double gv[3];
+        double ju[6];
+        double jv[6];
+        double weight = weights ? weights[i] : 1.0;
+
+        if (weight == 0.0) continue;
+
+        // Transform the point into the camera frame.
+        for (j = 0; j < 3; ++j)
+        {
+            a[j] = rotation[j * 3] * objectPoints[i].x + rotation[j * 3 + 1] * objectPoints[i].y + rotation[j * 3 + 2] * objectPoints[i].z;
+            p[j] = a[j] + translation[j];
+        }
+        if (p[2] < DBL_EPSILON) return false;
+
+        // Project and distort the point and find its error in pixels.
+        iz = 1.0 / p[2];
+        x = p[0] * iz;
+        y = p[1] * iz;
+        rvPose_Distort(self, x, y, &xd, &yd, distortion);
+        ru = self->fx * xd + self->cx - imagePoints[i].x;
+        rv = self->fy * yd + self->cy - imagePoints[i].y;
+        *error += weight * (ru * ru + rv * rv);
+
+        // Chain the derivatives of the pixel position with respect to the point
+        // in the camera frame.
+        gu[0] = self->fx * distortion[0] * iz;
+        gu[1] = self->fx * distortion[1] * iz;
+        gu[2] = -self->fx * (distortion[0] * x + distortion[1] * y) * iz;
+        gv[0] = self->fy * distortion[2] * iz;
+        gv[1] = self->fy * distortion[3] * iz;
+        gv[2] = -self->fy * (distortion[2] * x + distortion[3] * y) * iz;
+
+        // A small rotation w moves the point by w x a so its derivative is a x g.
+        ju[0] = a[1] * gu[2] - a[2] * gu[1];
+        ju[1] = a[2] * gu[0] - a[0] * gu[2];
+        ju[2] = a[0] * gu[1] - a[1] * gu[0];
+        jv[0] = a[1] * gv[2] - a[2] * gv[1];
+        jv[1] = a[2] * gv[0] - a[0] * gv[2];
+        jv[2] = a[0] * gv[1] - a[1] * gv[0];
+        for (j = 0; j < 3; ++j)
+        {
+            ju[3 + j] = gu[j];
+            jv[3 + j] = gv[j];
+        }
+
+        // Accumulate the upper triangle of the normal equations.
+        for (j = 0; j < 6; ++j)
+        {
+            for (k = j; k < 6; ++k) jtj[j * 6 + k] += weight * (ju[j] * ju[k] + jv[j] * jv[k]);
+            jtr[j] += weight * (ju[j] * ru + jv[j] * rv);
+        }
+    }
+
+    // Fill in the lower triangle.
+    for (j = 0; j < 6; ++j)
+    {
+        for (k = 0; k < j; ++k) jtj[j * 6 + k] = jtj[k * 6 + j];
+    }
+
+    return true;
+}
+
+
+static void rvPose_SetCovariance(rvPose *self, const double jtj[36], double error, int observations)
+// Find the covariance of the pose from the normal equations at the pose.  The
+// variance of each observation is estimated from the sum of the squared
+// reprojection errors left over after fitting the six pose parameters.  The
+// covariance is zero if the pose isn't constrained.
+{
+    int i;
+    int j;
+    double variance;
+    double a[36];
+    double column[6];
+
+    memset(self->covariance, 0, sizeof(self->covariance));
+    if (observations <= 6) return;
+    variance = error / (observations - 6);
+
+    // Invert the normal equations one column at a time.
+    for (i = 0; i < 6; ++i)
+    {
+        memcpy(a, jtj, sizeof(a));
+        memset(column, 0, sizeof(column));
+        column[i] = 1.0;
+        if (!rvPose_SolveLinear(a, column, 6))
+        {
+            memset(self->covariance, 0, sizeof(self->covariance));
+            return;
+        }
+
+        for (j = 0; j < 6; ++j) self->covariance[j * 6 + i] = column[j] * variance;
+    }
+}
+
+
+static bool rvPose_Optimize(rvPose *self, const CvPoint3D32f *objectPoints, const CvPoint2D32f *imagePoints, const double *weights,
+                            int count, double rotation[9], double translation[3], int iterations)
+// Refine the pose by Levenberg-Marquardt iterations.  A step which increases the
+// reprojection error is undone and retried with more damping, while a step
+// which reduces it is kept and the damping is relaxed.  The points are weighted
+// as by rvPose_Accumulate().  The RMS reprojection error and covariance of the
+// final pose are kept.  Returns false if the starting pose puts a point behind
+// the camera.
+{
+    int i;
+    int j;
+    int used = count;
+    double error;
+    double weightSum = count;
+    double damping = RVPOSE_DAMPING;
+    double jtj[36];
+    double jtr[6];
+
+    // Find the error and normal equations at the starting pose.
+    if (!rvPose_Accumulate(self, objectPoints, imagePoints, weights, count, rotation, translation, jtj, jtr, &error)) return false;
+
+    for (i = 0; i < iterations; ++i)
+    {
+        double a[36];
+        double step[6];
+        double stepRotation[9];
+        double nextRotation[9];
+        double nextTranslation[3];
+        double nextJtj[36];
+        double nextJtr[6];
+        double nextError;
+
+        // Solve the damped normal equations for the step.
+        memcpy(a, jtj, sizeof(a));
+        for (j = 0; j < 6; ++j)
+        {
+            a[j * 7] += damping * jtj[j * 7];
+            step[j] = -jtr[j];
+        }
+        if (!rvPose_SolveLinear(a, step, 6)) break;
+
+        // Apply the small rotation before the rotation and add the translation.
+        rvPose_VectorToRotation(step, stepRotation);
+        for (j = 0; j < 9; ++j)
+        {
+            int row = j / 3;
+            int column = j % 3;
+
+            nextRotation[j] = stepRotation[row * 3] * rotation[column] + stepRotation[row * 3 + 1] * rotation[3 + column] +
+                              stepRotation[row * 3 + 2] * rotation[6 + column];
+        }
+        for (j = 0; j < 3; ++j) nextTranslation[j] = translation[j] + step[3 + j];
+
+        // Retry with more damping if the step made the pose worse.  A step
+        // which leaves the error unchanged means the pose has converged.
+        if (!rvPose_Accumulate(self, objectPoints, imagePoints, weights, count, nextRotation, nextTranslation, nextJtj, nextJtr, &nextError))
+        {
+            damping *= 10.0;
+            continue;
+        }
+        if (nextError >= error)
+        {
+            if (nextError - error <= error * RVPOSE_TOLERANCE) break;
+            damping *= 10.0;
+            continue;
+        }
+
+        // Keep the step and relax the damping.
+        memcpy(rotation, nextRotation, sizeof(nextRotation));
+        memcpy(translation, nextTranslation, sizeof(nextTranslation));
+        memcpy(jtj, nextJtj, sizeof(nextJtj));
+        memcpy(jtr, nextJtr, sizeof(nextJtr));
+        damping *= 0.1;
+
+        // Stop once the error stops improving.
+        if (error - nextError <= error * RVPOSE_TOLERANCE)
+        {
+            error = nextError;
+            break;
+        }
+        error = nextError;
+    }
+
+    if (weights)
+    {
+        used = 0;
+        weightSum = 0.0;
+        for (i = 0; i < count; ++i)
+        {
+            weightSum += weights[i];
+            if (weights[i] != 0.0) ++used;
+        }
+    }
+    self->error = weightSum > 0.0 ? sqrt(error / weightSum) : 0.0;
+    rvPose_SetCovariance(self, jtj, error, used * 2);
+
+    return true;
+}
+
+
+static void rvPose_Residuals(rvPose *self, const CvPoint3D32f *objectPoints, const CvPoint2D32f *imagePoints, int count,
+                             const double rotation[9], const double translation[3], double *residuals)
+// Find the reprojection error in pixels of each point under the pose.  Points
+// behind the camera get the largest error.
+{
+    int i;
+    int j;
+
+    for (i = 0; i < count; ++i)
+    {
+        double p[3];
+        double xd;
+        double yd;
+        double ru;
+        double rv;
+        double distortion[4];
+
+        // Transform the point into the camera frame.
+        for (j = 0; j < 3; ++j)
+        {
+            p[j] = rotation[j * 3] * objectPoints[i].x + rotation[j * 3 + 1] * objectPoints[i].y +
+                   rotation[j * 3 + 2] * objectPoints[i].z + translation[j];
+        }
+        if (p[2] < DBL_EPSILON)
+        {
+            residuals[i] = DBL_MAX;
+            continue;
+        }
+
+        // Project and distort the point and find its error.
+        rvPose_Distort(self, p[0] / p[2], p[1] / p[2], &xd, &yd, distortion);
+        ru = self->fx * xd + self->cx - imagePoints[i].x;
+        rv = self->fy * yd + self->cy - imagePoints[i].y;
+        residuals[i] = sqrt(ru * ru + rv * rv);
+    }
+}
+
+
+static int rvPose_Score(const double *residuals, int groupCount, int groupSize, double threshold,
+                        bool *inliers, double *groupResiduals, double *cost)
+// Find the RMS reprojection error of each group of points from the error of its
+// points and mark the groups within the threshold as inliers.  The cost sums the
+// squared group errors with each limited to the threshold so poses with the same
+// number of inliers are ranked by how well they fit.  Returns the number of inliers.
+{
+    int i;
+    int j;
+    int inlierCount = 0;
+
+    *cost = 0.0;
+    for (i = 0; i < groupCount; ++i)
+    {
+        double sum = 0.0;
+
+        for (j = 0; j < groupSize; ++j)
+        {
+            double residual = residuals[i * groupSize + j];
+
+            sum += residual < DBL_MAX ? residual * residual : DBL_MAX / groupSize;
+        }
+
+        groupResiduals[i] = sqrt(sum / groupSize);
+        inliers[i] = groupResiduals[i] <= threshold;
+        if (inliers[i])
+        {
+            *cost += groupResiduals[i] * groupResiduals[i];
+            ++inlierCount;
+        }
+        else
+        {
+            *cost += threshold * threshold;
+        }
+    }
+
+    return inlierCount;
+}
+
+
+static bool rvPose_KeepInlierError(rvPose *self, const CvPoint3D32f *objectPoints, const CvPoint2D32f *imagePoints, int groupCount, int groupSize,
+                                   const bool *inliers, int inlierCount, const double rotation[9], const double translation[3])
+// Keep the RMS reprojection error and covariance of the pose from the points of
+// the inlier groups alone.  Returns false if a point is behind the camera.
+{
+    int i;
+    int count = groupCount * groupSize;
+    double sum;
+    double jtj[36];
+    double jtr[6];
+
+    for (i = 0; i < count; ++i) self->weights[i] = inliers[i / groupSize] ? 1.0 : 0.0;
+    if (!rvPose_Accumulate(self, objectPoints, imagePoints, self->weights, count, rotation, translation, jtj, jtr, &sum)) return false;
+    self->error = sqrt(sum / (inlierCount * groupSize));
+    rvPose_SetCovariance(self, jtj, sum, inlierCount * groupSize * 2);
+
+    return true;
+}
+
+
+static void rvPose_SolveLanes(rvPose *self, const double *input, double *output)
+// Solve the poses of a batch of square tags, one tag to each lane.  The input
+// holds the half size of each tag followed by the x and y image position of
+// each of its four corners, lane by lane.  The corners are the target points
+// (h, h), (-h, h), (-h, -h) and (h, -h) for a half size h.  The output holds the
+// rotation matrix in row order, the translation and the summed squared
+// reprojection error, lane by lane.  Every lane runs the same steps so a lane
+// which fails gives an error which is not finite.
+//
+// The starting pose comes from the closed form homography from the unit square
+// to the undistorted corners, and is refined by damped Gauss-Newton steps with
+// the rotation updated by the Cayley transform which needs no trigonometry.
+// The pose with the least error seen is kept for each lane.
+{
+    int i;
+    int j;
+    int k;
+    int c;
+    int iteration;
+    static const double cornerX[4] = { 1.0, -1.0, -1.0, 1.0 };
+    static const double cornerY[4] = { 1.0, 1.0, -1.0, -1.0 };
+    rvPoseLanes zero = RVPOSE_SET(0.0);
+    rvPoseLanes one = RVPOSE_SET(1.0);
+    rvPoseLanes two = RVPOSE_SET(2.0);
+    rvPoseLanes half = RVPOSE_SET(0.5);
+    rvPoseLanes fx = RVPOSE_SET(self->fx);
+    rvPoseLanes fy = RVPOSE_SET(self->fy);
+    rvPoseLanes cx = RVPOSE_SET(self->cx);
+    rvPoseLanes cy = RVPOSE_SET(self->cy);
+    rvPoseLanes k1 = RVPOSE_SET(self->k1);
+    rvPoseLanes k2 = RVPOSE_SET(self->k2);
+    rvPoseLanes k3 = RVPOSE_SET(self->k3);
+    rvPoseLanes p1 = RVPOSE_SET(self->p1);
+    rvPoseLanes p2 = RVPOSE_SET(self->p2);
+    rvPoseLanes size;
+    rvPoseLanes px[4];
+    rvPoseLanes py[4];
+    rvPoseLanes ux[4];
+    rvPoseLanes uy[4];
+    rvPoseLanes h[9];
+    rvPoseLanes r[9];
+    rvPoseLanes t[3];
+    rvPoseLanes bestR[9];
+    rvPoseLanes bestT[3];
+    rvPoseLanes bestError = RVPOSE_SET(DBL_MAX);
+
+    // Load the half size and corners.
+    size = RVPOSE_LOAD(input);
+    for (c = 0; c < 4; ++c)
+    {
+        px[c] = RVPOSE_LOAD(input + (1 + c * 2) * RVPOSE_LANES);
+        py[c] = RVPOSE_LOAD(input + (2 + c * 2) * RVPOSE_LANES);
+    }
+
+    // Remove the lens distortion from the corners.
+    for (c = 0; c < 4; ++c)
+    {
+        rvPoseLanes x0 = RVPOSE_DIV(RVPOSE_SUB(px[c], cx), fx);
+        rvPoseLanes y0 = RVPOSE_DIV(RVPOSE_SUB(py[c], cy), fy);
+        rvPoseLanes x = x0;
+        rvPoseLanes y = y0;
+
+        for (i = 0; i < 5; ++i)
+        {
+            rvPoseLanes xy = RVPOSE_MUL(x, y);
+            rvPoseLanes xx = RVPOSE_MUL(x, x);
+            rvPoseLanes yy = RVPOSE_MUL(y, y);
+            rvPoseLanes r2 = RVPOSE_ADD(xx, yy);
+            rvPoseLanes radial = RVPOSE_ADD(one, RVPOSE_MUL(r2, RVPOSE_ADD(k1, RVPOSE_MUL(r2, RVPOSE_ADD(k2, RVPOSE_MUL(r2, k3))))));
+            rvPoseLanes dx = RVPOSE_ADD(RVPOSE_MUL(RVPOSE_MUL(two, p1), xy), RVPOSE_MUL(p2, RVPOSE_ADD(r2, RVPOSE_MUL(two, xx))));
+            rvPoseLanes dy = RVPOSE_ADD(RVPOSE_MUL(p1, RVPOSE_ADD(r2, RVPOSE_MUL(two, yy))), RVPOSE_MUL(RVPOSE_MUL(two, p2), xy));
+
+            x = RVPOSE_DIV(RVPOSE_SUB(x0, dx), radial);
+            y = RVPOSE_DIV(RVPOSE_SUB(y0, dy), radial);
+        }
+
+        ux[c] = x;
+        uy[c] = y;
+    }
+
+    // Find the homography from the unit square to the corners in closed form.
+    {
+        rvPoseLanes sx = RVPOSE_ADD(RVPOSE_SUB(ux[0], ux[1]), RVPOSE_SUB(ux[2], ux[3]));
+        rvPoseLanes sy = RVPOSE_ADD(RVPOSE_SUB(uy[0], uy[1]), RVPOSE_SUB(uy[2], uy[3]));
+        rvPoseLanes dx1 = RVPOSE_SUB(ux[1], ux[2]);
+        rvPoseLanes dx2 = RVPOSE_SUB(ux[3], ux[2]);
+        rvPoseLanes dy1 = RVPOSE_SUB(uy[1], uy[2]);
+        rvPoseLanes dy2 = RVPOSE_SUB(uy[3], uy[2]);
+        rvPoseLanes den = RVPOSE_SUB(RVPOSE_MUL(dx1, dy2), RVPOSE_MUL(dx2, dy1));
+        rvPoseLanes g = RVPOSE_DIV(RVPOSE_SUB(RVPOSE_MUL(sx, dy2), RVPOSE_MUL(sy, dx2)), den);
+        rvPoseLanes e = RVPOSE_DIV(RVPOSE_SUB(RVPOSE_MUL(dx1, sy), RVPOSE_MUL(dy1, sx)), den);
+        rvPoseLanes scale = RVPOSE_DIV(RVPOSE_SET(-0.5), size);
+
+        // The unit square is the target square scaled by -1 / 2h and moved by
+        // one half, which scales the first two columns and adds half of each to
+        // the third.
+        h[0] = RVPOSE_ADD(RVPOSE_SUB(ux[1], ux[0]), RVPOSE_MUL(g, ux[1]));
+        h[1] = RVPOSE_ADD(RVPOSE_SUB(ux[3], ux[0]), RVPOSE_MUL(e, ux[3]));
+        h[3] = RVPOSE_ADD(RVPOSE_SUB(uy[1], uy[0]), RVPOSE_MUL(g, uy[1]));
+        h[4] = RVPOSE_ADD(RVPOSE_SUB(uy[3], uy[0]), RVPOSE_MUL(e, uy[3]));
+        h[6] = g;
+        h[7] = e;
+        h[2] = RVPOSE_ADD(RVPOSE_MUL(half, RVPOSE_ADD(h[0], h[1])), ux[0]);
+        h[5] = RVPOSE_ADD(RVPOSE_MUL(half, RVPOSE_ADD(h[3], h[4])), uy[0]);
+        h[8] = RVPOSE_ADD(RVPOSE_MUL(half, RVPOSE_ADD(g, e)), one);
+        for (i = 0; i < 3; ++i)
+        {
+            h[i * 3] = RVPOSE_MUL(h[i * 3], scale);
+            h[i * 3 + 1] = RVPOSE_MUL(h[i * 3 + 1], scale);
+        }
+    }
+
+    // Decompose the homography into the starting pose as rvPose_DecomposeHomography() does.
+    {
+        rvPoseLanes norm1 = RVPOSE_SQRT(RVPOSE_ADD(RVPOSE_ADD(RVPOSE_MUL(h[0], h[0]), RVPOSE_MUL(h[3], h[3])), RVPOSE_MUL(h[6], h[6])));
+        rvPoseLanes norm2 = RVPOSE_SQRT(RVPOSE_ADD(RVPOSE_ADD(RVPOSE_MUL(h[1], h[1]), RVPOSE_MUL(h[4], h[4])), RVPOSE_MUL(h[7], h[7])));
+        rvPoseLanes sign = RVPOSE_SELECT(RVPOSE_LESS(h[8], zero), RVPOSE_SET(-1.0), one);
+        rvPoseLanes scale = RVPOSE_DIV(RVPOSE_MUL(two, sign), RVPOSE_ADD(norm1, norm2));
+        rvPoseLanes sum[3];
+        rvPoseLanes difference[3];
+        rvPoseLanes sumNorm;
+        rvPoseLanes differenceNorm;
+
+        for (i = 0; i < 3; ++i)
+        {
+            rvPoseLanes r1 = RVPOSE_DIV(RVPOSE_MUL(h[i * 3], sign), norm1);
+            rvPoseLanes r2 = RVPOSE_DIV(RVPOSE_MUL(h[i * 3 + 1], sign), norm2);
+
+            t[i] = RVPOSE_MUL(h[i * 3 + 2], scale);
+            sum[i] = RVPOSE_ADD(r1, r2);
+            difference[i] = RVPOSE_SUB(r1, r2);
+        }
+
+        sumNorm = RVPOSE_SQRT(RVPOSE_ADD(RVPOSE_ADD(RVPOSE_MUL(sum[0], sum[0]), RVPOSE_MUL(sum[1], sum[1])), RVPOSE_MUL(sum[2], sum[2])));
+        differenceNorm = RVPOSE_SQRT(RVPOSE_ADD(RVPOSE_ADD(RVPOSE_MUL(difference[0], difference[0]), RVPOSE_MUL(difference[1], difference[1])),
+                                                RVPOSE_MUL(difference[2], difference[2])));
+        sumNorm = RVPOSE_DIV(RVPOSE_SET(sqrt(0.5)), sumNorm);
+        differenceNorm = RVPOSE_DIV(RVPOSE_SET(sqrt(0.5)), differenceNorm);
+        for (i = 0; i < 3; ++i)
+        {
+            r[i * 3] = RVPOSE_ADD(RVPOSE_MUL(sum[i], sumNorm), RVPOSE_MUL(difference[i], differenceNorm));
+            r[i * 3 + 1] = RVPOSE_SUB(RVPOSE_MUL(sum[i], sumNorm), RVPOSE_MUL(difference[i], differenceNorm));
+        }
+        r[2] = RVPOSE_SUB(RVPOSE_MUL(r[3], r[7]), RVPOSE_MUL(r[6], r[4]));
+        r[5] = RVPOSE_SUB(RVPOSE_MUL(r[6], r[1]), RVPOSE_MUL(r[0], r[7]));
+        r[8] = RVPOSE_SUB(RVPOSE_MUL(r[0], r[4]), RVPOSE_MUL(r[3], r[1]));
+    }
+
+    // Start from the homography pose.
+    for (i = 0; i < 9; ++i) bestR[i] = r[i];
+    for (i = 0; i < 3; ++i) bestT[i] = t[i];
+
+    for (iteration = 0; ; ++iteration)
+    {
+        rvPoseLanes error = zero;
+        rvPoseLanes jtj[36];
+        rvPoseLanes jtr[6];
+        rvPoseLanes step[6];
+        rvPoseLanes better;
+
+        // Accumulate the error and the upper triangle of the normal equations
+        // as rvPose_Accumulate() does.
+        for (j = 0; j < 36; ++j) jtj[j] = zero;
+        for (j = 0; j < 6; ++j) jtr[j] = zero;
+        for (c = 0; c < 4; ++c)
+        {
+            rvPoseLanes X = RVPOSE_MUL(size, RVPOSE_SET(cornerX[c]));
+            rvPoseLanes Y = RVPOSE_MUL(size, RVPOSE_SET(cornerY[c]));
+            rvPoseLanes a[3];
+            rvPoseLanes p[3];
+            rvPoseLanes gu[3];
+            rvPoseLanes gv[3];
+            rvPoseLanes ju[6];
+            rvPoseLanes jv[6];
+            rvPoseLanes iz;
+            rvPoseLanes x;
+            rvPoseLanes y;
+            rvPoseLanes xy;
+            rvPoseLanes xx;
+            rvPoseLanes yy;
+            rvPoseLanes r2;
+            rvPoseLanes radial;
+            rvPoseLanes dradial;
+            rvPoseLanes xd;
+            rvPoseLanes yd;
+            rvPoseLanes d0;
+            rvPoseLanes d1;
+            rvPoseLanes d3;
+            rvPoseLanes ru;
+            rvPoseLanes rv;
+
+            // Transform the corner into the camera frame and project it.
+            for (j = 0; j < 3; ++j)
+            {
+                a[j] = RVPOSE_ADD(RVPOSE_MUL(r[j * 3], X), RVPOSE_MUL(r[j * 3 + 1], Y));
+                p[j] = RVPOSE_ADD(a[j], t[j]);
+            }
+            iz = RVPOSE_DIV(one, p[2]);
+            x = RVPOSE_MUL(p[0], iz);
+            y = RVPOSE_MUL(p[1], iz);
+
+            // Distort the corner as rvPose_Distort() does.
+            xy = RVPOSE_MUL(x, y);
+            xx = RVPOSE_MUL(x, x);
+            yy = RVPOSE_MUL(y, y);
+            r2 = RVPOSE_ADD(xx, yy);
+            radial = RVPOSE_ADD(one, RVPOSE_MUL(r2, RVPOSE_ADD(k1, RVPOSE_MUL(r2, RVPOSE_ADD(k2, RVPOSE_MUL(r2, k3))))));
+            dradial = RVPOSE_ADD(k1, RVPOSE_MUL(r2, RVPOSE_ADD(RVPOSE_MUL(two, k2), RVPOSE_MUL(r2, RVPOSE_MUL(RVPOSE_SET(3.0), k3)))));
+            xd = RVPOSE_ADD(RVPOSE_ADD(RVPOSE_MUL(x, radial), RVPOSE_MUL(RVPOSE_MUL(two, p1), xy)), RVPOSE_MUL(p2, RVPOSE_ADD(r2, RVPOSE_MUL(two, xx))));
+            yd = RVPOSE_ADD(RVPOSE_ADD(RVPOSE_MUL(y, radial), RVPOSE_MUL(p1, RVPOSE_ADD(r2, RVPOSE_MUL(two, yy)))), RVPOSE_MUL(RVPOSE_MUL(two, p2), xy));
+            d0 = RVPOSE_ADD(RVPOSE_ADD(radial, RVPOSE_MUL(RVPOSE_MUL(two, xx), dradial)),
+                            RVPOSE_ADD(RVPOSE_MUL(RVPOSE_MUL(two, p1), y), RVPOSE_MUL(RVPOSE_MUL(RVPOSE_SET(6.0), p2), x)));
+            d1 = RVPOSE_ADD(RVPOSE_MUL(RVPOSE_MUL(two, xy), dradial), RVPOSE_MUL(two, RVPOSE_ADD(RVPOSE_MUL(p1, x), RVPOSE_MUL(p2, y))));
+            d3 = RVPOSE_ADD(RVPOSE_ADD(radial, RVPOSE_MUL(RVPOSE_MUL(two, yy), dradial)),
+                            RVPOSE_ADD(RVPOSE_MUL(RVPOSE_MUL(RVPOSE_SET(6.0), p1), y), RVPOSE_MUL(RVPOSE_MUL(two, p2), x)));
+
+            // Find the error in pixels.
+            ru = RVPOSE_SUB(RVPOSE_ADD(RVPOSE_MUL(fx, xd), cx), px[c]);
+            rv = RVPOSE_SUB(RVPOSE_ADD(RVPOSE_MUL(fy, yd), cy), py[c]);
+            error = RVPOSE_ADD(error, RVPOSE_ADD(RVPOSE_MUL(ru, ru), RVPOSE_MUL(rv, rv)));
+
+            // Chain the derivatives of the pixel position with respect to the
+            // corner in the camera frame.
+            gu[0] = RVPOSE_MUL(RVPOSE_MUL(fx, d0), iz);
+            gu[1] = RVPOSE_MUL(RVPOSE_MUL(fx, d1), iz);
+            gu[2] = RVPOSE_SUB(zero, RVPOSE_ADD(RVPOSE_MUL(gu[0], x), RVPOSE_MUL(gu[1], y)));
+            gv[0] = RVPOSE_MUL(RVPOSE_MUL(fy, d1), iz);
+            gv[1] = RVPOSE_MUL(RVPOSE_MUL(fy, d3), iz);
+            gv[2] = RVPOSE_SUB(zero, RVPOSE_ADD(RVPOSE_MUL(gv[0], x), RVPOSE_MUL(gv[1], y)));
+
+            // A small rotation w moves the corner by w x a so its derivative is a x g.
+            ju[0] = RVPOSE_SUB(RVPOSE_MUL(a[1], gu[2]), RVPOSE_MUL(a[2], gu[1]));
+            ju[1] = RVPOSE_SUB(RVPOSE_MUL(a[2], gu[0]), RVPOSE_MUL(a[0], gu[2]));
+            ju[2] = RVPOSE_SUB(RVPOSE_MUL(a[0], gu[1]), RVPOSE_MUL(a[1], gu[0]));
+            jv[0] = RVPOSE_SUB(RVPOSE_MUL(a[1], gv[2]), RVPOSE_MUL(a[2], gv[1]));
+            jv[1] = RVPOSE_SUB(RVPOSE_MUL(a[2], gv[0]), RVPOSE_MUL(a[0], gv[2]));
+            jv[2] = RVPOSE_SUB(RVPOSE_MUL(a[0], gv[1]), RVPOSE_MUL(a[1], gv[0]));
+            for (j = 0; j < 3; ++j)
+            {
+                ju[3 + j] = gu[j];
+                jv[3 + j] = gv[j];
+            }
+
+            for (j = 0; j < 6; ++j)
+            {
+                for (k = j; k < 6; ++k) jtj[j * 6 + k] = RVPOSE_ADD(jtj[j * 6 + k], RVPOSE_ADD(RVPOSE_MUL(ju[j], ju[k]), RVPOSE_MUL(jv[j], jv[k])));
+                jtr[j] = RVPOSE_ADD(jtr[j], RVPOSE_ADD(RVPOSE_MUL(ju[j], ru), RVPOSE_MUL(jv[j], rv)));
+            }
+        }
+
+        // Keep the pose of each lane whose error improved.  Poses with corners
+        // behind the camera are never kept.
+        better = RVPOSE_LESS(error, bestError);
+        for (c = 0; c < 4; ++c)
+        {
+            rvPoseLanes z = RVPOSE_ADD(RVPOSE_ADD(RVPOSE_MUL(r[6], RVPOSE_MUL(size, RVPOSE_SET(cornerX[c]))),
+                                                  RVPOSE_MUL(r[7], RVPOSE_MUL(size, RVPOSE_SET(cornerY[c])))), t[2]);
+
+            better = RVPOSE_SELECT(RVPOSE_LESS(zero, z), better, zero);
+        }
+        for (i = 0; i < 9; ++i) bestR[i] = RVPOSE_SELECT(better, r[i], bestR[i]);
+        for (i = 0; i < 3; ++i) bestT[i] = RVPOSE_SELECT(better, t[i], bestT[i]);
+        bestError = RVPOSE_SELECT(better, error, bestError);
+
+        if (iteration == RVPOSE_ITERATIONS) break;
+
+        // Solve the damped normal equations for the step by LDL decomposition.
+        // The lower triangle holds L and the diagonal holds D.
+        for (j = 0; j < 6; ++j)
+        {
+            jtj[j * 7] = RVPOSE_ADD(jtj[j * 7], RVPOSE_MUL(RVPOSE_SET(RVPOSE_BATCH_DAMPING), jtj[j * 7]));
+            for (k = 0; k < j; ++k) jtj[j * 6 + k] = jtj[k * 6 + j];
+        }
+        for (j = 0; j < 6; ++j)
+        {
+            for (k = 0; k < j; ++k) jtj[j * 7] = RVPOSE_SUB(jtj[j * 7], RVPOSE_MUL(RVPOSE_MUL(jtj[j * 6 + k], jtj[j * 6 + k]), jtj[k * 7]));
+            for (i = j + 1; i < 6; ++i)
+            {
+                rvPoseLanes sum = jtj[i * 6 + j];
+
+                for (k = 0; k < j; ++k) sum = RVPOSE_SUB(sum, RVPOSE_MUL(RVPOSE_MUL(jtj[i * 6 + k], jtj[j * 6 + k]), jtj[k * 7]));
+                jtj[i * 6 + j] = RVPOSE_DIV(sum, jtj[j * 7]);
+            }
+        }
+        for (i = 0; i < 6; ++i)
+        {
+            step[i] = RVPOSE_SUB(zero, jtr[i]);
+            for (k = 0; k < i; ++k) step[i] = RVPOSE_SUB(step[i], RVPOSE_MUL(jtj[i * 6 + k], step[k]));
+        }
+        for (i = 5; i >= 0; --i)
+        {
+            step[i] = RVPOSE_DIV(step[i], jtj[i * 7]);
+            for (k = i + 1; k < 6; ++k) step[i] = RVPOSE_SUB(step[i], RVPOSE_MUL(jtj[k * 6 + i], step[k]));
+        }
+
+        // Apply the small rotation by the Cayley transform of half the step,
+        // which matches the rotation vector to first order, and add the translation.
+        {
+            rvPoseLanes q0 = RVPOSE_MUL(half, step[0]);
+            rvPoseLanes q1 = RVPOSE_MUL(half, step[1]);
+            rvPoseLanes q2 = RVPOSE_MUL(half, step[2]);
+            rvPoseLanes qq = RVPOSE_ADD(RVPOSE_ADD(RVPOSE_MUL(q0, q0), RVPOSE_MUL(q1, q1)), RVPOSE_MUL(q2, q2));
+            rvPoseLanes w = RVPOSE_DIV(two, RVPOSE_ADD(one, qq));
+            rvPoseLanes s[9];
+            rvPoseLanes next[9];
+
+            s[0] = RVPOSE_ADD(one, RVPOSE_MUL(w, RVPOSE_SUB(RVPOSE_MUL(q0, q0), qq)));
+            s[1] = RVPOSE_MUL(w, RVPOSE_SUB(RVPOSE_MUL(q0, q1), q2));
+            s[2] = RVPOSE_MUL(w, RVPOSE_ADD(RVPOSE_MUL(q0, q2), q1));
+            s[3] = RVPOSE_MUL(w, RVPOSE_ADD(RVPOSE_MUL(q1, q0), q2));
+            s[4] = RVPOSE_ADD(one, RVPOSE_MUL(w, RVPOSE_SUB(RVPOSE_MUL(q1, q1), qq)));
+            s[5] = RVPOSE_MUL(w, RVPOSE_SUB(RVPOSE_MUL(q1, q2), q0));
+            s[6] = RVPOSE_MUL(w, RVPOSE_SUB(RVPOSE_MUL(q2, q0), q1));
+            s[7] = RVPOSE_MUL(w, RVPOSE_ADD(RVPOSE_MUL(q2, q1), q0));
+            s[8] = RVPOSE_ADD(one, RVPOSE_MUL(w, RVPOSE_SUB(RVPOSE_MUL(q2, q2), qq)));
+
+            for (i = 0; i < 3; ++i)
+            {
+                for (j = 0; j < 3; ++j)
+                {
+                    next[i * 3 + j] = RVPOSE_ADD(RVPOSE_ADD(RVPOSE_MUL(s[i * 3], r[j]), RVPOSE_MUL(s[i * 3 + 1], r[3 + j])), RVPOSE_MUL(s[i * 3 + 2], r[6 + j]));
+                }
+            }
+            for (i = 0; i < 9; ++i) r[i] = next[i];
+            for (i = 0; i < 3; ++i) t[i] = RVPOSE_ADD(t[i], step[3 + i]);
+        }
+    }
+
+    // Store the best pose and its error.
+    for (i = 0; i < 9; ++i) RVPOSE_STORE(output + i * RVPOSE_LANES, bestR[i]);
+    for (i = 0; i < 3; ++i) RVPOSE_STORE(output + (9 + i) * RVPOSE_LANES, bestT[i]);
+    RVPOSE_STORE(output + 12 * RVPOSE_LANES, bestError);
+}
+
+
+static bool rvPose_IsSquare(const CvPoint3D32f objectPoints[4], double *size)
+// Returns true if the target points are the corners (h, h), (-h, h), (-h, -h)
+// and (h, -h) of a square centered on the origin and sets the half size h.
+{
+    float h = objectPoints[0].x;
+
+    *size = h;
+
+    return (h > 0.0f) &&
+           (objectPoints[0].y == h) && (objectPoints[1].x == -h) && (objectPoints[1].y == h) &&
+           (objectPoints[2].x == -h) && (objectPoints[2].y == -h) && (objectPoints[3].x == h) && (objectPoints[3].y == -h) &&
+           (objectPoints[0].z == 0.0f) && (objectPoints[1].z == 0.0f) && (objectPoints[2].z == 0.0f) && (objectPoints[3].z == 0.0f);
+}
+
+
+rvPose *rvPose_New(int maxPoints)
+// Create a new pose object which solves for poses from up to the maximum number
+// of points.
+{
+    rvPose *self;
+
+    // Sanity check the arguments.
+    if (maxPoints < 4) return NULL;
+
+    // Allocate the object.
+    self = (rvPose *) malloc(sizeof(rvPose));
+
+    // Did we allocate the object.
+    if (self != NULL)
+    {
+        // Allocate the undistorted points and the error and weight of each point.
+        self->maxPoints = maxPoints;
+        self->undistorted = (double *) malloc(sizeof(double) * 2 * maxPoints);
+        self->residuals = (double *) malloc(sizeof(double) * maxPoints);
+        self->weights = (double *) malloc(sizeof(double) * maxPoints);
+
+        // Did we allocate the points?
+        if ((self->undistorted == NULL) || (self->residuals == NULL) || (self->weights == NULL))
+        {
+            // Clean up.
+            if (self->undistorted) free(self->undistorted);
+            if (self->residuals) free(self->residuals);
+            if (self->weights) free(self->weights);
+            free(self);
+
+            return NULL;
+        }
+
+        // Start with an ideal camera.
+        rvPose_SetIntrinsics(self, NULL, NULL);
+        self->error = 0.0;
+        memset(self->covariance, 0, sizeof(self->covariance));
+    }
+
+    return self;
+}
+
+
+void rvPose_Free(rvPose *self)
+// Free the pose object.
+{
+    // Sanity check the arguments.
+    if (self == NULL) return;
+
+    // Free the points.
+    free(self->undistorted);
+    free(self->residuals);
+    free(self->weights);
+
+    // Free the object.
+    free(self);
+}
+
+
+void rvPose_SetIntrinsics(rvPose *self, CvMat *cameraMatrix, CvMat *distortionCoeffs)
+// Set the camera matrix and the distortion coefficients used to project points.
+// Either may be NULL for an ideal camera.  The distortion coefficients are
+// k1, k2, p1, p2 and optionally k3 as used by OpenCV.
+{
+    int count;
+
+    // Set the focal lengths and principal point.
+    self->fx = cameraMatrix ? cvGetReal2D(cameraMatrix, 0, 0) : 1.0;
+    self->fy = cameraMatrix ? cvGetReal2D(cameraMatrix, 1, 1) : 1.0;
+    self->cx = cameraMatrix ? cvGetReal2D(cameraMatrix, 0, 2) : 0.0;
+    self->cy = cameraMatrix ? cvGetReal2D(cameraMatrix, 1, 2) : 0.0;
+
+    // Set the distortion coefficients.
+    count = distortionCoeffs ? distortionCoeffs->rows * distortionCoeffs->cols : 0;
+    self->k1 = count > 0 ? cvGetReal1D(distortionCoeffs, 0) : 0.0;
+    self->k2 = count > 1 ? cvGetReal1D(distortionCoeffs, 1) : 0.0;
+    self->p1 = count > 2 ? cvGetReal1D(distortionCoeffs, 2) : 0.0;
+    self->p2 = count > 3 ? cvGetReal1D(distortionCoeffs, 3) : 0.0;
+    self->k3 = count > 4 ? cvGetReal1D(distortionCoeffs, 4) : 0.0;
+}
+
+
+bool rvPose_Solve(rvPose *self, const CvPoint3D32f *objectPoints, const CvPoint2D32f *imagePoints, int count,
+                  double rotationVector[3], double translationVector[3])
+// Find the rotation and translation vectors which transform the target points
+// into the camera frame where they project onto the image points.  Returns false
+// if there are fewer than four points, the target points are not in the z = 0
+// plane or they are degenerate.
+{
+    int i;
+    double homography[9];
+    double rotation[9];
+
+    // Sanity check the arguments.
+    if ((count < 4) || (count > self->maxPoints) || (self->fx == 0.0) || (self->fy == 0.0)) return false;
+
+    // The homography only holds for points in the target plane.
+    for (i = 0; i < count; ++i)
+    {
+        if (objectPoints[i].z != 0.0f) return false;
+    }
+
+    // Find the starting pose from the homography of the undistorted points.
+    rvPose_Undistort(self, imagePoints, count);
+    if (!rvPose_FindHomography(self, objectPoints, self->undistorted, count, homography) ||
+        !rvPose_DecomposeHomography(homography, rotation, translationVector)) return false;
+
+    // Refine the pose against the distorted image points.
+    if (!rvPose_Optimize(self, objectPoints, imagePoints, NULL, count, rotation, translationVector, RVPOSE_ITERATIONS)) return false;
+
+    rvPose_RotationToVector(rotation, rotationVector);
+
+    return true;
+}
+
+
+bool rvPose_Refine(rvPose *self, const CvPoint3D32f *objectPoints, const CvPoint2D32f *imagePoints, int count,
+                   double rotationVector[3], double translationVector[3], int iterations)
+// Refine the rotation and translation vectors of a known pose, such as the pose
+// found in the previous frame, by up to the number of iterations.  The points
+// needn't be planar.  Returns false if there are too few points or the starting
+// pose puts a point behind the camera.
+{
+    double rotation[9];
+
+    // Sanity check the arguments.
+    if ((count < 4) || (count > self->maxPoints) || (self->fx == 0.0) || (self->fy == 0.0)) return false;
+
+    // Refine the pose from the rotation matrix.
+    rvPose_VectorToRotation(rotationVector, rotation);
+    if (!rvPose_Optimize(self, objectPoints, imagePoints, NULL, count, rotation, translationVector, iterations)) return false;
+
+    rvPose_RotationToVector(rotation, rotationVector);
+
+    return true;
+}
+
+
+double rvPose_GetError(rvPose *self)
+{
+    return self->error;
+}
+
+
+void rvPose_GetCovariance(rvPose *self, double covariance[36])
+// Get the 6x6 covariance in row order of the last pose found.  The parameters
+// are a small rotation vector applied after the rotation, so in the camera
+// frame, followed by the translation.
+{
+    memcpy(covariance, self->covariance, sizeof(self->covariance));
+}
+
+
+int rvPose_SolveTags(rvPose *self, const CvPoint3D32f (*objectPoints)[4], const CvPoint2D32f (*imagePoints)[4], int count,
+                     double (*rotationVectors)[3], double (*translationVectors)[3], double (*matrices)[16], bool *solved)
+// Solve the poses of a number of four cornered tags at once.  Tags whose target
+// points form a square centered on the origin are solved in batches with each
+// tag in a vector lane.  Any other tags, and tags whose batch pose fails, are
+// solved by rvPose_Solve().  Each solved tag gets its rotation and translation
+// vectors and its 4x4 matrix in row order as from rvPose_GetMatrix().  Returns
+// the number of tags solved.
+{
+    int i = 0;
+    int j;
+    int k;
+    int total = 0;
+    double input[9 * RVPOSE_LANES];
+    double output[13 * RVPOSE_LANES];
+    int tags[RVPOSE_LANES];
+
+    while (i < count)
+    {
+        int laneCount = 0;
+
+        // Gather the next batch of square tags into the lanes.
+        for (; (i < count) && (laneCount < RVPOSE_LANES); ++i)
+        {
+            double size;
+
+            if (!rvPose_IsSquare(objectPoints[i], &size))
+            {
+                solved[i] = false;
+                continue;
+            }
+
+            tags[laneCount] = i;
+            input[laneCount] = size;
+            for (j = 0; j < 4; ++j)
+            {
+                input[(1 + j * 2) * RVPOSE_LANES + laneCount] = imagePoints[i][j].x;
+                input[(2 + j * 2) * RVPOSE_LANES + laneCount] = imagePoints[i][j].y;
+            }
+            ++laneCount;
+        }
+        if (laneCount == 0) continue;
+
+        // Fill the unused lanes with copies of the first tag.
+        for (k = laneCount; k < RVPOSE_LANES; ++k)
+        {
+            for (j = 0; j < 9; ++j) input[j * RVPOSE_LANES + k] = input[j * RVPOSE_LANES];
+        }
+
+        // Solve the batch.
+        rvPose_SolveLanes(self, input, output);
+
+        // Convert the pose of each lane.  Poses which failed are left unsolved.
+        for (k = 0; k < laneCount; ++k)
+        {
+            int tag = tags[k];
+            double rotation[9];
+
+            solved[tag] = output[12 * RVPOSE_LANES + k] < DBL_MAX;
+            if (!solved[tag]) continue;
+
+            for (j = 0; j < 9; ++j) rotation[j] = output[j * RVPOSE_LANES + k];
+            for (j = 0; j < 3; ++j)
+            {
+                translationVectors[tag][j] = output[(9 + j) * RVPOSE_LANES + k];
+                matrices[tag][j * 4] = rotation[j * 3];
+                matrices[tag][j * 4 + 1] = rotation[j * 3 + 1];
+                matrices[tag][j * 4 + 2] = rotation[j * 3 + 2];
+                matrices[tag][j * 4 + 3] = translationVectors[tag][j];
+            }
+            matrices[tag][12] = 0.0;
+            matrices[tag][13] = 0.0;
+            matrices[tag][14] = 0.0;
+            matrices[tag][15] = 1.0;
+            rvPose_RotationToVector(rotation, rotationVectors[tag]);
+        }
+    }
+
+    // Solve the remaining tags one at a time.
+    for (i = 0; i < count; ++i)
+    {
+        if (!solved[i])
+        {
+            solved[i] = rvPose_Solve(self, objectPoints[i], imagePoints[i], 4, rotationVectors[i], translationVectors[i]);
+            if (solved[i]) rvPose_GetMatrix(rotationVectors[i], translationVectors[i], matrices[i]);
+        }
+        if (solved[i]) ++total;
+    }
+
+    return total;
+}
+
+
+int rvPose_SolveRobust(rvPose *self, const CvPoint3D32f *objectPoints, const CvPoint2D32f *imagePoints, int groupCount, int groupSize,
+                       double threshold, double rotationVector[3], double translationVector[3], bool *inliers, double *residuals)
+// Find the pose from groups of points, such as the corners of each tag, while
+// ignoring groups which don't agree with the others.  Each group is solved on its
+// own from its homography to give a candidate pose, and the candidate under which
+// the most groups have an RMS reprojection error within the threshold is kept.
+// The pose is then refined against the inlier groups only, weighting each point by the
+// Huber loss so that poorly placed points have less pull.  The inlier flag and
+// RMS reprojection error in pixels of each group are returned.  Returns the
+// number of inlier groups, which is zero if no pose was found.
+{
+    int i;
+    int j;
+    int group;
+    int count = groupCount * groupSize;
+    int step;
+    int tries = 0;
+    int neededTries = groupCount;
+    int inlierCount = 0;
+    int bestInlierCount = 0;
+    double cost;
+    double bestCost = DBL_MAX;
+    double homography[9];
+    double rotation[9];
+    double translation[3];
+    double bestRotation[9];
+    double bestTranslation[3];
+
+    // Sanity check the arguments.
+    if ((groupSize < 4) || (groupCount < 1) || (count > self->maxPoints) || (self->fx == 0.0) || (self->fy == 0.0)) return 0;
+
+    // The homography only holds for points in the target plane.
+    for (i = 0; i < count; ++i)
+    {
+        if (objectPoints[i].z != 0.0f) return 0;
+    }
+
+    // Try up to the maximum number of groups spread through the list.  Each
+    // candidate comes from a single group so once a fraction w of the groups
+    // are inliers, trying log(1 - confidence) / log(1 - w) groups finds an
+    // inlier group with the given confidence.
+    rvPose_Undistort(self, imagePoints, count);
+    step = (groupCount + RVPOSE_MAX_HYPOTHESES - 1) / RVPOSE_MAX_HYPOTHESES;
+    for (group = 0; (group < groupCount) && (tries < neededTries); group += step)
+    {
+        int first = group * groupSize;
+
+        // Find the candidate pose from the group alone.
+        if (!rvPose_FindHomography(self, &objectPoints[first], &self->undistorted[first << 1], groupSize, homography) ||
+                 !rvPose_DecomposeHomography(homography, rotation, translation) ||
+                 !rvPose_Optimize(self, &objectPoints[first], &imagePoints[first], NULL, groupSize, rotation, translation, RVPOSE_ITERATIONS))
+        {
+            continue;
+        }
+
+        // Score the candidate by the groups which agree with it.
+        rvPose_Residuals(self, objectPoints, imagePoints, count, rotation, translation, self->residuals);
+        inlierCount = rvPose_Score(self->residuals, groupCount, groupSize, threshold, inliers, residuals, &cost);
+
+        // A pose from one group fits the far groups loosely, so refine a
+        // promising candidate against the groups which agree with it and
+        // score it again for as long as more groups agree.
+        for (i = 0; (i < RVPOSE_ROBUST_ROUNDS) && (inlierCount > 0) && (inlierCount >= bestInlierCount); ++i)
+        {
+            int refinedCount;
+            double refinedCost;
+
+            for (j = 0; j < count; ++j) self->weights[j] = inliers[j / groupSize] ? 1.0 : 0.0;
+            if (!rvPose_Optimize(self, objectPoints, imagePoints, self->weights, count, rotation, translation, RVPOSE_ITERATIONS)) break;
+
+            rvPose_Residuals(self, objectPoints, imagePoints, count, rotation, translation, self->residuals);
+            refinedCount = rvPose_Score(self->residuals, groupCount, groupSize, threshold, inliers, residuals, &refinedCost);
+            if (refinedCount <= inlierCount)
+            {
+                cost = refinedCost < cost ? refinedCost : cost;
+                break;
+            }
+            inlierCount = refinedCount;
+            cost = refinedCost;
+        }
+
+        // Keep the candidate if more groups agree with it or they agree better.
+        if ((inlierCount > bestInlierCount) || ((inlierCount == bestInlierCount) && (inlierCount > 0) && (cost < bestCost)))
+        {
+            memcpy(bestRotation, rotation, sizeof(rotation));
+            memcpy(bestTranslation, translation, sizeof(translation));
+            bestInlierCount = inlierCount;
+            bestCost = cost;
+
+            // Find the number of tries needed with this many inliers.
+            neededTries = inlierCount == groupCount ? 0 :
+                          (int) ceil(log(1.0 - RVPOSE_CONFIDENCE) / log(1.0 - (double) inlierCount / groupCount));
+        }
+        ++tries;
+    }
+    if (bestInlierCount == 0) return 0;
+
+    // Refine the best pose against the inlier groups.  The inliers and the
+    // weights of their points are found again after each round.
+    for (i = 0; i <= RVPOSE_ROBUST_ROUNDS; ++i)
+    {
+        rvPose_Residuals(self, objectPoints, imagePoints, count, bestRotation, bestTranslation, self->residuals);
+        inlierCount = rvPose_Score(self->residuals, groupCount, groupSize, threshold, inliers, residuals, &cost);
+        if ((i == RVPOSE_ROBUST_ROUNDS) || (inlierCount == 0)) break;
+
+        for (j = 0; j < count; ++j)
+        {
+            double residual = self->residuals[j];
+
+            self->weights[j] = !inliers[j / groupSize] ? 0.0 : residual <= RVPOSE_HUBER_WIDTH ? 1.0 : RVPOSE_HUBER_WIDTH / residual;
+        }
+        if (!rvPose_Optimize(self, objectPoints, imagePoints, self->weights, count, bestRotation, bestTranslation, RVPOSE_ITERATIONS)) break;
+    }
+    if (inlierCount == 0) return 0;
+    if (!rvPose_KeepInlierError(self, objectPoints, imagePoints, groupCount, groupSize, inliers, inlierCount, bestRotation, bestTranslation)) return 0;
+
+    rvPose_RotationToVector(bestRotation, rotationVector);
+    memcpy(translationVector, bestTranslation, sizeof(bestTranslation));
+
+    return inlierCount;
+}
+
+
+int rvPose_RefineRobust(rvPose *self, const CvPoint3D32f *objectPoints, const CvPoint2D32f *imagePoints, int groupCount, int groupSize,
+                        double threshold, int iterations, double rotationVector[3], double translationVector[3], bool *inliers, double *residuals)
+// Refine a known pose, such as the pose found in the previous frame, against the
+// groups of points which agree with it by up to the number of iterations.  The
+// points are weighted and the results returned as by rvPose_SolveRobust().  The
+// pose is only kept if more than half of the groups agree with it and the same
+// groups still agree once it is refined.  Returns the number of inlier groups,
+// which is zero if the pose was not kept.
+{
+    int i;
+    int count = groupCount * groupSize;
+    int inlierCount;
+    double cost;
+    double rotation[9];
+    double translation[3];
+
+    // Sanity check the arguments.
+    if ((groupSize < 4) || (groupCount < 1) || (count > self->maxPoints) || (self->fx == 0.0) || (self->fy == 0.0)) return 0;
+
+    // Find the groups which agree with the pose.
+    rvPose_VectorToRotation(rotationVector, rotation);
+    memcpy(translation, translationVector, sizeof(translation));
+    rvPose_Residuals(self, objectPoints, imagePoints, count, rotation, translation, self->residuals);
+    inlierCount = rvPose_Score(self->residuals, groupCount, groupSize, threshold, inliers, residuals, &cost);
+    if (inlierCount * 2 <= groupCount) return 0;
+
+    // Refine the pose against the inlier groups.  Only the points of the inlier
+    // groups have weight, so the weights keep which groups agreed before.
+    for (i = 0; i < count; ++i)
+    {
+        double residual = self->residuals[i];
+
+        self->weights[i] = !inliers[i / groupSize] ? 0.0 : residual <= RVPOSE_HUBER_WIDTH ? 1.0 : RVPOSE_HUBER_WIDTH / residual;
+    }
+    if (!rvPose_Optimize(self, objectPoints, imagePoints, self->weights, count, rotation, translation, iterations)) return 0;
+
+    // Make sure the same groups agree with the refined pose.
+    rvPose_Residuals(self, objectPoints, imagePoints, count, rotation, translation, self->residuals);
+    if (rvPose_Score(self->residuals, groupCount, groupSize, threshold, inliers, residuals, &cost) != inlierCount) return 0;
+    for (i = 0; i < groupCount; ++i)
+    {
+        if (inliers[i] != (self->weights[i * groupSize] != 0.0)) return 0;
+    }
+    if (!rvPose_KeepInlierError(self, objectPoints, imagePoints, groupCount, groupSize, inliers, inlierCount, rotation, translation)) return 0;
+
+    rvPose_RotationToVector(rotation, rotationVector);
+    memcpy(translationVector, translation, sizeof(translation));
+
+    return inlierCount;
+}
+
+
+void rvPose_GetGroupErrors(rvPose *self, const CvPoint3D32f *objectPoints, const CvPoint2D32f *imagePoints, int groupCount, int groupSize,
+                           const double rotationVector[3], const double translationVector[3], double *errors)
+// Find the RMS reprojection error in pixels of each group of points under the pose.
+{
+    int i;
+    int j;
+    double rotation[9];
+
+    // Sanity check the arguments.
+    if (groupCount * groupSize > self->maxPoints) return;
+
+    // Find the error of each point and combine the errors of each group.
+    rvPose_VectorToRotation(rotationVector, rotation);
+    rvPose_Residuals(self, objectPoints, imagePoints, groupCount * groupSize, rotation, translationVector, self->residuals);
+    for (i = 0; i < groupCount; ++i)
+    {
+        double sum = 0.0;
+
+        for (j = 0; j < groupSize; ++j) sum += self->residuals[i * groupSize + j] * self->residuals[i * groupSize + j];
+        errors[i] = sqrt(sum / groupSize);
+    }
+}
+
+
+void rvPose_GetMatrix(const double rotationVector[3], const double translationVector[3], double matrix[16])
+// Convert the rotation and translation vectors into a 4x4 matrix in row order
+// which transforms target points into the camera frame.
+{
+    int i;
+    double rotation[9];
+
+    rvPose_VectorToRotation(rotationVector, rotation);
+
+    for (i = 0; i < 3; ++i)
+    {
+        matrix[i * 4] = rotation[i * 3];
+        matrix[i * 4 + 1] = rotation[i * 3 + 1];
+        matrix[i * 4 + 2] = rotation[i * 3 + 2];
+        matrix[i * 4 + 3] = translationVector[i];
+    }
+    matrix[12] = 0.0;
+    matrix[13] = 0.0;
+    matrix[14] = 0.0;
+    matrix[15] = 1.0;
+}
+
+
+void rvPose_GetInverseMatrix(const double rotationVector[3], const double translationVector[3], double matrix[16])
+// Convert the rotation and translation vectors into the inverse 4x4 matrix in
+// row order which transforms camera points into the target frame.  This gives
+// the position of the camera relative to the target.
+{
+    int i;
+    double rotation[9];
+
+    rvPose_VectorToRotation(rotationVector, rotation);
+
+    for (i = 0; i < 3; ++i)
+    {
+        matrix[i * 4] = rotation[i];
+        matrix[i * 4 + 1] = rotation[3 + i];
+        matrix[i * 4 + 2] = rotation[6 + i];
+        matrix[i * 4 + 3] = -(rotation[i] * translationVector[0] + rotation[3 + i] * translationVector[1] + rotation[6 + i] * translationVector[2]);
+    }
+    matrix[12] = 0.0;
+    matrix[13] = 0.0;
+    matrix[14] = 0.0;
+    matrix[15] = 1.0;
+}
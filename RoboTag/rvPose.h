@@ -0,0 +1,82 @@
+/*
+    Copyright (C) 2010, Michael P. Thompson
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 2 as
+    specified in the README.txt file or as published by the Free Software
+    Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    $Id$
+*/
+
+
+#ifndef _RV_POSE_INCLUDED_
+#define _RV_POSE_INCLUDED_
+
+#include "rvTypes.h"
+#include "cv.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Levenberg-Marquardt iterations used to refine the pose from the homography,
+// the relative improvement in the reprojection error at which they stop early
+// and the starting damping relative to the diagonal of the normal equations.
+#define RVPOSE_ITERATIONS       10
+#define RVPOSE_TOLERANCE        1e-10
+#define RVPOSE_DAMPING          1e-3
+
+// Fixed damping of the steps taken by rvPose_SolveTags().  The batch steps can't
+// be rejected one tag at a time so the damping is kept small.
+#define RVPOSE_BATCH_DAMPING    1e-6
+
+// Most candidate poses tried by rvPose_SolveRobust(), the confidence of having
+// tried an inlier candidate at which it stops early, the rounds of refining the
+// pose against the inliers and the reprojection error in pixels beyond which
+// points are weighted down by the Huber loss.
+#define RVPOSE_MAX_HYPOTHESES   32
+#define RVPOSE_CONFIDENCE       0.999
+#define RVPOSE_ROBUST_ROUNDS    3
+#define RVPOSE_HUBER_WIDTH      1.0
+
+// Pose types.
+typedef struct _rvPose rvPose;
+
+// Pose methods.
+rvPose *rvPose_New(int maxPoints);
+void rvPose_Free(rvPose *self);
+void rvPose_SetIntrinsics(rvPose *self, CvMat *cameraMatrix, CvMat *distortionCoeffs);
+bool rvPose_Solve(rvPose *self, const CvPoint3D32f *objectPoints, const CvPoint2D32f *imagePoints, int count,
+                  double rotationVector[3], double translationVector[3]);
+bool rvPose_Refine(rvPose *self, const CvPoint3D32f *objectPoints, const CvPoint2D32f *imagePoints, int count,
+                   double rotationVector[3], double translationVector[3], int iterations);
+int rvPose_SolveTags(rvPose *self, const CvPoint3D32f (*objectPoints)[4], const CvPoint2D32f (*imagePoints)[4], int count,
+                     double (*rotationVectors)[3], double (*translationVectors)[3], double (*matrices)[16], bool *solved);
+int rvPose_SolveRobust(rvPose *self, const CvPoint3D32f *objectPoints, const CvPoint2D32f *imagePoints, int groupCount, int groupSize,
+                       double threshold, double rotationVector[3], double translationVector[3], bool *inliers, double *residuals);
+int rvPose_RefineRobust(rvPose *self, const CvPoint3D32f *objectPoints, const CvPoint2D32f *imagePoints, int groupCount, int groupSize,
+                        double threshold, int iterations, double rotationVector[3], double translationVector[3], bool *inliers, double *residuals);
+void rvPose_GetGroupErrors(rvPose *self, const CvPoint3D32f *objectPoints, const CvPoint2D32f *imagePoints, int groupCount, int groupSize,
+                           const double rotationVector[3], const double translationVector[3], double *errors);
+double rvPose_GetError(rvPose *self);
+void rvPose_GetCovariance(rvPose *self, double covariance[36]);
+
+// Pose conversion functions.
+void rvPose_GetMatrix(const double rotationVector[3], const double translationVector[3], double matrix[16]);
+void rvPose_GetInverseMatrix(const double rotationVector[3], const double translationVector[3], double matrix[16]);
+
+#ifdef __cplusplus
+} // "C"
+#endif
+
+#endif // _RV_POSE_INCLUDED_
@@ -0,0 +1,264 @@
+/*
+    Copyright (C) 2010, Michael P. Thompson
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 2 as
+    specified in the README.txt file or as published by the Free Software
+    Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    $Id$
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include "rvProfile.h"
+
+// Keeps a rolling histogram of the durations of each stage of a process.  The
+// last RVPROFILE_WINDOW_SIZE samples of each stage are kept as the index of the
+// histogram bucket they fell into, so adding a sample removes the oldest one from
+// the histogram at a fixed cost and percentiles are found by walking the buckets.
+// Bucket zero holds durations under a microsecond, which are reported as zero,
+// and the last bucket holds everything too long for the others.
+
+// Profile stage structure.
+typedef struct _rvProfileStage
+{
+    int sampleCount;            // Samples in the window.
+    int next;                   // Window entry replaced by the next sample.
+    double last;                // Duration of the last sample in microseconds.
+    rvUint8 window[RVPROFILE_WINDOW_SIZE];
+    int buckets[RVPROFILE_BUCKET_COUNT];
+} rvProfileStage;
+
+// Profile structure.
+struct _rvProfile
+{
+    int stageCount;
+    rvProfileStage *stages;
+};
+
+
+static int rvProfile_GetBucket(double microseconds)
+// Get the histogram bucket holding the duration.
+{
+    int exponent;
+    int bucket;
+    double fraction;
+
+    // Durations under a microsecond share the first bucket.
+    if (microseconds < 1.0) return 0;
+
+    // Split the duration into a fraction in [0.5, 1) and a power of two.
+    fraction = frexp(microseconds, &exponent);
+    bucket = 1 + (exponent - 1) * RVPROFILE_BUCKETS_PER_OCTAVE + (int) ((fraction * 2.0 - 1.0) * RVPROFILE_BUCKETS_PER_OCTAVE);
+
+    return bucket < RVPROFILE_BUCKET_COUNT ? bucket : RVPROFILE_BUCKET_COUNT - 1;
+}
+
+
+static double rvProfile_GetBucketValue(int bucket)
+// Get the duration in the middle of the histogram bucket.
+{
+    int octave;
+    int step;
+
+    // The first bucket holds durations under a microsecond.
+    if (bucket == 0) return 0.0;
+
+    // Find the power of two and the step within it.
+    octave = (bucket - 1) / RVPROFILE_BUCKETS_PER_OCTAVE;
+    step = (bucket - 1) % RVPROFILE_BUCKETS_PER_OCTAVE;
+
+    return ldexp(1.0 + (step + 0.5) / RVPROFILE_BUCKETS_PER_OCTAVE, octave);
+}
+
+
+rvProfile *rvProfile_New(int stageCount)
+// Create a new profile object which keeps a histogram for each stage.
+{
+    rvProfile *self;
+
+    // Sanity check the arguments.
+    if (stageCount < 1) return NULL;
+
+    // Allocate the object.
+    self = (rvProfile *) malloc(sizeof(rvProfile));
+
+    // Did we allocate the object.
+    if (self != NULL)
+    {
+        // Allocate the stages.
+        self->stageCount = stageCount;
+        self->stages = (rvProfileStage *) malloc(sizeof(rvProfileStage) * stageCount);
+
+        // Did we allocate the stages?
+        if (self->stages == NULL)
+        {
+            // Clean up.
+            free(self);
+
+            return NULL;
+        }
+
+        // Start with empty histograms.
+        rvProfile_Reset(self);
+    }
+
+    return self;
+}
+
+
+void rvProfile_Free(rvProfile *self)
+// Free the profile object.
+{
+    // Sanity check the arguments.
+    if (self == NULL) return;
+
+    // Free the stages.
+    free(self->stages);
+
+    // Free the object.
+    free(self);
+}
+
+
+void rvProfile_Reset(rvProfile *self)
+// Discard the samples of every stage.
+{
+    // Sanity check the arguments.
+    if (self == NULL) return;
+
+    memset(self->stages, 0, sizeof(rvProfileStage) * self->stageCount);
+}
+
+
+void rvProfile_AddSample(rvProfile *self, int stage, double microseconds)
+// Add the duration in microseconds to the histogram of the stage.  Once the
+// window is full the oldest sample is removed.
+{
+    int bucket;
+    rvProfileStage *profileStage;
+
+    // Sanity check the arguments.
+    if ((self == NULL) || (stage < 0) || (stage >= self->stageCount)) return;
+
+    profileStage = &self->stages[stage];
+
+    // Remove the sample being replaced from the histogram.
+    if (profileStage->sampleCount == RVPROFILE_WINDOW_SIZE)
+    {
+        --profileStage->buckets[profileStage->window[profileStage->next]];
+    }
+    else
+    {
+        ++profileStage->sampleCount;
+    }
+
+    // Add the sample to the window and the histogram.
+    bucket = rvProfile_GetBucket(microseconds);
+    profileStage->window[profileStage->next] = (rvUint8) bucket;
+    ++profileStage->buckets[bucket];
+    profileStage->next = (profileStage->next + 1) % RVPROFILE_WINDOW_SIZE;
+    profileStage->last = microseconds;
+}
+
+
+int rvProfile_GetSampleCount(rvProfile *self, int stage)
+{
+    // Sanity check the arguments.
+    if ((self == NULL) || (stage < 0) || (stage >= self->stageCount)) return 0;
+
+    return self->stages[stage].sampleCount;
+}
+
+
+double rvProfile_GetLast(rvProfile *self, int stage)
+{
+    // Sanity check the arguments.
+    if ((self == NULL) || (stage < 0) || (stage >= self->stageCount)) return 0.0;
+
+    return self->stages[stage].last;
+}
+
+
+double rvProfile_GetPercentile(rvProfile *self, int stage, double percentile)
+// Get the duration in microseconds which the percentile of the samples in the
+// window of the stage do not exceed.  For example a percentile of 99.0 gives the
+// p99 duration.  Returns zero if the stage has no samples.
+{
+    int i;
+    int rank;
+    int count = 0;
+    rvProfileStage *profileStage;
+
+    // Sanity check the arguments.
+    if ((self == NULL) || (stage < 0) || (stage >= self->stageCount)) return 0.0;
+
+    profileStage = &self->stages[stage];
+    if (profileStage->sampleCount == 0) return 0.0;
+
+    // Find the rank of the sample at the percentile.
+    rank = (int) ceil(percentile * profileStage->sampleCount / 100.0);
+    if (rank < 1) rank = 1;
+    if (rank > profileStage->sampleCount) rank = profileStage->sampleCount;
+
+    // Walk the buckets until the rank is reached.
+    for (i = 0; i < RVPROFILE_BUCKET_COUNT - 1; ++i)
+    {
+        count += profileStage->buckets[i];
+        if (count >= rank) break;
+    }
+
+    return rvProfile_GetBucketValue(i);
+}
+
+
+rvUint64 rvProfile_GetTicks(void)
+// Get the ticks of a monotonic clock.  Only the difference between two calls is
+// meaningful and it is converted with rvProfile_GetMicroseconds().
+{
+#if defined(_WIN32)
+    LARGE_INTEGER counter;
+
+    QueryPerformanceCounter(&counter);
+
+    return (rvUint64) counter.QuadPart;
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (rvUint64) now.tv_sec * 1000000000 + (rvUint64) now.tv_nsec;
+#endif
+}
+
+
+double rvProfile_GetMicroseconds(rvUint64 ticks)
+// Convert ticks of the monotonic clock to microseconds.
+{
+#if defined(_WIN32)
+    LARGE_INTEGER frequency;
+
+    QueryPerformanceFrequency(&frequency);
+
+    return (double) ticks * 1000000.0 / (double) frequency.QuadPart;
+#else
+    return (double) ticks / 1000.0;
+#endif
+}
@@ -0,0 +1,59 @@
+/*
+    Copyright (C) 2010, Michael P. Thompson
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 2 as
+    specified in the README.txt file or as published by the Free Software
+    Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    $Id$
+*/
+
+
+#ifndef _RV_PROFILE_INCLUDED_
+#define _RV_PROFILE_INCLUDED_
+
+#include "rvTypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Samples kept for each stage and the resolution of the histogram of their
+// durations.  Each power of two microseconds is split into eight buckets so a
+// percentile is reported to within about six percent.
+#define RVPROFILE_WINDOW_SIZE           256
+#define RVPROFILE_BUCKETS_PER_OCTAVE    8
+#define RVPROFILE_OCTAVE_COUNT          24
+#define RVPROFILE_BUCKET_COUNT          (1 + RVPROFILE_OCTAVE_COUNT * RVPROFILE_BUCKETS_PER_OCTAVE)
+
+// Profile types.
+typedef struct _rvProfile rvProfile;
+
+// Profile methods.
+rvProfile *rvProfile_New(int stageCount);
+void rvProfile_Free(rvProfile *self);
+void rvProfile_Reset(rvProfile *self);
+void rvProfile_AddSample(rvProfile *self, int stage, double microseconds);
+int rvProfile_GetSampleCount(rvProfile *self, int stage);
+double rvProfile_GetLast(rvProfile *self, int stage);
+double rvProfile_GetPercentile(rvProfile *self, int stage, double percentile);
+
+// Clock methods.
+rvUint64 rvProfile_GetTicks(void);
+double rvProfile_GetMicroseconds(rvUint64 ticks);
+
+#ifdef __cplusplus
+} // "C"
+#endif
+
+#endif // _RV_PROFILE_INCLUDED_
@@ -0,0 +1,634 @@
+/*
+    Copyright (C) 2010, Michael P. Thompson
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 2 as
+    specified in the README.txt file or as published by the Free Software
+    Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    $Id$
+*/
+
+#include <stdlib.h>
+#include <math.h>
+#include "rvQuadFinder.h"
+
+// Finds the four sided black shapes in a binary image such as the outer edge of
+// a tag's black border.  The black pixels are grouped into runs along each row
+// and runs touching a run in the row above are joined into components with a
+// union-find.  Each component is first rejected by its bounding box, then the
+// outline of the component is gathered from the ends of its rows and columns and
+// split at the four points furthest apart.  A line is fitted to each side and
+// the component is rejected if any outline point strays from its side.  The
+// corners are the intersections of the fitted lines, which places them to a
+// fraction of a pixel without refining them against the gray image.
+//
+// The buffers are grown to the largest image seen and reused, so no memory is
+// allocated for each component.
+
+// Smallest width or height of a component bounding box.
+#define RVQUADFINDER_MIN_SIDE           4
+
+// Fewest outline points fitted to each side.
+#define RVQUADFINDER_MIN_SIDE_POINTS    3
+
+// Distance an outline point may stray from its side as a fraction of the
+// perimeter with a lower limit in pixels.  This matches the precision used
+// to approximate contours as polygons.
+#define RVQUADFINDER_LINE_TOLERANCE     0.02
+#define RVQUADFINDER_MIN_TOLERANCE      1.5
+
+// Fraction of each side at either end left out of the line fit as the corners
+// are rounded by blurring.
+#define RVQUADFINDER_CORNER_MARGIN      0.1
+
+// Smallest sine of the angle between neighboring sides.
+#define RVQUADFINDER_MIN_SINE           0.1
+
+// Run structure.  A run is a horizontal span of black pixels in a row.
+typedef struct _rvQuadFinderRun
+{
+    int x0;                     // First pixel in the run.
+    int x1;                     // Pixel after the last pixel in the run.
+    int y;
+    int parent;                 // Parent run within the component.  Roots are the first run of the component.
+    int component;              // Component of a root run.
+    int next;                   // Next run of the component.
+} rvQuadFinderRun;
+
+// Component structure.  A component is a group of runs which touch.
+typedef struct _rvQuadFinderComponent
+{
+    int minX;
+    int maxX;
+    int minY;
+    int maxY;
+    int first;                  // First run of the component.
+    int last;                   // Last run of the component.
+} rvQuadFinderComponent;
+
+// Outline point structure.
+typedef struct _rvQuadFinderPoint
+{
+    float x;
+    float y;
+    float angle;                // Angle around the center of the outline.
+} rvQuadFinderPoint;
+
+// Line structure.  The points on the line satisfy nx * x + ny * y = d.
+typedef struct _rvQuadFinderLine
+{
+    double nx;
+    double ny;
+    double d;
+} rvQuadFinderLine;
+
+// Quad finder structure.
+struct _rvQuadFinder
+{
+    int runCapacity;
+    rvQuadFinderRun *runs;
+    int componentCapacity;
+    rvQuadFinderComponent *components;
+    int extentCapacity;
+    int *extents;               // First and last pixel of each row and column of a component.
+    int pointCapacity;
+    rvQuadFinderPoint *points;
+};
+
+
+rvQuadFinder *rvQuadFinder_New(void)
+// Create a new quad finder object.  The buffers are allocated as images are searched.
+{
+    rvQuadFinder *self;
+
+    // Allocate the object.
+    self = (rvQuadFinder *) malloc(sizeof(rvQuadFinder));
+
+    // Did we allocate the object.
+    if (self != NULL)
+    {
+        // Set the object variables.
+        self->runCapacity = 0;
+        self->runs = NULL;
+        self->componentCapacity = 0;
+        self->components = NULL;
+        self->extentCapacity = 0;
+        self->extents = NULL;
+        self->pointCapacity = 0;
+        self->points = NULL;
+    }
+
+    return self;
+}
+
+
+void rvQuadFinder_Free(rvQuadFinder *self)
+// Free the quad finder object.
+{
+    // Sanity check the arguments.
+    if (self == NULL) return;
+
+    // Free the internal objects.
+    if (self->runs) free(self->runs);
+    if (self->components) free(self->components);
+    if (self->extents) free(self->extents);
+    if (self->points) free(self->points);
+
+    // Free the object.
+    free(self);
+}
+
+
+static bool rvQuadFinder_Grow(void **buffer, int *capacity, int count, size_t size)
+// Grow the buffer to hold at least count elements of the size.  The buffer is
+// doubled so repeated growth is rare.  Returns false if the buffer can't be grown.
+{
+    int newCapacity;
+    void *newBuffer;
+
+    // Is the buffer already large enough?
+    if (count <= *capacity) return true;
+
+    // Double the capacity until the elements fit.
+    for (newCapacity = *capacity > 0 ? *capacity : 1024; newCapacity < count; newCapacity *= 2);
+
+    // Reallocate the buffer.
+    newBuffer = realloc(*buffer, size * newCapacity);
+    if (newBuffer == NULL) return false;
+
+    *buffer = newBuffer;
+    *capacity = newCapacity;
+
+    return true;
+}
+
+
+static bool rvQuadFinder_ReserveRuns(rvQuadFinder *self, int count)
+// Grow the run and component buffers to hold at least count runs.  Each run
+// may start a component.
+{
+    return rvQuadFinder_Grow((void **) &self->runs, &self->runCapacity, count, sizeof(rvQuadFinderRun)) &&
+           rvQuadFinder_Grow((void **) &self->components, &self->componentCapacity, count, sizeof(rvQuadFinderComponent));
+}
+
+
+static int rvQuadFinder_FindRoot(rvQuadFinderRun *runs, int run)
+// Find the root run of the component containing the run.  The path is halved
+// along the way to keep later searches short.
+{
+    while (runs[run].parent != run)
+    {
+        runs[run].parent = runs[runs[run].parent].parent;
+        run = runs[run].parent;
+    }
+
+    return run;
+}
+
+
+static void rvQuadFinder_Join(rvQuadFinderRun *runs, int run1, int run2)
+// Join the components of the two runs.  The earlier root becomes the root of
+// both so that each root is the first run of its component.
+{
+    int root1 = rvQuadFinder_FindRoot(runs, run1);
+    int root2 = rvQuadFinder_FindRoot(runs, run2);
+
+    if (root1 < root2) runs[root2].parent = root1;
+    else if (root2 < root1) runs[root1].parent = root2;
+}
+
+
+static int rvQuadFinder_FindRuns(rvQuadFinder *self, CvMat *mat)
+// Find the runs of black pixels in each row of the image and join the runs
+// which touch a run in the row above.  Returns the run count or -1 if the
+// runs couldn't be stored.
+{
+    int x;
+    int y;
+    int count = 0;
+    int previousFirst = 0;
+    int previousEnd = 0;
+
+    for (y = 0; y < mat->rows; ++y)
+    {
+        const rvUint8 *row = mat->data.ptr + y * mat->step;
+        int previous = previousFirst;
+        int first = count;
+
+        for (x = 0; x < mat->cols; )
+        {
+            int x0;
+            int above;
+            rvQuadFinderRun *run;
+
+            // Skip the white pixels.
+            while ((x < mat->cols) && row[x]) ++x;
+            if (x >= mat->cols) break;
+
+            // Find the end of the black pixels.
+            x0 = x;
+            while ((x < mat->cols) && !row[x]) ++x;
+
+            // Add the run.
+            if (!rvQuadFinder_ReserveRuns(self, count + 1)) return -1;
+            run = &self->runs[count];
+            run->x0 = x0;
+            run->x1 = x;
+            run->y = y;
+            run->parent = count;
+
+            // Join the run with the runs above which share a column with it.
+            while ((previous < previousEnd) && (self->runs[previous].x1 <= x0)) ++previous;
+            for (above = previous; (above < previousEnd) && (self->runs[above].x0 < x); ++above) rvQuadFinder_Join(self->runs, above, count);
+
+            ++count;
+        }
+
+        previousFirst = first;
+        previousEnd = count;
+    }
+
+    return count;
+}
+
+
+static int rvQuadFinder_FindComponents(rvQuadFinder *self, int runCount)
+// Gather the runs into components with their bounding boxes and link the runs
+// of each component in row order.  Returns the component count.
+{
+    int i;
+    int count = 0;
+
+    for (i = 0; i < runCount; ++i)
+    {
+        rvQuadFinderRun *run = &self->runs[i];
+        int root = rvQuadFinder_FindRoot(self->runs, i);
+        rvQuadFinderComponent *component;
+
+        run->next = -1;
+
+        // Roots start a new component.  The root is the first run of its component
+        // so it is always seen before the other runs.
+        if (root == i)
+        {
+            run->component = count;
+            component = &self->components[count++];
+            component->minX = run->x0;
+            component->maxX = run->x1 - 1;
+            component->minY = run->y;
+            component->maxY = run->y;
+            component->first = i;
+            component->last = i;
+            continue;
+        }
+
+        // Add the run to the component of its root.
+        component = &self->components[self->runs[root].component];
+        if (run->x0 < component->minX) component->minX = run->x0;
+        if (run->x1 - 1 > component->maxX) component->maxX = run->x1 - 1;
+        component->maxY = run->y;
+        self->runs[component->last].next = i;
+        component->last = i;
+    }
+
+    return count;
+}
+
+
+static int rvQuadFinder_ComparePoints(const void *point1, const void *point2)
+// Compare the angles of two outline points for sorting.
+{
+    float angle1 = ((const rvQuadFinderPoint *) point1)->angle;
+    float angle2 = ((const rvQuadFinderPoint *) point2)->angle;
+
+    return (angle1 < angle2) ? -1 : ((angle1 > angle2) ? 1 : 0);
+}
+
+
+static int rvQuadFinder_GetOutline(rvQuadFinder *self, rvQuadFinderComponent *component)
+// Gather the outline of the component from the first and last pixel of each of
+// its rows and columns and sort the outline points by their angle around the
+// center of the outline.  Returns the point count or -1 if the points couldn't
+// be stored.
+{
+    int i;
+    int x;
+    int run;
+    int count = 0;
+    int width = component->maxX - component->minX + 1;
+    int height = component->maxY - component->minY + 1;
+    int *rowMins;
+    int *rowMaxs;
+    int *columnMins;
+    int *columnMaxs;
+    float centerX = 0.0f;
+    float centerY = 0.0f;
+
+    // Make room for the extents and a point at each end of each row and column.
+    if (!rvQuadFinder_Grow((void **) &self->extents, &self->extentCapacity, 2 * (width + height), sizeof(int))) return -1;
+    if (!rvQuadFinder_Grow((void **) &self->points, &self->pointCapacity, 2 * (width + height), sizeof(rvQuadFinderPoint))) return -1;
+    rowMins = self->extents;
+    rowMaxs = rowMins + height;
+    columnMins = rowMaxs + height;
+    columnMaxs = columnMins + width;
+
+    // Reset the first extents.  Every row and column of a component has a pixel
+    // as the runs touch.
+    for (i = 0; i < height; ++i) rowMins[i] = -1;
+    for (i = 0; i < width; ++i) columnMins[i] = -1;
+
+    // Find the extents of each row and column from the runs, which are in row
+    // order and in column order within each row.
+    for (run = component->first; run >= 0; run = self->runs[run].next)
+    {
+        rvQuadFinderRun *r = &self->runs[run];
+        int row = r->y - component->minY;
+
+        if (rowMins[row] < 0) rowMins[row] = r->x0;
+        rowMaxs[row] = r->x1 - 1;
+
+        for (x = r->x0 - component->minX; x < r->x1 - component->minX; ++x)
+        {
+            if (columnMins[x] < 0) columnMins[x] = r->y;
+            columnMaxs[x] = r->y;
+        }
+    }
+
+    // Add the ends of each row and column to the outline.
+    for (i = 0; i < height; ++i)
+    {
+        self->points[count].x = (float) rowMins[i];
+        self->points[count++].y = (float) (component->minY + i);
+        if (rowMaxs[i] == rowMins[i]) continue;
+        self->points[count].x = (float) rowMaxs[i];
+        self->points[count++].y = (float) (component->minY + i);
+    }
+    for (i = 0; i < width; ++i)
+    {
+        self->points[count].x = (float) (component->minX + i);
+        self->points[count++].y = (float) columnMins[i];
+        if (columnMaxs[i] == columnMins[i]) continue;
+        self->points[count].x = (float) (component->minX + i);
+        self->points[count++].y = (float) columnMaxs[i];
+    }
+
+    // Find the center of the outline.
+    for (i = 0; i < count; ++i)
+    {
+        centerX += self->points[i].x;
+        centerY += self->points[i].y;
+    }
+    centerX /= (float) count;
+    centerY /= (float) count;
+
+    // Sort the points around the center.
+    for (i = 0; i < count; ++i) self->points[i].angle = (float) atan2(self->points[i].y - centerY, self->points[i].x - centerX);
+    qsort(self->points, count, sizeof(rvQuadFinderPoint), rvQuadFinder_ComparePoints);
+
+    return count;
+}
+
+
+static int rvQuadFinder_FindFarthest(rvQuadFinderPoint *points, int count, int first, int last, float x, float y, float dx, float dy)
+// Find the point from first to last going around the outline which is furthest
+// from the point (x, y) when dx and dy are zero or else furthest from the line
+// through the point in the direction (dx, dy).
+{
+    int i;
+    int farthest = first;
+    float farthestDistance = -1.0f;
+
+    for (i = first; ; i = (i + 1) % count)
+    {
+        float distance;
+
+        if ((dx == 0.0f) && (dy == 0.0f))
+        {
+            distance = (points[i].x - x) * (points[i].x - x) + (points[i].y - y) * (points[i].y - y);
+        }
+        else
+        {
+            distance = (float) fabs((points[i].x - x) * dy - (points[i].y - y) * dx);
+        }
+
+        if (distance > farthestDistance)
+        {
+            farthest = i;
+            farthestDistance = distance;
+        }
+
+        if (i == last) break;
+    }
+
+    return farthest;
+}
+
+
+static bool rvQuadFinder_FitSide(rvQuadFinderPoint *points, int count, int first, int last, double tolerance, rvQuadFinderLine *line)
+// Fit a line to the outline points between the corners at first and last.  The
+// points near the corners are left out of the fit.  Returns false if there are
+// too few points or a point strays too far from the line.
+{
+    int i;
+    int n = 0;
+    int length = (last - first + count) % count + 1;
+    int margin = (int) (length * RVQUADFINDER_CORNER_MARGIN);
+    double meanX = 0.0;
+    double meanY = 0.0;
+    double xx = 0.0;
+    double xy = 0.0;
+    double yy = 0.0;
+    double angle;
+
+    // Sanity check the side length.
+    if (length - 2 * margin < RVQUADFINDER_MIN_SIDE_POINTS) return false;
+
+    // Find the mean and covariance of the points away from the corners.
+    for (i = margin; i < length - margin; ++i)
+    {
+        rvQuadFinderPoint *point = &points[(first + i) % count];
+
+        meanX += point->x;
+        meanY += point->y;
+        ++n;
+    }
+    meanX /= n;
+    meanY /= n;
+    for (i = margin; i < length - margin; ++i)
+    {
+        rvQuadFinderPoint *point = &points[(first + i) % count];
+        double dx = point->x - meanX;
+        double dy = point->y - meanY;
+
+        xx += dx * dx;
+        xy += dx * dy;
+        yy += dy * dy;
+    }
+
+    // The line runs along the direction of greatest spread.  Its normal is
+    // perpendicular to that direction.
+    angle = 0.5 * atan2(2.0 * xy, xx - yy);
+    line->nx = -sin(angle);
+    line->ny = cos(angle);
+    line->d = line->nx * meanX + line->ny * meanY;
+
+    // Check every point of the side is close to the line.
+    for (i = 0; i < length; ++i)
+    {
+        rvQuadFinderPoint *point = &points[(first + i) % count];
+
+        if (fabs(line->nx * point->x + line->ny * point->y - line->d) > tolerance) return false;
+    }
+
+    return true;
+}
+
+
+static bool rvQuadFinder_FitQuad(rvQuadFinder *self, rvQuadFinderComponent *component, double minArea, CvPoint2D32f corners[RVQUADFINDER_CORNER_COUNT])
+// Fit a quad to the outline of the component.  Returns false if the outline is
+// not close to a convex four sided shape of at least the minimum area.
+{
+    int i;
+    int count;
+    int indexes[RVQUADFINDER_CORNER_COUNT];
+    float centerX = 0.5f * (component->minX + component->maxX);
+    float centerY = 0.5f * (component->minY + component->maxY);
+    double perimeter = 0.0;
+    double tolerance;
+    double area = 0.0;
+    double sign = 0.0;
+    rvQuadFinderPoint *points;
+    rvQuadFinderLine lines[RVQUADFINDER_CORNER_COUNT];
+
+    // Get the outline sorted around its center.
+    count = rvQuadFinder_GetOutline(self, component);
+    if (count < RVQUADFINDER_CORNER_COUNT * RVQUADFINDER_MIN_SIDE_POINTS) return false;
+    points = self->points;
+
+    // The first corner is the point furthest from the center and the opposite
+    // corner is the point furthest from it.  The other two corners are the points
+    // on each side furthest from the diagonal between them.
+    indexes[0] = rvQuadFinder_FindFarthest(points, count, 0, count - 1, centerX, centerY, 0.0f, 0.0f);
+    indexes[2] = rvQuadFinder_FindFarthest(points, count, 0, count - 1, points[indexes[0]].x, points[indexes[0]].y, 0.0f, 0.0f);
+    if (indexes[0] == indexes[2]) return false;
+    indexes[1] = rvQuadFinder_FindFarthest(points, count, indexes[0], indexes[2], points[indexes[0]].x, points[indexes[0]].y,
+                                           points[indexes[2]].x - points[indexes[0]].x, points[indexes[2]].y - points[indexes[0]].y);
+    indexes[3] = rvQuadFinder_FindFarthest(points, count, indexes[2], indexes[0], points[indexes[0]].x, points[indexes[0]].y,
+                                           points[indexes[2]].x - points[indexes[0]].x, points[indexes[2]].y - points[indexes[0]].y);
+    if ((indexes[1] == indexes[0]) || (indexes[1] == indexes[2]) || (indexes[3] == indexes[0]) || (indexes[3] == indexes[2])) return false;
+
+    // Find the tolerance for the outline points from the perimeter.
+    for (i = 0; i < RVQUADFINDER_CORNER_COUNT; ++i)
+    {
+        rvQuadFinderPoint *point1 = &points[indexes[i]];
+        rvQuadFinderPoint *point2 = &points[indexes[(i + 1) % RVQUADFINDER_CORNER_COUNT]];
+
+        perimeter += sqrt((point2->x - point1->x) * (point2->x - point1->x) + (point2->y - point1->y) * (point2->y - point1->y));
+    }
+    tolerance = perimeter * RVQUADFINDER_LINE_TOLERANCE;
+    if (tolerance < RVQUADFINDER_MIN_TOLERANCE) tolerance = RVQUADFINDER_MIN_TOLERANCE;
+
+    // Fit a line to each side.
+    for (i = 0; i < RVQUADFINDER_CORNER_COUNT; ++i)
+    {
+        rvQuadFinderLine *line = &lines[i];
+
+        if (!rvQuadFinder_FitSide(points, count, indexes[i], indexes[(i + 1) % RVQUADFINDER_CORNER_COUNT], tolerance, line)) return false;
+
+        // Point the normal away from the center.
+        if (line->nx * centerX + line->ny * centerY > line->d)
+        {
+            line->nx = -line->nx;
+            line->ny = -line->ny;
+            line->d = -line->d;
+        }
+
+        // The outline points are the centers of the outermost black pixels.  Move
+        // the line out to the boundary between the black and white pixels.
+        line->d += 0.5 * (fabs(line->nx) > fabs(line->ny) ? fabs(line->nx) : fabs(line->ny));
+    }
+
+    // Intersect the neighboring sides to find the corners.
+    for (i = 0; i < RVQUADFINDER_CORNER_COUNT; ++i)
+    {
+        rvQuadFinderLine *line1 = &lines[(i + RVQUADFINDER_CORNER_COUNT - 1) % RVQUADFINDER_CORNER_COUNT];
+        rvQuadFinderLine *line2 = &lines[i];
+        double det = line1->nx * line2->ny - line1->ny * line2->nx;
+
+        // Reject sides which are close to parallel.
+        if (fabs(det) < RVQUADFINDER_MIN_SINE) return false;
+
+        corners[i].x = (float) ((line1->d * line2->ny - line2->d * line1->ny) / det);
+        corners[i].y = (float) ((line1->nx * line2->d - line2->nx * line1->d) / det);
+
+        // Reject corners which are far outside the component.
+        if ((corners[i].x < component->minX - tolerance - 1.0) || (corners[i].x > component->maxX + tolerance + 1.0) ||
+            (corners[i].y < component->minY - tolerance - 1.0) || (corners[i].y > component->maxY + tolerance + 1.0)) return false;
+    }
+
+    // Check the quad is convex by turning the same way at each corner and sum its area.
+    for (i = 0; i < RVQUADFINDER_CORNER_COUNT; ++i)
+    {
+        CvPoint2D32f *corner0 = &corners[i];
+        CvPoint2D32f *corner1 = &corners[(i + 1) % RVQUADFINDER_CORNER_COUNT];
+        CvPoint2D32f *corner2 = &corners[(i + 2) % RVQUADFINDER_CORNER_COUNT];
+        double turn = (corner1->x - corner0->x) * (corner2->y - corner1->y) - (corner1->y - corner0->y) * (corner2->x - corner1->x);
+
+        if (turn * sign < 0.0) return false;
+        sign = turn;
+        area += corner0->x * corner1->y - corner1->x * corner0->y;
+    }
+
+    return fabs(area) * 0.5 > minArea;
+}
+
+
+int rvQuadFinder_Find(rvQuadFinder *self, CvArr *binaryImage, double minArea, CvPoint2D32f (*quads)[RVQUADFINDER_CORNER_COUNT], int maxQuads)
+// Find the four sided shapes of black pixels in the 8-bit single channel binary
+// image with an area greater than the minimum area.  Up to maxQuads quads are
+// returned in image coordinates.  Returns the number of quads found.
+{
+    int i;
+    int runCount;
+    int componentCount;
+    int quadCount = 0;
+    CvMat header;
+    CvMat *mat;
+
+    // Get the image data.
+    mat = cvGetMat(binaryImage, &header, NULL, 0);
+
+    // Sanity check the arguments.
+    if ((CV_MAT_TYPE(mat->type) != CV_8UC1) || (maxQuads <= 0)) return 0;
+
+    // Gather the black pixels into components.
+    runCount = rvQuadFinder_FindRuns(self, mat);
+    if (runCount <= 0) return 0;
+    componentCount = rvQuadFinder_FindComponents(self, runCount);
+
+    // Fit a quad to each component.
+    for (i = 0; (i < componentCount) && (quadCount < maxQuads); ++i)
+    {
+        rvQuadFinderComponent *component = &self->components[i];
+        int width = component->maxX - component->minX + 1;
+        int height = component->maxY - component->minY + 1;
+
+        // Reject components whose bounding box is too small to hold the quad.
+        if ((width < RVQUADFINDER_MIN_SIDE) || (height < RVQUADFINDER_MIN_SIDE) || ((double) width * height <= minArea)) continue;
+
+        // Add the quad if one fits the component.
+        if (rvQuadFinder_FitQuad(self, component, minArea, quads[quadCount])) ++quadCount;
+    }
+
+    return quadCount;
+}
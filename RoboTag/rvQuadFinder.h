@@ -0,0 +1,45 @@
+/*
+    Copyright (C) 2010, Michael P. Thompson
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 2 as
+    specified in the README.txt file or as published by the Free Software
+    Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    $Id$
+*/
+
+#ifndef _RV_QUAD_FINDER_INCLUDED_
+#define _RV_QUAD_FINDER_INCLUDED_
+
+#include "rvTypes.h"
+#include "cv.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RVQUADFINDER_CORNER_COUNT   4
+
+// Quad finder types.
+typedef struct _rvQuadFinder rvQuadFinder;
+
+// Quad finder methods.
+rvQuadFinder *rvQuadFinder_New(void);
+void rvQuadFinder_Free(rvQuadFinder *self);
+int rvQuadFinder_Find(rvQuadFinder *self, CvArr *binaryImage, double minArea, CvPoint2D32f (*quads)[RVQUADFINDER_CORNER_COUNT], int maxQuads);
+
+#ifdef __cplusplus
+} // "C"
+#endif
+
+#endif // _RV_QUAD_FINDER_INCLUDED_
@@ -0,0 +1,112 @@
+/*
+    Copyright (C) 2010, Michael P. Thompson
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 2 as
+    specified in the README.txt file or as published by the Free Software
+    Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    $Id$
+*/
+
+#include <stdlib.h>
+#include "rvRing.h"
+
+
+rvRing *rvRing_New(unsigned long capacity)
+// Create a ring able to hold at least the capacity number of items.
+{
+    rvRing *self;
+    unsigned long size;
+
+    // Round the capacity up to a power of two.
+    for (size = 2; size < capacity; size <<= 1);
+
+    // Allocate the object.
+    self = (rvRing *) malloc(sizeof(rvRing));
+
+    // Did we allocate the object.
+    if (self != NULL)
+    {
+        // Set the object variables.
+        self->size = size;
+        self->mask = size - 1;
+        self->head = 0;
+        self->tail = 0;
+        self->items = (void **) calloc(size, sizeof(void *));
+
+        // Clean up if we failed to allocate the items.
+        if (self->items == NULL)
+        {
+            free(self);
+            self = NULL;
+        }
+    }
+
+    return self;
+}
+
+
+void rvRing_Free(rvRing *self)
+// Free the ring.  Items remaining in the ring are not freed.
+{
+    // Sanity check the arguments.
+    if (self == NULL) return;
+
+    // Free the object.
+    free(self->items);
+    free(self);
+}
+
+
+bool rvRing_Push(rvRing *self, void *item)
+// Push an item onto the ring.  Must only be called from the producer thread.
+// Returns false without blocking if the ring is full.
+{
+    unsigned long head = (unsigned long) self->head;
+    unsigned long tail = (unsigned long) rvAtomic_Load(&self->tail);
+
+    // Is the ring full?
+    if ((head - tail) >= self->size) return false;
+
+    // Store the item before publishing the new head.
+    self->items[head & self->mask] = item;
+    rvAtomic_Store(&self->head, (long) (head + 1));
+
+    return true;
+}
+
+
+void *rvRing_Pop(rvRing *self)
+// Pop an item from the ring.  Must only be called from the consumer thread.
+// Returns NULL without blocking if the ring is empty.
+{
+    void *item;
+    unsigned long tail = (unsigned long) self->tail;
+    unsigned long head = (unsigned long) rvAtomic_Load(&self->head);
+
+    // Is the ring empty?
+    if (head == tail) return NULL;
+
+    // Read the item before releasing the slot to the producer.
+    item = self->items[tail & self->mask];
+    rvAtomic_Store(&self->tail, (long) (tail + 1));
+
+    return item;
+}
+
+
+unsigned long rvRing_GetCount(rvRing *self)
+// Returns the approximate number of items in the ring.
+{
+    return (unsigned long) rvAtomic_Load(&self->head) - (unsigned long) rvAtomic_Load(&self->tail);
+}
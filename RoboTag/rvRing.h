@@ -0,0 +1,57 @@
+/*
+    Copyright (C) 2010, Michael P. Thompson
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 2 as
+    specified in the README.txt file or as published by the Free Software
+    Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    $Id$
+*/
+
+#ifndef _RV_RING_INCLUDED_
+#define _RV_RING_INCLUDED_
+
+#include "rvTypes.h"
+#include "rvThread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Ring types.
+typedef struct _rvRing rvRing;
+
+// Bounded lock-free ring of pointers.  A ring may have exactly one producer
+// thread and one consumer thread which never block on each other.
+struct _rvRing
+{
+    unsigned long size;
+    unsigned long mask;
+    void **items;
+    rvAtomic head;              // Written only by the producer.
+    char padding[64];           // Keep head and tail on separate cache lines.
+    rvAtomic tail;              // Written only by the consumer.
+};
+
+// Ring methods.
+rvRing *rvRing_New(unsigned long capacity);
+void rvRing_Free(rvRing *self);
+bool rvRing_Push(rvRing *self, void *item);
+void *rvRing_Pop(rvRing *self);
+unsigned long rvRing_GetCount(rvRing *self);
+
+#ifdef __cplusplus
+} // "C"
+#endif
+
+#endif // _RV_RING_INCLUDED_
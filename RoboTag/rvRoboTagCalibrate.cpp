@@ -77,11 +77,13 @@ bool rvRoboTagCalibrate::Show(bool show)
     rvGrid* grid = m_camera->GetGrid();
 
     // Reset the calibration data.
+    m_camera->LockGrid();
     rvGrid_CalibrateReset(grid);
 
     // Update the tag and image counts.
     int tagCount = rvGrid_GetCalibrateTagCount(grid);
     int imageCount = rvGrid_GetCalibrateImageCount(grid);
+    m_camera->UnlockGrid();
     wxString tagCountString;
     tagCountString.Printf(wxT("%d tags and %d images for calibration"), tagCount, imageCount);
     m_tagCountLabel->SetLabel(tagCountString);
@@ -95,11 +97,13 @@ void rvRoboTagCalibrate::OnCalibrateAdd(wxCommandEvent& WXUNUSED(event))
     rvGrid* grid = m_camera->GetGrid();
 
     // Add the latest calibration.
+    m_camera->LockGrid();
     rvGrid_CalibrateAdd(grid);
 
     // Update the tag and image counts.
     int tagCount = rvGrid_GetCalibrateTagCount(grid);
     int imageCount = rvGrid_GetCalibrateImageCount(grid);
+    m_camera->UnlockGrid();
     wxString tagCountString;
     tagCountString.Printf(wxT("%d tags and %d images for calibration"), tagCount, imageCount);
     m_tagCountLabel->SetLabel(tagCountString);
@@ -111,11 +115,13 @@ void rvRoboTagCalibrate::OnCalibrateProcess(wxCommandEvent& WXUNUSED(event))
     rvGrid* grid = m_camera->GetGrid();
 
     // Process the calibration.
+    m_camera->LockGrid();
     rvGrid_Calibrate(grid);
 
     // Update the tag and image counts.
     int tagCount = rvGrid_GetCalibrateTagCount(grid);
     int imageCount = rvGrid_GetCalibrateImageCount(grid);
+    m_camera->UnlockGrid();
     wxString tagCountString;
     tagCountString.Printf(wxT("%d tags and %d images for calibration"), tagCount, imageCount);
     m_tagCountLabel->SetLabel(tagCountString);
@@ -127,11 +133,13 @@ void rvRoboTagCalibrate::OnCalibrateReset(wxCommandEvent& WXUNUSED(event))
     rvGrid* grid = m_camera->GetGrid();
 
     // Reset the calibration.
+    m_camera->LockGrid();
     rvGrid_CalibrateReset(grid);
 
     // Update the tag and image counts.
     int tagCount = rvGrid_GetCalibrateTagCount(grid);
     int imageCount = rvGrid_GetCalibrateImageCount(grid);
+    m_camera->UnlockGrid();
     wxString tagCountString;
     tagCountString.Printf(wxT("%d tags and %d images for calibration"), tagCount, imageCount);
     m_tagCountLabel->SetLabel(tagCountString);
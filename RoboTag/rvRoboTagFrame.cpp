@@ -123,7 +123,9 @@ void rvRoboTagFrame::OnNew(wxCommandEvent& WXUNUSED(event))
     m_filepath = wxEmptyString;
 
     // Reset the camera intrinsics.
+    m_camera->LockGrid();
     rvGrid_ResetIntrinsics(m_camera->GetGrid());
+    m_camera->UnlockGrid();
 }
 
 
@@ -145,7 +147,9 @@ void rvRoboTagFrame::OnOpen(wxCommandEvent& WXUNUSED(event))
         if (wxFile::Exists(m_filepath))
         {
             // Load the intrinsics.
+            m_camera->LockGrid();
             rvGrid_LoadIntrinsics(m_camera->GetGrid(), m_filepath.c_str());
+            m_camera->UnlockGrid();
         }
         else
         {
@@ -166,7 +170,9 @@ void rvRoboTagFrame::OnSave(wxCommandEvent& event)
     else
     {
         // Save the intrinsics.
+        m_camera->LockGrid();
         rvGrid_SaveIntrinsics(m_camera->GetGrid(), m_filepath.c_str());
+        m_camera->UnlockGrid();
     }
 }
 
@@ -186,7 +192,9 @@ void rvRoboTagFrame::OnSaveAs(wxCommandEvent& WXUNUSED(event))
         m_filepath = dialog.GetPath();
 
         // Save the intrinsics.
+        m_camera->LockGrid();
         rvGrid_SaveIntrinsics(m_camera->GetGrid(), m_filepath.c_str());
+        m_camera->UnlockGrid();
     }
 }
 
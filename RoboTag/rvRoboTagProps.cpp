@@ -59,11 +59,14 @@ rvRoboTagProps::rvRoboTagProps(wxWindow *parent, rvCamera* camera)
     // Get the notebook that contains the panels we will be creating below.
     wxBookCtrlBase* notebook = GetBookCtrl();
 
+    // Create the panels from the current grid settings.
+    m_camera->LockGrid();
     wxPanel* generalSettings = CreateGeneralPanel(notebook);
     wxPanel* adaptiveThresholdSettings = CreateAdaptiveThresholdPanel(notebook);
     wxPanel* cannyEdgeSettings = CreateCannyEdgePanel(notebook);
     wxPanel* suzanEdgeSettings = CreateSuzanEdgePanel(notebook);
     wxPanel* displayOptionSettings = CreateDisplayOptionsPanel(notebook);
+    m_camera->UnlockGrid();
 
     notebook->AddPage(generalSettings, wxT("General"), true);
     notebook->AddPage(adaptiveThresholdSettings, wxT("Adaptive Threshold"), false);
@@ -104,12 +107,14 @@ wxPanel* rvRoboTagProps::CreateGeneralPanel(wxWindow* parent)
     m_cameraView->SetSelection(rvGrid_GetDisplay(grid));
 
     // Configure edge detection method.
-    wxString edgeMethods[3];
+    wxString edgeMethods[5];
     edgeMethods[0] = wxT("&Adaptive Threshold");
     edgeMethods[1] = wxT("&Canny Edge");
     edgeMethods[2] = wxT("&Suzan Edge");
+    edgeMethods[3] = wxT("&Integral Threshold");
+    edgeMethods[4] = wxT("&Fused Threshold");
 
-    m_edgeMethod = new wxRadioBox(panel, ID_EDGE_METHOD, wxT("&Edge Detection Method:"), wxDefaultPosition, wxDefaultSize, 3, edgeMethods, 1, wxRA_SPECIFY_ROWS);
+    m_edgeMethod = new wxRadioBox(panel, ID_EDGE_METHOD, wxT("&Edge Detection Method:"), wxDefaultPosition, wxDefaultSize, 5, edgeMethods, 1, wxRA_SPECIFY_ROWS);
     item0->Add(m_edgeMethod, 0, wxGROW | wxALL, 5);
     m_edgeMethod->SetSelection(rvGrid_GetEdgeMethod(grid));
 
@@ -145,8 +150,10 @@ void rvRoboTagProps::OnCameraView(wxCommandEvent& WXUNUSED(event))
     rvGrid* grid = m_camera->GetGrid();
 
     // Set the display.
+    m_camera->LockGrid();
     rvGrid_SetDisplay(grid, m_cameraView->GetSelection());
     m_cameraView->SetSelection(rvGrid_GetDisplay(grid));
+    m_camera->UnlockGrid();
 }
 
 
@@ -155,8 +162,10 @@ void rvRoboTagProps::OnEdgeMethod(wxCommandEvent& WXUNUSED(event))
     rvGrid* grid = m_camera->GetGrid();
 
     // Set the edge detection method.
+    m_camera->LockGrid();
     rvGrid_SetEdgeMethod(grid, m_edgeMethod->GetSelection());
     m_edgeMethod->SetSelection(rvGrid_GetEdgeMethod(grid));
+    m_camera->UnlockGrid();
 }
 
 
@@ -165,8 +174,10 @@ void rvRoboTagProps::OnEdgeDilation(wxSpinEvent& WXUNUSED(event))
     rvGrid* grid = m_camera->GetGrid();
 
     // Set the edge dilation.
+    m_camera->LockGrid();
     rvGrid_SetEdgeDilation(grid, m_edgeDilation->GetValue());
     m_edgeDilation->SetValue(rvGrid_GetEdgeDilation(grid));
+    m_camera->UnlockGrid();
 }
 
 
@@ -175,8 +186,10 @@ void rvRoboTagProps::OnGaussianBlur(wxSpinEvent& WXUNUSED(event))
     rvGrid* grid = m_camera->GetGrid();
 
     // Set the gaussian blur.
+    m_camera->LockGrid();
     rvGrid_SetGaussianBlur(grid, m_gaussianBlur->GetValue());
     m_gaussianBlur->SetValue(rvGrid_GetGaussianBlur(grid));
+    m_camera->UnlockGrid();
 }
 
 
@@ -226,8 +239,10 @@ void rvRoboTagProps::OnAdaptiveMethod(wxCommandEvent& WXUNUSED(event))
     rvGrid* grid = m_camera->GetGrid();
 
     // Set the adaptive threshold method.
+    m_camera->LockGrid();
     rvGrid_SetAdaptiveMethod(grid, m_adaptiveMethod->GetSelection());
     m_adaptiveMethod->SetSelection(rvGrid_GetAdaptiveMethod(grid));
+    m_camera->UnlockGrid();
 }
 
 
@@ -236,8 +251,10 @@ void rvRoboTagProps::OnAdaptiveBlockSize(wxSpinEvent& WXUNUSED(event))
     rvGrid* grid = m_camera->GetGrid();
 
     // Set the adaptive block size value.
+    m_camera->LockGrid();
     rvGrid_SetAdaptiveBlockSize(grid, m_adaptiveBlockSize->GetValue());
     m_adaptiveBlockSize->SetValue(rvGrid_GetAdaptiveBlockSize(grid));
+    m_camera->UnlockGrid();
 }
 
 
@@ -246,8 +263,10 @@ void rvRoboTagProps::OnAdaptiveSubtraction(wxSpinEvent& WXUNUSED(event))
     rvGrid* grid = m_camera->GetGrid();
 
     // Set the adaptive subtraction value.
+    m_camera->LockGrid();
     rvGrid_SetAdaptiveSubtraction(grid, m_adaptiveSubtraction->GetValue());
     m_adaptiveSubtraction->SetValue(rvGrid_GetAdaptiveSubtraction(grid));
+    m_camera->UnlockGrid();
 }
 
 
@@ -381,6 +400,8 @@ void rvRoboTagProps::OnDrawSetting(wxCommandEvent& event)
     int id = event.GetId();
     rvGrid* grid = m_camera->GetGrid();
 
+    // Set the drawing option.
+    m_camera->LockGrid();
     switch (id)
     {
         case ID_DRAW_RAW_CONTOURS:
@@ -438,6 +459,7 @@ void rvRoboTagProps::OnDrawSetting(wxCommandEvent& event)
             m_drawCharacters->SetValue(rvGrid_GetDrawCharacters(grid));
             break;
     }
+    m_camera->UnlockGrid();
 }
 
 
@@ -0,0 +1,489 @@
+/*
+    Copyright (C) 2010, Michael P. Thompson
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 2 as
+    specified in the README.txt file or as published by the Free Software
+    Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    $Id$
+*/
+
+#include <stdlib.h>
+#include <math.h>
+#include "rvSampler.h"
+
+// Select the vector instruction set used by the sampler.  Defining RV_NO_SIMD
+// forces the portable scalar code.
+#if !defined(RV_NO_SIMD) && defined(__AVX2__)
+#define RVSAMPLER_AVX2
+#include <immintrin.h>
+#elif !defined(RV_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)))
+#define RVSAMPLER_SSE2
+#include <emmintrin.h>
+#endif
+
+// Multiplier which divides a sum of five 8-bit pixels by five when used with
+// the upper half of a 16-bit multiply.  Exact for sums up to 5 * 255.
+#define RVSAMPLER_DIVIDE_BY_FIVE    13108
+
+// Normalized coordinates of the 64 sample points.  The first coordinate runs
+// along the rows of the tag and the second coordinate along the columns.
+static const float rvSampler_SampleU[RVSAMPLER_SAMPLE_COUNT] =
+{
+    0.15f, 0.15f, 0.15f, 0.15f, 0.15f, 0.15f, 0.15f, 0.15f,
+    0.25f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f,
+    0.35f, 0.35f, 0.35f, 0.35f, 0.35f, 0.35f, 0.35f, 0.35f,
+    0.45f, 0.45f, 0.45f, 0.45f, 0.45f, 0.45f, 0.45f, 0.45f,
+    0.55f, 0.55f, 0.55f, 0.55f, 0.55f, 0.55f, 0.55f, 0.55f,
+    0.65f, 0.65f, 0.65f, 0.65f, 0.65f, 0.65f, 0.65f, 0.65f,
+    0.75f, 0.75f, 0.75f, 0.75f, 0.75f, 0.75f, 0.75f, 0.75f,
+    0.85f, 0.85f, 0.85f, 0.85f, 0.85f, 0.85f, 0.85f, 0.85f
+};
+
+static const float rvSampler_SampleV[RVSAMPLER_SAMPLE_COUNT] =
+{
+    0.85f, 0.75f, 0.65f, 0.55f, 0.45f, 0.35f, 0.25f, 0.15f,
+    0.85f, 0.75f, 0.65f, 0.55f, 0.45f, 0.35f, 0.25f, 0.15f,
+    0.85f, 0.75f, 0.65f, 0.55f, 0.45f, 0.35f, 0.25f, 0.15f,
+    0.85f, 0.75f, 0.65f, 0.55f, 0.45f, 0.35f, 0.25f, 0.15f,
+    0.85f, 0.75f, 0.65f, 0.55f, 0.45f, 0.35f, 0.25f, 0.15f,
+    0.85f, 0.75f, 0.65f, 0.55f, 0.45f, 0.35f, 0.25f, 0.15f,
+    0.85f, 0.75f, 0.65f, 0.55f, 0.45f, 0.35f, 0.25f, 0.15f,
+    0.85f, 0.75f, 0.65f, 0.55f, 0.45f, 0.35f, 0.25f, 0.15f
+};
+
+// Normalized coordinates of the 8 reference points.  The first 4 reference points
+// are in the white border outside the tag and the last 4 are in the black border
+// inside the tag.
+static const float rvSampler_ReferenceU[RVSAMPLER_REFERENCE_COUNT] =
+{
+    0.25f, 0.25f, 0.75f, 0.75f, 0.25f, 0.25f, 0.75f, 0.75f
+};
+
+static const float rvSampler_ReferenceV[RVSAMPLER_REFERENCE_COUNT] =
+{
+    -0.05f, 1.05f, -0.05f, 1.05f, 0.05f, 0.95f, 0.05f, 0.95f
+};
+
+// Normalized coordinates of the 16 pairs of border points.  The first 16 points
+// are in the white border outside the tag, four along each side, and the last
+// 16 points are in the black border inside the tag opposite them.  The points
+// are symmetric so they don't depend on the direction of the corners.
+static const float rvSampler_BorderU[2 * RVSAMPLER_BORDER_COUNT] =
+{
+    0.2f, 0.4f, 0.6f, 0.8f, 0.2f, 0.4f, 0.6f, 0.8f, -0.05f, -0.05f, -0.05f, -0.05f, 1.05f, 1.05f, 1.05f, 1.05f,
+    0.2f, 0.4f, 0.6f, 0.8f, 0.2f, 0.4f, 0.6f, 0.8f, 0.05f, 0.05f, 0.05f, 0.05f, 0.95f, 0.95f, 0.95f, 0.95f
+};
+
+static const float rvSampler_BorderV[2 * RVSAMPLER_BORDER_COUNT] =
+{
+    -0.05f, -0.05f, -0.05f, -0.05f, 1.05f, 1.05f, 1.05f, 1.05f, 0.2f, 0.4f, 0.6f, 0.8f, 0.2f, 0.4f, 0.6f, 0.8f,
+    0.05f, 0.05f, 0.05f, 0.05f, 0.95f, 0.95f, 0.95f, 0.95f, 0.2f, 0.4f, 0.6f, 0.8f, 0.2f, 0.4f, 0.6f, 0.8f
+};
+
+
+static void rvSampler_MapPoints(const rvSamplerQuad *quad, const float *u, const float *v, CvPoint2D32f *points, int count)
+// Map the normalized coordinates to image coordinates.
+{
+    int i;
+
+    for (i = 0; i < count; ++i)
+    {
+        float w = quad->h[6] * u[i] + quad->h[7] * v[i] + quad->h[8];
+
+        points[i].x = (quad->h[0] * u[i] + quad->h[1] * v[i] + quad->h[2]) / w;
+        points[i].y = (quad->h[3] * u[i] + quad->h[4] * v[i] + quad->h[5]) / w;
+    }
+}
+
+
+static void rvSampler_GetOffsets(IplImage *img, const CvPoint2D32f *points, int *offsets, int count)
+// Fill in the image offsets of the points.  Points too close to the image border
+// to be sampled are given an offset of -1.
+{
+    int i;
+
+    for (i = 0; i < count; ++i)
+    {
+        int x = cvRound(points[i].x);
+        int y = cvRound(points[i].y);
+
+        // Sanity check the values.
+        if (x < 1 || y < 1 || x >= (img->width - 1) || y >= (img->height - 1))
+        {
+            offsets[i] = -1;
+        }
+        else
+        {
+            offsets[i] = (img->widthStep * y) + x;
+        }
+    }
+}
+
+
+static void rvSampler_GetSampleOffsets(IplImage *img, const rvSamplerQuad *quad, int offsets[RVSAMPLER_SAMPLE_COUNT])
+// Fill in the image offsets of the 64 sample points.  The sample coordinates are
+// projected, rounded and bounds checked several points at a time.
+{
+#if defined(RVSAMPLER_AVX2)
+    int k;
+    __m256 h0 = _mm256_set1_ps(quad->h[0]);
+    __m256 h1 = _mm256_set1_ps(quad->h[1]);
+    __m256 h2 = _mm256_set1_ps(quad->h[2]);
+    __m256 h3 = _mm256_set1_ps(quad->h[3]);
+    __m256 h4 = _mm256_set1_ps(quad->h[4]);
+    __m256 h5 = _mm256_set1_ps(quad->h[5]);
+    __m256 h6 = _mm256_set1_ps(quad->h[6]);
+    __m256 h7 = _mm256_set1_ps(quad->h[7]);
+    __m256 h8 = _mm256_set1_ps(quad->h[8]);
+    __m256i zero = _mm256_setzero_si256();
+    __m256i invalid = _mm256_set1_epi32(-1);
+    __m256i xmax = _mm256_set1_epi32(img->width - 1);
+    __m256i ymax = _mm256_set1_epi32(img->height - 1);
+    __m256i step = _mm256_set1_epi32(img->widthStep);
+
+    // Eight points at a time.
+    for (k = 0; k < RVSAMPLER_SAMPLE_COUNT; k += 8)
+    {
+        __m256 u = _mm256_loadu_ps(&rvSampler_SampleU[k]);
+        __m256 v = _mm256_loadu_ps(&rvSampler_SampleV[k]);
+        __m256 w = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(h6, u), _mm256_mul_ps(h7, v)), h8);
+        __m256 px = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(h0, u), _mm256_mul_ps(h1, v)), h2);
+        __m256 py = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(h3, u), _mm256_mul_ps(h4, v)), h5);
+        __m256i x = _mm256_cvtps_epi32(_mm256_div_ps(px, w));
+        __m256i y = _mm256_cvtps_epi32(_mm256_div_ps(py, w));
+        __m256i valid;
+        __m256i offset;
+
+        // Mask the points which can be sampled.
+        valid = _mm256_and_si256(_mm256_cmpgt_epi32(x, zero), _mm256_cmpgt_epi32(xmax, x));
+        valid = _mm256_and_si256(valid, _mm256_cmpgt_epi32(y, zero));
+        valid = _mm256_and_si256(valid, _mm256_cmpgt_epi32(ymax, y));
+
+        // Calculate the offsets and mark the invalid points.
+        offset = _mm256_add_epi32(_mm256_mullo_epi32(y, step), x);
+        offset = _mm256_or_si256(_mm256_and_si256(valid, offset), _mm256_andnot_si256(valid, invalid));
+        _mm256_storeu_si256((__m256i *) &offsets[k], offset);
+    }
+#else
+#if defined(RVSAMPLER_SSE2)
+    // The offset multiply below packs the coordinates into 16-bit values.
+    if (img->width <= 32767 && img->widthStep <= 32767)
+    {
+        int k;
+        __m128 h0 = _mm_set1_ps(quad->h[0]);
+        __m128 h1 = _mm_set1_ps(quad->h[1]);
+        __m128 h2 = _mm_set1_ps(quad->h[2]);
+        __m128 h3 = _mm_set1_ps(quad->h[3]);
+        __m128 h4 = _mm_set1_ps(quad->h[4]);
+        __m128 h5 = _mm_set1_ps(quad->h[5]);
+        __m128 h6 = _mm_set1_ps(quad->h[6]);
+        __m128 h7 = _mm_set1_ps(quad->h[7]);
+        __m128 h8 = _mm_set1_ps(quad->h[8]);
+        __m128i zero = _mm_setzero_si128();
+        __m128i invalid = _mm_set1_epi32(-1);
+        __m128i low = _mm_set1_epi32(0xffff);
+        __m128i xmax = _mm_set1_epi32(img->width - 1);
+        __m128i ymax = _mm_set1_epi32(img->height - 1);
+        __m128i step = _mm_set1_epi32((img->widthStep << 16) | 1);
+
+        // Four points at a time.
+        for (k = 0; k < RVSAMPLER_SAMPLE_COUNT; k += 4)
+        {
+            __m128 u = _mm_loadu_ps(&rvSampler_SampleU[k]);
+            __m128 v = _mm_loadu_ps(&rvSampler_SampleV[k]);
+            __m128 w = _mm_add_ps(_mm_add_ps(_mm_mul_ps(h6, u), _mm_mul_ps(h7, v)), h8);
+            __m128 px = _mm_add_ps(_mm_add_ps(_mm_mul_ps(h0, u), _mm_mul_ps(h1, v)), h2);
+            __m128 py = _mm_add_ps(_mm_add_ps(_mm_mul_ps(h3, u), _mm_mul_ps(h4, v)), h5);
+            __m128i x = _mm_cvtps_epi32(_mm_div_ps(px, w));
+            __m128i y = _mm_cvtps_epi32(_mm_div_ps(py, w));
+            __m128i valid;
+            __m128i offset;
+
+            // Mask the points which can be sampled.
+            valid = _mm_and_si128(_mm_cmpgt_epi32(x, zero), _mm_cmplt_epi32(x, xmax));
+            valid = _mm_and_si128(valid, _mm_cmpgt_epi32(y, zero));
+            valid = _mm_and_si128(valid, _mm_cmplt_epi32(y, ymax));
+
+            // Calculate the offsets as x * 1 + y * widthStep and mark the invalid points.
+            offset = _mm_madd_epi16(_mm_or_si128(_mm_and_si128(x, low), _mm_slli_epi32(y, 16)), step);
+            offset = _mm_or_si128(_mm_and_si128(valid, offset), _mm_andnot_si128(valid, invalid));
+            _mm_storeu_si128((__m128i *) &offsets[k], offset);
+        }
+
+        return;
+    }
+#endif
+    {
+        CvPoint2D32f points[RVSAMPLER_SAMPLE_COUNT];
+
+        // Map and round each point.
+        rvSampler_MapPoints(quad, rvSampler_SampleU, rvSampler_SampleV, points, RVSAMPLER_SAMPLE_COUNT);
+        rvSampler_GetOffsets(img, points, offsets, RVSAMPLER_SAMPLE_COUNT);
+    }
+#endif
+}
+
+
+static void rvSampler_GatherSums(IplImage *img, const int *offsets, rvInt16 *sums, int count)
+// Sum the five pixels at and around each offset.  Offsets which can't be
+// sampled are given a sum of -1.  This function assumes a single plane image.
+{
+    int i;
+    int step = img->widthStep;
+    const uchar *data = (const uchar *) img->imageData;
+
+    for (i = 0; i < count; ++i)
+    {
+        // Was the point within the image?
+        if (offsets[i] < 0)
+        {
+            sums[i] = -1;
+        }
+        else
+        {
+            const uchar *pixel = data + offsets[i];
+
+            // Sum the center, left, right, up and down pixels.
+            sums[i] = (rvInt16) (pixel[0] + pixel[-1] + pixel[1] + pixel[-step] + pixel[step]);
+        }
+    }
+}
+
+
+#if defined(RVSAMPLER_AVX2)
+static __m256i rvSampler_ClassifySums(__m256i sums, __m256i black, __m256i white)
+// Returns a mask of the sums whose average is closer to white than black.
+{
+    __m256i valid = _mm256_cmpgt_epi16(sums, _mm256_set1_epi16(-1));
+    __m256i average = _mm256_mulhi_epu16(sums, _mm256_set1_epi16(RVSAMPLER_DIVIDE_BY_FIVE));
+    __m256i blackDifference = _mm256_or_si256(_mm256_subs_epu16(average, black), _mm256_subs_epu16(black, average));
+    __m256i whiteDifference = _mm256_or_si256(_mm256_subs_epu16(average, white), _mm256_subs_epu16(white, average));
+
+    return _mm256_and_si256(valid, _mm256_cmpgt_epi16(blackDifference, whiteDifference));
+}
+#elif defined(RVSAMPLER_SSE2)
+static __m128i rvSampler_ClassifySums(__m128i sums, __m128i black, __m128i white)
+// Returns a mask of the sums whose average is closer to white than black.
+{
+    __m128i valid = _mm_cmpgt_epi16(sums, _mm_set1_epi16(-1));
+    __m128i average = _mm_mulhi_epu16(sums, _mm_set1_epi16(RVSAMPLER_DIVIDE_BY_FIVE));
+    __m128i blackDifference = _mm_or_si128(_mm_subs_epu16(average, black), _mm_subs_epu16(black, average));
+    __m128i whiteDifference = _mm_or_si128(_mm_subs_epu16(average, white), _mm_subs_epu16(white, average));
+
+    return _mm_and_si128(valid, _mm_cmpgt_epi16(blackDifference, whiteDifference));
+}
+#endif
+
+
+bool rvSampler_SetQuad(rvSamplerQuad *quad, CvPoint2D32f corners[4])
+// Calculate the homography which maps the normalized tag coordinates onto the
+// given quadralateral.  The corners should follow a clockwise direction with the
+// unit square corners (0, 0), (1, 0), (1, 1) and (0, 1) mapping to corners 1, 2,
+// 3 and 0.  Returns false if the quadralateral is degenerate.
+{
+    double x0 = corners[1].x;
+    double y0 = corners[1].y;
+    double x1 = corners[2].x;
+    double y1 = corners[2].y;
+    double x2 = corners[3].x;
+    double y2 = corners[3].y;
+    double x3 = corners[0].x;
+    double y3 = corners[0].y;
+    double dx1 = x1 - x2;
+    double dy1 = y1 - y2;
+    double dx2 = x3 - x2;
+    double dy2 = y3 - y2;
+    double sx = x0 - x1 + x2 - x3;
+    double sy = y0 - y1 + y2 - y3;
+    double denominator = dx1 * dy2 - dx2 * dy1;
+    double g;
+    double h;
+
+    // Make sure the sides of the quadralateral aren't parallel.
+    if (fabs(denominator) < 1e-9) return false;
+
+    // Calculate the perspective terms.  These are zero for a parallelogram.
+    g = (sx * dy2 - dx2 * sy) / denominator;
+    h = (dx1 * sy - sx * dy1) / denominator;
+
+    // Fill in the homography.
+    quad->h[0] = (float) (x1 - x0 + g * x1);
+    quad->h[1] = (float) (x3 - x0 + h * x3);
+    quad->h[2] = (float) x0;
+    quad->h[3] = (float) (y1 - y0 + g * y1);
+    quad->h[4] = (float) (y3 - y0 + h * y3);
+    quad->h[5] = (float) y0;
+    quad->h[6] = (float) g;
+    quad->h[7] = (float) h;
+    quad->h[8] = 1.0f;
+
+    return true;
+}
+
+
+void rvSampler_GetSamplePoints(const rvSamplerQuad *quad, CvPoint2D32f samples[RVSAMPLER_SAMPLE_COUNT])
+// Fill in the 64 sample points associated with the quadralateral.
+{
+    rvSampler_MapPoints(quad, rvSampler_SampleU, rvSampler_SampleV, samples, RVSAMPLER_SAMPLE_COUNT);
+}
+
+
+void rvSampler_GetReferencePoints(const rvSamplerQuad *quad, CvPoint2D32f reference[RVSAMPLER_REFERENCE_COUNT])
+// Fill in the 8 reference points associated with the quadralateral.  The first
+// 4 reference points are outside the quadralateral and the last four reference
+// points are inside the quadralateral.
+{
+    rvSampler_MapPoints(quad, rvSampler_ReferenceU, rvSampler_ReferenceV, reference, RVSAMPLER_REFERENCE_COUNT);
+}
+
+
+void rvSampler_SampleReferences(IplImage *img, const rvSamplerQuad *quad, int *whiteReference, int *blackReference)
+// Sample the reference points of the quadralateral returning the average white
+// and black pixel values.  Reference points outside the image are ignored.
+{
+    int i;
+    int white = 0;
+    int black = 0;
+    int whiteCount = 0;
+    int blackCount = 0;
+    int offsets[RVSAMPLER_REFERENCE_COUNT];
+    rvInt16 sums[RVSAMPLER_REFERENCE_COUNT];
+    CvPoint2D32f reference[RVSAMPLER_REFERENCE_COUNT];
+
+    // Sample the reference points.
+    rvSampler_GetReferencePoints(quad, reference);
+    rvSampler_GetOffsets(img, reference, offsets, RVSAMPLER_REFERENCE_COUNT);
+    rvSampler_GatherSums(img, offsets, sums, RVSAMPLER_REFERENCE_COUNT);
+
+    // Add the samples to the white and black averages.
+    for (i = 0; i < RVSAMPLER_REFERENCE_COUNT / 2; ++i)
+    {
+        if (sums[i] >= 0)
+        {
+            white += sums[i] / 5;
+            whiteCount += 1;
+        }
+        if (sums[i + RVSAMPLER_REFERENCE_COUNT / 2] >= 0)
+        {
+            black += sums[i + RVSAMPLER_REFERENCE_COUNT / 2] / 5;
+            blackCount += 1;
+        }
+    }
+
+    // Average the samples.
+    *whiteReference = whiteCount ? white / whiteCount : 0;
+    *blackReference = blackCount ? black / blackCount : 0;
+}
+
+
+void rvSampler_SampleBorder(IplImage *img, const rvSamplerQuad *quad, int outside[RVSAMPLER_BORDER_COUNT], int inside[RVSAMPLER_BORDER_COUNT])
+// Sample pairs of points just outside and just inside the edge of the
+// quadralateral along each side returning the average pixel values.  On a tag
+// the outside points fall on the white border and the inside points on the
+// black border.  Points outside the image are given a value of -1.
+{
+    int i;
+    int offsets[2 * RVSAMPLER_BORDER_COUNT];
+    rvInt16 sums[2 * RVSAMPLER_BORDER_COUNT];
+    CvPoint2D32f border[2 * RVSAMPLER_BORDER_COUNT];
+
+    // Sample the border points.
+    rvSampler_MapPoints(quad, rvSampler_BorderU, rvSampler_BorderV, border, 2 * RVSAMPLER_BORDER_COUNT);
+    rvSampler_GetOffsets(img, border, offsets, 2 * RVSAMPLER_BORDER_COUNT);
+    rvSampler_GatherSums(img, offsets, sums, 2 * RVSAMPLER_BORDER_COUNT);
+
+    // Average the samples of each pair.
+    for (i = 0; i < RVSAMPLER_BORDER_COUNT; ++i)
+    {
+        outside[i] = (sums[i] >= 0) ? sums[i] / 5 : -1;
+        inside[i] = (sums[i + RVSAMPLER_BORDER_COUNT] >= 0) ? sums[i + RVSAMPLER_BORDER_COUNT] / 5 : -1;
+    }
+}
+
+
+rvUint64 rvSampler_SamplePattern(IplImage *img, const rvSamplerQuad *quad, int blackReference, int whiteReference)
+// Sample the 64 points of the quadralateral and return them as a bit pattern.  Bit
+// n of the pattern is set if the average of the five pixels around sample point n
+// is closer to the white reference than the black reference.  Sample points
+// outside the image are treated as black.
+{
+    rvUint64 pattern = 0;
+    int offsets[RVSAMPLER_SAMPLE_COUNT];
+    rvInt16 sums[RVSAMPLER_SAMPLE_COUNT];
+
+    // Get the offsets of the sample points and sum the pixels around them.
+    rvSampler_GetSampleOffsets(img, quad, offsets);
+    rvSampler_GatherSums(img, offsets, sums, RVSAMPLER_SAMPLE_COUNT);
+
+#if defined(RVSAMPLER_AVX2)
+    {
+        int k;
+        __m256i black = _mm256_set1_epi16((short) blackReference);
+        __m256i white = _mm256_set1_epi16((short) whiteReference);
+
+        // Classify 32 samples at a time.  Packing interleaves the 128-bit lanes so
+        // they must be put back in order before extracting the bits.
+        for (k = 0; k < RVSAMPLER_SAMPLE_COUNT; k += 32)
+        {
+            __m256i mask0 = rvSampler_ClassifySums(_mm256_loadu_si256((const __m256i *) &sums[k]), black, white);
+            __m256i mask1 = rvSampler_ClassifySums(_mm256_loadu_si256((const __m256i *) &sums[k + 16]), black, white);
+            __m256i mask = _mm256_permute4x64_epi64(_mm256_packs_epi16(mask0, mask1), 0xd8);
+
+            pattern |= ((rvUint64) (unsigned int) _mm256_movemask_epi8(mask)) << k;
+        }
+    }
+#elif defined(RVSAMPLER_SSE2)
+    {
+        int k;
+        __m128i black = _mm_set1_epi16((short) blackReference);
+        __m128i white = _mm_set1_epi16((short) whiteReference);
+
+        // Classify 16 samples at a time.
+        for (k = 0; k < RVSAMPLER_SAMPLE_COUNT; k += 16)
+        {
+            __m128i mask0 = rvSampler_ClassifySums(_mm_loadu_si128((const __m128i *) &sums[k]), black, white);
+            __m128i mask1 = rvSampler_ClassifySums(_mm_loadu_si128((const __m128i *) &sums[k + 8]), black, white);
+
+            pattern |= ((rvUint64) (unsigned int) _mm_movemask_epi8(_mm_packs_epi16(mask0, mask1))) << k;
+        }
+    }
+#else
+    {
+        int k;
+
+        // Classify each sample.
+        for (k = 0; k < RVSAMPLER_SAMPLE_COUNT; ++k)
+        {
+            int average;
+            int blackDifference;
+            int whiteDifference;
+
+            // Skip samples outside the image.
+            if (sums[k] < 0) continue;
+
+            // Get the black and white differences.
+            average = sums[k] / 5;
+            blackDifference = average - blackReference;
+            whiteDifference = average - whiteReference;
+            if (blackDifference < 0) blackDifference = -blackDifference;
+            if (whiteDifference < 0) whiteDifference = -whiteDifference;
+
+            // Is this a white square?
+            if (whiteDifference < blackDifference) pattern |= ((rvUint64) 1) << k;
+        }
+    }
+#endif
+
+    return pattern;
+}
@@ -0,0 +1,62 @@
+/*
+    Copyright (C) 2010, Michael P. Thompson
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 2 as
+    specified in the README.txt file or as published by the Free Software
+    Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    $Id$
+*/
+
+#ifndef _RV_SAMPLER_INCLUDED_
+#define _RV_SAMPLER_INCLUDED_
+
+#include "rvTypes.h"
+#include "cv.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RVSAMPLER_SAMPLE_COUNT      64
+#define RVSAMPLER_REFERENCE_COUNT   8
+#define RVSAMPLER_BORDER_COUNT      16
+
+// Sampler types.
+typedef struct _rvSamplerQuad rvSamplerQuad;
+
+// Homography mapping normalized tag coordinates (u, v) to image coordinates for
+// a quadralateral.  The 3x3 matrix is stored in row order and points are
+// projected as:
+//
+//   x = (h[0] * u + h[1] * v + h[2]) / (h[6] * u + h[7] * v + h[8])
+//   y = (h[3] * u + h[4] * v + h[5]) / (h[6] * u + h[7] * v + h[8])
+//
+struct _rvSamplerQuad
+{
+    float h[9];
+};
+
+// Sampler methods.
+bool rvSampler_SetQuad(rvSamplerQuad *quad, CvPoint2D32f corners[4]);
+void rvSampler_GetSamplePoints(const rvSamplerQuad *quad, CvPoint2D32f samples[RVSAMPLER_SAMPLE_COUNT]);
+void rvSampler_GetReferencePoints(const rvSamplerQuad *quad, CvPoint2D32f reference[RVSAMPLER_REFERENCE_COUNT]);
+void rvSampler_SampleReferences(IplImage *img, const rvSamplerQuad *quad, int *whiteReference, int *blackReference);
+void rvSampler_SampleBorder(IplImage *img, const rvSamplerQuad *quad, int outside[RVSAMPLER_BORDER_COUNT], int inside[RVSAMPLER_BORDER_COUNT]);
+rvUint64 rvSampler_SamplePattern(IplImage *img, const rvSamplerQuad *quad, int blackReference, int whiteReference);
+
+#ifdef __cplusplus
+} // "C"
+#endif
+
+#endif // _RV_SAMPLER_INCLUDED_
@@ -0,0 +1,270 @@
+/*
+    Copyright (C) 2010, Michael P. Thompson
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 2 as
+    specified in the README.txt file or as published by the Free Software
+    Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    $Id$
+*/
+
+#include <stdlib.h>
+#include "rvStorage.h"
+
+// Manages the memory storage used to find and approximate contours.  Noisy
+// images produce many contours which would otherwise grow the storage without
+// bound.  The blocks of the budget are allocated up front and kept when the
+// storage is cleared.  Finding contours stops once three quarters of the budget
+// is used or the number of contours reaches its limit, which leaves the rest of
+// the budget for processing the contours found.  Processing stops once the whole
+// budget is used, so the storage only grows past the budget if a single contour
+// fills more than a block.  A truncation is counted for each clear in which
+// finding or processing is cut short, and the most storage used between clears
+// is kept as the high water mark.
+
+// Storage structure.
+struct _rvStorage
+{
+    CvMemStorage *memStorage;
+    int budget;                 // Bytes of storage reserved.
+    int maxContours;            // Contours found between clears.
+    int contourCount;           // Contours found since the last clear.
+    int highWater;              // Most bytes used between clears.
+    int truncations;            // Clears between which finding or processing contours was cut short.
+    bool truncated;             // Finding or processing was cut short since the last clear.
+};
+
+
+static int rvStorage_CountBlocks(CvMemStorage *memStorage)
+// Count the blocks allocated by the memory storage.
+{
+    int count = 0;
+    CvMemBlock *block;
+
+    for (block = memStorage->bottom; block != NULL; block = block->next) ++count;
+
+    return count;
+}
+
+
+static void rvStorage_Truncate(rvStorage *self)
+// Count a truncation unless one was already counted since the last clear.
+{
+    if (!self->truncated) ++self->truncations;
+    self->truncated = true;
+}
+
+
+static bool rvStorage_Reserve(rvStorage *self)
+// Allocate the blocks of the budget and clear the storage so they are reused.
+// Returns false if the blocks could not be allocated.
+{
+    int blockCount = (self->budget + RVSTORAGE_BLOCK_SIZE - 1) / RVSTORAGE_BLOCK_SIZE;
+
+    // Fill the storage a quarter block at a time until the blocks are allocated.
+    while (rvStorage_CountBlocks(self->memStorage) < blockCount)
+    {
+        if (cvMemStorageAlloc(self->memStorage, RVSTORAGE_BLOCK_SIZE / 4) == NULL) return false;
+    }
+
+    // Release the space while keeping the blocks.
+    cvClearMemStorage(self->memStorage);
+
+    return true;
+}
+
+
+rvStorage *rvStorage_New(int budget, int maxContours)
+// Create a new storage object which reserves the budget in bytes and finds up
+// to the maximum number of contours between clears.
+{
+    rvStorage *self;
+
+    // Allocate the object.
+    self = (rvStorage *) malloc(sizeof(rvStorage));
+
+    // Did we allocate the object.
+    if (self != NULL)
+    {
+        // Set the object variables.
+        self->memStorage = cvCreateMemStorage(RVSTORAGE_BLOCK_SIZE);
+        self->budget = RVSTORAGE_DEFAULT_BUDGET;
+        self->maxContours = RVSTORAGE_DEFAULT_MAX_CONTOURS;
+        self->contourCount = 0;
+        self->highWater = 0;
+        self->truncations = 0;
+        self->truncated = false;
+
+        // Set the limits and reserve the storage.
+        rvStorage_SetMaxContours(self, maxContours);
+        if ((self->memStorage == NULL) || !rvStorage_SetBudget(self, budget))
+        {
+            // Clean up.
+            if (self->memStorage) cvReleaseMemStorage(&self->memStorage);
+            free(self);
+
+            return NULL;
+        }
+    }
+
+    return self;
+}
+
+
+void rvStorage_Free(rvStorage *self)
+// Free the storage object.
+{
+    // Sanity check the arguments.
+    if (self == NULL) return;
+
+    // Free the internal objects.
+    cvReleaseMemStorage(&self->memStorage);
+
+    // Free the object.
+    free(self);
+}
+
+
+bool rvStorage_SetBudget(rvStorage *self, int budget)
+// Sanity check and set the budget value.  More blocks are reserved if the
+// budget grows.  The storage must be cleared.  Returns false if the blocks
+// could not be reserved.
+{
+    // Sanity check and set the budget value.
+    if ((budget >= RVSTORAGE_MIN_BUDGET) && (budget <= RVSTORAGE_MAX_BUDGET)) self->budget = budget;
+
+    // Reserve the blocks of the budget.
+    return rvStorage_Reserve(self);
+}
+
+
+void rvStorage_SetMaxContours(rvStorage *self, int maxContours)
+{
+    // Sanity check and set the maximum contours value.
+    if ((maxContours >= 1) && (maxContours <= RVSTORAGE_MAX_CONTOURS)) self->maxContours = maxContours;
+}
+
+
+void rvStorage_Clear(rvStorage *self)
+// Release the space used in the storage for reuse.  The space used is added to
+// the high water mark first.
+{
+    // Update the high water mark.
+    rvStorage_GetUsed(self);
+
+    // Clear the memory storage, the contour count and the truncation.
+    cvClearMemStorage(self->memStorage);
+    self->contourCount = 0;
+    self->truncated = false;
+}
+
+
+CvMemStorage *rvStorage_GetMemStorage(rvStorage *self)
+{
+    return self->memStorage;
+}
+
+
+CvSeq *rvStorage_FindContours(rvStorage *self, CvArr *image, int mode, CvPoint offset)
+// Find the contours in the image as with cvFindContours using simple chain
+// approximation.  The image is modified.  Finding stops and a truncation is
+// counted if the share of the budget for finding is used or the contour limit
+// is reached.  Returns the contours found linked through h_next.
+{
+    int limit = self->budget - self->budget / 4;
+    CvContourScanner scanner;
+
+    // Is there room to find contours?
+    if ((rvStorage_GetUsed(self) > limit) || (self->contourCount >= self->maxContours))
+    {
+        rvStorage_Truncate(self);
+        return NULL;
+    }
+
+    // Start finding the contours.
+    scanner = cvStartFindContours(image, self->memStorage, sizeof(CvContour), mode, CV_CHAIN_APPROX_SIMPLE, offset);
+
+    // Find contours until there are no more or the limits are reached.
+    while (cvFindNextContour(scanner) != NULL)
+    {
+        if ((++self->contourCount >= self->maxContours) || (rvStorage_GetUsed(self) > limit))
+        {
+            rvStorage_Truncate(self);
+            break;
+        }
+    }
+
+    // Finish finding the contours.
+    return cvEndFindContours(&scanner);
+}
+
+
+bool rvStorage_CheckBudget(rvStorage *self)
+// Check there is room to keep processing the contours found.  Returns false and
+// counts a truncation if the whole budget is used.
+{
+    // Processing may use the part of the budget left by finding the contours.
+    if (rvStorage_GetUsed(self) >= self->budget)
+    {
+        rvStorage_Truncate(self);
+        return false;
+    }
+
+    return true;
+}
+
+
+int rvStorage_GetUsed(rvStorage *self)
+// Get the bytes used in the storage since the last clear including the block
+// headers.  The high water mark is updated.
+{
+    int used = 0;
+    CvMemBlock *block;
+    CvMemStorage *memStorage = self->memStorage;
+
+    // Sum the blocks up to the block in use less its free space.
+    if (memStorage->top != NULL)
+    {
+        for (block = memStorage->bottom; block != memStorage->top; block = block->next) used += memStorage->block_size;
+        used += memStorage->block_size - memStorage->free_space;
+    }
+
+    // Update the high water mark.
+    if (used > self->highWater) self->highWater = used;
+
+    return used;
+}
+
+
+int rvStorage_GetHighWater(rvStorage *self)
+// Get the most bytes used in the storage between clears.
+{
+    // Include the space used since the last clear.
+    rvStorage_GetUsed(self);
+
+    return self->highWater;
+}
+
+
+int rvStorage_GetTruncations(rvStorage *self)
+// Get the number of clears between which finding or processing contours was cut short.
+{
+    return self->truncations;
+}
+
+
+bool rvStorage_IsTruncated(rvStorage *self)
+// Returns true if finding or processing contours was cut short since the last clear.
+{
+    return self->truncated;
+}
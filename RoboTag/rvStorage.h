@@ -0,0 +1,59 @@
+/*
+    Copyright (C) 2010, Michael P. Thompson
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 2 as
+    specified in the README.txt file or as published by the Free Software
+    Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    $Id$
+*/
+
+#ifndef _RV_STORAGE_INCLUDED_
+#define _RV_STORAGE_INCLUDED_
+
+#include "rvTypes.h"
+#include "cv.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RVSTORAGE_BLOCK_SIZE            65536
+#define RVSTORAGE_MIN_BUDGET            RVSTORAGE_BLOCK_SIZE
+#define RVSTORAGE_MAX_BUDGET            (256 * RVSTORAGE_BLOCK_SIZE)
+#define RVSTORAGE_DEFAULT_BUDGET        (32 * RVSTORAGE_BLOCK_SIZE)
+#define RVSTORAGE_MAX_CONTOURS          65536
+#define RVSTORAGE_DEFAULT_MAX_CONTOURS  4096
+
+// Storage types.
+typedef struct _rvStorage rvStorage;
+
+// Storage methods.
+rvStorage *rvStorage_New(int budget, int maxContours);
+void rvStorage_Free(rvStorage *self);
+bool rvStorage_SetBudget(rvStorage *self, int budget);
+void rvStorage_SetMaxContours(rvStorage *self, int maxContours);
+void rvStorage_Clear(rvStorage *self);
+CvMemStorage *rvStorage_GetMemStorage(rvStorage *self);
+CvSeq *rvStorage_FindContours(rvStorage *self, CvArr *image, int mode, CvPoint offset);
+bool rvStorage_CheckBudget(rvStorage *self);
+int rvStorage_GetUsed(rvStorage *self);
+int rvStorage_GetHighWater(rvStorage *self);
+int rvStorage_GetTruncations(rvStorage *self);
+bool rvStorage_IsTruncated(rvStorage *self);
+
+#ifdef __cplusplus
+} // "C"
+#endif
+
+#endif // _RV_STORAGE_INCLUDED_
@@ -19,6 +19,7 @@
 */
 
 #include <stdlib.h>
+#include <string.h>
 #include "rvTag.h"
 
 rvTag* rvTag_New(void)
@@ -67,12 +68,28 @@ void rvTag_Free(rvTag* self)
 
 
 bool rvTag_DecodeSamples(rvTag* self, CvPoint2D32f corners[RVTAG_CORNER_COUNT], rvUint8 samples[RVTAG_SAMPLE_COUNT])
+{
+    int i;
+    rvUint64 pattern = 0;
+
+    // Pack the samples into a bit pattern.
+    for (i = 0; i < RVTAG_SAMPLE_COUNT; ++i)
+    {
+        if (samples[i]) pattern |= ((rvUint64) 1) << i;
+    }
+
+    return rvTag_DecodePattern(self, corners, pattern);
+}
+
+
+bool rvTag_DecodePattern(rvTag* self, CvPoint2D32f corners[RVTAG_CORNER_COUNT], rvUint64 pattern)
+// Decode the sample pattern with bit n set for white sample n.
 {
     // Assume we fail.
     self->result = false;
 
     // Decode the bits and see if we found a valid pattern.
-    self->result = rvDecode_SetBits(self->decoder, samples, RVTAG_SAMPLE_COUNT);
+    self->result = rvDecode_SetPattern(self->decoder, pattern);
 
     // Did the decoding succeed?
     if (self->result)
@@ -130,6 +147,20 @@ bool rvTag_DecodeSamples(rvTag* self, CvPoint2D32f corners[RVTAG_CORNER_COUNT],
 }
 
 
+void rvTag_SetCodebook(rvTag* self, rvCodebook *codebook)
+{
+    // Set the codebook of the decoder.
+    rvDecode_SetCodebook(self->decoder, codebook);
+}
+
+
+void rvTag_SetDecodeMethod(rvTag* self, rvInt16 method, rvInt16 maxBitErrors)
+{
+    // Set the decode method of the decoder.
+    rvDecode_SetMethod(self->decoder, method, maxBitErrors);
+}
+
+
 bool rvTag_GetDecodedResult(rvTag* self)
 {
     // Return the result of previous decoding.
@@ -178,3 +209,9 @@ bool rvTag_GetDecodedCorners(rvTag* self, CvPoint2D32f corners[RVTAG_CORNER_COUN
     return self->result;
 }
 
+
+bool rvTag_GetDecodedBitErrors(rvTag* self, rvInt16 *bitErrors)
+{
+    // Return the bit errors of previous decoding.
+    return rvDecode_GetBitErrors(self->decoder, bitErrors);
+}
@@ -50,10 +50,14 @@ struct _rvTag
 rvTag* rvTag_New(void);
 void rvTag_Free(rvTag* self);
 bool rvTag_DecodeSamples(rvTag* self, CvPoint2D32f corners[RVTAG_CORNER_COUNT], rvUint8 samples[RVTAG_SAMPLE_COUNT]);
+bool rvTag_DecodePattern(rvTag* self, CvPoint2D32f corners[RVTAG_CORNER_COUNT], rvUint64 pattern);
+void rvTag_SetCodebook(rvTag* self, rvCodebook *codebook);
+void rvTag_SetDecodeMethod(rvTag* self, rvInt16 method, rvInt16 maxBitErrors);
 bool rvTag_GetDecodedResult(rvTag* self);
 bool rvTag_GetDecodedId(rvTag* self, rvUint16 *id);
 bool rvTag_GetDecodedDirection(rvTag* self, rvInt16 *direction);
 bool rvTag_GetDecodedCorners(rvTag* self, CvPoint2D32f corners[RVTAG_CORNER_COUNT]);
+bool rvTag_GetDecodedBitErrors(rvTag* self, rvInt16 *bitErrors);
 
 #ifdef __cplusplus
 } // "C"
@@ -0,0 +1,114 @@
+/*
+    Copyright (C) 2010, Michael P. Thompson
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 2 as
+    specified in the README.txt file or as published by the Free Software
+    Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    $Id$
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "rvTagSet.h"
+
+
+rvTagSet *rvTagSet_New(void)
+// Create a new empty tag set.
+{
+    rvTagSet *self;
+
+    // Allocate the object.
+    self = (rvTagSet *) malloc(sizeof(rvTagSet));
+
+    // Did we allocate the object.
+    if (self != NULL) rvTagSet_Clear(self);
+
+    return self;
+}
+
+
+void rvTagSet_Free(rvTagSet *self)
+// Free the tag set object.
+{
+    // Sanity check the arguments.
+    if (self == NULL) return;
+
+    // Free the object.
+    free(self);
+}
+
+
+void rvTagSet_Clear(rvTagSet *self)
+// Remove all tag ids from the set.
+{
+    memset(self->bits, 0, sizeof(self->bits));
+    self->count = 0;
+}
+
+
+void rvTagSet_Copy(rvTagSet *self, const rvTagSet *other)
+// Make the set hold the same tag ids as the other set.
+{
+    memcpy(self, other, sizeof(rvTagSet));
+}
+
+
+void rvTagSet_Add(rvTagSet *self, rvUint16 id)
+// Add the tag id to the set.
+{
+    rvUint8 mask = (rvUint8) (1 << (id & 7));
+
+    // Set the bit if it isn't already set.
+    if ((self->bits[id >> 3] & mask) == 0)
+    {
+        self->bits[id >> 3] |= mask;
+        ++self->count;
+    }
+}
+
+
+void rvTagSet_AddRange(rvTagSet *self, rvUint16 firstId, rvUint16 lastId)
+// Add the tag ids from the first id to the last id inclusive to the set.
+{
+    long id;
+
+    for (id = firstId; id <= lastId; ++id) rvTagSet_Add(self, (rvUint16) id);
+}
+
+
+void rvTagSet_Remove(rvTagSet *self, rvUint16 id)
+// Remove the tag id from the set.
+{
+    rvUint8 mask = (rvUint8) (1 << (id & 7));
+
+    // Clear the bit if it is set.
+    if ((self->bits[id >> 3] & mask) != 0)
+    {
+        self->bits[id >> 3] &= (rvUint8) ~mask;
+        --self->count;
+    }
+}
+
+
+bool rvTagSet_Contains(const rvTagSet *self, rvUint16 id)
+// Returns true if the tag id is in the set.
+{
+    return (self->bits[id >> 3] & (1 << (id & 7))) != 0;
+}
+
+
+int rvTagSet_GetCount(const rvTagSet *self)
+{
+    return self->count;
+}
@@ -0,0 +1,57 @@
+/*
+    Copyright (C) 2010, Michael P. Thompson
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 2 as
+    specified in the README.txt file or as published by the Free Software
+    Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    $Id$
+*/
+
+#ifndef _RV_TAGSET_INCLUDED_
+#define _RV_TAGSET_INCLUDED_
+
+#include "rvTypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RVTAGSET_ID_COUNT   65536
+
+// Tag set types.
+typedef struct _rvTagSet rvTagSet;
+
+// Tag set structure.  Holds one bit for each possible tag id.
+struct _rvTagSet
+{
+    int count;
+    rvUint8 bits[RVTAGSET_ID_COUNT / 8];
+};
+
+// Tag set methods.
+rvTagSet *rvTagSet_New(void);
+void rvTagSet_Free(rvTagSet *self);
+void rvTagSet_Clear(rvTagSet *self);
+void rvTagSet_Copy(rvTagSet *self, const rvTagSet *other);
+void rvTagSet_Add(rvTagSet *self, rvUint16 id);
+void rvTagSet_AddRange(rvTagSet *self, rvUint16 firstId, rvUint16 lastId);
+void rvTagSet_Remove(rvTagSet *self, rvUint16 id);
+bool rvTagSet_Contains(const rvTagSet *self, rvUint16 id);
+int rvTagSet_GetCount(const rvTagSet *self);
+
+#ifdef __cplusplus
+} // "C"
+#endif
+
+#endif // _RV_TAGSET_INCLUDED_
@@ -0,0 +1,202 @@
+/*
+    Copyright (C) 2010, Michael P. Thompson
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 2 as
+    specified in the README.txt file or as published by the Free Software
+    Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    $Id$
+*/
+
+#include <stdlib.h>
+#include "rvTaskPool.h"
+
+
+static void rvTaskPool_Work(rvTaskPool *self, int worker)
+// Run the tasks in the range owned by the worker and then steal the
+// remaining tasks from the ranges of the other workers.
+{
+    int i;
+    long task;
+
+    // Loop over the ranges starting with our own.
+    for (i = 0; i < self->workerCount; ++i)
+    {
+        rvTaskPoolRange *range = &self->ranges[(worker + i) % self->workerCount];
+
+        // Claim tasks from the range until it is exhausted.
+        while ((task = rvAtomic_Add(&range->next, 1) - 1) < range->end)
+        {
+            self->func(self->arg, (int) task, worker);
+        }
+    }
+}
+
+
+static void rvTaskPool_WorkerThread(void *arg)
+// Worker thread.  Waits to be started, runs tasks and reports completion.
+{
+    rvTaskPoolWorker *worker = (rvTaskPoolWorker *) arg;
+    rvTaskPool *self = worker->pool;
+
+    for (;;)
+    {
+        // Wait to be started.
+        rvEvent_Wait(self->startEvents[worker->index], -1);
+
+        // Should we exit?
+        if (!rvAtomic_Load(&self->running)) break;
+
+        // Run the tasks.
+        rvTaskPool_Work(self, worker->index);
+
+        // Signal if we are the last worker to finish.
+        if (rvAtomic_Add(&self->activeWorkers, -1) == 0) rvEvent_Signal(self->doneEvent);
+    }
+}
+
+
+rvTaskPool *rvTaskPool_New(int workerCount)
+// Create a task pool with the number of workers.  A worker count less than
+// one creates a worker for each processor.
+{
+    int i;
+    rvTaskPool *self;
+
+    // Sanity check the arguments.
+    if (workerCount < 1) workerCount = rvThread_GetCpuCount();
+    if (workerCount > RVTASKPOOL_MAX_WORKERS) workerCount = RVTASKPOOL_MAX_WORKERS;
+
+    // Allocate the object.
+    self = (rvTaskPool *) calloc(1, sizeof(rvTaskPool));
+
+    // Did we allocate the object.
+    if (self != NULL)
+    {
+        // Set the object variables.
+        self->workerCount = 1;
+        self->running = 1;
+        self->doneEvent = rvEvent_New();
+
+        // Did we create the done event?
+        if (self->doneEvent == NULL)
+        {
+            // Clean up.
+            free(self);
+            return NULL;
+        }
+
+        // Start the worker threads.  Worker zero is the calling thread.
+        for (i = 1; i < workerCount; ++i)
+        {
+            self->workers[i].pool = self;
+            self->workers[i].index = i;
+
+            // Create the start event and thread.
+            self->startEvents[i] = rvEvent_New();
+            if (self->startEvents[i] != NULL) self->threads[i] = rvThread_New(rvTaskPool_WorkerThread, &self->workers[i]);
+
+            // Stop adding workers if we failed.
+            if (self->threads[i] == NULL)
+            {
+                rvEvent_Free(self->startEvents[i]);
+                self->startEvents[i] = NULL;
+                break;
+            }
+
+            self->workerCount = i + 1;
+        }
+    }
+
+    return self;
+}
+
+
+void rvTaskPool_Free(rvTaskPool *self)
+// Stop the worker threads and free the task pool.
+{
+    int i;
+
+    // Sanity check the arguments.
+    if (self == NULL) return;
+
+    // Signal the worker threads to exit.
+    rvAtomic_Store(&self->running, 0);
+    for (i = 1; i < self->workerCount; ++i) rvEvent_Signal(self->startEvents[i]);
+
+    // Wait for the worker threads to exit.
+    for (i = 1; i < self->workerCount; ++i)
+    {
+        rvThread_Free(self->threads[i]);
+        rvEvent_Free(self->startEvents[i]);
+    }
+
+    // Free the object.
+    rvEvent_Free(self->doneEvent);
+    free(self);
+}
+
+
+int rvTaskPool_GetWorkerCount(rvTaskPool *self)
+{
+    return self->workerCount;
+}
+
+
+void rvTaskPool_Run(rvTaskPool *self, int taskCount, rvTaskPool_Func func, void *arg)
+// Run the task function for each task index and wait for all of them to
+// complete.  The tasks are divided evenly between the workers and idle
+// workers steal tasks from busy ones.  Must only be called from one thread
+// at a time.
+{
+    int i;
+    int workerCount;
+
+    // Anything to do?
+    if (taskCount < 1) return;
+
+    // Don't wake more workers than there are tasks.
+    workerCount = taskCount < self->workerCount ? taskCount : self->workerCount;
+
+    // Run everything on this thread if there is only one worker.
+    if (workerCount == 1)
+    {
+        for (i = 0; i < taskCount; ++i) func(arg, i, 0);
+        return;
+    }
+
+    // Set the task function.
+    self->func = func;
+    self->arg = arg;
+
+    // Divide the tasks between the workers.  Workers that are not woken
+    // are given empty ranges.
+    for (i = 0; i < self->workerCount; ++i)
+    {
+        long begin = i < workerCount ? ((long) taskCount * i) / workerCount : taskCount;
+        long end = i < workerCount ? ((long) taskCount * (i + 1)) / workerCount : taskCount;
+
+        self->ranges[i].end = end;
+        rvAtomic_Store(&self->ranges[i].next, begin);
+    }
+
+    // Wake the workers.
+    rvAtomic_Store(&self->activeWorkers, workerCount);
+    for (i = 1; i < workerCount; ++i) rvEvent_Signal(self->startEvents[i]);
+
+    // Run tasks on this thread as well.
+    rvTaskPool_Work(self, 0);
+
+    // Wait for the other workers if we were not the last to finish.
+    if (rvAtomic_Add(&self->activeWorkers, -1) != 0) rvEvent_Wait(self->doneEvent, -1);
+}
@@ -0,0 +1,86 @@
+/*
+    Copyright (C) 2010, Michael P. Thompson
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 2 as
+    specified in the README.txt file or as published by the Free Software
+    Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    $Id$
+*/
+
+#ifndef _RV_TASKPOOL_INCLUDED_
+#define _RV_TASKPOOL_INCLUDED_
+
+#include "rvTypes.h"
+#include "rvThread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RVTASKPOOL_MAX_WORKERS      64
+
+// Task pool types.
+typedef struct _rvTaskPool rvTaskPool;
+typedef struct _rvTaskPoolRange rvTaskPoolRange;
+typedef struct _rvTaskPoolWorker rvTaskPoolWorker;
+
+// Task function type.  Called once for each task index with the index of the
+// worker running it.  Worker indexes range from zero to the worker count.
+typedef void (*rvTaskPool_Func)(void *arg, int task, int worker);
+
+// Range of task indexes owned by a worker.  Both the owner and stealing
+// workers claim tasks by atomically incrementing the next index.
+struct _rvTaskPoolRange
+{
+    rvAtomic next;
+    long end;
+    char padding[64];           // Keep ranges on separate cache lines.
+};
+
+// Worker thread argument.
+struct _rvTaskPoolWorker
+{
+    rvTaskPool *pool;
+    int index;
+};
+
+// Task pool structure.  The thread calling rvTaskPool_Run acts as worker
+// zero so a pool with a single worker creates no threads.
+struct _rvTaskPool
+{
+    int workerCount;
+    rvTaskPoolWorker workers[RVTASKPOOL_MAX_WORKERS];
+    rvThread *threads[RVTASKPOOL_MAX_WORKERS];
+    rvEvent *startEvents[RVTASKPOOL_MAX_WORKERS];
+    rvEvent *doneEvent;
+    rvAtomic running;
+    rvAtomic activeWorkers;
+
+    rvTaskPool_Func func;
+    void *arg;
+
+    rvTaskPoolRange ranges[RVTASKPOOL_MAX_WORKERS];
+};
+
+// Task pool methods.
+rvTaskPool *rvTaskPool_New(int workerCount);
+void rvTaskPool_Free(rvTaskPool *self);
+int rvTaskPool_GetWorkerCount(rvTaskPool *self);
+void rvTaskPool_Run(rvTaskPool *self, int taskCount, rvTaskPool_Func func, void *arg);
+
+#ifdef __cplusplus
+} // "C"
+#endif
+
+#endif // _RV_TASKPOOL_INCLUDED_
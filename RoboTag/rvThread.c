@@ -0,0 +1,401 @@
+/*
+    Copyright (C) 2010, Michael P. Thompson
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 2 as
+    specified in the README.txt file or as published by the Free Software
+    Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    $Id$
+*/
+
+#include <stdlib.h>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/time.h>
+#endif
+#include "rvThread.h"
+
+struct _rvThread
+{
+    rvThread_Func func;
+    void *arg;
+#if defined(_WIN32)
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+};
+
+struct _rvMutex
+{
+#if defined(_WIN32)
+    CRITICAL_SECTION section;
+#else
+    pthread_mutex_t mutex;
+#endif
+};
+
+struct _rvEvent
+{
+#if defined(_WIN32)
+    HANDLE handle;
+#else
+    bool signaled;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+#endif
+};
+
+
+#if defined(_WIN32)
+static DWORD WINAPI rvThread_Entry(LPVOID param)
+// Platform thread entry point which calls the thread function.
+{
+    rvThread *self = (rvThread *) param;
+
+    // Call the thread function.
+    self->func(self->arg);
+
+    return 0;
+}
+#else
+static void *rvThread_Entry(void *param)
+// Platform thread entry point which calls the thread function.
+{
+    rvThread *self = (rvThread *) param;
+
+    // Call the thread function.
+    self->func(self->arg);
+
+    return NULL;
+}
+#endif
+
+
+rvThread *rvThread_New(rvThread_Func func, void *arg)
+// Create and start a new thread running the thread function.
+{
+    rvThread *self;
+
+    // Sanity check the arguments.
+    if (func == NULL) return NULL;
+
+    // Allocate the object.
+    self = (rvThread *) malloc(sizeof(rvThread));
+
+    // Did we allocate the object.
+    if (self != NULL)
+    {
+        // Set the object variables.
+        self->func = func;
+        self->arg = arg;
+
+#if defined(_WIN32)
+        // Create the thread.
+        self->handle = CreateThread(NULL, 0, rvThread_Entry, self, 0, NULL);
+        if (self->handle == NULL)
+        {
+            // Clean up.
+            free(self);
+            self = NULL;
+        }
+#else
+        // Create the thread.
+        if (pthread_create(&self->handle, NULL, rvThread_Entry, self) != 0)
+        {
+            // Clean up.
+            free(self);
+            self = NULL;
+        }
+#endif
+    }
+
+    return self;
+}
+
+
+void rvThread_Free(rvThread *self)
+// Wait for the thread to exit and free the thread object.  The caller
+// is responsible for signaling the thread function to return.
+{
+    // Sanity check the arguments.
+    if (self == NULL) return;
+
+#if defined(_WIN32)
+    // Wait for the thread to exit.
+    WaitForSingleObject(self->handle, INFINITE);
+    CloseHandle(self->handle);
+#else
+    // Wait for the thread to exit.
+    pthread_join(self->handle, NULL);
+#endif
+
+    // Free the object.
+    free(self);
+}
+
+
+int rvThread_GetCpuCount(void)
+// Returns the number of processors available to this process.
+{
+    int count;
+
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+
+    // Get the system information.
+    GetSystemInfo(&info);
+    count = (int) info.dwNumberOfProcessors;
+#else
+    // Get the number of online processors.
+    count = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    return count > 0 ? count : 1;
+}
+
+
+void rvThread_Yield(void)
+// Yield the remainder of the time slice of the calling thread.
+{
+#if defined(_WIN32)
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+
+rvMutex *rvMutex_New(void)
+// Create a new mutex object.
+{
+    rvMutex *self;
+
+    // Allocate the object.
+    self = (rvMutex *) malloc(sizeof(rvMutex));
+
+    // Did we allocate the object.
+    if (self != NULL)
+    {
+#if defined(_WIN32)
+        InitializeCriticalSection(&self->section);
+#else
+        pthread_mutex_init(&self->mutex, NULL);
+#endif
+    }
+
+    return self;
+}
+
+
+void rvMutex_Free(rvMutex *self)
+// Free the mutex object.
+{
+    // Sanity check the arguments.
+    if (self == NULL) return;
+
+#if defined(_WIN32)
+    DeleteCriticalSection(&self->section);
+#else
+    pthread_mutex_destroy(&self->mutex);
+#endif
+
+    // Free the object.
+    free(self);
+}
+
+
+void rvMutex_Lock(rvMutex *self)
+// Lock the mutex.
+{
+#if defined(_WIN32)
+    EnterCriticalSection(&self->section);
+#else
+    pthread_mutex_lock(&self->mutex);
+#endif
+}
+
+
+void rvMutex_Unlock(rvMutex *self)
+// Unlock the mutex.
+{
+#if defined(_WIN32)
+    LeaveCriticalSection(&self->section);
+#else
+    pthread_mutex_unlock(&self->mutex);
+#endif
+}
+
+
+rvEvent *rvEvent_New(void)
+// Create a new auto-reset event object in the non-signaled state.
+{
+    rvEvent *self;
+
+    // Allocate the object.
+    self = (rvEvent *) malloc(sizeof(rvEvent));
+
+    // Did we allocate the object.
+    if (self != NULL)
+    {
+#if defined(_WIN32)
+        self->handle = CreateEvent(NULL, FALSE, FALSE, NULL);
+        if (self->handle == NULL)
+        {
+            // Clean up.
+            free(self);
+            self = NULL;
+        }
+#else
+        self->signaled = false;
+        pthread_mutex_init(&self->mutex, NULL);
+        pthread_cond_init(&self->cond, NULL);
+#endif
+    }
+
+    return self;
+}
+
+
+void rvEvent_Free(rvEvent *self)
+// Free the event object.
+{
+    // Sanity check the arguments.
+    if (self == NULL) return;
+
+#if defined(_WIN32)
+    CloseHandle(self->handle);
+#else
+    pthread_cond_destroy(&self->cond);
+    pthread_mutex_destroy(&self->mutex);
+#endif
+
+    // Free the object.
+    free(self);
+}
+
+
+void rvEvent_Signal(rvEvent *self)
+// Signal the event releasing a single waiting thread.
+{
+#if defined(_WIN32)
+    SetEvent(self->handle);
+#else
+    pthread_mutex_lock(&self->mutex);
+    self->signaled = true;
+    pthread_cond_signal(&self->cond);
+    pthread_mutex_unlock(&self->mutex);
+#endif
+}
+
+
+bool rvEvent_Wait(rvEvent *self, long milliseconds)
+// Wait up to the number of milliseconds for the event to be signaled.  A
+// negative timeout waits forever.  Returns true if the event was signaled.
+{
+#if defined(_WIN32)
+    DWORD timeout = milliseconds < 0 ? INFINITE : (DWORD) milliseconds;
+
+    return WaitForSingleObject(self->handle, timeout) == WAIT_OBJECT_0;
+#else
+    bool signaled;
+
+    pthread_mutex_lock(&self->mutex);
+
+    // Wait for the event to be signaled.
+    if (milliseconds < 0)
+    {
+        while (!self->signaled) pthread_cond_wait(&self->cond, &self->mutex);
+    }
+    else
+    {
+        struct timeval now;
+        struct timespec abstime;
+        int rc = 0;
+
+        // Determine the absolute timeout time.
+        gettimeofday(&now, NULL);
+        abstime.tv_sec = now.tv_sec + milliseconds / 1000;
+        abstime.tv_nsec = now.tv_usec * 1000 + (milliseconds % 1000) * 1000000;
+        if (abstime.tv_nsec >= 1000000000)
+        {
+            abstime.tv_sec += 1;
+            abstime.tv_nsec -= 1000000000;
+        }
+
+        while (!self->signaled && (rc != ETIMEDOUT))
+        {
+            rc = pthread_cond_timedwait(&self->cond, &self->mutex, &abstime);
+        }
+    }
+
+    // Automatically reset the event.
+    signaled = self->signaled;
+    self->signaled = false;
+
+    pthread_mutex_unlock(&self->mutex);
+
+    return signaled;
+#endif
+}
+
+
+long rvAtomic_Load(rvAtomic *value)
+// Read the value with acquire semantics.
+{
+#if defined(_WIN32)
+    return InterlockedCompareExchange(value, 0, 0);
+#else
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+#endif
+}
+
+
+void rvAtomic_Store(rvAtomic *value, long newValue)
+// Write the value with release semantics.
+{
+#if defined(_WIN32)
+    InterlockedExchange(value, newValue);
+#else
+    __atomic_store_n(value, newValue, __ATOMIC_RELEASE);
+#endif
+}
+
+
+long rvAtomic_Add(rvAtomic *value, long addend)
+// Add to the value and return the resulting value.
+{
+#if defined(_WIN32)
+    return InterlockedExchangeAdd(value, addend) + addend;
+#else
+    return __atomic_add_fetch(value, addend, __ATOMIC_SEQ_CST);
+#endif
+}
+
+
+long rvAtomic_CompareExchange(rvAtomic *value, long newValue, long compareValue)
+// Set the value to the new value if it currently equals the compare value.
+// Returns the initial value.
+{
+#if defined(_WIN32)
+    return InterlockedCompareExchange(value, newValue, compareValue);
+#else
+    __atomic_compare_exchange_n(value, &compareValue, newValue, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return compareValue;
+#endif
+}
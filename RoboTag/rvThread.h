@@ -0,0 +1,69 @@
+/*
+    Copyright (C) 2010, Michael P. Thompson
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 2 as
+    specified in the README.txt file or as published by the Free Software
+    Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    $Id$
+*/
+
+#ifndef _RV_THREAD_INCLUDED_
+#define _RV_THREAD_INCLUDED_
+
+#include "rvTypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Thread types.
+typedef struct _rvThread rvThread;
+typedef struct _rvMutex rvMutex;
+typedef struct _rvEvent rvEvent;
+
+// Atomic integer type.  All access should be through the atomic methods.
+typedef volatile long rvAtomic;
+
+// Thread entry function type.
+typedef void (*rvThread_Func)(void *arg);
+
+// Thread methods.
+rvThread *rvThread_New(rvThread_Func func, void *arg);
+void rvThread_Free(rvThread *self);
+int rvThread_GetCpuCount(void);
+void rvThread_Yield(void);
+
+// Mutex methods.
+rvMutex *rvMutex_New(void);
+void rvMutex_Free(rvMutex *self);
+void rvMutex_Lock(rvMutex *self);
+void rvMutex_Unlock(rvMutex *self);
+
+// Auto-reset event methods.
+rvEvent *rvEvent_New(void);
+void rvEvent_Free(rvEvent *self);
+void rvEvent_Signal(rvEvent *self);
+bool rvEvent_Wait(rvEvent *self, long milliseconds);
+
+// Atomic methods.
+long rvAtomic_Load(rvAtomic *value);
+void rvAtomic_Store(rvAtomic *value, long newValue);
+long rvAtomic_Add(rvAtomic *value, long addend);
+long rvAtomic_CompareExchange(rvAtomic *value, long newValue, long compareValue);
+
+#ifdef __cplusplus
+} // "C"
+#endif
+
+#endif // _RV_THREAD_INCLUDED_
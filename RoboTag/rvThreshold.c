@@ -0,0 +1,455 @@
+/*
+    Copyright (C) 2010, Michael P. Thompson
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 2 as
+    specified in the README.txt file or as published by the Free Software
+    Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    $Id$
+*/
+
+#include <stdlib.h>
+#include <math.h>
+#include "rvThreshold.h"
+
+// Implements an adaptive threshold against the mean of the block around each
+// pixel.  The sums of each column of the block are kept as the block moves down
+// the image and a prefix sum of the column sums gives the sum of each block with
+// a single subtraction.  The cost is independent of the block size.  Pixels past
+// the image edges repeat the edge pixels as with cvAdaptiveThreshold.
+//
+// The color threshold fuses the gray scale conversion and Gaussian blur of a
+// color image with the threshold in a single pass.  Each color row is read once
+// and converted just ahead of the rows being thresholded, so only the rows of the
+// blur and the block are kept in the cache rather than streaming whole images
+// through memory between steps.
+
+// Select the vector instruction set used by the threshold.  Defining RV_NO_SIMD
+// forces the portable scalar code.
+#if !defined(RV_NO_SIMD) && defined(__AVX2__)
+#define RVTHRESHOLD_AVX2
+#include <immintrin.h>
+#elif !defined(RV_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)))
+#define RVTHRESHOLD_SSE2
+#include <emmintrin.h>
+#endif
+
+// Largest Gaussian blur size of the color threshold.
+#define RVTHRESHOLD_MAX_BLUR_SIZE   31
+
+// Fixed point weights of the red, green and blue channels in 14 bits matching
+// the gray scale conversion of cvCvtColor.
+#define RVTHRESHOLD_RED_WEIGHT      4899
+#define RVTHRESHOLD_GREEN_WEIGHT    9617
+#define RVTHRESHOLD_BLUE_WEIGHT     1868
+
+// Threshold structure.
+struct _rvThreshold
+{
+    int width;                  // Widest image which can be thresholded.
+    int *columnSums;            // Column sums with the edge columns repeated on each side.
+    int *prefixSums;            // Prefix sums of the column sums.
+    rvUint8 *blurRows;          // Ring of the gray rows being blurred.
+    int *blurColumns;           // Vertically blurred row with the edge columns repeated on each side.
+    int *blurSums;              // Horizontally blurred row.
+    int blurWeights[RVTHRESHOLD_MAX_BLUR_SIZE];
+};
+
+
+rvThreshold *rvThreshold_New(int width)
+// Create a new threshold object able to threshold images up to the given width.
+{
+    rvThreshold *self;
+
+    // Sanity check the arguments.
+    if ((width < 1) || (width > RVTHRESHOLD_MAX_WIDTH)) return NULL;
+
+    // Allocate the object.
+    self = (rvThreshold *) malloc(sizeof(rvThreshold));
+
+    // Did we allocate the object.
+    if (self != NULL)
+    {
+        // Set the object variables.
+        self->width = width;
+        self->columnSums = (int *) malloc(sizeof(int) * (width + RVTHRESHOLD_MAX_BLOCK_SIZE));
+        self->prefixSums = (int *) malloc(sizeof(int) * (width + RVTHRESHOLD_MAX_BLOCK_SIZE + 1));
+        self->blurRows = (rvUint8 *) malloc(sizeof(rvUint8) * width * RVTHRESHOLD_MAX_BLUR_SIZE);
+        self->blurColumns = (int *) malloc(sizeof(int) * (width + RVTHRESHOLD_MAX_BLUR_SIZE));
+        self->blurSums = (int *) malloc(sizeof(int) * width);
+
+        // Did we allocate the internal objects?
+        if ((self->columnSums == NULL) || (self->prefixSums == NULL) || (self->blurRows == NULL) || (self->blurColumns == NULL) || (self->blurSums == NULL))
+        {
+            // Clean up.
+            if (self->columnSums) free(self->columnSums);
+            if (self->prefixSums) free(self->prefixSums);
+            if (self->blurRows) free(self->blurRows);
+            if (self->blurColumns) free(self->blurColumns);
+            if (self->blurSums) free(self->blurSums);
+            free(self);
+
+            return NULL;
+        }
+    }
+
+    return self;
+}
+
+
+void rvThreshold_Free(rvThreshold *self)
+// Free the threshold object.
+{
+    // Sanity check the arguments.
+    if (self == NULL) return;
+
+    // Free the internal objects.
+    free(self->columnSums);
+    free(self->prefixSums);
+    free(self->blurRows);
+    free(self->blurColumns);
+    free(self->blurSums);
+
+    // Free the object.
+    free(self);
+}
+
+
+static void rvThreshold_UpdateColumns(int *sums, const rvUint8 *addRow, const rvUint8 *subRow, int width)
+// Add a row entering the block to the column sums and subtract a row leaving it.
+{
+    int x = 0;
+
+#if defined(RVTHRESHOLD_AVX2)
+    for (; x + 8 <= width; x += 8)
+    {
+        __m256i add = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (addRow + x)));
+        __m256i sub = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (subRow + x)));
+        __m256i sum = _mm256_loadu_si256((const __m256i *) (sums + x));
+
+        _mm256_storeu_si256((__m256i *) (sums + x), _mm256_sub_epi32(_mm256_add_epi32(sum, add), sub));
+    }
+#elif defined(RVTHRESHOLD_SSE2)
+    __m128i zero = _mm_setzero_si128();
+
+    for (; x + 8 <= width; x += 8)
+    {
+        // Take the difference of the rows as 16-bit values.
+        __m128i add = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (addRow + x)), zero);
+        __m128i sub = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (subRow + x)), zero);
+        __m128i diff = _mm_sub_epi16(add, sub);
+
+        // Sign extend the differences to 32-bit values and add them to the sums.
+        __m128i sign = _mm_srai_epi16(diff, 15);
+        __m128i lo = _mm_unpacklo_epi16(diff, sign);
+        __m128i hi = _mm_unpackhi_epi16(diff, sign);
+
+        _mm_storeu_si128((__m128i *) (sums + x), _mm_add_epi32(_mm_loadu_si128((const __m128i *) (sums + x)), lo));
+        _mm_storeu_si128((__m128i *) (sums + x + 4), _mm_add_epi32(_mm_loadu_si128((const __m128i *) (sums + x + 4)), hi));
+    }
+#endif
+
+    for (; x < width; ++x) sums[x] += (int) addRow[x] - (int) subRow[x];
+}
+
+
+static void rvThreshold_CompareRow(const int *prefix, const rvUint8 *src, rvUint8 *dst, int width, int blockSize, int subtraction)
+// Set each pixel of the row which is brighter than the mean of its block less the
+// subtraction.  The comparison is made against the block sums scaled up by the
+// block area to avoid a division.
+{
+    int x = 0;
+    int area = blockSize * blockSize;
+
+#if defined(RVTHRESHOLD_AVX2)
+    __m256i areas = _mm256_set1_epi32(area);
+    __m256i offsets = _mm256_set1_epi32(subtraction);
+
+    for (; x + 8 <= width; x += 8)
+    {
+        __m256i sum = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *) (prefix + x + blockSize)), _mm256_loadu_si256((const __m256i *) (prefix + x)));
+        __m256i value = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (src + x)));
+        __m256i mask = _mm256_cmpgt_epi32(_mm256_mullo_epi32(_mm256_add_epi32(value, offsets), areas), sum);
+        __m128i mask16 = _mm_packs_epi32(_mm256_castsi256_si128(mask), _mm256_extracti128_si256(mask, 1));
+
+        _mm_storel_epi64((__m128i *) (dst + x), _mm_packs_epi16(mask16, mask16));
+    }
+#endif
+
+    for (; x < width; ++x) dst[x] = (((int) src[x] + subtraction) * area > prefix[x + blockSize] - prefix[x]) ? 255 : 0;
+}
+
+
+static void rvThreshold_ThresholdRow(rvThreshold *self, CvMat *srcMat, CvMat *dstMat, int y, int radius, int subtraction)
+// Threshold a row of the source image.  Rows must be thresholded in order from
+// the top and the source rows up to the radius below the row must be available.
+{
+    int i;
+    int x;
+    int width = srcMat->cols;
+    int height = srcMat->rows;
+    int *columns = self->columnSums + radius;
+
+    // Sum the block of rows around the first row repeating the top row.
+    // Otherwise move the block down to the row.
+    if (y == 0)
+    {
+        for (x = 0; x < width; ++x) columns[x] = 0;
+        for (i = -radius; i <= radius; ++i)
+        {
+            const rvUint8 *row = srcMat->data.ptr + (i < 0 ? 0 : (i < height ? i : height - 1)) * srcMat->step;
+
+            for (x = 0; x < width; ++x) columns[x] += row[x];
+        }
+    }
+    else
+    {
+        int add = y + radius;
+        int sub = y - radius - 1;
+
+        rvThreshold_UpdateColumns(columns,
+                                  srcMat->data.ptr + (add < height ? add : height - 1) * srcMat->step,
+                                  srcMat->data.ptr + (sub > 0 ? sub : 0) * srcMat->step, width);
+    }
+
+    // Repeat the edge columns on each side.
+    for (i = 1; i <= radius; ++i)
+    {
+        columns[-i] = columns[0];
+        columns[width - 1 + i] = columns[width - 1];
+    }
+
+    // Get the prefix sums of the columns.
+    self->prefixSums[0] = 0;
+    for (x = 0; x < width + 2 * radius; ++x) self->prefixSums[x + 1] = self->prefixSums[x] + self->columnSums[x];
+
+    // Threshold the row.
+    rvThreshold_CompareRow(self->prefixSums, srcMat->data.ptr + y * srcMat->step, dstMat->data.ptr + y * dstMat->step, width, 2 * radius + 1, subtraction);
+}
+
+
+bool rvThreshold_Apply(rvThreshold *self, CvArr *src, CvArr *dst, int blockSize, int subtraction)
+// Threshold the 8-bit single channel source image into the destination image.
+// Destination pixels are set to 255 where the source pixel is greater than the
+// mean of the block of pixels around it less the subtraction, otherwise zero.
+// The block size is rounded down to an odd number.  Returns false if the images
+// or block size are not supported.
+{
+    int y;
+    CvMat srcHeader;
+    CvMat dstHeader;
+    CvMat *srcMat;
+    CvMat *dstMat;
+
+    // Get the matrices of the images.
+    srcMat = cvGetMat(src, &srcHeader, NULL, 0);
+    dstMat = cvGetMat(dst, &dstHeader, NULL, 0);
+
+    // Sanity check the arguments.
+    if ((CV_MAT_TYPE(srcMat->type) != CV_8UC1) || (CV_MAT_TYPE(dstMat->type) != CV_8UC1)) return false;
+    if ((dstMat->cols != srcMat->cols) || (dstMat->rows != srcMat->rows) || (srcMat->cols > self->width)) return false;
+    if ((blockSize < 1) || (blockSize > RVTHRESHOLD_MAX_BLOCK_SIZE)) return false;
+
+    // Threshold each row.
+    for (y = 0; y < srcMat->rows; ++y) rvThreshold_ThresholdRow(self, srcMat, dstMat, y, (blockSize - 1) / 2, subtraction);
+
+    return true;
+}
+
+
+static void rvThreshold_ConvertRow(const rvUint8 *src, rvUint8 *dst, int width)
+// Convert a row of three channel color pixels to gray scale.
+{
+    int x;
+
+    for (x = 0; x < width; ++x, src += 3)
+    {
+        dst[x] = (rvUint8) ((src[0] * RVTHRESHOLD_RED_WEIGHT + src[1] * RVTHRESHOLD_GREEN_WEIGHT + src[2] * RVTHRESHOLD_BLUE_WEIGHT + (1 << 13)) >> 14);
+    }
+}
+
+
+static void rvThreshold_SetBlurWeights(rvThreshold *self, int blurRadius)
+// Set the fixed point weights of the Gaussian blur which sum to 256.  The sigma
+// is derived from the size as with cvSmooth.
+{
+    int i;
+    int total = 0;
+    double sum = 0.0;
+    double weights[RVTHRESHOLD_MAX_BLUR_SIZE];
+    double sigma = 0.3 * (blurRadius - 1) + 0.8;
+
+    // Get the weights.
+    for (i = -blurRadius; i <= blurRadius; ++i)
+    {
+        weights[i + blurRadius] = exp(-(i * i) / (2.0 * sigma * sigma));
+        sum += weights[i + blurRadius];
+    }
+
+    // Scale the weights to 256.  Any rounding error is added to the center weight.
+    for (i = 0; i <= 2 * blurRadius; ++i)
+    {
+        self->blurWeights[i] = (int) floor(weights[i] * 256.0 / sum + 0.5);
+        total += self->blurWeights[i];
+    }
+    self->blurWeights[blurRadius] += 256 - total;
+}
+
+
+static void rvThreshold_AddWeightedBytes(int *sums, const rvUint8 *src, int weight, int width)
+// Add the weighted row of bytes to the sums.
+{
+    int x = 0;
+
+#if defined(RVTHRESHOLD_AVX2)
+    __m256i weights = _mm256_set1_epi32(weight);
+
+    for (; x + 8 <= width; x += 8)
+    {
+        __m256i value = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (src + x)));
+        __m256i sum = _mm256_loadu_si256((const __m256i *) (sums + x));
+
+        _mm256_storeu_si256((__m256i *) (sums + x), _mm256_add_epi32(sum, _mm256_mullo_epi32(value, weights)));
+    }
+#endif
+
+    for (; x < width; ++x) sums[x] += src[x] * weight;
+}
+
+
+static void rvThreshold_AddWeightedInts(int *sums, const int *src, int weight, int width)
+// Add the weighted row of integers to the sums.
+{
+    int x = 0;
+
+#if defined(RVTHRESHOLD_AVX2)
+    __m256i weights = _mm256_set1_epi32(weight);
+
+    for (; x + 8 <= width; x += 8)
+    {
+        __m256i value = _mm256_loadu_si256((const __m256i *) (src + x));
+        __m256i sum = _mm256_loadu_si256((const __m256i *) (sums + x));
+
+        _mm256_storeu_si256((__m256i *) (sums + x), _mm256_add_epi32(sum, _mm256_mullo_epi32(value, weights)));
+    }
+#endif
+
+    for (; x < width; ++x) sums[x] += src[x] * weight;
+}
+
+
+static void rvThreshold_BlurRow(rvThreshold *self, CvMat *dstMat, int y, int blurRadius)
+// Blur a row of the ring of gray rows into the destination image.  The ring
+// must hold the rows up to the blur radius below the row.
+{
+    int i;
+    int x;
+    int width = dstMat->cols;
+    int height = dstMat->rows;
+    int blurSize = 2 * blurRadius + 1;
+    int *columns = self->blurColumns + blurRadius;
+    rvUint8 *dst = dstMat->data.ptr + y * dstMat->step;
+
+    // Blur the rows vertically.
+    for (x = 0; x < width; ++x) columns[x] = 0;
+    for (i = -blurRadius; i <= blurRadius; ++i)
+    {
+        int row = y + i < 0 ? 0 : (y + i < height ? y + i : height - 1);
+
+        rvThreshold_AddWeightedBytes(columns, self->blurRows + (row % blurSize) * width, self->blurWeights[i + blurRadius], width);
+    }
+
+    // Repeat the edge columns on each side.
+    for (i = 1; i <= blurRadius; ++i)
+    {
+        columns[-i] = columns[0];
+        columns[width - 1 + i] = columns[width - 1];
+    }
+
+    // Blur the row horizontally one weight at a time so each pass runs along the row.
+    for (x = 0; x < width; ++x) self->blurSums[x] = 1 << 15;
+    for (i = 0; i < blurSize; ++i) rvThreshold_AddWeightedInts(self->blurSums, self->blurColumns + i, self->blurWeights[i], width);
+
+    // Round the row to 8 bits.
+    for (x = 0; x < width; ++x) dst[x] = (rvUint8) (self->blurSums[x] >> 16);
+}
+
+
+bool rvThreshold_ApplyColor(rvThreshold *self, CvArr *src, CvArr *gray, CvArr *dst, int blurSize, int blockSize, int subtraction)
+// Convert the 8-bit three channel source image to gray scale, blur it with a
+// Gaussian of the blur size if not zero and threshold it into the destination
+// image in a single pass.  The gray image receives the blurred gray scale image.
+// The blur and block sizes are rounded down to odd numbers.  Returns false if
+// the images or sizes are not supported.
+{
+    int y;
+    int radius;
+    int blurRadius;
+    int converted = 0;
+    int blurred = 0;
+    int width;
+    int height;
+    CvMat srcHeader;
+    CvMat grayHeader;
+    CvMat dstHeader;
+    CvMat *srcMat;
+    CvMat *grayMat;
+    CvMat *dstMat;
+
+    // Get the matrices of the images.
+    srcMat = cvGetMat(src, &srcHeader, NULL, 0);
+    grayMat = cvGetMat(gray, &grayHeader, NULL, 0);
+    dstMat = cvGetMat(dst, &dstHeader, NULL, 0);
+    width = srcMat->cols;
+    height = srcMat->rows;
+
+    // Sanity check the arguments.
+    if ((CV_MAT_TYPE(srcMat->type) != CV_8UC3) || (CV_MAT_TYPE(grayMat->type) != CV_8UC1) || (CV_MAT_TYPE(dstMat->type) != CV_8UC1)) return false;
+    if ((grayMat->cols != width) || (grayMat->rows != height) || (dstMat->cols != width) || (dstMat->rows != height) || (width > self->width)) return false;
+    if ((blurSize < 0) || (blurSize > RVTHRESHOLD_MAX_BLUR_SIZE) || (blockSize < 1) || (blockSize > RVTHRESHOLD_MAX_BLOCK_SIZE)) return false;
+
+    // Get the radius of the blur and the block.
+    blurRadius = blurSize > 0 ? (blurSize - 1) / 2 : 0;
+    radius = (blockSize - 1) / 2;
+
+    // Get the blur weights.
+    if (blurRadius > 0) rvThreshold_SetBlurWeights(self, blurRadius);
+
+    // Loop over each row.
+    for (y = 0; y < height; ++y)
+    {
+        // Make the gray rows within the radius below the row available.
+        for (; (blurred < height) && (blurred <= y + radius); ++blurred)
+        {
+            if (blurRadius == 0)
+            {
+                // Convert the row directly into the gray image.
+                rvThreshold_ConvertRow(srcMat->data.ptr + blurred * srcMat->step, grayMat->data.ptr + blurred * grayMat->step, width);
+            }
+            else
+            {
+                // Convert the rows within the blur radius into the ring and blur the row.
+                for (; (converted < height) && (converted <= blurred + blurRadius); ++converted)
+                {
+                    rvThreshold_ConvertRow(srcMat->data.ptr + converted * srcMat->step, self->blurRows + (converted % (2 * blurRadius + 1)) * width, width);
+                }
+                rvThreshold_BlurRow(self, grayMat, blurred, blurRadius);
+            }
+        }
+
+        // Threshold the row.
+        rvThreshold_ThresholdRow(self, grayMat, dstMat, y, radius, subtraction);
+    }
+
+    return true;
+}
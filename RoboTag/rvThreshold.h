@@ -0,0 +1,47 @@
+/*
+    Copyright (C) 2010, Michael P. Thompson
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License Version 2 as
+    specified in the README.txt file or as published by the Free Software
+    Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    $Id$
+*/
+
+#ifndef _RV_THRESHOLD_INCLUDED_
+#define _RV_THRESHOLD_INCLUDED_
+
+#include "rvTypes.h"
+#include "cv.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RVTHRESHOLD_MAX_BLOCK_SIZE  255
+#define RVTHRESHOLD_MAX_WIDTH       8192
+
+// Threshold types.
+typedef struct _rvThreshold rvThreshold;
+
+// Threshold methods.
+rvThreshold *rvThreshold_New(int width);
+void rvThreshold_Free(rvThreshold *self);
+bool rvThreshold_Apply(rvThreshold *self, CvArr *src, CvArr *dst, int blockSize, int subtraction);
+bool rvThreshold_ApplyColor(rvThreshold *self, CvArr *src, CvArr *gray, CvArr *dst, int blurSize, int blockSize, int subtraction);
+
+#ifdef __cplusplus
+} // "C"
+#endif
+
+#endif // _RV_THRESHOLD_INCLUDED_
@@ -33,11 +33,18 @@ typedef unsigned long       rvUint32;
 #if defined(_MSC_VER)
 typedef __int64             rvInt64;
 typedef unsigned __int64    rvUint64;
-#elif defined(__GNUC__)
+#else
 typedef long long           rvInt64;
 typedef unsigned long long  rvUint64;
 #endif
 
+// 64 bit integer constants are also compiler specific.
+#if defined(_MSC_VER)
+#define rvUint64Const(C)            C##ui64
+#else
+#define rvUint64Const(C)            C##ULL
+#endif
+
 // A boolean type to match the C++ definition of "bool".
 #ifndef __cplusplus
 typedef char bool;
@@ -60,10 +67,21 @@ typedef char bool;
 #ifndef UNREFERENCED_PARAMETER
 #define UNREFERENCED_PARAMETER(P)   (P)
 #endif
-#elif defined(__GNUC__)
+#else
 #ifndef UNREFERENCED_PARAMETER
 #define UNREFERENCED_PARAMETER(P)   {;}
 #endif
 #endif
 
+// Platform/compiler specific stack allocation and formatted printing.
+#if defined(_MSC_VER)
+#include <malloc.h>
+#define rvAlloca(S)                 _alloca(S)
+#define rvSnprintf                  _snprintf
+#else
+#include <alloca.h>
+#define rvAlloca(S)                 alloca(S)
+#define rvSnprintf                  snprintf
+#endif
+
 #endif